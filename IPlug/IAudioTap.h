@@ -0,0 +1,147 @@
+#pragma once
+
+/*
+	IAudioTap is a wait-free single-producer ring of the plugin output
+	(mixed to mono, and optionally decimated), for a scope or spectrum in
+	the GUI.
+
+	The audio thread writes after each ProcessDoubleReplacing() call, which
+	costs at most one pass over the block, and no locks or allocations.
+	The GUI thread (the only reader) copies the most recent frames, and
+	retries if the writer lapped it during the copy. The writer publishes
+	where a write will end before it starts (like a seqlock), so the
+	reader also notices a write that is still in progress.
+
+	When the reader finds no new audio, it can ask to be woken up by the
+	next write, so it doesn't have to keep polling while the host is idle.
+*/
+
+#include <string.h>
+
+#include "IWakeup.h"
+
+#include "WDL/wdltypes.h"
+
+class IAudioTap
+{
+public:
+	static const int kSize = 8192; // Power of 2.
+
+	IAudioTap():
+		mSum(0.0),
+		mWritePos(0),
+		mWriteEnd(0),
+		mPhase(0),
+		mDecimation(1),
+		mEnabled(false)
+	{
+		for (int i = 0; i < kSize; ++i) mBuf[i] = 0.0f;
+	}
+
+	// GUI thread. Disabled by default, so the audio thread skips the tap
+	// unless something is reading it.
+	inline void Enable(const bool enable) { mEnabled = enable; }
+	inline bool IsEnabled() const { return mEnabled; }
+
+	inline void SetDecimation(const int decimation) { mDecimation = wdl_max(decimation, 1); }
+	inline int GetDecimation() const { return mDecimation; }
+
+	// Called (from the audio thread) after RequestWake(). Clear (NULL)
+	// before destroying the target, see IWakeup::SetTarget().
+	inline void SetWakeTarget(const IWakeup::Target* const pTarget) { mWakeup.SetTarget(pTarget); }
+
+	// Audio thread.
+	void Write(const double* const* const ppData, const int nChannels, int nFrames)
+	{
+		if (!mEnabled || nChannels <= 0 || nFrames <= 0) return;
+
+		const int decimation = mDecimation;
+		const double scale = 1.0 / (double)(nChannels * decimation);
+
+		// Older frames would only be overwritten again.
+		int i = 0;
+		const int maxFrames = kSize * decimation;
+		if (nFrames > maxFrames) i = nFrames - maxFrames;
+
+		unsigned int pos = mWritePos;
+		int phase = mPhase;
+		double sum = mSum;
+
+		// Announce the frames before overwriting older ones.
+		mWriteEnd = pos + (unsigned int)((phase + nFrames - i) / decimation);
+		Barrier();
+
+		for (; i < nFrames; ++i)
+		{
+			for (int c = 0; c < nChannels; ++c) sum += ppData[c][i];
+			if (++phase >= decimation)
+			{
+				mBuf[pos++ & (kSize - 1)] = (float)(sum * scale);
+				sum = 0.0;
+				phase = 0;
+			}
+		}
+
+		mPhase = phase;
+		mSum = sum;
+
+		// Publish the frames, then check if the reader is waiting.
+		Barrier();
+		mWritePos = pos;
+		mWakeup.Signal();
+	}
+
+	// Reader. Total number of frames written so far (wraps).
+	inline unsigned int GetWritePos() const { return mWritePos; }
+
+	// Copies the most recent n (<= kSize / 2) frames, and returns the
+	// write position they end at. Returns false if the writer kept lapping
+	// the reader.
+	bool Read(float* const pDest, const int n, unsigned int* const pPos) const
+	{
+		for (int tries = 0; tries < 4; ++tries)
+		{
+			const unsigned int end = mWritePos;
+			Barrier();
+
+			const unsigned int start = end - (unsigned int)n;
+			const int ofs = (int)(start & (kSize - 1));
+			const int n1 = wdl_min(n, kSize - ofs);
+			memcpy(pDest, (const float*)&mBuf[ofs], n1 * sizeof(float));
+			memcpy(pDest + n1, (const float*)mBuf, (n - n1) * sizeof(float));
+
+			// Valid unless a write (even one still in progress) reached the
+			// start while copying.
+			Barrier();
+			if (mWriteEnd - start <= (unsigned int)kSize)
+			{
+				*pPos = end;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Call when there was nothing new since lastPos. Returns true if the
+	// next write will call the wake proc, or false if new frames arrived
+	// meanwhile (so read again instead).
+	inline bool RequestWake(const unsigned int lastPos) { return mWakeup.Request(&mWritePos, lastPos); }
+
+protected:
+	static inline void Barrier() { IWakeup::Barrier(); }
+
+	volatile float mBuf[kSize];
+
+	// Audio thread only.
+	double WDL_FIXALIGN mSum;
+
+	volatile unsigned int mWritePos;
+	// Where the current (or last) write ends, set before it starts.
+	volatile unsigned int mWriteEnd;
+	int mPhase;
+	volatile int mDecimation;
+	volatile bool mEnabled;
+
+	IWakeup mWakeup;
+}
+WDL_FIXALIGN;
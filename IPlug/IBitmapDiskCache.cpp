@@ -0,0 +1,296 @@
+#include "IBitmapDiskCache.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "WDL/dirscan.h"
+#include "WDL/wdlstring.h"
+
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+#include "WDL/wdlatomic.h"
+
+static const char kMagic[4] = { 'L', 'B', 'M', 'C' };
+static const int kVersion = 1;
+
+// Channel order, so a cache can't be used by a build with another layout.
+static const int kPixelFormat = LICE_PIXEL_B | (LICE_PIXEL_G << 2) | (LICE_PIXEL_R << 4) | (LICE_PIXEL_A << 6);
+
+// 32 bytes, so the pixels are 16-byte aligned.
+struct IBitmapDiskCacheHeader
+{
+	char magic[4];
+	int version;
+	WDL_UINT64 key;
+	int w, h;
+	int pixelFormat;
+	int reserved;
+};
+
+static void CacheFileName(WDL_String* const pFileName, const char* const dir, const WDL_UINT64 key, const char* const ext = ".lbm")
+{
+	pFileName->SetFormatted(1024, "%s" WDL_DIRCHAR_STR "%08x%08x%s", dir, (unsigned int)(key >> 32), (unsigned int)key, ext);
+}
+
+static bool IsValidHeader(const IBitmapDiskCacheHeader* const pHeader, const WDL_UINT64 key, const WDL_UINT64 fileSize)
+{
+	return !memcmp(pHeader->magic, kMagic, sizeof(kMagic)) &&
+		pHeader->version == kVersion && pHeader->key == key && pHeader->pixelFormat == kPixelFormat &&
+		pHeader->w > 0 && pHeader->h > 0 && pHeader->w <= 16384 && pHeader->h <= 16384 &&
+		fileSize == sizeof(IBitmapDiskCacheHeader) + (WDL_UINT64)pHeader->w * pHeader->h * sizeof(LICE_pixel);
+}
+
+#ifdef _WIN32
+
+static bool ToWide(const char* const str, WCHAR* const pBuf, const int bufSize)
+{
+	return !!MultiByteToWideChar(CP_UTF8, 0, str, -1, pBuf, bufSize);
+}
+
+#endif
+
+// Wrapper around the mapped pixels, unmaps on delete.
+class IMappedBitmap: public LICE_WrapperBitmap
+{
+public:
+	IMappedBitmap(void* const pView, const size_t size, const int w, const int h)
+	: LICE_WrapperBitmap((LICE_pixel*)((char*)pView + sizeof(IBitmapDiskCacheHeader)), w, h, w, false)
+	, mView(pView)
+	, mSize(size)
+	{}
+
+	~IMappedBitmap()
+	{
+		#ifdef _WIN32
+		UnmapViewOfFile(mView);
+		#else
+		munmap(mView, mSize);
+		#endif
+	}
+
+private:
+	void* mView;
+	size_t mSize;
+};
+
+LICE_IBitmap* IBitmapDiskCache::Load(const char* const dir, const WDL_UINT64 key)
+{
+	WDL_String fn;
+	CacheFileName(&fn, dir, key);
+
+	void* pView = NULL;
+	WDL_UINT64 size = 0;
+
+	#ifdef _WIN32
+	WCHAR fnW[MAX_PATH];
+	if (!ToWide(fn.Get(), fnW, MAX_PATH)) return NULL;
+
+	HANDLE const hFile = CreateFileW(fnW, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE) return NULL;
+
+	LARGE_INTEGER fileSize;
+	if (GetFileSizeEx(hFile, &fileSize) && fileSize.QuadPart > (LONGLONG)sizeof(IBitmapDiskCacheHeader))
+	{
+		size = (WDL_UINT64)fileSize.QuadPart;
+		HANDLE const hMapping = CreateFileMappingW(hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+		if (hMapping)
+		{
+			pView = MapViewOfFile(hMapping, FILE_MAP_COPY, 0, 0, 0);
+			CloseHandle(hMapping);
+		}
+	}
+	CloseHandle(hFile);
+	#else
+	const int fd = open(fn.Get(), O_RDONLY);
+	if (fd < 0) return NULL;
+
+	struct stat st;
+	if (!fstat(fd, &st) && st.st_size > (off_t)sizeof(IBitmapDiskCacheHeader))
+	{
+		size = (WDL_UINT64)st.st_size;
+		pView = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		if (pView == MAP_FAILED) pView = NULL;
+	}
+	close(fd);
+	#endif
+
+	if (!pView) return NULL;
+
+	const IBitmapDiskCacheHeader* const pHeader = (const IBitmapDiskCacheHeader*)pView;
+	if (!IsValidHeader(pHeader, key, size))
+	{
+		#ifdef _WIN32
+		UnmapViewOfFile(pView);
+		#else
+		munmap(pView, (size_t)size);
+		#endif
+		return NULL;
+	}
+
+	return new IMappedBitmap(pView, (size_t)size, pHeader->w, pHeader->h);
+}
+
+static void CreateDirs(const char* const dir)
+{
+	WDL_String path(dir);
+	char* const p = path.Get();
+
+	// Skip the root (or drive), and create each level in turn.
+	for (int i = 1; ; ++i)
+	{
+		const char c = p[i];
+		if (c && c != '/' && c != '\\') continue;
+
+		p[i] = 0;
+		#ifdef _WIN32
+		WCHAR pathW[MAX_PATH];
+		if (i > 2 && ToWide(p, pathW, MAX_PATH)) CreateDirectoryW(pathW, NULL);
+		#else
+		mkdir(p, 0755);
+		#endif
+		p[i] = c;
+
+		if (!c) break;
+	}
+}
+
+static bool DeleteFileUTF8(const char* const path)
+{
+	#ifdef _WIN32
+	WCHAR pathW[MAX_PATH];
+	return ToWide(path, pathW, MAX_PATH) && !!DeleteFileW(pathW);
+	#else
+	return !unlink(path);
+	#endif
+}
+
+static bool RemoveDirUTF8(const char* const path)
+{
+	#ifdef _WIN32
+	WCHAR pathW[MAX_PATH];
+	return ToWide(path, pathW, MAX_PATH) && !!RemoveDirectoryW(pathW);
+	#else
+	return !rmdir(path);
+	#endif
+}
+
+// Deletes the files in dir, and then dir itself. Cache dirs are flat, so
+// this doesn't recurse. Files that are still mapped (by another process)
+// may stay until they are unmapped.
+static void DeleteCacheDir(const char* const dir)
+{
+	WDL_DirScan scan;
+	for (int ret = scan.First(dir); !ret; ret = scan.Next())
+	{
+		if (scan.GetCurrentIsDirectory()) continue;
+
+		WDL_String path;
+		scan.GetCurrentFullFN(&path);
+		DeleteFileUTF8(path.Get());
+	}
+	scan.Close();
+
+	RemoveDirUTF8(dir);
+}
+
+void IBitmapDiskCache::Open(WDL_String* const pDir, const char* const baseDir, const unsigned int version)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%d.%08x", kVersion, version);
+
+	// Prune the caches of other versions (and of other cache formats), and
+	// any stray files.
+	WDL_DirScan scan;
+	for (int ret = scan.First(baseDir); !ret; ret = scan.Next())
+	{
+		const char* const fn = scan.GetCurrentFN();
+		const bool isDir = !!scan.GetCurrentIsDirectory();
+		if (isDir && (fn[0] == '.' || !strcmp(fn, name))) continue;
+
+		WDL_String path;
+		scan.GetCurrentFullFN(&path);
+		if (isDir)
+			DeleteCacheDir(path.Get());
+		else
+			DeleteFileUTF8(path.Get());
+	}
+	scan.Close();
+
+	pDir->Set(baseDir);
+	pDir->Append(WDL_DIRCHAR_STR);
+	pDir->Append(name);
+}
+
+bool IBitmapDiskCache::Store(const char* const dir, const WDL_UINT64 key, LICE_IBitmap* const pBitmap)
+{
+	const int w = pBitmap->getWidth(), h = pBitmap->getHeight();
+	const LICE_pixel* pRow = pBitmap->getBits();
+	if (w <= 0 || h <= 0 || !pRow) return false;
+
+	CreateDirs(dir);
+
+	// Unique per process and per call, so concurrent writers (also threads
+	// or instances within the same process) don't share a temp file.
+	static int sNWrites = 0;
+	const unsigned int n = (unsigned int)wdl_atomic_incr(&sNWrites);
+
+	WDL_String fn, tmp;
+	CacheFileName(&fn, dir, key);
+	#ifdef _WIN32
+	const unsigned int pid = (unsigned int)GetCurrentProcessId();
+	#else
+	const unsigned int pid = (unsigned int)getpid();
+	#endif
+	char ext[32];
+	snprintf(ext, sizeof(ext), ".%u.%u.tmp", pid, n);
+	CacheFileName(&tmp, dir, key, ext);
+
+	#ifdef _WIN32
+	WCHAR fnW[MAX_PATH], tmpW[MAX_PATH];
+	if (!(ToWide(fn.Get(), fnW, MAX_PATH) && ToWide(tmp.Get(), tmpW, MAX_PATH))) return false;
+	FILE* const fp = _wfopen(tmpW, L"wb");
+	#else
+	FILE* const fp = fopen(tmp.Get(), "wb");
+	#endif
+	if (!fp) return false;
+
+	IBitmapDiskCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, kMagic, sizeof(kMagic));
+	header.version = kVersion;
+	header.key = key;
+	header.w = w;
+	header.h = h;
+	header.pixelFormat = kPixelFormat;
+
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+
+	int span = pBitmap->getRowSpan();
+	if (pBitmap->isFlipped())
+	{
+		pRow += (h - 1) * span;
+		span = -span;
+	}
+	for (int y = 0; y < h && ok; ++y, pRow += span)
+	{
+		ok = fwrite(pRow, sizeof(LICE_pixel), w, fp) == (size_t)w;
+	}
+	ok = !fclose(fp) && ok;
+
+	#ifdef _WIN32
+	ok = ok && !!MoveFileExW(tmpW, fnW, MOVEFILE_REPLACE_EXISTING);
+	if (!ok) DeleteFileW(tmpW);
+	#else
+	ok = ok && !rename(tmp.Get(), fn.Get());
+	if (!ok) unlink(tmp.Get());
+	#endif
+
+	return ok;
+}
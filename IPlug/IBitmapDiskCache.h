@@ -0,0 +1,35 @@
+#pragma once
+
+/*
+	Persistent cache of decoded bitmaps.
+
+	Each bitmap is stored as raw LICE_pixels in <dir>/<key>.lbm, where the
+	key is a hash of the (compressed) resource data. Cached bitmaps are
+	memory-mapped copy-on-write, so loading them costs little more than
+	opening the file, and the file itself is never modified.
+
+	Files are written to a temporary file first, and then renamed, so
+	other processes never see a partially written bitmap.
+
+	The cache of each version (e.g. of the plug-in) is in its own dir, and
+	opening it deletes the caches of other versions, so bitmaps of earlier
+	versions don't pile up.
+*/
+
+#include "WDL/lice/lice.h"
+#include "WDL/wdlstring.h"
+#include "WDL/wdltypes.h"
+
+class IBitmapDiskCache
+{
+public:
+	// Sets pDir to the cache dir for version within baseDir (neither have
+	// to exist yet), and deletes the cache dirs of other versions.
+	static void Open(WDL_String* pDir, const char* baseDir, unsigned int version);
+
+	// Returns NULL if the bitmap isn't cached (or the file is invalid).
+	static LICE_IBitmap* Load(const char* dir, WDL_UINT64 key);
+
+	// Creates dir if needed.
+	static bool Store(const char* dir, WDL_UINT64 key, LICE_IBitmap* pBitmap);
+};
@@ -1,5 +1,7 @@
 #include "IControl.h"
 
+#include <math.h>
+
 const float IControl::kGrayedAlpha = 0.25f;
 
 void IControl::SetValueFromPlug(const double value)
@@ -24,9 +26,21 @@ void IControl::SetValueFromUserInput(const double value)
 	}
 }
 
+void IControl::MarkDirty()
+{
+	// The GUI isn't attached to the plugin while it is being built, but then
+	// IGraphics::AttachControl() takes care of it.
+	IGraphics* const pGraphics = GetGUI();
+	if (pGraphics && mDirtyIdx >= 0) pGraphics->SetControlDirty(mDirtyIdx);
+}
+
 void IControl::SetDirty(const bool pushParamToPlug)
 {
-	if (!mHide) mDirty = 1;
+	if (!mHide)
+	{
+		mDirty = 1;
+		MarkDirty();
+	}
 
 	if (pushParamToPlug && mParamIdx >= 0)
 	{
@@ -86,40 +100,17 @@ IBackgroundControl::IBackgroundControl(
 {
 	mRECT = IRECT(0, 0, pBitmap);
 	mBitmap = *pBitmap;
+	mStatic = 1;
 }
 
 void IBackgroundControl::Draw(IGraphics* const pGraphics)
 {
 	LICE_IBitmap* const dest = pGraphics->GetDrawBitmap();
 
-	const int scale = pGraphics->Scale();
-	IRECT dirty = *pGraphics->GetDirtyRECT();
-
-	int x1 = mRECT.L;
-	int y1 = mRECT.T;
-
-	if (scale)
-	{
-		// const int mask = (1 << scale) - 1;
-
-		// dirty.L >>= scale;
-		// dirty.T >>= scale;
-		// dirty.R = (dirty.R >> scale) + !!(dirty.R & mask);
-		// dirty.B = (dirty.B >> scale) + !!(dirty.B & mask);
-
-		// x1 >>= scale;
-		// y1 >>= scale;
+	const IRECT dirty = pGraphics->ToPixelsInner(pGraphics->GetDirtyRECT());
 
-		assert(scale == 1);
-
-		dirty.L >>= 1;
-		dirty.T >>= 1;
-		dirty.R = (dirty.R >> 1) + (dirty.R & 1);
-		dirty.B = (dirty.B >> 1) + (dirty.B & 1);
-
-		x1 >>= 1;
-		y1 >>= 1;
-	}
+	int x1 = pGraphics->ToPixels(mRECT.L);
+	int y1 = pGraphics->ToPixels(mRECT.T);
 
 	int x2 = x1 + mBitmap.W;
 	int y2 = y1 + mBitmap.H;
@@ -186,10 +177,8 @@ void IBitmapControl::Draw(IGraphics* const pGraphics)
 {
 	LICE_IBitmap* const dest = pGraphics->GetDrawBitmap();
 
-	const int scale = pGraphics->Scale();
-
-	const int x = mRECT.L >> scale;
-	const int y = mRECT.T >> scale;
+	const int x = pGraphics->ToPixels(mRECT.L);
+	const int y = pGraphics->ToPixels(mRECT.T);
 
 	const int n = mBitmap.N - 1;
 	int i = (int)((double)n * mValue + 0.5);
@@ -455,10 +444,8 @@ void IFaderControl::Draw(IGraphics* const pGraphics)
 
 	LICE_IBitmap* const dest = pGraphics->GetDrawBitmap();
 
-	const int scale = pGraphics->Scale();
-
-	const int x = mHandleRECT.L >> scale;
-	const int y = mHandleRECT.T >> scale;
+	const int x = pGraphics->ToPixels(mHandleRECT.L);
+	const int y = pGraphics->ToPixels(mHandleRECT.T);
 
 	LICE_IBitmap* const src = (LICE_IBitmap*)mBitmap.mData;
 	const float weight = mGrayed ? kGrayedAlpha : 1.0f;
@@ -552,6 +539,86 @@ void IKnobMultiControl::SetValueFromPlug(const double value)
 	IBitmapControl::SetValueFromPlug(value);
 }
 
+IKnobVectorControl::IKnobVectorControl(
+	IPlugBase* const pPlug,
+	const int x,
+	const int y,
+	const int paramIdx,
+	const IBitmap* const pBase,
+	const IColor color
+):
+	IKnobMultiControl(pPlug, x, y, paramIdx, pBase),
+	mFrameValue(-1.0),
+	mColor(color),
+	mMinAngle(-150.0f),
+	mMaxAngle(150.0f)
+{
+	assert(!pBase || pBase->N == 1);
+
+	const int size = wdl_min(mRECT.W(), mRECT.H());
+	mRadius = (float)size * 0.37f;
+	mDotRadius = (float)size * 0.035f;
+}
+
+void IKnobVectorControl::SetIndicator(const float radius, const float dotRadius)
+{
+	mRadius = radius;
+	mDotRadius = dotRadius;
+	mFrameValue = -1.0;
+}
+
+void IKnobVectorControl::SetAngles(const float minAngle, const float maxAngle)
+{
+	mMinAngle = minAngle;
+	mMaxAngle = maxAngle;
+	mFrameValue = -1.0;
+}
+
+void IKnobVectorControl::RenderFrame(IGraphics* const pGraphics, const double value)
+{
+	const int w = mBitmap.W;
+	const int h = mBitmap.H;
+
+	mFrame.resize(w, h);
+	LICE_Blit(&mFrame, (LICE_IBitmap*)mBitmap.mData, 0, 0, 0, 0, w, h, 1.0f, LICE_BLIT_MODE_COPY);
+
+	const float mul = pGraphics->ScaleFactor();
+	const double angle = ((double)mMinAngle + value * (double)(mMaxAngle - mMinAngle)) * M_PI / 180.0;
+	const float r = mRadius * mul;
+	const float x = (float)(w - 1) * 0.5f + r * (float)sin(angle);
+	const float y = (float)(h - 1) * 0.5f - r * (float)cos(angle);
+
+	LICE_FillCircle(&mFrame, x, y, mDotRadius * mul, mColor.Get(), 1.0f, LICE_BLIT_MODE_COPY, true);
+	mFrameValue = value;
+}
+
+void IKnobVectorControl::Draw(IGraphics* const pGraphics)
+{
+	// Bitmap not loaded (yet).
+	if (!mBitmap.W) return;
+
+	const double value = mReverse ? 1.0 - mValue : mValue;
+	if (value != mFrameValue) RenderFrame(pGraphics, value);
+
+	const int x = pGraphics->ToPixels(mRECT.L);
+	const int y = pGraphics->ToPixels(mRECT.T);
+
+	const float weight = mGrayed ? kGrayedAlpha : 1.0f;
+	LICE_Blit(pGraphics->GetDrawBitmap(), &mFrame, x, y, 0, 0, mFrame.getWidth(), mFrame.getHeight(), weight, LICE_BLIT_MODE_COPY | LICE_BLIT_USE_ALPHA);
+}
+
+void IKnobVectorControl::Rescale(IGraphics* const pGraphics)
+{
+	IKnobMultiControl::Rescale(pGraphics);
+	mFrameValue = -1.0;
+}
+
+void IKnobVectorControl::ReleaseCachedResources()
+{
+	mFrame.resize(0, 0);
+	mFrameValue = -1.0;
+}
+
 ITextControl::ITextControl(
 	IPlugBase* const pPlug,
 	const IRECT* const pR,
@@ -587,3 +654,303 @@ void ITextControl::Rescale(IGraphics* /* pGraphics */)
 {
 	mFont.mCached = NULL;
 }
+
+IDSPLoadControl::IDSPLoadControl(
+	IPlugBase* const pPlug,
+	const IRECT* const pR,
+	const IText* const pFont
+):
+	IControl(pPlug, pR),
+	mBlocks(0)
+{
+	if (pFont)
+		mFont = *pFont;
+	else
+		mFont = IText(14, IColor::kWhite, NULL, IText::kStyleNormal, IText::kAlignNear);
+
+	UpdateText();
+
+	mWakeTarget.mProc = Wake;
+	mWakeTarget.mArg = this;
+	pPlug->GetDSPLoadMeter()->SetWakeTarget(&mWakeTarget);
+}
+
+IDSPLoadControl::~IDSPLoadControl()
+{
+	// Waits for a wake that is still calling us.
+	mPlug->GetDSPLoadMeter()->SetWakeTarget(NULL);
+}
+
+void IDSPLoadControl::Wake(void* const pControl)
+{
+	((IDSPLoadControl*)pControl)->MarkDirty();
+}
+
+void IDSPLoadControl::OnMouseDown(int /* x */, int /* y */, const IMouseMod mod)
+{
+	#ifndef NDEBUG
+	if (mod.C)
+	{
+		mPlug->StressTest();
+		return;
+	}
+	#endif
+
+	IDSPLoadMeter* const pMeter = mPlug->GetDSPLoadMeter();
+	IPlugBase::DebugLog("DSP load: p50 %.1f%%, p99 %.1f%%, max %.1f%% (%u blocks)",
+		(double)pMeter->GetPercentile(0.5) * 0.1, (double)pMeter->GetPercentile(0.99) * 0.1,
+		(double)pMeter->GetMax() * 0.1, pMeter->GetBlockCount());
+	pMeter->RequestReset();
+}
+
+void IDSPLoadControl::UpdateText()
+{
+	const IDSPLoadMeter* const pMeter = mPlug->GetDSPLoadMeter();
+	const int p50 = pMeter->GetPercentile(0.5), p99 = pMeter->GetPercentile(0.99), max = pMeter->GetMax();
+	mStr.SetFormatted(64, "p50 %d.%d%%  p99 %d.%d%%  max %d.%d%%", p50 / 10, p50 % 10, p99 / 10, p99 % 10, max / 10, max % 10);
+}
+
+void IDSPLoadControl::Draw(IGraphics* const pGraphics)
+{
+	IDSPLoadMeter* const pMeter = mPlug->GetDSPLoadMeter();
+
+	// Only reformat if the audio thread has processed blocks since last
+	// time, and keep polling while it does. Otherwise stay dirty, but
+	// unmarked, until the next block marks us through Wake(), so the GUI
+	// can idle while the host isn't processing.
+	const unsigned int blocks = pMeter->GetBlockCount();
+	if (blocks != mBlocks)
+	{
+		mBlocks = blocks;
+		UpdateText();
+		Redraw();
+	}
+	else if (!pMeter->RequestWake(blocks))
+	{
+		Redraw();
+	}
+	else
+	{
+		mDirty = 1;
+	}
+
+	static const IColor bg(192, 0, 0, 0);
+	pGraphics->FillIRect(bg, &mRECT);
+
+	const int lh = pGraphics->DrawIText(&mFont, NULL, &mRECT);
+	const IRECT textR(mRECT.L + 4, mRECT.T + 2, mRECT.R - 4, mRECT.T + 2 + lh);
+	pGraphics->DrawIText(&mFont, mStr.Get(), &textR);
+
+	// Histogram below the text, one line per bucket, up to 200% of the budget.
+	const IRECT histR(mRECT.L + 4, textR.B + 2, mRECT.R - 4, mRECT.B - 2);
+	const int w = histR.W(), h = histR.H();
+	if (w <= 0 || h <= 0) return;
+
+	static const int nBuckets = IDSPLoadMeter::kNumBuckets;
+	unsigned int hist[nBuckets];
+	pMeter->GetHistogram(hist);
+
+	unsigned int peak = 1;
+	for (int i = 0; i < nBuckets; ++i) peak = wdl_max(peak, hist[i]);
+
+	static const IColor green(255, 0, 192, 0), red(255, 224, 0, 0);
+	for (int x = 0; x < w; ++x)
+	{
+		const int i = x * nBuckets / w;
+		if (!hist[i]) continue;
+
+		const int y = histR.B - 1 - (int)((double)hist[i] * (double)(h - 1) / (double)peak);
+		pGraphics->DrawVerticalLine(i < IDSPLoadMeter::kBucketsPerBudget ? green : red, histR.L + x, y, histR.B - 1);
+	}
+}
+
+void IDSPLoadControl::Rescale(IGraphics* /* pGraphics */)
+{
+	mFont.mCached = NULL;
+}
+
+IScopeControl::IScopeControl(
+	IPlugBase* const pPlug,
+	const IRECT* const pR,
+	const IColor color,
+	const int mode
+):
+	IControl(pPlug, pR),
+	mColor(color),
+	mMode(mode),
+	mReadPos(0)
+{
+	WDL_fft_init();
+
+	static const int n = kFFTSize;
+	memset(mSamples.Resize(n), 0, n * sizeof(float));
+	mFFT.Resize(n + n / 2);
+
+	// Hann window, scaled to a sum of 1. Its coherent gain is 0.5, so a
+	// full scale sine peaks at 0.5 (about -6 dB), and lower between bins.
+	WDL_FFT_REAL* const pWindow = mWindow.Resize(n);
+	for (int i = 0; i < n; ++i)
+	{
+		pWindow[i] = (WDL_FFT_REAL)((0.5 - 0.5 * cos(2.0 * M_PI * (double)i / (double)n)) * 2.0 / (double)n);
+	}
+
+	mWakeTarget.mProc = Wake;
+	mWakeTarget.mArg = this;
+
+	IAudioTap* const pTap = pPlug->GetAudioTap();
+	pTap->SetWakeTarget(&mWakeTarget);
+	pTap->Enable(true);
+}
+
+IScopeControl::~IScopeControl()
+{
+	IAudioTap* const pTap = mPlug->GetAudioTap();
+	pTap->Enable(false);
+	// Waits for a wake that is still calling us.
+	pTap->SetWakeTarget(NULL);
+}
+
+void IScopeControl::Wake(void* const pControl)
+{
+	IScopeControl* const pScope = (IScopeControl*)pControl;
+	IGraphics* const pGraphics = pScope->GetGUI();
+	if (pGraphics && pScope->mDirtyIdx >= 0) pGraphics->SetControlDirty(pScope->mDirtyIdx);
+}
+
+void IScopeControl::OnMouseDown(int /* x */, int /* y */, const IMouseMod mod)
+{
+	if (mod.L) SetMode(mMode == kModeScope ? kModeSpectrum : kModeScope);
+}
+
+void IScopeControl::Draw(IGraphics* const pGraphics)
+{
+	IAudioTap* const pTap = mPlug->GetAudioTap();
+
+	// On failure keep showing the previous frames.
+	unsigned int pos = mReadPos;
+	pTap->Read(mSamples.Get(), kFFTSize, &pos);
+
+	static const IColor bg(192, 0, 0, 0);
+	pGraphics->FillIRect(bg, &mRECT);
+
+	if (mMode == kModeSpectrum)
+		DrawSpectrum(pGraphics);
+	else
+		DrawScope(pGraphics);
+
+	// Keep polling while audio comes in. Otherwise stay dirty, but
+	// unmarked, until the next write marks us through Wake().
+	if (pos != mReadPos || !pTap->RequestWake(pos))
+		Redraw();
+	else
+		mDirty = 1;
+
+	mReadPos = pos;
+}
+
+void IScopeControl::DrawScope(IGraphics* const pGraphics)
+{
+	const IRECT r = pGraphics->ToPixels(&mRECT);
+	const int x1 = r.L, w = r.W();
+	const int y1 = r.T, h = r.H();
+	if (w < 2 || h <= 0) return;
+
+	// One frame per pixel, starting at the last rising zero crossing that
+	// still leaves enough frames, so periodic waveforms stand still.
+	const float* const pSamples = mSamples.Get();
+	const int span = wdl_min(w, kFFTSize / 2);
+
+	int start = kFFTSize - span;
+	for (int i = start; i > 0; --i)
+	{
+		if (pSamples[i - 1] < 0.0f && pSamples[i] >= 0.0f)
+		{
+			start = i;
+			break;
+		}
+	}
+
+	LICE_IBitmap* const pDest = pGraphics->GetDrawBitmap();
+	const LICE_pixel color = mColor.Get();
+
+	const float xStep = (float)w / (float)span;
+	const float mid = (float)y1 + (float)h * 0.5f;
+	const float amp = (float)(h - 1) * 0.5f;
+
+	float prevX = 0.0f, prevY = 0.0f;
+	for (int i = 0; i < span; ++i)
+	{
+		float v = pSamples[start + i];
+		v = wdl_max(wdl_min(v, 1.0f), -1.0f);
+
+		const float x = (float)x1 + (float)i * xStep;
+		const float y = mid - v * amp;
+		if (i) LICE_FLine(pDest, prevX, prevY, x, y, color, 1.0f, LICE_BLIT_MODE_COPY, true);
+		prevX = x;
+		prevY = y;
+	}
+}
+
+void IScopeControl::DrawSpectrum(IGraphics* const pGraphics)
+{
+	const IRECT r = pGraphics->ToPixels(&mRECT);
+	const int x1 = r.L, w = r.W();
+	const int y1 = r.T, h = r.H();
+	if (w < 2 || h <= 0) return;
+
+	static const int n = kFFTSize;
+	static const int nBins = n / 2;
+
+	WDL_FFT_REAL* const pFFT = mFFT.Get();
+	const float* const pSamples = mSamples.Get();
+	const WDL_FFT_REAL* const pWindow = mWindow.Get();
+	for (int i = 0; i < n; ++i) pFFT[i] = (WDL_FFT_REAL)pSamples[i] * pWindow[i];
+
+	WDL_real_fft(pFFT, n, 0);
+
+	// Power per bin (the FFT output is permuted), DC is ignored.
+	const WDL_FFT_COMPLEX* const pBins = (const WDL_FFT_COMPLEX*)pFFT;
+	const int* const pPermute = WDL_fft_permute_tab(nBins);
+	WDL_FFT_REAL* const pPower = pFFT + n;
+	pPower[0] = 0.0f;
+	for (int k = 1; k < nBins; ++k)
+	{
+		const WDL_FFT_COMPLEX c = pBins[pPermute[k]];
+		pPower[k] = c.re * c.re + c.im * c.im;
+	}
+
+	// Log frequency axis, from 20 Hz to Nyquist.
+	static const double minFreq = 20.0;
+	static const float minDB = -96.0f;
+
+	const double binHz = GetPlug()->GetSampleRate() / (double)(n * GetPlug()->GetAudioTap()->GetDecimation());
+	const double ratio = binHz * (double)nBins / minFreq;
+	if (ratio <= 1.0) return;
+
+	LICE_IBitmap* const pDest = pGraphics->GetDrawBitmap();
+	const LICE_pixel color = mColor.Get();
+
+	float prevX = 0.0f, prevY = 0.0f;
+	double lo = minFreq / binHz;
+	for (int x = 0; x < w; ++x)
+	{
+		const double hi = minFreq * pow(ratio, (double)(x + 1) / (double)w) / binHz;
+
+		// Loudest bin in this column, or the nearest if the column is
+		// narrower than a bin.
+		int k = wdl_max((int)(lo + 0.5), 1);
+		const int kEnd = wdl_min(wdl_max((int)(hi + 0.5), k + 1), nBins);
+		WDL_FFT_REAL p = 0.0f;
+		for (; k < kEnd; ++k) p = wdl_max(p, pPower[k]);
+		lo = hi;
+
+		const float dB = p > 0.0f ? 10.0f * log10f((float)p) : minDB;
+		const float t = wdl_max(wdl_min(dB / minDB, 1.0f), 0.0f);
+
+		const float fx = (float)(x1 + x);
+		const float fy = (float)y1 + t * (float)(h - 1);
+		if (x) LICE_FLine(pDest, prevX, prevY, fx, fy, color, 1.0f, LICE_BLIT_MODE_COPY, true);
+		prevX = fx;
+		prevY = fy;
+	}
+}
@@ -4,6 +4,7 @@
 #include "IGraphics.h"
 
 #include <assert.h>
+#include "WDL/fft.h"
 #include "WDL/wdltypes.h"
 
 // A control is anything on the GUI, it could be a static bitmap, or
@@ -28,6 +29,7 @@ public:
 	):
 		mPlug(pPlug),
 		mParamIdx(paramIdx),
+		mDirtyIdx(-1),
 		mDirty(1),
 		mRedraw(0),
 		mHide(0),
@@ -39,6 +41,7 @@ public:
 		mAutoUpdate(0),
 		mReadOnly(0),
 		mBypass(0),
+		mStatic(0),
 		_unused(0)
 	{
 		if (pR) mRECT = *pR;
@@ -102,6 +105,11 @@ public:
 	inline void Bypass(const bool bypass) { mBypass = bypass; }
 	inline bool IsBypassed() const { return mBypass; }
 
+	// Static controls always draw the same, so if they are at the bottom of
+	// the z-order IGraphics draws them once into a composition layer.
+	inline void SetStatic(const bool isStatic) { mStatic = isStatic; }
+	inline bool IsStatic() const { return mStatic; }
+
 	// Override if you want the control to be hit only if a visible part of it is hit, or whatever.
 	virtual bool IsHit(int x, int y);
 
@@ -118,7 +126,7 @@ public:
 	virtual const char* GetTooltip() { return NULL; }
 
 	// Sometimes a control changes its state as part of its Draw method.
-	inline void Redraw() { mDirty = mRedraw = 1; }
+	inline void Redraw() { mDirty = mRedraw = 1; MarkDirty(); }
 
 	// This is an idle call from the GUI thread, as opposed to
 	// IPlugBase::OnIdle which is called from the audio processing thread.
@@ -132,14 +140,24 @@ public:
 
 	virtual void Rescale(IGraphics* pGraphics) {}
 
+	// Called when the window closes (see IGraphics::ReleaseCachedResources()),
+	// to free any pre-rendered bitmaps, which Draw() should then rebuild.
+	virtual void ReleaseCachedResources() {}
+
 	// For pure text edit controls (i.e. no value, paramIdx < 0).
 	virtual void SetTextFromUserInput(const char* txt) {}
 	virtual char* GetTextForUserInput(char* buf, int bufSize = 128);
 
 protected:
+	friend class IGraphics;
+
+	// Tells IGraphics to check this control on the next timer tick.
+	void MarkDirty();
+
 	IPlugBase* mPlug;
 	int mParamIdx;
-	unsigned int mDirty:1, mRedraw:1, mHide:1, mGrayed:1, mDisablePrompt:1, mDblAsSingleClick:1, mReverse:1, mDirection:1, mAutoUpdate:1, mReadOnly:1, mBypass:1, _unused:21;
+	int mDirtyIdx; // Set by IGraphics::AttachControl().
+	unsigned int mDirty:1, mRedraw:1, mHide:1, mGrayed:1, mDisablePrompt:1, mDblAsSingleClick:1, mReverse:1, mDirection:1, mAutoUpdate:1, mReadOnly:1, mBypass:1, mStatic:1, _unused:20;
 	IRECT mRECT;
 };
 
@@ -356,6 +374,45 @@ protected:
 }
 WDL_FIXALIGN;
 
+// A knob that draws a dot indicator on top of a single base bitmap, instead
+// of cycling through a bitmap frame for each position.
+class IKnobVectorControl: public IKnobMultiControl
+{
+public:
+	IKnobVectorControl(
+		IPlugBase* pPlug,
+		int x,
+		int y,
+		int paramIdx = -1,
+		const IBitmap* pBase = NULL,
+		IColor color = IColor::kWhite
+	);
+
+	// Distance from the knob center and radius of the dot, in full scale
+	// pixels.
+	void SetIndicator(float radius, float dotRadius);
+
+	// Degrees clockwise from 12 o'clock.
+	void SetAngles(float minAngle, float maxAngle);
+
+	void Draw(IGraphics* pGraphics);
+	void Rescale(IGraphics* pGraphics);
+	void ReleaseCachedResources();
+
+protected:
+	void RenderFrame(IGraphics* pGraphics, double value);
+
+	// Last rendered frame, redrawn only when the value changes (or after
+	// the window was closed).
+	LICE_MemBitmap mFrame;
+	double WDL_FIXALIGN mFrameValue;
+
+	IColor mColor;
+	float mRadius, mDotRadius;
+	float mMinAngle, mMaxAngle;
+}
+WDL_FIXALIGN;
+
 // Output text to the screen.
 class ITextControl: public IControl
 {
@@ -381,3 +438,74 @@ protected:
 	IText mFont;
 	WDL_FastString mStr;
 };
+
+// DSP load overlay: p50/p99/max of the realtime budget and a histogram,
+// read from IPlugBase::GetDSPLoadMeter(). Click to log the stats and reset,
+// Ctrl+click to run IPlugBase::StressTest() (debug builds only).
+class IDSPLoadControl: public IControl
+{
+public:
+	IDSPLoadControl(
+		IPlugBase* pPlug,
+		const IRECT* pR,
+		const IText* pFont = NULL
+	);
+
+	~IDSPLoadControl();
+
+	void OnMouseDown(int x, int y, IMouseMod mod);
+
+	void Draw(IGraphics* pGraphics);
+	void Rescale(IGraphics* pGraphics);
+
+protected:
+	// Called by the meter on the audio thread, after we stopped polling.
+	static void Wake(void* pControl);
+
+	void UpdateText();
+
+	IText mFont;
+	WDL_FastString mStr;
+	IWakeup::Target mWakeTarget;
+	unsigned int mBlocks;
+};
+
+// Oscilloscope or spectrum of the plugin output, read from
+// IPlugBase::GetAudioTap(). Click to switch between the two.
+class IScopeControl: public IControl
+{
+public:
+	enum EMode { kModeScope = 0, kModeSpectrum };
+
+	// Spectrum resolution, also the number of frames read per redraw.
+	static const int kFFTSize = 2048;
+
+	IScopeControl(
+		IPlugBase* pPlug,
+		const IRECT* pR,
+		IColor color = IColor(255, 0, 192, 255),
+		int mode = kModeScope
+	);
+
+	~IScopeControl();
+
+	void OnMouseDown(int x, int y, IMouseMod mod);
+	void Draw(IGraphics* pGraphics);
+
+	inline int GetMode() const { return mMode; }
+	inline void SetMode(const int mode) { mMode = mode; Redraw(); }
+
+protected:
+	// Called by the tap on the audio thread, after we stopped polling.
+	static void Wake(void* pControl);
+
+	void DrawScope(IGraphics* pGraphics);
+	void DrawSpectrum(IGraphics* pGraphics);
+
+	WDL_TypedBuf<float> mSamples;
+	WDL_TypedBuf<WDL_FFT_REAL> mFFT, mWindow;
+	IWakeup::Target mWakeTarget;
+	IColor mColor;
+	int mMode;
+	unsigned int mReadPos;
+};
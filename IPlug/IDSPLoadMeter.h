@@ -0,0 +1,138 @@
+#pragma once
+
+/*
+	IDSPLoadMeter measures the time spent in each ProcessDoubleReplacing()
+	call relative to the realtime budget of the block (nFrames/sampleRate),
+	and keeps a histogram of the results.
+
+	The audio thread is the only writer, the GUI thread (or anyone else) can
+	read the stats without locking the plugin mutex. Readers may see stats
+	that are a block behind, but never a torn value.
+
+	Load values are in units of 0.1% (i.e. 1000 = 100% of the budget).
+
+	A reader that found no new blocks can ask to be woken up by the next
+	block (like IAudioTap), so it doesn't have to keep polling while the
+	host isn't processing.
+*/
+
+#include <string.h>
+
+#include "IWakeup.h"
+
+#include "WDL/time_precise.h"
+#include "WDL/wdltypes.h"
+
+class IDSPLoadMeter
+{
+public:
+	// Histogram resolution is 1/kBucketsPerBudget of the realtime budget,
+	// the last bucket also holds anything above kNumBuckets/kBucketsPerBudget.
+	static const int kBucketsPerBudget = 64;
+	static const int kNumBuckets = 2 * kBucketsPerBudget;
+
+	IDSPLoadMeter()
+	{
+		Clear();
+		mStartTime = 0.0;
+		mResetReq = mResetAck = 0;
+	}
+
+	// Audio thread.
+	inline void BeginBlock() { mStartTime = time_precise(); }
+
+	void EndBlock(const int nFrames, const double sampleRate)
+	{
+		const double elapsed = time_precise() - mStartTime;
+
+		if (mResetReq != mResetAck)
+		{
+			Clear();
+			mResetAck = mResetReq;
+		}
+
+		if (nFrames <= 0) return;
+		const double load = elapsed * sampleRate / (double)nFrames;
+
+		int bucket = (int)(load * (double)kBucketsPerBudget);
+		bucket = wdl_min(bucket, kNumBuckets - 1);
+		mHistogram[wdl_max(bucket, 0)]++;
+
+		const int permille = (int)(load * 1000.0 + 0.5);
+		if (permille > mMax) mMax = permille;
+		mLast = permille;
+
+		mBlocks++;
+		mWakeup.Signal();
+	}
+
+	// Any thread.
+	inline unsigned int GetBlockCount() const { return mBlocks; }
+	inline int GetLast() const { return mLast; }
+	inline int GetMax() const { return mMax; }
+
+	// Returns the upper bound of the histogram bucket that contains the
+	// requested percentile (0.0..1.0), so p99 = GetPercentile(0.99).
+	int GetPercentile(const double p) const
+	{
+		unsigned int hist[kNumBuckets];
+		const unsigned int total = GetHistogram(hist);
+		if (!total) return 0;
+
+		const unsigned int rank = (unsigned int)(p * (double)total + 0.5);
+		unsigned int sum = 0;
+		int i = 0;
+		for (; i < kNumBuckets - 1; ++i)
+		{
+			sum += hist[i];
+			if (sum >= rank) break;
+		}
+
+		// The overflow bucket has no upper bound, so report the max instead.
+		return i < kNumBuckets - 1 ? (i + 1) * 1000 / kBucketsPerBudget : mMax;
+	}
+
+	// Copies the histogram, and returns the total number of blocks in it.
+	unsigned int GetHistogram(unsigned int* const pDest) const
+	{
+		unsigned int total = 0;
+		for (int i = 0; i < kNumBuckets; ++i)
+		{
+			const unsigned int n = mHistogram[i];
+			pDest[i] = n;
+			total += n;
+		}
+		return total;
+	}
+
+	// Stats are cleared by the audio thread on the next block.
+	inline void RequestReset() { mResetReq++; }
+
+	// Called (from the audio thread) after RequestWake(). Clear (NULL)
+	// before destroying the target, see IWakeup::SetTarget().
+	inline void SetWakeTarget(const IWakeup::Target* const pTarget) { mWakeup.SetTarget(pTarget); }
+
+	// Call when the block count was still lastBlocks. Returns true if the
+	// next block will call the wake target, or false if blocks were
+	// processed meanwhile.
+	inline bool RequestWake(const unsigned int lastBlocks) { return mWakeup.Request(&mBlocks, lastBlocks); }
+
+protected:
+	void Clear()
+	{
+		memset((void*)mHistogram, 0, sizeof(mHistogram));
+		mBlocks = 0;
+		mLast = mMax = 0;
+	}
+
+	double WDL_FIXALIGN mStartTime;
+
+	volatile unsigned int mHistogram[kNumBuckets];
+	volatile unsigned int mBlocks;
+	volatile int mLast, mMax;
+
+	volatile unsigned int mResetReq, mResetAck;
+
+	IWakeup mWakeup;
+}
+WDL_FIXALIGN;
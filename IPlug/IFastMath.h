@@ -0,0 +1,238 @@
+#pragma once
+
+/*
+	Vectorized exp(), log(), and pow() for mapping params in bulk (see the
+	batch versions of IParam::FromNormalized() and ToNormalized()).
+
+	Accuracy (measured against the C runtime):
+	- Exp(x): relative error < 1e-15. x is clamped to [-708, 709].
+	- Log(x): absolute error < 1e-15 for x = [0.5, 2], and relative error
+	  < 1e-15 elsewhere. x must be positive and normal.
+	- Pow(x, y): relative error < 1e-15 * max(1, |y*log(x)|). Returns 0 for
+	  x <= 0, and exactly 1 for x = 1.
+
+	The scalar versions, and the last value of an odd sized batch, go
+	through the same vector code, so a value always maps to the exact same
+	result, whether it is converted on its own or in a batch.
+*/
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+	#define IFASTMATH_SSE2
+	#include <emmintrin.h>
+#elif defined(_M_ARM64) || defined(__aarch64__)
+	#define IFASTMATH_NEON
+	#include <arm_neon.h>
+#else
+	#include <string.h>
+#endif
+
+#include "WDL/wdltypes.h"
+
+class IFastMath
+{
+public:
+	static void Exp(const double* const pIn, double* const pOut, const int n)
+	{
+		int i = 0;
+		for (; i + kN <= n; i += kN) Store(&pOut[i], ExpV(Load(&pIn[i])));
+		if (i < n) pOut[i] = First(ExpV(Set(pIn[i])));
+	}
+
+	static void Log(const double* const pIn, double* const pOut, const int n)
+	{
+		int i = 0;
+		for (; i + kN <= n; i += kN) Store(&pOut[i], LogV(Load(&pIn[i])));
+		if (i < n) pOut[i] = First(LogV(Set(pIn[i])));
+	}
+
+	// pOut[i] = pow(pIn[i], y)
+	static void Pow(const double* const pIn, double* const pOut, const int n, const double y)
+	{
+		const V vy = Set(y);
+
+		int i = 0;
+		for (; i + kN <= n; i += kN) Store(&pOut[i], PowV(Load(&pIn[i]), vy));
+		if (i < n) pOut[i] = First(PowV(Set(pIn[i]), vy));
+	}
+
+	// pOut[i] = pow(pIn[i], pY[i])
+	static void Pow(const double* const pIn, const double* const pY, double* const pOut, const int n)
+	{
+		int i = 0;
+		for (; i + kN <= n; i += kN) Store(&pOut[i], PowV(Load(&pIn[i]), Load(&pY[i])));
+		if (i < n) pOut[i] = First(PowV(Set(pIn[i]), Set(pY[i])));
+	}
+
+	static inline double Exp(const double x)
+	{
+		double y;
+		Exp(&x, &y, 1);
+		return y;
+	}
+
+	static inline double Log(const double x)
+	{
+		double y;
+		Log(&x, &y, 1);
+		return y;
+	}
+
+	static inline double Pow(const double x, const double y)
+	{
+		double z;
+		Pow(&x, &z, 1, y);
+		return z;
+	}
+
+protected:
+	// kN doubles, and the few ops the kernels below need. Multiply and add
+	// are separate (no FMA), on purpose.
+
+	#if defined(IFASTMATH_SSE2)
+
+	typedef __m128d V;
+	enum { kN = 2 };
+
+	static inline V Load(const double* const p) { return _mm_loadu_pd(p); }
+	static inline void Store(double* const p, const V a) { _mm_storeu_pd(p, a); }
+	static inline V Set(const double a) { return _mm_set1_pd(a); }
+	static inline double First(const V a) { return _mm_cvtsd_f64(a); }
+
+	static inline V Add(const V a, const V b) { return _mm_add_pd(a, b); }
+	static inline V Sub(const V a, const V b) { return _mm_sub_pd(a, b); }
+	static inline V Mul(const V a, const V b) { return _mm_mul_pd(a, b); }
+	static inline V Div(const V a, const V b) { return _mm_div_pd(a, b); }
+	static inline V Min(const V a, const V b) { return _mm_min_pd(a, b); }
+	static inline V Max(const V a, const V b) { return _mm_max_pd(a, b); }
+
+	// a > b ? c : 0.0
+	static inline V IfGreater(const V a, const V b, const V c) { return _mm_and_pd(_mm_cmpgt_pd(a, b), c); }
+
+	// Keeps the low 12 bits of t's mantissa, shifted into the exponent.
+	static inline V ShiftToExponent(const V t) { return _mm_castsi128_pd(_mm_slli_epi64(_mm_castpd_si128(t), 52)); }
+	// Exponent bits of x, in the low mantissa bits of 2^52.
+	static inline V ExponentBits(const V x) { return _mm_or_pd(_mm_castsi128_pd(_mm_srli_epi64(_mm_castpd_si128(x), 52)), Set(4503599627370496.0)); }
+	// Mantissa bits of x, in the mantissa of 1.0.
+	static inline V MantissaBits(const V x) { return _mm_or_pd(_mm_and_pd(x, _mm_castsi128_pd(_mm_set_epi32(0x000FFFFF, -1, 0x000FFFFF, -1))), Set(1.0)); }
+
+	#elif defined(IFASTMATH_NEON)
+
+	typedef float64x2_t V;
+	enum { kN = 2 };
+
+	static inline V Load(const double* const p) { return vld1q_f64(p); }
+	static inline void Store(double* const p, const V a) { vst1q_f64(p, a); }
+	static inline V Set(const double a) { return vdupq_n_f64(a); }
+	static inline double First(const V a) { return vgetq_lane_f64(a, 0); }
+
+	static inline V Add(const V a, const V b) { return vaddq_f64(a, b); }
+	static inline V Sub(const V a, const V b) { return vsubq_f64(a, b); }
+	static inline V Mul(const V a, const V b) { return vmulq_f64(a, b); }
+	static inline V Div(const V a, const V b) { return vdivq_f64(a, b); }
+	static inline V Min(const V a, const V b) { return vminq_f64(a, b); }
+	static inline V Max(const V a, const V b) { return vmaxq_f64(a, b); }
+
+	static inline V IfGreater(const V a, const V b, const V c) { return vreinterpretq_f64_u64(vandq_u64(vcgtq_f64(a, b), vreinterpretq_u64_f64(c))); }
+
+	static inline V ShiftToExponent(const V t) { return vreinterpretq_f64_u64(vshlq_n_u64(vreinterpretq_u64_f64(t), 52)); }
+	static inline V ExponentBits(const V x) { return vreinterpretq_f64_u64(vorrq_u64(vshrq_n_u64(vreinterpretq_u64_f64(x), 52), vreinterpretq_u64_f64(Set(4503599627370496.0)))); }
+	static inline V MantissaBits(const V x) { return vreinterpretq_f64_u64(vorrq_u64(vandq_u64(vreinterpretq_u64_f64(x), vdupq_n_u64(WDL_UINT64_CONST(0x000FFFFFFFFFFFFF))), vreinterpretq_u64_f64(Set(1.0)))); }
+
+	#else
+
+	typedef double V;
+	enum { kN = 1 };
+
+	static inline V Load(const double* const p) { return *p; }
+	static inline void Store(double* const p, const V a) { *p = a; }
+	static inline V Set(const double a) { return a; }
+	static inline double First(const V a) { return a; }
+
+	static inline V Add(const V a, const V b) { return a + b; }
+	static inline V Sub(const V a, const V b) { return a - b; }
+	static inline V Mul(const V a, const V b) { return a * b; }
+	static inline V Div(const V a, const V b) { return a / b; }
+	static inline V Min(const V a, const V b) { return wdl_min(a, b); }
+	static inline V Max(const V a, const V b) { return wdl_max(a, b); }
+
+	static inline V IfGreater(const V a, const V b, const V c) { return a > b ? c : 0.0; }
+
+	static inline WDL_UINT64 ToBits(const double a) { WDL_UINT64 bits; memcpy(&bits, &a, sizeof(bits)); return bits; }
+	static inline double FromBits(const WDL_UINT64 bits) { double a; memcpy(&a, &bits, sizeof(a)); return a; }
+
+	static inline V ShiftToExponent(const V t) { return FromBits(ToBits(t) << 52); }
+	static inline V ExponentBits(const V x) { return FromBits((ToBits(x) >> 52) | ToBits(4503599627370496.0)); }
+	static inline V MantissaBits(const V x) { return FromBits((ToBits(x) & WDL_UINT64_CONST(0x000FFFFFFFFFFFFF)) | ToBits(1.0)); }
+
+	#endif
+
+	// a + b*c
+	static inline V MulAdd(const V a, const V b, const V c) { return Add(a, Mul(b, c)); }
+
+	// exp(x) = 2^k * exp(r), with k = round(x/ln(2)), so |r| <= ln(2)/2,
+	// and exp(r) = degree 12 Taylor polynomial, evaluated with Estrin's
+	// scheme (shorter dependency chains than Horner's).
+	static inline V ExpV(V x)
+	{
+		// Adding 1.5 * 2^52 rounds to the nearest integer, which then ends
+		// up in the low mantissa bits.
+		static const double roundBias = 6755399441055744.0;
+
+		x = Min(Max(x, Set(-708.0)), Set(709.0));
+
+		const V t = MulAdd(Set(roundBias), x, Set(1.4426950408889634));
+		const V k = Sub(t, Set(roundBias));
+
+		// ln(2) split in two, so k*ln2Hi is exact.
+		const V r = Sub(Sub(x, Mul(k, Set(6.93147180369123816490e-01))), Mul(k, Set(1.90821492927058770002e-10)));
+		const V r2 = Mul(r, r), r4 = Mul(r2, r2), r8 = Mul(r4, r4);
+
+		const V p =
+			MulAdd(
+				MulAdd(
+					MulAdd(MulAdd(Set(1.0), Set(1.0), r), MulAdd(Set(1.0 / 2.0), Set(1.0 / 6.0), r), r2),
+					MulAdd(MulAdd(Set(1.0 / 24.0), Set(1.0 / 120.0), r), MulAdd(Set(1.0 / 720.0), Set(1.0 / 5040.0), r), r2),
+					r4),
+				MulAdd(
+					MulAdd(MulAdd(Set(1.0 / 40320.0), Set(1.0 / 362880.0), r), MulAdd(Set(1.0 / 3628800.0), Set(1.0 / 39916800.0), r), r2),
+					Set(1.0 / 479001600.0),
+					r4),
+				r8);
+
+		// 2^k = (k + 1023) << 52
+		return Mul(p, ShiftToExponent(Add(t, Set(1023.0))));
+	}
+
+	// x = 2^e * m, with m = [sqrt(2)/2, sqrt(2)), and log(m) = 2s + s*z*P(z),
+	// with s = (m - 1)/(m + 1), z = s^2, and P(z) = 2/3 + 2/5 z + ... + 2/21 z^9.
+	static inline V LogV(const V x)
+	{
+		V e = Sub(ExponentBits(x), Set(4503599627370496.0 + 1023.0));
+		V m = MantissaBits(x);
+
+		const V big = IfGreater(m, Set(1.4142135623730951), Set(1.0));
+		m = Mul(m, Sub(Set(1.0), Mul(big, Set(0.5))));
+		e = Add(e, big);
+
+		const V f = Sub(m, Set(1.0));
+		const V s = Div(f, Add(f, Set(2.0)));
+		const V z = Mul(s, s), z2 = Mul(z, z), z4 = Mul(z2, z2), z8 = Mul(z4, z4);
+
+		const V p =
+			MulAdd(
+				MulAdd(
+					MulAdd(MulAdd(Set(2.0 / 3.0), Set(2.0 / 5.0), z), MulAdd(Set(2.0 / 7.0), Set(2.0 / 9.0), z), z2),
+					MulAdd(MulAdd(Set(2.0 / 11.0), Set(2.0 / 13.0), z), MulAdd(Set(2.0 / 15.0), Set(2.0 / 17.0), z), z2),
+					z4),
+				MulAdd(Set(2.0 / 19.0), Set(2.0 / 21.0), z),
+				z8);
+
+		const V logM = MulAdd(Add(s, s), Mul(s, z), p);
+		return Add(Mul(e, Set(6.93147180369123816490e-01)), MulAdd(logM, e, Set(1.90821492927058770002e-10)));
+	}
+
+	static inline V PowV(const V x, const V y)
+	{
+		return IfGreater(x, Set(0.0), ExpV(Mul(y, LogV(x))));
+	}
+};
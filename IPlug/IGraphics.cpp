@@ -1,78 +1,407 @@
 #include "IGraphics.h"
+#include "IBitmapDiskCache.h"
 #include "IControl.h"
+#include "IPresetBank.h"
 
 #include <assert.h>
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "WDL/fnv64.h"
+#include "WDL/heapbuf.h"
 #include "WDL/mutex.h"
 #include "WDL/wdltypes.h"
 
+#ifdef _WIN32
+	#include <windows.h>
+	#include <process.h>
+#else
+	#include <pthread.h>
+	#include <unistd.h>
+#endif
+
+#include "WDL/lice/lice_simd.h"
+
 const int IGraphics::kDefaultFPS;
 
+// Chained hash table of entries that have mHash and mNext members.
+template <class ENTRY> class HashedEntries
+{
+public:
+	HashedEntries(): mCount(0) { Rehash(16); }
+
+	inline ENTRY* First(const unsigned int hash) const { return mBuckets.Get()[hash & (mBuckets.GetSize() - 1)]; }
+
+	void Add(ENTRY* const pEntry)
+	{
+		if (mCount >= mBuckets.GetSize()) Rehash(mBuckets.GetSize() * 2);
+		Insert(pEntry);
+		mCount++;
+	}
+
+	void Remove(ENTRY* const pEntry)
+	{
+		ENTRY** pp = &mBuckets.Get()[pEntry->mHash & (mBuckets.GetSize() - 1)];
+		while (*pp != pEntry) pp = &(*pp)->mNext;
+		*pp = pEntry->mNext;
+		mCount--;
+	}
+
+	// Enumerates all entries, or returns NULL.
+	ENTRY* Enumerate(int idx) const
+	{
+		const int n = mBuckets.GetSize();
+		ENTRY* const* const ppBuckets = mBuckets.Get();
+		for (int i = 0; i < n; ++i)
+		{
+			for (ENTRY* pEntry = ppBuckets[i]; pEntry; pEntry = pEntry->mNext)
+			{
+				if (!idx--) return pEntry;
+			}
+		}
+		return NULL;
+	}
+
+	inline int GetSize() const { return mCount; }
+
+private:
+	void Insert(ENTRY* const pEntry)
+	{
+		ENTRY** const ppBucket = &mBuckets.Get()[pEntry->mHash & (mBuckets.GetSize() - 1)];
+		pEntry->mNext = *ppBucket;
+		*ppBucket = pEntry;
+	}
+
+	void Rehash(const int nBuckets)
+	{
+		// Unlink everything into a single list, then reinsert.
+		ENTRY* pList = NULL;
+		const int n = mBuckets.GetSize();
+		for (int i = 0; i < n; ++i)
+		{
+			ENTRY* pEntry = mBuckets.Get()[i];
+			while (pEntry)
+			{
+				ENTRY* const pNext = pEntry->mNext;
+				pEntry->mNext = pList;
+				pList = pEntry;
+				pEntry = pNext;
+			}
+		}
+
+		mBuckets.Resize(nBuckets, false);
+		memset(mBuckets.Get(), 0, nBuckets * sizeof(ENTRY*));
+
+		while (pList)
+		{
+			ENTRY* const pNext = pList->mNext;
+			Insert(pList);
+			pList = pNext;
+		}
+	}
+
+	WDL_TypedBuf<ENTRY*> mBuckets;
+	int mCount;
+};
+
+struct BitmapCacheEntry
+{
+	unsigned int mHash;
+	BitmapCacheEntry* mNext;
+	int mID, mScaleMul, mRefs; // mScaleMul is 0 if decoded, else resampled.
+	LICE_IBitmap* mBitmap; // NULL while being decoded.
+};
+
+// Bitmaps shared by all instances. Each IGraphics holds a reference to the
+// bitmaps of the scale set it uses, and a bitmap is deleted when its last
+// reference is released.
 class BitmapStorage
 {
 public:
-	WDL_IntKeyedArray<LICE_IBitmap*> m_bitmaps;
+	HashedEntries<BitmapCacheEntry> m_bitmaps;
 	WDL_Mutex m_mutex;
 
-	BitmapStorage(): m_bitmaps(Dispose) {}
+	static inline unsigned int Hash(const int id, const int mul) { return (unsigned int)id * 0x9E3779B1 ^ (unsigned int)mul * 0x85EBCA6B; }
 
-	LICE_IBitmap* Find(const int id)
+	LICE_IBitmap* Find(const int id, const int mul = 0)
 	{
 		m_mutex.Enter();
-		LICE_IBitmap* const bitmap = m_bitmaps.Get(id, NULL);
+		const BitmapCacheEntry* const pEntry = FindEntry(id, mul);
+		LICE_IBitmap* const bitmap = pEntry ? pEntry->mBitmap : NULL;
 		m_mutex.Leave();
 		return bitmap;
 	}
 
-	void Add(LICE_IBitmap* const bitmap, const int id)
+	// Adds a reference, creating an empty entry if there is none yet.
+	BitmapCacheEntry* Acquire(const int id, const int mul = 0)
 	{
 		m_mutex.Enter();
-		m_bitmaps.Insert(id, bitmap);
+		BitmapCacheEntry* pEntry = FindEntry(id, mul);
+		if (!pEntry)
+		{
+			pEntry = new BitmapCacheEntry;
+			pEntry->mHash = Hash(id, mul);
+			pEntry->mID = id;
+			pEntry->mScaleMul = mul;
+			pEntry->mRefs = 0;
+			pEntry->mBitmap = NULL;
+			m_bitmaps.Add(pEntry);
+		}
+		pEntry->mRefs++;
 		m_mutex.Leave();
+		return pEntry;
 	}
 
-	/* void Remove(LICE_IBitmap* const bitmap)
+	void Release(BitmapCacheEntry* const pEntry)
 	{
 		m_mutex.Enter();
-		const int* const id = m_bitmaps.ReverseLookupPtr(bitmap);
-		if (id)
+		if (!--pEntry->mRefs)
+		{
+			m_bitmaps.Remove(pEntry);
+			delete pEntry->mBitmap;
+			delete pEntry;
+		}
+		m_mutex.Leave();
+	}
+
+	// Returns the cached bitmap, which is not the one passed in (and which
+	// gets deleted) if another thread got there first. If the ID is no
+	// longer referenced the bitmap is deleted, and NULL is returned.
+	LICE_IBitmap* Add(LICE_IBitmap* bitmap, const int id, const int mul = 0)
+	{
+		m_mutex.Enter();
+		BitmapCacheEntry* const pEntry = FindEntry(id, mul);
+		if (pEntry && !pEntry->mBitmap)
+		{
+			pEntry->mBitmap = bitmap;
+		}
+		else
 		{
-			m_bitmaps.Delete(*id);
 			delete bitmap;
+			bitmap = pEntry ? pEntry->mBitmap : NULL;
 		}
 		m_mutex.Leave();
-	} */
+		return bitmap;
+	}
+
+	~BitmapStorage()
+	{
+		BitmapCacheEntry* pEntry;
+		while ((pEntry = m_bitmaps.Enumerate(0)))
+		{
+			m_bitmaps.Remove(pEntry);
+			delete pEntry->mBitmap;
+			delete pEntry;
+		}
+	}
 
-	static void Dispose(LICE_IBitmap* const bitmap)
+	#ifndef NDEBUG
+	int Bytes()
 	{
-		delete bitmap;
+		int bytes = 0;
+		m_mutex.Enter();
+		for (int i = 0; ; ++i)
+		{
+			const BitmapCacheEntry* const pEntry = m_bitmaps.Enumerate(i);
+			if (!pEntry) break;
+
+			LICE_IBitmap* const bitmap = pEntry->mBitmap;
+			if (bitmap) bytes += bitmap->getRowSpan() * bitmap->getHeight() * (int)sizeof(LICE_pixel);
+		}
+		m_mutex.Leave();
+		return bytes;
 	}
+	#endif
 
 	static const LICE_WrapperBitmap kEmptyBitmap;
+
+private:
+	BitmapCacheEntry* FindEntry(const int id, const int mul) const
+	{
+		BitmapCacheEntry* pEntry = m_bitmaps.First(Hash(id, mul));
+		while (pEntry && !(pEntry->mID == id && pEntry->mScaleMul == mul)) pEntry = pEntry->mNext;
+		return pEntry;
+	}
 };
 
 const LICE_WrapperBitmap BitmapStorage::kEmptyBitmap(NULL, 0, 0, 0, false);
 
 static BitmapStorage s_bitmapCache;
 
-class FontStorage
+// Decodes bitmaps on a worker thread, which runs until the queue is empty.
+class BitmapLoader
 {
 public:
-	struct FontKey
+	struct Job
 	{
-		WDL_UINT64 style;
-		const char* face;
-		LICE_IFont* font;
+		IGraphics* pGraphics;
+		int id;
+		const char* name;
 	};
 
-	WDL_PtrList<FontKey> m_fonts;
+	WDL_TypedBuf<Job> m_jobs;
+	IGraphics* m_current;
+	bool m_running;
+	WDL_Mutex m_mutex;
+
+	BitmapLoader(): m_current(NULL), m_running(false) {}
+
+	void Add(IGraphics* const pGraphics, const int id, const char* const name)
+	{
+		const Job job = { pGraphics, id, name };
+
+		m_mutex.Enter();
+		m_jobs.Add(job);
+		const bool start = !m_running;
+		m_running = true;
+		m_mutex.Leave();
+
+		if (start && !StartThread()) Run();
+	}
+
+	bool IsPending(const IGraphics* const pGraphics)
+	{
+		m_mutex.Enter();
+		bool pending = m_current == pGraphics;
+		const int n = m_jobs.GetSize();
+		const Job* const pJobs = m_jobs.Get();
+		for (int i = 0; i < n && !pending; ++i) pending = pJobs[i].pGraphics == pGraphics;
+		m_mutex.Leave();
+		return pending;
+	}
+
+	// Drops queued jobs, and waits for the one in progress.
+	void Cancel(const IGraphics* const pGraphics)
+	{
+		m_mutex.Enter();
+		for (int i = m_jobs.GetSize() - 1; i >= 0; --i)
+		{
+			if (m_jobs.Get()[i].pGraphics == pGraphics) m_jobs.Delete(i);
+		}
+		m_mutex.Leave();
+
+		while (IsCurrent(pGraphics)) Sleep1();
+	}
+
+private:
+	bool IsCurrent(const IGraphics* const pGraphics)
+	{
+		m_mutex.Enter();
+		const bool current = m_current == pGraphics;
+		m_mutex.Leave();
+		return current;
+	}
+
+	void Run()
+	{
+		for (;;)
+		{
+			m_mutex.Enter();
+			if (!m_jobs.GetSize())
+			{
+				m_current = NULL;
+				m_running = false;
+				m_mutex.Leave();
+				return;
+			}
+			const Job job = m_jobs.Get()[0];
+			m_jobs.Delete(0);
+			m_current = job.pGraphics;
+			m_mutex.Leave();
+
+			// Another instance may have queued the same bitmap.
+			if (!s_bitmapCache.Find(job.id))
+			{
+				LICE_IBitmap* const lb = job.pGraphics->DecodeBitmap(job.id, job.name);
+				assert(lb);
+				if (lb) s_bitmapCache.Add(lb, job.id);
+			}
+		}
+	}
+
+	#ifdef _WIN32
+	static unsigned int WINAPI ThreadProc(void* const pLoader)
+	{
+		((BitmapLoader*)pLoader)->Run();
+		return 0;
+	}
+
+	bool StartThread()
+	{
+		const HANDLE hThread = (HANDLE)_beginthreadex(NULL, 0, ThreadProc, this, 0, NULL);
+		if (!hThread) return false;
+		CloseHandle(hThread);
+		return true;
+	}
+
+	static void Sleep1() { Sleep(1); }
+	#else
+	static void* ThreadProc(void* const pLoader)
+	{
+		((BitmapLoader*)pLoader)->Run();
+		return NULL;
+	}
+
+	bool StartThread()
+	{
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, ThreadProc, this)) return false;
+		pthread_detach(thread);
+		return true;
+	}
+
+	static void Sleep1() { usleep(1000); }
+	#endif
+};
+
+static BitmapLoader s_bitmapLoader;
+
+// Atomic bit set and fetch-and-clear, for the dirty control bitmask.
+#ifdef _WIN32
+static inline void AtomicOr(volatile int* const p, const int bits) { InterlockedOr((volatile LONG*)p, (LONG)bits); }
+static inline int AtomicTake(volatile int* const p) { return (int)InterlockedExchange((volatile LONG*)p, 0); }
+#else
+static inline void AtomicOr(volatile int* const p, const int bits) { __sync_fetch_and_or(p, bits); }
+static inline int AtomicTake(volatile int* const p) { return __sync_fetch_and_and(p, 0); }
+#endif
+
+// Drawn instead of the controls while bitmaps are being decoded.
+static const IColor kPlaceholderColor(255, 32, 32, 32);
+
+// SIMD blits should be pixel exact. If they aren't on this CPU, then fall
+// back to the scalar blits.
+static void CheckSIMDBlits()
+{
+	const int errors = LICE_SIMD_SelfTest();
+	assert(!errors);
+	if (errors) LICE_SIMD_SetLevel(LICE_SIMD_NONE);
+}
+
+struct FontCacheEntry
+{
+	unsigned int mHash;
+	FontCacheEntry* mNext;
+	WDL_UINT64 mStyle;
+	WDL_String mFace;
+	LICE_IFont* mFont; // NULL until created.
+	int mRefs;
+};
+
+// Fonts shared by all instances, reference counted like the bitmaps. Each
+// IText keeps a pointer to its font, which is only valid as long as the
+// generation hasn't changed (i.e. no font was deleted since).
+class FontStorage
+{
+public:
+	HashedEntries<FontCacheEntry> m_fonts;
 	WDL_Mutex m_mutex;
+	volatile int m_generation;
 
 	WDL_TypedBuf<int> m_load;
 
+	FontStorage(): m_generation(1) {}
+
 	static WDL_UINT64 PackStyle(const int size, const int style, const int orientation)
 	{
 		assert(style >= 0 && style < 8);
@@ -81,53 +410,79 @@ public:
 		return ((WDL_UINT64)((orientation << 3) | style) << 32) | size;
 	}
 
-	LICE_IFont* Find(const WDL_UINT64 style, const char* const face)
+	static unsigned int Hash(const WDL_UINT64 style, const char* const face)
 	{
-		const int n = m_fonts.GetSize();
-		for (int i = 0; i < n; ++i)
+		const WDL_UINT64 h = WDL_FNV64(WDL_FNV64(WDL_FNV64_IV, (const unsigned char*)&style, sizeof(style)), (const unsigned char*)face, (int)strlen(face));
+		return (unsigned int)(h ^ (h >> 32));
+	}
+
+	// Adds a reference, creating an empty entry if there is none yet.
+	FontCacheEntry* Acquire(const IText* const pTxt, const int scaleMul)
+	{
+		const WDL_UINT64 style = PackStyle(IGraphics::ToPixels(pTxt->mSize, scaleMul), pTxt->mStyle, pTxt->mOrientation);
+		const unsigned int hash = Hash(style, pTxt->mFont);
+
+		m_mutex.Enter();
+		FontCacheEntry* pEntry = m_fonts.First(hash);
+		while (pEntry && !(pEntry->mHash == hash && pEntry->mStyle == style && !strcmp(pEntry->mFace.Get(), pTxt->mFont)))
 		{
-			const FontKey* const key = m_fonts.Get(i);
-			if (key->style == style && (key->face == face || !strcmp(key->face, face)))
-			{
-				return key->font;
-			}
+			pEntry = pEntry->mNext;
 		}
-		return NULL;
+		if (!pEntry)
+		{
+			pEntry = new FontCacheEntry;
+			pEntry->mHash = hash;
+			pEntry->mStyle = style;
+			pEntry->mFace.Set(pTxt->mFont);
+			pEntry->mFont = NULL;
+			pEntry->mRefs = 0;
+			m_fonts.Add(pEntry);
+		}
+		pEntry->mRefs++;
+		m_mutex.Leave();
+		return pEntry;
 	}
 
-	LICE_IFont* Find(const IText* const pTxt, const int scale = 0)
+	void Release(FontCacheEntry* const pEntry)
 	{
 		m_mutex.Enter();
-		const WDL_UINT64 style = PackStyle(pTxt->mSize >> scale, pTxt->mStyle, pTxt->mOrientation);
-		LICE_IFont* const font = Find(style, pTxt->mFont);
+		if (!--pEntry->mRefs)
+		{
+			m_fonts.Remove(pEntry);
+			delete pEntry->mFont;
+			delete pEntry;
+			m_generation++;
+		}
 		m_mutex.Leave();
-		return font;
 	}
 
-	LICE_IFont* Add(LICE_IFont* const font, const IText* const pTxt, const int scale = 0)
+	// Returns the cached font, which is not the one passed in (and which
+	// gets deleted) if another thread got there first.
+	LICE_IFont* SetFont(FontCacheEntry* const pEntry, LICE_IFont* font)
 	{
 		m_mutex.Enter();
-		const WDL_UINT64 style = PackStyle(pTxt->mSize >> scale, pTxt->mStyle, pTxt->mOrientation);
-		LICE_IFont* ret = Find(style, pTxt->mFont);
-		if (!ret)
+		if (pEntry->mFont)
 		{
-			FontKey* const key = m_fonts.Add(new FontKey);
-			key->style = style;
-			key->face = pTxt->mFont;
-			key->font = ret = font;
+			delete font;
+			font = pEntry->mFont;
+		}
+		else
+		{
+			pEntry->mFont = font;
 		}
 		m_mutex.Leave();
-		return ret;
+		return font;
 	}
 
 	~FontStorage()
 	{
-		const int n = m_fonts.GetSize();
-		for (int i = 0; i < n; ++i)
+		FontCacheEntry* pEntry;
+		while ((pEntry = m_fonts.Enumerate(0)))
 		{
-			delete m_fonts.Get(i)->font;
+			m_fonts.Remove(pEntry);
+			delete pEntry->mFont;
+			delete pEntry;
 		}
-		m_fonts.Empty(true);
 	}
 };
 
@@ -141,13 +496,19 @@ IGraphics::IGraphics(
 ):
 	mPlug(pPlug),
 	mDrawBitmap(&mBackBuf),
+	mStaticLayerValid(false),
+	mBitmapsPending(false),
 	// mTmpBitmap(NULL),
 	mDirtyRECT(NULL),
+	mNDirtyRects(0),
 	mWidth(w),
 	mHeight(h),
 	mScale(-1),
 	mDefaultScale(kScaleFull),
+	mScaleMul(0),
 	mFPS(refreshFPS > 0 ? refreshFPS : kDefaultFPS),
+	mRefreshMs(1000 / mFPS),
+	mQuietTicks(0),
 	mMouseCapture(-1),
 	mMouseOver(-1),
 	mMouseX(0),
@@ -161,10 +522,18 @@ IGraphics::IGraphics(
 	, mIdleTicks(0)
 	#endif
 {
+	// Once per process, in the GUI thread before anything is drawn.
+	static bool simdChecked = false;
+	if (!simdChecked)
+	{
+		CheckSIMDBlits();
+		simdChecked = true;
+	}
 }
 
 IGraphics::~IGraphics()
 {
+	ReleaseCachedResources();
 	mControls.Empty(true);
 	// delete mTmpBitmap;
 }
@@ -181,16 +550,12 @@ IGraphics::~IGraphics()
 
 void IGraphics::SetFromStringAfterPrompt(IControl* const pControl, const IParam* const pParam, const char* const txt)
 {
+	WakeRefresh();
 	if (pParam)
 	{
 		double v;
-		const bool mapped = pParam->MapDisplayText(txt, &v);
-		if (!mapped)
-		{
-			v = strtod(txt, NULL);
-			if (pParam->DisplayIsNegated()) v = -v;
-			v = pParam->GetNormalized(v);
-		}
+		if (!pParam->FromDisplayText(txt, &v)) return;
+
 		const int paramIdx = pControl->ParamIdx();
 		if (paramIdx >= 0)
 		{
@@ -225,11 +590,15 @@ bool IGraphics::UserDataPath(WDL_String* const pPath, const char* const mfrName,
 	return ok;
 }
 
+bool IGraphics::PresetLibraryPath(WDL_String* const pPath)
+{
+	return IPresetLibrary::DefaultPath(pPath, mPlug->GetMfrName(), mPlug->GetEffectName());
+}
+
 void IGraphics::AttachBackground(const int ID, const char* const name)
 {
 	const IBitmap bg = LoadIBitmap(ID, name);
-	IControl* const pBG = new IBackgroundControl(mPlug, &bg);
-	mControls.Insert(0, pBG);
+	AttachBackground(new IBackgroundControl(mPlug, &bg));
 }
 
 void IGraphics::HideControl(const int paramIdx, const bool hide)
@@ -304,6 +673,18 @@ void IGraphics::SetParameterFromPlug(const int paramIdx, double value, const boo
 	}
 }
 
+void IGraphics::UpdateParamControls()
+{
+	const int n = mControls.GetSize();
+	IControl* const* const ppControl = mControls.GetList();
+	for (int i = 0; i < n; ++i)
+	{
+		IControl* const pControl = ppControl[i];
+		const int paramIdx = pControl->ParamIdx();
+		if (paramIdx >= 0) pControl->SetValueFromPlug(mPlug->GetParam(paramIdx)->GetNormalized());
+	}
+}
+
 void IGraphics::SetControlFromPlug(const int controlIdx, const double normalizedValue)
 {
 	IControl* const pControl = mControls.Get(controlIdx);
@@ -340,16 +721,68 @@ void IGraphics::LoadBitmapResources(const BitmapResource* const pResources)
 {
 	for (int i = 0; pResources[i].mID; ++i)
 	{
-		LoadIBitmap(pResources[i].mID, pResources[i].Name());
+		const int ID = pResources[i].mID;
+
+		BitmapCacheEntry* const pEntry = s_bitmapCache.Acquire(ID);
+		if (mBitmapRefs.Find(pEntry) < 0)
+		{
+			mBitmapRefs.Add(pEntry);
+		}
+		else
+		{
+			s_bitmapCache.Release(pEntry);
+		}
+
+		if (!s_bitmapCache.Find(ID))
+		{
+			s_bitmapLoader.Add(this, ID, pResources[i].Name());
+			mBitmapsPending = true;
+		}
 	}
 }
 
+void IGraphics::EnableBitmapDiskCache(const bool enable)
+{
+	WDL_String baseDir;
+	if (enable && UserDataPath(&baseDir, mPlug->GetMfrName(), mPlug->GetEffectName()))
+	{
+		baseDir.Append(WDL_DIRCHAR_STR "BitmapCache");
+		IBitmapDiskCache::Open(&mBitmapCacheDir, baseDir.Get(), (unsigned int)mPlug->GetEffectVersion(false));
+	}
+	else
+	{
+		mBitmapCacheDir.Set("");
+	}
+}
+
+LICE_IBitmap* IGraphics::DecodeBitmap(const int ID, const char* const name)
+{
+	const char* const dir = mBitmapCacheDir.Get();
+	const WDL_UINT64 key = *dir ? OSHashBitmap(ID, name) : 0;
+
+	LICE_IBitmap* lb = key ? IBitmapDiskCache::Load(dir, key) : NULL;
+	if (!lb)
+	{
+		lb = OSLoadBitmap(ID, name);
+		if (lb && key) IBitmapDiskCache::Store(dir, key, lb);
+	}
+	return lb;
+}
+
+void IGraphics::CancelBitmapLoading()
+{
+	s_bitmapLoader.Cancel(this);
+}
+
+// Bitmaps loaded this way are never released.
 IBitmap IGraphics::LoadIBitmap(const int ID, const char* const name, const int nStates)
 {
+	s_bitmapCache.Acquire(ID);
+
 	LICE_IBitmap* lb = s_bitmapCache.Find(ID);
 	if (!lb)
 	{
-		lb = OSLoadBitmap(ID, name);
+		lb = DecodeBitmap(ID, name);
 
 		#ifndef NDEBUG
 		{
@@ -361,20 +794,204 @@ IBitmap IGraphics::LoadIBitmap(const int ID, const char* const name, const int n
 		}
 		#endif
 
-		s_bitmapCache.Add(lb, ID);
+		lb = s_bitmapCache.Add(lb, ID);
 	}
 	return IBitmap(lb, lb->getWidth(), lb->getHeight() / nStates, nStates);
 }
 
+// Area (box) filter for resampling srcSize pixels to destSize pixels, each
+// dest pixel is the average of the source pixels it covers, weighted by
+// how much of each it covers. Per dest pixel stores the first source
+// pixel, and nTaps 16.16 weights that add up to 65536. Returns nTaps, or 0
+// if out of memory.
+static int BuildAreaFilter(WDL_TypedBuf<int>* const pFilter, const int srcSize, const int destSize)
+{
+	// Only an integer ratio lines up with the source pixels.
+	int nTaps = srcSize % destSize ? srcSize / destSize + 2 : srcSize / destSize;
+	nTaps = wdl_min(nTaps, srcSize);
+
+	const int stride = nTaps + 1;
+	int* p = pFilter->Resize(destSize * stride, false);
+	if (pFilter->GetSize() != destSize * stride) return 0;
+
+	// In units of 1/destSize source pixels, dest pixel d covers [d*srcSize,
+	// (d+1)*srcSize), and source pixel s covers [s*destSize, (s+1)*destSize).
+	for (int d = 0; d < destSize; ++d, p += stride)
+	{
+		const WDL_INT64 lo = (WDL_INT64)d * srcSize, hi = lo + srcSize;
+		const int first = wdl_min((int)(lo / destSize), srcSize - nTaps);
+		p[0] = first;
+
+		int sum = 0, maxTap = 1;
+		for (int i = 0; i < nTaps; ++i)
+		{
+			const WDL_INT64 sLo = (WDL_INT64)(first + i) * destSize;
+			const WDL_INT64 overlap = wdl_min(hi, sLo + destSize) - wdl_max(lo, sLo);
+			const int w = overlap > 0 ? (int)(overlap * 65536 / srcSize) : 0;
+
+			p[1 + i] = w;
+			sum += w;
+			if (w > p[maxTap]) maxTap = 1 + i;
+		}
+
+		// Rounding leftovers go to the largest weight.
+		p[maxTap] += 65536 - sum;
+	}
+
+	return nTaps;
+}
+
+static inline LICE_pixel* BitmapRow(LICE_IBitmap* const pBitmap, const int y)
+{
+	const int row = pBitmap->isFlipped() ? pBitmap->getHeight() - 1 - y : y;
+	return pBitmap->getBits() + row * pBitmap->getRowSpan();
+}
+
+// Resamples dest columns [x1, x2) and rows [y1, y2) from pSrc, using the
+// area filters from BuildAreaFilter(). pAcc holds (x2 - x1) * 4 values.
+static void AreaResample(LICE_IBitmap* const pDest, LICE_IBitmap* const pSrc, const int x1, const int y1, const int x2, const int y2,
+	const int* const pFilterX, const int nTapsX, const int* const pFilterY, const int nTapsY, unsigned int* const pAcc)
+{
+	const int w = x2 - x1;
+
+	for (int y = y1; y < y2; ++y)
+	{
+		const int* const pFy = &pFilterY[y * (nTapsY + 1)];
+		memset(pAcc, 0, w * 4 * sizeof(unsigned int));
+
+		for (int j = 0; j < nTapsY; ++j)
+		{
+			const unsigned int wy = pFy[1 + j];
+			if (!wy) continue;
+
+			const LICE_pixel* const pRow = BitmapRow(pSrc, pFy[0] + j);
+			unsigned int* pA = pAcc;
+
+			for (int x = x1; x < x2; ++x, pA += 4)
+			{
+				const int* const pFx = &pFilterX[x * (nTapsX + 1)];
+				const LICE_pixel* const pIn = &pRow[pFx[0]];
+
+				// <= 255 * 65536
+				unsigned int r = 0, g = 0, b = 0, a = 0;
+				for (int i = 0; i < nTapsX; ++i)
+				{
+					const unsigned int wx = pFx[1 + i];
+					const LICE_pixel px = pIn[i];
+
+					r += LICE_GETR(px) * wx;
+					g += LICE_GETG(px) * wx;
+					b += LICE_GETB(px) * wx;
+					a += LICE_GETA(px) * wx;
+				}
+
+				// <= 255 * 256 * 65536 in total, so fits 32 bits.
+				pA[0] += (r >> 8) * wy;
+				pA[1] += (g >> 8) * wy;
+				pA[2] += (b >> 8) * wy;
+				pA[3] += (a >> 8) * wy;
+			}
+		}
+
+		LICE_pixel* const pOut = BitmapRow(pDest, y) + x1;
+		const unsigned int* pA = pAcc;
+		for (int x = 0; x < w; ++x, pA += 4)
+		{
+			static const unsigned int round = 1 << 23;
+			pOut[x] = LICE_RGBA((pA[0] + round) >> 24, (pA[1] + round) >> 24, (pA[2] + round) >> 24, (pA[3] + round) >> 24);
+		}
+	}
+}
+
+// Resamples each of the nStates frames of pSrc by scaleMul (see
+// IGraphics::kScaleUnit). Scaling down averages the pixels that each dest
+// pixel covers, scaling up is bilinear.
+static LICE_IBitmap* ResampleBitmap(LICE_IBitmap* const pSrc, const int nStates, const int scaleMul)
+{
+	const int w = pSrc->getWidth(), h = pSrc->getHeight() / nStates;
+	if (w <= 0 || h <= 0) return NULL;
+
+	// Rounded down, so a bitmap doesn't draw outside of its control.
+	const int destW = wdl_max(IGraphics::ToPixels(w, scaleMul), 1);
+	const int destH = wdl_max(IGraphics::ToPixels(h, scaleMul), 1);
+
+	LICE_MemBitmap* const pDest = new LICE_MemBitmap(destW, destH * nStates);
+	if (pDest->getWidth() != destW || pDest->getHeight() != destH * nStates || !pDest->getBits())
+	{
+		delete pDest;
+		return NULL;
+	}
+
+	const bool down = scaleMul < IGraphics::kScaleUnit;
+	WDL_TypedBuf<int> filterX, filterY;
+	WDL_TypedBuf<unsigned int> acc;
+	int nTapsX = 0, nTapsY = 0;
+	if (down)
+	{
+		nTapsX = BuildAreaFilter(&filterX, w, destW);
+		nTapsY = BuildAreaFilter(&filterY, h, destH);
+		acc.Resize(destW * 4, false);
+		if (!nTapsX || !nTapsY || acc.GetSize() != destW * 4)
+		{
+			delete pDest;
+			return NULL;
+		}
+	}
+
+	for (int i = 0; i < nStates; ++i)
+	{
+		LICE_SubBitmap src(pSrc, 0, i * h, w, h);
+		LICE_SubBitmap dest(pDest, 0, i * destH, destW, destH);
+
+		if (down)
+		{
+			AreaResample(&dest, &src, 0, 0, destW, destH, filterX.Get(), nTapsX, filterY.Get(), nTapsY, acc.Get());
+		}
+		else
+		{
+			LICE_ScaledBlit(&dest, &src, 0, 0, destW, destH, 0.0f, 0.0f, (float)w, (float)h,
+				1.0f, LICE_BLIT_MODE_COPY | LICE_BLIT_FILTER_BILINEAR);
+		}
+	}
+
+	return pDest;
+}
+
+// Resampled once per scale, and shared by all instances drawing at that
+// scale. Falls back to pSrc if out of memory.
+LICE_IBitmap* IGraphics::ScaledBitmap(const int ID, LICE_IBitmap* const pSrc, const int nStates, const int scaleMul)
+{
+	BitmapCacheEntry* const pEntry = s_bitmapCache.Acquire(ID, scaleMul);
+	if (mScaledBitmapRefs.Find(pEntry) < 0)
+	{
+		mScaledBitmapRefs.Add(pEntry);
+	}
+	else
+	{
+		s_bitmapCache.Release(pEntry);
+	}
+
+	LICE_IBitmap* lb = s_bitmapCache.Find(ID, scaleMul);
+	if (!lb)
+	{
+		lb = ResampleBitmap(pSrc, nStates, scaleMul);
+		if (lb) lb = s_bitmapCache.Add(lb, ID, scaleMul);
+	}
+	return lb ? lb : pSrc;
+}
+
 bool IGraphics::UpdateIBitmap(IBitmap* const pBitmap)
 {
 	LICE_IBitmap* const empty = (LICE_IBitmap*)&BitmapStorage::kEmptyBitmap;
-	LICE_IBitmap* lb = (LICE_IBitmap*)pBitmap->mData;
 
+	// Always look it up, the previous bitmap may have been released.
 	const int ID = pBitmap->ID() | Scale();
-	if (pBitmap->mID == ID && lb) return lb != empty;
+	LICE_IBitmap* lb = s_bitmapCache.Find(ID);
 
-	lb = s_bitmapCache.Find(ID);
+	// Draw scale relative to the set, so e.g. the half scale set drawn at
+	// half scale is used as is.
+	const int scaleMul = ScaleMul() << Scale();
+	if (lb && scaleMul != kScaleUnit) lb = ScaledBitmap(ID, lb, pBitmap->N, scaleMul);
 	if (!lb) lb = empty;
 
 	pBitmap->mData = lb;
@@ -389,35 +1006,113 @@ void IGraphics::Rescale(const int scale)
 {
 	assert(scale == kScaleFull || scale == kScaleHalf);
 
-	const int w = mWidth >> scale;
-	const int h = mHeight >> scale;
 	mScale = scale;
+	const int w = ToPixels(mWidth);
+	const int h = ToPixels(mHeight);
 
 	mBackBuf.resize(w, h);
+	mStaticLayerValid = false;
 }
 
-bool IGraphics::PrepDraw(const int wantScale)
+bool IGraphics::PrepDraw(const int wantScale, const int scaleMul)
 {
-	if (wantScale != mScale && mPlug->OnGUIRescale(wantScale))
+	if (wantScale != mScale || scaleMul != mScaleMul)
 	{
-		const int n = mControls.GetSize();
-		IControl* const* const ppControl = mControls.GetList();
-		for (int i = 0; i < n; ++i)
+		// Hold on to the previous bitmaps and fonts until the controls have
+		// moved on to the new ones. Only the draw scale changing keeps the
+		// scale set, but not the resampled bitmaps.
+		const bool newSet = wantScale != mScale;
+		const int oldScaleMul = mScaleMul;
+
+		WDL_PtrList<BitmapCacheEntry> oldBitmaps, oldScaled;
+		WDL_PtrList<FontCacheEntry> oldFonts;
+		if (newSet) MoveCacheRefs(&oldBitmaps, &mBitmapRefs);
+		MoveCacheRefs(&oldScaled, &mScaledBitmapRefs);
+		MoveCacheRefs(&oldFonts, &mFontRefs);
+
+		mScaleMul = scaleMul;
+		if (!newSet) Rescale(mScale);
+
+		if (!newSet || mPlug->OnGUIRescale(wantScale))
 		{
-			IControl* const pControl = ppControl[i];
-			pControl->Rescale(this);
+			RescaleControls();
+			MoveCacheRefs(&oldBitmaps, &oldScaled);
+			ReleaseCacheRefs(&oldBitmaps, &oldFonts);
+		}
+		else
+		{
+			mScaleMul = oldScaleMul;
+			MoveCacheRefs(&mBitmapRefs, &oldBitmaps);
+			MoveCacheRefs(&mScaledBitmapRefs, &oldScaled);
+			MoveCacheRefs(&mFontRefs, &oldFonts);
 		}
 	}
 	return !!mBackBuf.getBits();
 }
 
+template <class T> void IGraphics::MoveCacheRefs(WDL_PtrList<T>* const pDest, WDL_PtrList<T>* const pSrc)
+{
+	const int n = pSrc->GetSize();
+	for (int i = 0; i < n; ++i) pDest->Add(pSrc->Get(i));
+	pSrc->Empty();
+}
+
+void IGraphics::ReleaseCacheRefs(WDL_PtrList<BitmapCacheEntry>* const pBitmaps, WDL_PtrList<FontCacheEntry>* const pFonts)
+{
+	for (int i = pBitmaps->GetSize() - 1; i >= 0; --i) s_bitmapCache.Release(pBitmaps->Get(i));
+	pBitmaps->Empty();
+
+	for (int i = pFonts->GetSize() - 1; i >= 0; --i) s_fontCache.Release(pFonts->Get(i));
+	pFonts->Empty();
+}
+
+void IGraphics::ReleaseCachedResources()
+{
+	CancelBitmapLoading();
+	mBitmapsPending = false;
+
+	MoveCacheRefs(&mBitmapRefs, &mScaledBitmapRefs);
+	ReleaseCacheRefs(&mBitmapRefs, &mFontRefs);
+
+	const int n = mControls.GetSize();
+	IControl* const* const ppControl = mControls.GetList();
+	for (int i = 0; i < n; ++i) ppControl[i]->ReleaseCachedResources();
+
+	// Reload on the next PrepDraw().
+	mScale = -1;
+	mScaleMul = 0;
+	mStaticLayerValid = false;
+}
+
+void IGraphics::RescaleControls()
+{
+	const int n = mControls.GetSize();
+	IControl* const* const ppControl = mControls.GetList();
+	for (int i = 0; i < n; ++i)
+	{
+		IControl* const pControl = ppControl[i];
+		pControl->Rescale(this);
+	}
+}
+
+#ifndef NDEBUG
+void IGraphics::GetMemoryFootprint(int* const pInstanceBytes, int* const pSharedBytes)
+{
+	int bytes = sizeof(IGraphics) + mBackBuf.getRowSpan() * mBackBuf.getHeight() * (int)sizeof(LICE_pixel);
+	bytes += mStaticLayer.getRowSpan() * mStaticLayer.getHeight() * (int)sizeof(LICE_pixel);
+	bytes += mControls.GetSize() * (int)(sizeof(IControl*) + sizeof(IControl));
+
+	*pInstanceBytes = bytes;
+	*pSharedBytes = s_bitmapCache.Bytes();
+}
+#endif
+
 void IGraphics::DrawBitmap(const IBitmap* const pIBitmap, const IRECT* const pDest, int srcX, int srcY, const float weight)
 {
 	LICE_IBitmap* const pLB = (LICE_IBitmap*)pIBitmap->mData;
-	IRECT r = *pDest;
-
-	const int scale = Scale();
-	if (scale) { r.Downscale(scale); srcX >>= scale; srcY >>= scale; }
+	const IRECT r = ToPixels(pDest);
+	srcX = ToPixels(srcX);
+	srcY = ToPixels(srcY);
 
 	LICE_Blit(mDrawBitmap, pLB, r.L, r.T, srcX, srcY, r.W(), r.H(), weight, IChannelBlend::kBlendNone);
 }
@@ -436,15 +1131,13 @@ void IGraphics::DrawRotatedBitmap(const IBitmap* const pIBitmap, const int destC
 	const int W = (int)(h * sinA + w * cosA);
 	const int H = (int)(h * cosA + w * sinA); */
 
-	const int scale = Scale();
-
 	const int W = pIBitmap->W;
 	const int H = pIBitmap->H;
-	const int destX = (destCtrX >> scale) - W / 2;
-	const int destY = (destCtrY >> scale) - H / 2;
+	const int destX = ToPixels(destCtrX) - W / 2;
+	const int destY = ToPixels(destCtrY) - H / 2;
 
 	LICE_RotatedBlit(mDrawBitmap, pLB, destX, destY, W, H, 0.0f, 0.0f, (float)W, (float)H, (float)angle,
-		false, weight, IChannelBlend::kBlendNone | LICE_BLIT_FILTER_BILINEAR, 0.0f, (float)(yOffsetZeroDeg >> scale));
+		false, weight, IChannelBlend::kBlendNone | LICE_BLIT_FILTER_BILINEAR, 0.0f, (float)ToPixels(yOffsetZeroDeg));
 }
 
 /* void IGraphics::DrawRotatedMask(const IBitmap* const pIBase, const IBitmap* const pIMask, const IBitmap* const pITop,
@@ -468,17 +1161,14 @@ void IGraphics::DrawRotatedBitmap(const IBitmap* const pIBitmap, const int destC
 	LICE_RotatedBlit(mTmpBitmap, pTop, 0, 0, W, H, 0.0f, 0.0f, (float)W, (float)H, (float)dA,
 		true, 1.0f, LICE_BLIT_MODE_COPY | LICE_BLIT_FILTER_BILINEAR | LICE_BLIT_USE_ALPHA, xOffs, 0.0f);
 
-	const int scale = Scale();
-	LICE_Blit(mDrawBitmap, mTmpBitmap, x >> scale, y >> scale, 0, 0, W, H, weight, IChannelBlend::kBlendNone);
+	LICE_Blit(mDrawBitmap, mTmpBitmap, ToPixels(x), ToPixels(y), 0, 0, W, H, weight, IChannelBlend::kBlendNone);
 } */
 
 void IGraphics::DrawPoint(const IColor color, float x, float y, const float weight)
 {
-	const int scale = Scale();
-	if (scale)
+	if (ScaleMul() != kScaleUnit)
 	{
-		// const float mul = 1.0f / (float)(1 << scale);
-		assert(scale == 1); static const float mul = 0.5f;
+		const float mul = ScaleFactor();
 		x *= mul; y *= mul;
 	}
 	LICE_PutPixel(mDrawBitmap, (int)(x + 0.5f), (int)(y + 0.5f), color.Get(), weight, IChannelBlend::kBlendNone);
@@ -486,28 +1176,24 @@ void IGraphics::DrawPoint(const IColor color, float x, float y, const float weig
 
 void IGraphics::ForcePixel(const IColor color, const int x, const int y)
 {
-	const int scale = Scale();
 	LICE_pixel* px = mDrawBitmap->getBits();
-	px += (x >> scale) + (y >> scale) * mDrawBitmap->getRowSpan();
+	px += ToPixels(x) + ToPixels(y) * mDrawBitmap->getRowSpan();
 	*px = color.Get();
 }
 
 void IGraphics::DrawLine(const IColor color, const int x1, const int y1, const int x2, const int y2,
 	const float weight, const bool antiAlias)
 {
-	const int scale = Scale();
-	LICE_Line(mDrawBitmap, x1 >> scale, y1 >> scale, x2 >> scale, y2 >> scale, color.Get(), weight,
+	LICE_Line(mDrawBitmap, ToPixels(x1), ToPixels(y1), ToPixels(x2), ToPixels(y2), color.Get(), weight,
 		IChannelBlend::kBlendNone, antiAlias);
 }
 
 void IGraphics::DrawArc(const IColor color, float cx, float cy, float r, const float minAngle, const float maxAngle,
 	const float weight, const bool antiAlias)
 {
-	const int scale = Scale();
-	if (scale)
+	if (ScaleMul() != kScaleUnit)
 	{
-		// const float mul = 1.0f / (float)(1 << scale);
-		assert(scale == 1); static const float mul = 0.5f;
+		const float mul = ScaleFactor();
 		cx *= mul; cy *= mul; r *= mul;
 	}
 	LICE_Arc(mDrawBitmap, cx, cy, r, minAngle, maxAngle, color.Get(), weight, IChannelBlend::kBlendNone, antiAlias);
@@ -515,11 +1201,9 @@ void IGraphics::DrawArc(const IColor color, float cx, float cy, float r, const f
 
 void IGraphics::DrawCircle(const IColor color, float cx, float cy, float r, const float weight, const bool antiAlias)
 {
-	const int scale = Scale();
-	if (scale)
+	if (ScaleMul() != kScaleUnit)
 	{
-		// const float mul = 1.0f / (float)(1 << scale);
-		assert(scale == 1); static const float mul = 0.5f;
+		const float mul = ScaleFactor();
 		cx *= mul; cy *= mul; r *= mul;
 	}
 	LICE_Circle(mDrawBitmap, cx, cy, r, color.Get(), weight, IChannelBlend::kBlendNone, antiAlias);
@@ -528,9 +1212,8 @@ void IGraphics::DrawCircle(const IColor color, float cx, float cy, float r, cons
 void IGraphics::RoundRect(const IColor color, const IRECT* const pR, const float weight, int cornerradius,
 	const bool aa)
 {
-	IRECT r = *pR;
-	const int scale = Scale();
-	if (scale) { r.Downscale(scale); cornerradius >>= scale; }
+	const IRECT r = ToPixels(pR);
+	cornerradius = ToPixels(cornerradius);
 
 	LICE_RoundRect(mDrawBitmap, (float)r.L, (float)r.T, (float)r.W(), (float)r.H(), cornerradius,
 		color.Get(), weight, IChannelBlend::kBlendNone, aa);
@@ -541,9 +1224,8 @@ void IGraphics::FillRoundRect(const IColor color, const IRECT* const pR, const f
 {
 	// assert(!(color.A < 255 || weight < 1.0f));
 
-	IRECT r = *pR;
-	const int scale = Scale();
-	if (scale) { r.Downscale(scale); cornerradius >>= scale; }
+	const IRECT r = ToPixels(pR);
+	cornerradius = ToPixels(cornerradius);
 
 	const int x1 = r.L;
 	const int y1 = r.T;
@@ -565,20 +1247,16 @@ void IGraphics::FillRoundRect(const IColor color, const IRECT* const pR, const f
 
 void IGraphics::FillIRect(const IColor color, const IRECT* const pR, const float weight)
 {
-	IRECT r = *pR;
-	const int scale = Scale();
-	if (scale) r.Downscale(scale);
+	const IRECT r = ToPixels(pR);
 
 	LICE_FillRect(mDrawBitmap, r.L, r.T, r.W(), r.H(), color.Get(), weight, IChannelBlend::kBlendNone);
 }
 
 void IGraphics::FillCircle(const IColor color, float cx, float cy, float r, const float weight, const bool antiAlias)
 {
-	const int scale = Scale();
-	if (scale)
+	if (ScaleMul() != kScaleUnit)
 	{
-		// const float mul = 1.0f / (float)(1 << scale);
-		assert(scale == 1); static const float mul = 0.5f;
+		const float mul = ScaleFactor();
 		cx *= mul; cy *= mul; r *= mul;
 	}
 	LICE_FillCircle(mDrawBitmap, cx, cy, r, color.Get(), weight, IChannelBlend::kBlendNone, antiAlias);
@@ -586,18 +1264,16 @@ void IGraphics::FillCircle(const IColor color, float cx, float cy, float r, cons
 
 int IGraphics::DrawIText(IText* const pTxt, const char* const str, const IRECT* const pR, const int clip)
 {
-	const int scale = Scale();
-
 	LICE_IFont* font = pTxt->mCached;
-	if (!font)
+	if (!font || pTxt->mCachedGen != s_fontCache.m_generation)
 	{
-		font = CacheFont(pTxt, scale);
+		font = CacheFont(pTxt, ScaleMul(), this);
 		if (!font) return 0;
 	}
 
 	if (!str || !*str)
 	{
-		const int lh = font->GetLineHeight() << scale;
+		const int lh = FromPixelsCeil(font->GetLineHeight());
 		return lh;
 	}
 
@@ -610,15 +1286,8 @@ int IGraphics::DrawIText(IText* const pTxt, const char* const str, const IRECT*
 	UINT fmt = align[pTxt->mAlign] | clip;
 	if (LICE_GETA(color) < 255) fmt |= LICE_DT_USEFGALPHA;
 
-	RECT R = { pR->L, pR->T, pR->R, pR->B };
-
-	if (scale)
-	{
-		R.left >>= scale;
-		R.top >>= scale;
-		R.right >>= scale;
-		R.bottom >>= scale;
-	}
+	const IRECT r = ToPixels(pR);
+	RECT R = { r.L, r.T, r.R, r.B };
 
 	// TN: Quick patch to fix vertical offset.
 	#ifdef __APPLE__
@@ -626,25 +1295,23 @@ int IGraphics::DrawIText(IText* const pTxt, const char* const str, const IRECT*
 	R.top = wdl_max(R.top, 0);
 	#endif
 
-	const int h = font->DrawText(mDrawBitmap, str, -1, &R, fmt) << scale;
+	const int h = FromPixelsCeil(font->DrawText(mDrawBitmap, str, -1, &R, fmt));
 
 	return h;
 }
 
 int IGraphics::MeasureIText(IText* const pTxt, const char* const str, IRECT* const pR)
 {
-	const int scale = Scale();
-
 	LICE_IFont* font = pTxt->mCached;
-	if (!font)
+	if (!font || pTxt->mCachedGen != s_fontCache.m_generation)
 	{
-		font = CacheFont(pTxt, scale);
+		font = CacheFont(pTxt, ScaleMul(), this);
 		if (!font) return 0;
 	}
 
 	if (!str || !*str)
 	{
-		const int lh = font->GetLineHeight() << scale;
+		const int lh = FromPixelsCeil(font->GetLineHeight());
 		pR->R = pR->L;
 		pR->B = pR->T + lh;
 		return lh;
@@ -654,16 +1321,12 @@ int IGraphics::MeasureIText(IText* const pTxt, const char* const str, IRECT* con
 	// if (LICE_GETA(color) < 255) fmt |= LICE_DT_USEFGALPHA;
 
 	RECT R = { 0 };
-	int h = font->DrawText(mDrawBitmap, str, -1, &R, fmt);
+	const int h = FromPixelsCeil(font->DrawText(mDrawBitmap, str, -1, &R, fmt));
 
-	if (scale)
-	{
-		h <<= scale;
-		R.left <<= scale;
-		R.top <<= scale;
-		R.right <<= scale;
-		R.bottom <<= scale;
-	}
+	R.left = FromPixels((int)R.left);
+	R.top = FromPixels((int)R.top);
+	R.right = FromPixelsCeil((int)R.right);
+	R.bottom = FromPixelsCeil((int)R.bottom);
 
 	pR->L += R.left;
 	pR->T += R.top;
@@ -686,13 +1349,23 @@ bool IGraphics::LoadFont(const int ID, const char* const name)
 	return ret;
 }
 
-LICE_CachedFont* IGraphics::CacheFont(IText* const pTxt, const int scale)
+LICE_CachedFont* IGraphics::CacheFont(IText* const pTxt, const int scaleMul, IGraphics* const pOwner)
 {
-	LICE_CachedFont* font = (LICE_CachedFont*)s_fontCache.Find(pTxt, scale);
+	// Without an owner the reference is never released.
+	FontCacheEntry* const pEntry = s_fontCache.Acquire(pTxt, scaleMul);
+	if (pOwner)
+	{
+		if (pOwner->mFontRefs.Find(pEntry) >= 0)
+			s_fontCache.Release(pEntry);
+		else
+			pOwner->mFontRefs.Add(pEntry);
+	}
+
+	LICE_CachedFont* font = (LICE_CachedFont*)pEntry->mFont;
 	if (!font)
 	{
 		font = new LICE_CachedFont;
-		int h = pTxt->mSize >> scale;
+		int h = ToPixels(pTxt->mSize, scaleMul);
 		const int esc = 10 * pTxt->mOrientation;
 		const int wt = pTxt->mStyle & IText::kStyleBold ? FW_BOLD : FW_NORMAL;
 		const int it = pTxt->mStyle & IText::kStyleItalic ? TRUE : FALSE;
@@ -734,36 +1407,29 @@ LICE_CachedFont* IGraphics::CacheFont(IText* const pTxt, const int scale)
 			resized = true;
 		}
 		#endif
-		LICE_CachedFont* const cached = (LICE_CachedFont*)s_fontCache.Add(font, pTxt, scale);
-		if (cached != font)
-		{
-			delete font;
-			font = cached;
-		}
+		font = (LICE_CachedFont*)s_fontCache.SetFont(pEntry, font);
 	}
 	pTxt->mCached = font;
+	pTxt->mCachedGen = s_fontCache.m_generation;
 	return font;
 }
 
 IColor IGraphics::GetPoint(const int x, const int y)
 {
-	const int scale = Scale();
-	const LICE_pixel pix = LICE_GetPixel(mDrawBitmap, x >> scale, y >> scale);
+	const LICE_pixel pix = LICE_GetPixel(mDrawBitmap, ToPixels(x), ToPixels(y));
 	return IColor(LICE_GETA(pix), LICE_GETR(pix), LICE_GETG(pix), LICE_GETB(pix));
 }
 
 void IGraphics::DrawVerticalLine(const IColor color, int xi, int yLo, int yHi)
 {
-	const int scale = Scale();
-	if (scale) { xi >>= scale; yLo >>= scale; yHi >>= scale; }
+	xi = ToPixels(xi); yLo = ToPixels(yLo); yHi = ToPixels(yHi);
 
 	LICE_Line(mDrawBitmap, xi, yLo, xi, yHi, color.Get(), 1.0f, LICE_BLIT_MODE_COPY, false);
 }
 
 void IGraphics::DrawHorizontalLine(const IColor color, int yi, int xLo, int xHi)
 {
-	const int scale = Scale();
-	if (scale) { yi >>= scale; xLo >>= scale; xHi >>= scale; }
+	yi = ToPixels(yi); xLo = ToPixels(xLo); xHi = ToPixels(xHi);
 
 	LICE_Line(mDrawBitmap, xLo, yi, xHi, yi, color.Get(), 1.0f, LICE_BLIT_MODE_COPY, false);
 }
@@ -773,9 +1439,7 @@ void IGraphics::DrawBitmap(const IBitmap* const pBitmap, const IRECT* const pR,
 	LICE_IBitmap* const pLB = (LICE_IBitmap*)pBitmap->mData;
 	const int srcY = pBitmap->N > 1 && bmpState > 1 ? (bmpState - 1) * pBitmap->H : 0;
 
-	IRECT r = *pR;
-	const int scale = Scale();
-	if (scale) r.Downscale(scale);
+	const IRECT r = ToPixels(pR);
 
 	LICE_Blit(mDrawBitmap, pLB, r.L, r.T, 0, srcY, r.W(), r.H(), weight, IChannelBlend::kBlendNone);
 }
@@ -818,37 +1482,109 @@ void IGraphics::DrawRadialLine(const IColor color, const float cx, const float c
 	DrawLine(color, xLo, yLo, xHi, yHi, weight, antiAlias);
 }
 
+static inline int DirtyArea(const IRECT* const pR)
+{
+	return pR->W() * pR->H();
+}
+
+void IGraphics::AddDirtyRect(IRECT r)
+{
+	// Snap to whole pixels, i.e. grow to all units that touch the pixels
+	// the rect covers (see ToPixelsInner()).
+	if (ScaleMul() != kScaleUnit)
+	{
+		r.L = FromPixels(ToPixels(r.L));
+		r.T = FromPixels(ToPixels(r.T));
+		r.R = FromPixelsCeil(ToPixelsCeil(r.R));
+		r.B = FromPixelsCeil(ToPixelsCeil(r.B));
+	}
+
+	if (r.Empty()) return;
+
+	// Merge with overlapping regions (so they stay disjoint), and with
+	// regions that are cheaper to redraw together.
+	for (int i = 0; i < mNDirtyRects;)
+	{
+		const IRECT* const pR = &mDirtyRects[i];
+		const IRECT u = r.Union(pR);
+		if (r.Intersects(pR) || DirtyArea(&u) <= DirtyArea(&r) + DirtyArea(pR) + kDirtyRectOverhead)
+		{
+			r = u;
+			mDirtyRects[i] = mDirtyRects[--mNDirtyRects];
+			i = 0; // Grown, so check again.
+		}
+		else
+		{
+			++i;
+		}
+	}
+
+	// Out of slots, so merge with whichever region grows the least.
+	if (mNDirtyRects == kMaxDirtyRects)
+	{
+		int best = 0, bestGrowth = 0;
+		for (int i = 0; i < mNDirtyRects; ++i)
+		{
+			const IRECT u = r.Union(&mDirtyRects[i]);
+			const int growth = DirtyArea(&u) - DirtyArea(&mDirtyRects[i]);
+			if (!i || growth < bestGrowth)
+			{
+				best = i;
+				bestGrowth = growth;
+			}
+		}
+
+		r = r.Union(&mDirtyRects[best]);
+		mDirtyRects[best] = mDirtyRects[--mNDirtyRects];
+		AddDirtyRect(r);
+		return;
+	}
+
+	mDirtyRects[mNDirtyRects++] = r;
+}
+
 bool IGraphics::IsDirty(IRECT* const pR)
 {
 	bool dirty = false;
-	const int n = mControls.GetSize();
-	IControl* const* const ppControl = mControls.GetList();
-	for (int i = 0; i < n; ++i)
+	mNDirtyRects = 0;
+
+	// Params changed on the audio thread, e.g. by the preset morph.
+	if (mPlug->TakeParamsChangedOnAudioThread()) UpdateParamControls();
+
+	// Swap the placeholders for the real bitmaps once they are decoded.
+	if (mBitmapsPending && !s_bitmapLoader.IsPending(this))
 	{
-		IControl* const pControl = ppControl[i];
-		if (pControl->IsDirty())
+		mBitmapsPending = false;
+		RescaleControls();
+		mStaticLayerValid = false;
+		SetAllControlsDirty();
+	}
+
+	// Only visit the controls marked by SetControlDirty().
+	const int nWords = mDirtyBits.GetSize();
+	int* const pWords = mDirtyBits.Get();
+	IControl* const* const ppControl = mDirtyControls.GetList();
+	for (int w = 0; w < nWords; ++w)
+	{
+		unsigned int bits = (unsigned int)AtomicTake(&pWords[w]);
+		for (int i = w * 32; bits; ++i, bits >>= 1)
 		{
-			pControl->SetClean();
-			*pR = pR->Union(pControl->GetRECT());
-			dirty = true;
+			if (!(bits & 1)) continue;
+
+			IControl* const pControl = ppControl[i];
+			if (pControl->IsDirty())
+			{
+				pControl->SetClean();
+				AddDirtyRect(*pControl->GetRECT());
+				dirty = true;
+				if (pControl->IsStatic()) mStaticLayerValid = false;
+			}
 		}
 	}
 
-	const int scale = Scale();
-	if (scale)
+	for (int i = 0; i < mNDirtyRects; ++i)
 	{
-		// const int mask = ~((1 << scale) - 1);
-		// pR->L &= mask;
-		// pR->T &= mask;
-		// pr->R = (((pr->R - 1) >> scale) + 1) << scale;
-		// pr->B = (((pr->B - 1) >> scale) + 1) << scale;
-
-		assert(scale == 1);
-		static const int mask = ~1;
-		pR->L &= mask;
-		pR->T &= mask;
-		pR->R += pR->R & 1;
-		pR->B += pR->B & 1;
+		*pR = pR->Union(&mDirtyRects[i]);
 	}
 
 	#ifdef IPLUG_USE_IDLE_CALLS
@@ -866,29 +1602,184 @@ bool IGraphics::IsDirty(IRECT* const pR)
 	return dirty;
 }
 
+void IGraphics::SetControlDirty(const int dirtyIdx)
+{
+	assert(dirtyIdx >= 0 && dirtyIdx < mDirtyControls.GetSize());
+	AtomicOr(&mDirtyBits.Get()[dirtyIdx >> 5], (int)(1u << (dirtyIdx & 31)));
+}
+
+// Called while attaching controls, so before the audio thread runs.
+void IGraphics::TrackDirty(IControl* const pControl)
+{
+	const int idx = mDirtyControls.GetSize();
+	mDirtyControls.Add(pControl);
+	if (!(idx & 31)) mDirtyBits.Add(0);
+
+	pControl->mDirtyIdx = idx;
+	if (pControl->IsDirty()) SetControlDirty(idx);
+}
+
+void IGraphics::UpdateRefreshRate(const bool busy)
+{
+	if (busy || mBitmapsPending)
+	{
+		mQuietTicks = 0;
+		mRefreshMs = 1000 / mFPS;
+	}
+	// Quiet for half a second, so gradually slow down.
+	else if (mQuietTicks >= mFPS / 2)
+	{
+		mRefreshMs = wdl_min(mRefreshMs * 2, 1000 / kIdleFPS);
+	}
+	else
+	{
+		mQuietTicks++;
+	}
+}
+
+void IGraphics::WakeRefresh()
+{
+	const int fast = 1000 / mFPS;
+	mQuietTicks = 0;
+	if (mRefreshMs != fast)
+	{
+		mRefreshMs = fast;
+		RescheduleRefresh();
+	}
+}
+
+int IGraphics::NStaticControls() const
+{
+	const int n = mControls.GetSize();
+	IControl* const* const ppControl = mControls.GetList();
+
+	int i = 0;
+	while (i < n && ppControl[i]->IsStatic()) ++i;
+	return i;
+}
+
+// Plain row copy, no blending.
+static void CopyPixels(LICE_IBitmap* const pDest, LICE_IBitmap* const pSrc, const int x1, const int y1, int x2, int y2)
+{
+	x2 = wdl_min(x2, wdl_min(pDest->getWidth(), pSrc->getWidth()));
+	y2 = wdl_min(y2, wdl_min(pDest->getHeight(), pSrc->getHeight()));
+
+	const int w = x2 - x1, h = y2 - y1;
+	if (w <= 0 || h <= 0) return;
+
+	int srcSpan = pSrc->getRowSpan();
+	const LICE_pixel* pSrcRow = pSrc->getBits() + x1;
+	pSrcRow += (pSrc->isFlipped() ? pSrc->getHeight() - 1 - y1 : y1) * srcSpan;
+	if (pSrc->isFlipped()) srcSpan = -srcSpan;
+
+	int destSpan = pDest->getRowSpan();
+	LICE_pixel* pDestRow = pDest->getBits() + x1;
+	pDestRow += (pDest->isFlipped() ? pDest->getHeight() - 1 - y1 : y1) * destSpan;
+	if (pDest->isFlipped()) destSpan = -destSpan;
+
+	for (int y = 0; y < h; ++y)
+	{
+		memcpy(pDestRow, pSrcRow, w * sizeof(LICE_pixel));
+		pSrcRow += srcSpan;
+		pDestRow += destSpan;
+	}
+}
+
+// Draws the static controls into the back buffer, and keeps a copy.
+bool IGraphics::BuildStaticLayer(const int nStatic)
+{
+	const IRECT full(0, 0, mWidth, mHeight);
+	mDirtyRECT = &full;
+
+	IControl* const* const ppControl = mControls.GetList();
+	for (int i = 0; i < nStatic; ++i)
+	{
+		IControl* const pControl = ppControl[i];
+		if (!pControl->IsHidden()) pControl->Draw(this);
+	}
+
+	mDirtyRECT = NULL;
+
+	const int w = ToPixels(mWidth);
+	const int h = ToPixels(mHeight);
+
+	mStaticLayer.resize(w, h);
+	if (mStaticLayer.getWidth() != w || mStaticLayer.getHeight() != h || !mStaticLayer.getBits()) return false;
+
+	CopyPixels(&mStaticLayer, mDrawBitmap, 0, 0, w, h);
+	mStaticLayerValid = true;
+	return true;
+}
+
+void IGraphics::RestoreStaticLayer(const IRECT* const pR)
+{
+	const IRECT r = ToPixelsInner(pR);
+	CopyPixels(mDrawBitmap, &mStaticLayer, wdl_max(r.L, 0), wdl_max(r.T, 0), r.R, r.B);
+}
+
 // The OS is announcing what needs to be redrawn,
 // which may be a larger area than what is strictly dirty.
-void IGraphics::Draw(const IRECT* const pR)
+void IGraphics::Draw(const IRECT* const pRects, const int nRects)
 {
-	mDirtyRECT = pR;
-
 	const int n = mControls.GetSize();
 	IControl* const* const ppControl = mControls.GetList();
-	for (int i = 0; i < n; ++i)
+
+	// Static controls at the bottom are restored from the composition
+	// layer, instead of being drawn. Not while showing placeholders.
+	const bool placeholders = mBitmapsPending;
+	int nStatic = placeholders ? 0 : NStaticControls();
+	const IRECT* pDrawRects = pRects;
+	int nDrawRects = nRects;
+
+	IRECT full;
+	if (nStatic && !mStaticLayerValid)
+	{
+		if (BuildStaticLayer(nStatic))
+		{
+			// Redraw everything on top, so the back buffer is consistent.
+			full = IRECT(0, 0, mWidth, mHeight);
+			pDrawRects = &full;
+			nDrawRects = 1;
+		}
+		else
+		{
+			nStatic = 0;
+		}
+	}
+
+	for (int r = 0; r < nDrawRects; ++r)
+	{
+		const IRECT* const pR = &pDrawRects[r];
+		if (nStatic) RestoreStaticLayer(pR);
+		else if (placeholders) FillIRect(kPlaceholderColor, pR);
+	}
+
+	// Draw each control once, over the regions it overlaps, so translucent
+	// controls that overlap several regions don't blend more than once.
+	for (int i = nStatic; i < n; ++i)
 	{
 		IControl* const pControl = ppControl[i];
-		if (!pControl->IsHidden() && pR->Intersects(pControl->GetRECT()))
+		if (pControl->IsHidden()) continue;
+
+		const IRECT* const pCR = pControl->GetRECT();
+		IRECT dirty;
+		for (int r = 0; r < nDrawRects; ++r)
 		{
-			pControl->Draw(this);
+			if (pDrawRects[r].Intersects(pCR)) dirty = dirty.Union(&pDrawRects[r]);
 		}
+
+		if (dirty.Empty()) continue;
+		mDirtyRECT = &dirty;
+		pControl->Draw(this);
 	}
 
 	mDirtyRECT = NULL;
-	DrawScreen(pR);
+	DrawScreen(pRects, nRects);
 }
 
 void IGraphics::OnMouseDown(const int x, const int y, const IMouseMod mod)
 {
+	WakeRefresh();
 	ReleaseMouseCapture();
 	const int c = GetMouseControlIdx(x, y);
 	if (c >= 0)
@@ -908,6 +1799,7 @@ void IGraphics::OnMouseDown(const int x, const int y, const IMouseMod mod)
 
 void IGraphics::OnMouseUp(const int x, const int y, const IMouseMod mod)
 {
+	WakeRefresh();
 	const int cap = mMouseCapture;
 	const int c = cap >= 0 ? cap : GetMouseControlIdx(x, y);
 	mMouseY = mMouseX = mMouseCapture = -1;
@@ -930,6 +1822,7 @@ void IGraphics::OnMouseUp(const int x, const int y, const IMouseMod mod)
 
 void IGraphics::OnMouseOver(const int x, const int y, const IMouseMod mod)
 {
+	WakeRefresh();
 	assert(mHandleMouseOver == true);
 
 	const int cap = mMouseCapture;
@@ -961,6 +1854,7 @@ void IGraphics::OnMouseOut()
 
 void IGraphics::OnMouseDrag(const int x, const int y, const IMouseMod mod)
 {
+	WakeRefresh();
 	const int c = mMouseCapture;
 	if (c >= 0)
 	{
@@ -977,6 +1871,7 @@ void IGraphics::OnMouseDrag(const int x, const int y, const IMouseMod mod)
 
 bool IGraphics::OnMouseDblClick(const int x, const int y, const IMouseMod mod)
 {
+	WakeRefresh();
 	ReleaseMouseCapture();
 	bool newCapture = false;
 	const int c = GetMouseControlIdx(x, y);
@@ -1011,6 +1906,7 @@ bool IGraphics::OnMouseDblClick(const int x, const int y, const IMouseMod mod)
 
 void IGraphics::OnMouseWheel(const int x, const int y, const IMouseMod mod, const float d)
 {
+	WakeRefresh();
 	const int cap = mMouseCapture;
 	const int c = cap >= 0 ? cap : GetMouseControlIdx(x, y);
 	if (c >= 0)
@@ -1031,6 +1927,7 @@ void IGraphics::OnMouseWheel(const int x, const int y, const IMouseMod mod, cons
 
 bool IGraphics::OnKeyDown(const int x, const int y, const IMouseMod mod, const int key)
 {
+	WakeRefresh();
 	const int c = mKeyboardFocus;
 	return c >= 0 ? mControls.Get(c)->OnKeyDown(x, y, mod, key) : false;
 }
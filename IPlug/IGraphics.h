@@ -16,6 +16,8 @@
 
 class IPlugBase;
 class IControl;
+struct BitmapCacheEntry;
+struct FontCacheEntry;
 class IParam;
 
 class IGraphics
@@ -23,6 +25,9 @@ class IGraphics
 public:
 	static const int kDefaultFPS = 24;
 
+	// Refresh rate when nothing has changed for a while.
+	static const int kIdleFPS = 4;
+
 	#ifdef IPLUG_USE_IDLE_CALLS
 	// If not dirty for this many timer ticks, we call OnGUIIDle.
 	static const int kIdleTicks = 20;
@@ -31,14 +36,45 @@ public:
 	static const int kMaxParamLen = 32;
 	static const int kMaxEditLen = 1024;
 
-	enum EGUIScale { kScaleFull = 0, kScaleHalf = 1 };
+	// Dirty regions are kept separate, unless the union is smaller than
+	// both plus this many pixels (roughly the cost of an extra redraw/blit).
+	static const int kMaxDirtyRects = 8;
+	static const int kDirtyRectOverhead = 64 * 64;
 
-	bool PrepDraw(int wantScale); // Recale the draw bitmap.
-	bool IsDirty(IRECT* pR); // Ask the plugin what needs to be redrawn.
-	void Draw(const IRECT* pR); // The system announces what needs to be redrawn. Ordering and drawing logic.
-	virtual void DrawScreen(const IRECT* pR) = 0; // Tells the OS class to put the final bitmap on the screen.
+	enum EGUIScale { kScaleFull = 0, kScaleHalf = 1 };
 
-	// So controls can draw only area that will actually be drawn to screen.
+	// Draw scale in 16.16 fixed point, i.e. draw bitmap pixels per full
+	// scale unit.
+	static const int kScaleUnit = 1 << 16;
+
+	// Recale the draw bitmap. Bitmaps come from the wantScale set, and are
+	// drawn at scaleMul (if 0 then kScaleUnit >> Scale()). Bitmaps of the
+	// set that don't match scaleMul are resampled once, and cached.
+	bool PrepDraw(int wantScale, int scaleMul = 0);
+	bool IsDirty(IRECT* pR); // Ask the plugin what needs to be redrawn, pR receives the union.
+	void Draw(const IRECT* pRects, int nRects); // The system announces what needs to be redrawn. Ordering and drawing logic.
+	inline void Draw(const IRECT* const pR) { Draw(pR, 1); }
+	virtual void DrawScreen(const IRECT* pRects, int nRects) = 0; // Tells the OS class to put the final bitmap on the screen.
+
+	// Adaptive refresh rate. The OS class calls this after each IsDirty(),
+	// and schedules the next timer tick after RefreshInterval() ms. This is
+	// 1000/FPS() while busy, and backs off to 1000/kIdleFPS once idle.
+	void UpdateRefreshRate(bool busy);
+	inline int RefreshInterval() const { return mRefreshMs; }
+
+	// Back to full rate, called on user input.
+	void WakeRefresh();
+
+	// Marks a control for the next IsDirty(). Lock-free, so it is safe to
+	// call from the audio thread (see IControl::SetDirty()).
+	void SetControlDirty(int dirtyIdx);
+
+	// Disjoint dirty regions found by the last IsDirty().
+	inline int NDirtyRects() const { return mNDirtyRects; }
+	inline const IRECT* GetDirtyRects() const { return mDirtyRects; }
+
+	// So controls can draw only area that will actually be drawn to screen
+	// (the bounds of the dirty regions that the control overlaps).
 	// Guaranteed to be valid in IControl::Draw().
 	inline const IRECT* GetDirtyRECT() const { return mDirtyRECT; }
 
@@ -61,8 +97,8 @@ public:
 	void FillCircle(IColor color, float cx, float cy, float r, float weight = 1.0f, bool antiAlias = false);
 
 	bool LoadFont(int ID, const char* name);
-	bool UpdateIText(IText* const pTxt) { return !!CacheFont(pTxt, Scale()); }
-	static void PrepDrawIText(IText* const pTxt, const int scale = 0) { CacheFont(pTxt, scale); }
+	bool UpdateIText(IText* const pTxt) { return !!CacheFont(pTxt, ScaleMul(), this); }
+	static void PrepDrawIText(IText* const pTxt, const int scale = 0) { CacheFont(pTxt, kScaleUnit >> scale); }
 	int DrawIText(IText* pTxt, const char* str, const IRECT* pR, int clip = DT_NOCLIP);
 	int MeasureIText(IText* pTxt, const char* str, IRECT* pR);
 
@@ -71,6 +107,10 @@ public:
 
 	// Methods for the OS implementation class.
 	// virtual void Resize(int w, int h);
+
+	// Resizes the open window (e.g. on request of the host), keeping the
+	// layout and scaling the GUI to fit. Returns false if not supported.
+	virtual bool SetWindowSize(int w, int h) { return false; }
 	virtual bool WindowIsOpen() const { return !!GetWindow(); }
 	enum EPromptFlags { kPromptCustomWidth = 1, kPromptCustomRect = 3, kPromptInline = 4, kPromptMouseClick = 8 };
 	virtual bool PromptUserInput(IControl* pControl, IParam* pParam, const IRECT* pR = NULL, int flags = 0, IText* pTxt = NULL, IColor bg = IColor(0), int delay = 0, int x = 0, int y = 0) = 0;
@@ -79,8 +119,13 @@ public:
 	virtual bool HostPath(WDL_String* pPath) = 0; // Full path to host executable.
 	virtual bool PluginPath(WDL_String* pPath) = 0; // Full path to plugin dll.
 
-	virtual bool UserDataPath(WDL_String* pPath) = 0; // Full path to user data dir.
-	bool UserDataPath(WDL_String* pPath, const char* mfrName, const char* plugName = NULL);
+	// Full path to user data dir (optionally with mfr and plug subdirs).
+	// Static, so it can also be used without a GUI (e.g. by
+	// IPresetLibrary::DefaultPath()).
+	static bool UserDataPath(WDL_String* pPath); // Implemented by the OS class.
+	static bool UserDataPath(WDL_String* pPath, const char* mfrName, const char* plugName = NULL);
+	// Preset library folder, see IPresetLibrary::DefaultPath().
+	bool PresetLibraryPath(WDL_String* pPath);
 
 	// Run the "open file" or "save file" dialog; extensions = "txt wav" for example.
 	enum EFileAction { kFileOpen = 0, kFileSave };
@@ -111,6 +156,38 @@ public:
 	inline int Scale() const { return mScale < 0 ? mDefaultScale : mScale; }
 	inline int FPS() const { return mFPS; }
 
+	inline int ScaleMul() const { return mScaleMul ? mScaleMul : kScaleUnit >> Scale(); }
+	inline float ScaleFactor() const { return (float)ScaleMul() * (1.0f / (float)kScaleUnit); }
+
+	// Full scale units to draw bitmap pixels, rounded down (or up). Same as
+	// x >> Scale() at integer scales.
+	static inline int ToPixels(const int x, const int scaleMul) { return (int)(((WDL_INT64)x * scaleMul) >> 16); }
+	inline int ToPixels(const int x) const { return ToPixels(x, ScaleMul()); }
+	inline int ToPixelsCeil(const int x) const { return (int)(((WDL_INT64)x * ScaleMul() + kScaleUnit - 1) >> 16); }
+
+	// Draw bitmap pixels to full scale units, rounded down (or up).
+	inline int FromPixels(const int x) const { return (int)((((WDL_INT64)x << 16) - (x < 0 ? ScaleMul() - 1 : 0)) / ScaleMul()); }
+	inline int FromPixelsCeil(const int x) const { return -FromPixels(-x); }
+
+	// Rect as drawn, i.e. each edge rounded down.
+	inline IRECT ToPixels(const IRECT* const pR) const
+	{
+		return IRECT(ToPixels(pR->L), ToPixels(pR->T), ToPixels(pR->R), ToPixels(pR->B));
+	}
+
+	// Pixels covered only by a rect that was snapped by AddDirtyRect(), or
+	// mapped by FromPixels(), which includes the pixels it came from.
+	inline IRECT ToPixelsInner(const IRECT* const pR) const
+	{
+		return IRECT(ToPixelsCeil(pR->L), ToPixelsCeil(pR->T), ToPixels(pR->R), ToPixels(pR->B));
+	}
+
+	// All units that touch these pixels.
+	inline IRECT FromPixels(const IRECT* const pR) const
+	{
+		return IRECT(FromPixels(pR->L), FromPixels(pR->T), FromPixelsCeil(pR->R), FromPixelsCeil(pR->B));
+	}
+
 	bool PreloadScale(const int scale) { return mScale < 0 ? PrepDraw(scale) : true; }
 
 	inline void SetDefaultScale(const int scale)
@@ -148,7 +225,16 @@ public:
 		#endif
 	};
 
+	// Bitmaps that aren't cached yet are decoded on a worker thread, and
+	// the controls are rescaled when they are all ready. Until then the
+	// GUI shows placeholders, see BitmapsPending().
 	void LoadBitmapResources(const BitmapResource* pResources);
+	inline bool BitmapsPending() const { return mBitmapsPending; }
+
+	// Keeps decoded bitmaps in <UserDataPath>/<mfr>/<plug>/BitmapCache, so
+	// later sessions don't need to decode the PNGs again. Only the cache of
+	// the current plug-in version is kept.
+	void EnableBitmapDiskCache(bool enable = true);
 
 	inline IPlugBase* GetPlug() { return mPlug; }
 
@@ -156,13 +242,19 @@ public:
 	bool UpdateIBitmap(IBitmap* pBitmap);
 
 	void AttachBackground(int ID, const char* name);
-	void AttachBackground(IControl* const pControl) { mControls.Insert(0, pControl); }
+	void AttachBackground(IControl* const pControl)
+	{
+		mControls.Insert(0, pControl);
+		TrackDirty(pControl);
+	}
 
 	// Returns the control index of this control (not the number of controls).
 	int AttachControl(IControl* const pControl)
 	{
 		const int idx = NControls();
-		return mControls.Add(pControl) ? idx : -1;
+		if (!mControls.Add(pControl)) return -1;
+		TrackDirty(pControl);
+		return idx;
 	}
 
 	int AttachControl(IControl* const pControl, const int ID)
@@ -194,6 +286,9 @@ public:
 	// Normalized means the value is in [0, 1].
 	void ClampControl(int paramIdx, double lo, double hi, bool normalized);
 	void SetParameterFromPlug(int paramIdx, double value, bool normalized);
+	// Sets all param controls to the current param values, only marking
+	// those that changed dirty.
+	void UpdateParamControls();
 	// For setting a control that does not have a parameter associated with it.
 	void SetControlFromPlug(int controlIdx, double normalizedValue);
 
@@ -288,6 +383,12 @@ public:
 	void OnGUIIdle();
 	#endif
 
+	#ifndef NDEBUG
+	// Per-instance bytes (back buffer, static layer, controls), and bytes
+	// in the bitmap cache that is shared by all instances.
+	void GetMemoryFootprint(int* pInstanceBytes, int* pSharedBytes);
+	#endif
+
 	// For controls that need to interface directly with LICE.
 	LICE_pixel* GetBits() { return mDrawBitmap->getBits(); }
 	inline LICE_SysBitmap* GetDrawBitmap() const { return mDrawBitmap; }
@@ -308,16 +409,69 @@ protected:
 	virtual LICE_IBitmap* OSLoadBitmap(int ID, const char* name) = 0;
 	virtual bool OSLoadFont(int ID, const char* name) = 0;
 
+	// Hash of the compressed bitmap resource, or 0 if not found.
+	virtual WDL_UINT64 OSHashBitmap(int ID, const char* name) = 0;
+
+	// OSLoadBitmap(), through the disk cache if enabled.
+	LICE_IBitmap* DecodeBitmap(int ID, const char* name);
+	WDL_String mBitmapCacheDir;
+
+	// The loader thread calls OSLoadBitmap(), so the OS class should call
+	// this before it is torn down.
+	friend class BitmapLoader;
+	void CancelBitmapLoading();
+	void RescaleControls();
+	bool mBitmapsPending;
+
+	// References into the shared bitmap/font caches for the current scale,
+	// and to the bitmaps resampled to the draw scale.
+	WDL_PtrList<BitmapCacheEntry> mBitmapRefs, mScaledBitmapRefs;
+	WDL_PtrList<FontCacheEntry> mFontRefs;
+	LICE_IBitmap* ScaledBitmap(int ID, LICE_IBitmap* pSrc, int nStates, int scaleMul);
+
+	template <class T> static void MoveCacheRefs(WDL_PtrList<T>* pDest, WDL_PtrList<T>* pSrc);
+	static void ReleaseCacheRefs(WDL_PtrList<BitmapCacheEntry>* pBitmaps, WDL_PtrList<FontCacheEntry>* pFonts);
+
+	// Lets go of all cached bitmaps and fonts, called by the OS class when
+	// its window closes.
+	void ReleaseCachedResources();
+
 	LICE_SysBitmap mBackBuf;
 	LICE_SysBitmap* mDrawBitmap;
 
-	static LICE_CachedFont* CacheFont(IText* pTxt, int scale = 0);
+	// Pre-composited static controls, see IControl::SetStatic().
+	LICE_MemBitmap mStaticLayer;
+	bool mStaticLayerValid;
+
+	int NStaticControls() const;
+	bool BuildStaticLayer(int nStatic);
+	void RestoreStaticLayer(const IRECT* pR);
+
+	// Called by WakeRefresh() if the timer was running slow, so the OS class
+	// can reschedule the next tick.
+	virtual void RescheduleRefresh() {}
+
+	// If pOwner is NULL, then the font stays cached until exit.
+	static LICE_CachedFont* CacheFont(IText* pTxt, int scaleMul = kScaleUnit, IGraphics* pOwner = NULL);
 
 private:
 	// LICE_MemBitmap* mTmpBitmap;
 
 	const IRECT* mDirtyRECT;
-	int mWidth, mHeight, mScale, mDefaultScale, mFPS;
+	IRECT mDirtyRects[kMaxDirtyRects];
+	int mNDirtyRects;
+
+	void AddDirtyRect(IRECT r);
+
+	// One bit per control, set by SetControlDirty(), and cleared by
+	// IsDirty(). Controls are indexed in order of attachment, so the index
+	// doesn't change when the background is inserted.
+	WDL_TypedBuf<int> mDirtyBits;
+	WDL_PtrList<IControl> mDirtyControls;
+	void TrackDirty(IControl* pControl);
+
+	int mWidth, mHeight, mScale, mDefaultScale, mScaleMul, mFPS;
+	int mRefreshMs, mQuietTicks;
 
 	int GetMouseControlIdx(int x, int y);
 	void EndInformHostOfParamChange(int controlIdx);
@@ -334,4 +488,5 @@ private:
 
 #ifndef NDEBUG
 void IPlugDebugLog(const char* str);
+size_t IPlugResidentMemory(); // Process working set size in bytes.
 #endif
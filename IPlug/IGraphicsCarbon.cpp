@@ -221,12 +221,18 @@ pascal void IGraphicsCarbon::CarbonTimerHandler(EventLoopTimerRef /* pTimer */,
 	{
 		if (_this->mIsComposited)
 		{
-			const int x = r.L >> kScaleFixed;
-			const int y = r.T >> kScaleFixed;
-			const int w = r.W() >> kScaleFixed;
-			const int h = r.H() >> kScaleFixed;
-			const HIRect hr = CGRectMake((CGFloat)x, (CGFloat)y, (CGFloat)w, (CGFloat)h);
-			HIViewSetNeedsDisplayInRect(_this->mView, &hr, true);
+			const int n = pGraphicsMac->NDirtyRects();
+			const IRECT* const pDirty = pGraphicsMac->GetDirtyRects();
+			for (int i = 0; i < n; ++i)
+			{
+				const IRECT* const pR = &pDirty[i];
+				const int x = pR->L >> kScaleFixed;
+				const int y = pR->T >> kScaleFixed;
+				const int w = pR->W() >> kScaleFixed;
+				const int h = pR->H() >> kScaleFixed;
+				const HIRect hr = CGRectMake((CGFloat)x, (CGFloat)y, (CGFloat)w, (CGFloat)h);
+				HIViewSetNeedsDisplayInRect(_this->mView, &hr, true);
+			}
 		}
 		else
 		{
@@ -47,6 +47,7 @@
 - (void) keyDown: (NSEvent*)pEvent;
 - (void) keyUp: (NSEvent*)pEvent;
 - (void) killTimer;
+- (void) scheduleTimer;
 - (void) removeFromSuperview;
 - (void) controlTextDidChange: (NSNotification*)aNotification;
 - (void) controlTextDidEndEditing: (NSNotification*)aNotification;
@@ -131,8 +131,22 @@ static IMouseMod GetRightMouseMod(const NSEvent* const pEvent, const bool right,
 {
 	if (mGraphics)
 	{
-		const IRECT r = ToIRECT(mGraphics, &rect);
-		mGraphics->Draw(&r);
+		const NSRect* pRects;
+		NSInteger n;
+		[self getRectsBeingDrawn: &pRects count: &n];
+
+		// Redraw only the invalidated rects, unless there are too many.
+		IRECT r[IGraphics::kMaxDirtyRects];
+		if (n > 0 && n <= IGraphics::kMaxDirtyRects)
+		{
+			for (int i = 0; i < (int)n; ++i) r[i] = ToIRECT(mGraphics, &pRects[i]);
+		}
+		else
+		{
+			r[0] = ToIRECT(mGraphics, &rect);
+			n = 1;
+		}
+		mGraphics->Draw(r, (int)n);
 	}
 }
 
@@ -156,9 +170,15 @@ static IMouseMod GetRightMouseMod(const NSEvent* const pEvent, const bool right,
 		}
 
 		IRECT r;
-		if (mGraphics->IsDirty(&r))
+		const bool dirty = mGraphics->IsDirty(&r);
+		if (dirty)
 		{
-			[self setNeedsDisplayInRect: ToNSRect(mGraphics, &r)];
+			const int n = mGraphics->NDirtyRects();
+			const IRECT* const pDirty = mGraphics->GetDirtyRects();
+			for (int i = 0; i < n; ++i)
+			{
+				[self setNeedsDisplayInRect: ToNSRect(mGraphics, &pDirty[i])];
+			}
 		}
 
 		int timer = mParamChangeTimer;
@@ -172,6 +192,10 @@ static IMouseMod GetRightMouseMod(const NSEvent* const pEvent, const bool right,
 		{
 			if (mParamEditView) [self commitUserInput];
 		}
+
+		// Slow down when idle, the timers above count ticks.
+		mGraphics->UpdateRefreshRate(dirty || mParamChangeTimer || mAutoCommitTimer);
+		if (mGraphics->RefreshInterval() > 1000 / mGraphics->FPS()) [self scheduleTimer];
 	}
 }
 
@@ -341,6 +365,13 @@ static IMouseMod GetRightMouseMod(const NSEvent* const pEvent, const bool right,
 	mTimer = nil;
 }
 
+// The timer repeats at full rate, so while idle push back the next tick.
+- (void) scheduleTimer
+{
+	const double sec = 0.001 * (double)mGraphics->RefreshInterval();
+	[mTimer setFireDate: [NSDate dateWithTimeIntervalSinceNow: sec]];
+}
+
 - (void) removeFromSuperview
 {
 	if (mParamEditView) [self endUserInput];
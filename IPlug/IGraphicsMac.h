@@ -20,7 +20,7 @@ public:
 
 	void SetBundleID(const char* const bundleID) { mBundleID.Set(bundleID); }
 
-	void DrawScreen(const IRECT* pR);
+	void DrawScreen(const IRECT* pRects, int nRects);
 
 	bool InitScale();
 	bool UpdateScale();
@@ -42,7 +42,6 @@ public:
 
 	bool HostPath(WDL_String* pPath);
 	bool PluginPath(WDL_String* pPath);
-	bool UserDataPath(WDL_String* pPath);
 
 	bool PromptForFile(WDL_String* pFilename, int action = kFileOpen, const char* dir = NULL, const char* extensions = NULL);
 	// bool PromptForColor(IColor* pColor, const char* prompt = NULL) { return false; }
@@ -63,7 +62,9 @@ public:
 
 protected:
 	LICE_IBitmap* OSLoadBitmap(int ID, const char* name);
+	WDL_UINT64 OSHashBitmap(int ID, const char* name);
 	bool OSLoadFont(int ID, const char* name);
+	void RescheduleRefresh();
 
 private:
 	#ifndef IPLUG_NO_CARBON_SUPPORT
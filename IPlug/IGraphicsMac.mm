@@ -6,9 +6,12 @@
 #endif
 
 #include "WDL/swell/swell.h"
+#include "WDL/fnv64.h"
 #include "WDL/wdltypes.h"
 
+#include <mach/mach.h>
 #include <pwd.h>
+#include <stdio.h>
 #include <string.h>
 #import <objc/runtime.h>
 
@@ -50,6 +53,7 @@ IGraphicsMac::IGraphicsMac(
 
 IGraphicsMac::~IGraphicsMac()
 {
+	CancelBitmapLoading();
 	CloseWindow();
 }
 
@@ -83,6 +87,22 @@ LICE_IBitmap* IGraphicsMac::OSLoadBitmap(int /* ID */, const char* const name)
 	return resourceFileName ? LICE_LoadPNG(resourceFileName) : NULL;
 }
 
+WDL_UINT64 IGraphicsMac::OSHashBitmap(int /* ID */, const char* const name)
+{
+	const CocoaAutoReleasePool pool;
+	const char* const resourceFileName = FindResourceOSX(GetBundleID(), name, "png");
+	FILE* const fp = resourceFileName ? fopen(resourceFileName, "rb") : NULL;
+	if (!fp) return 0;
+
+	WDL_UINT64 hash = WDL_FNV64_IV;
+	unsigned char buf[16384];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) hash = WDL_FNV64(hash, buf, (int)n);
+	fclose(fp);
+
+	return hash;
+}
+
 bool IGraphicsMac::OSLoadFont(int /* ID */, const char* const name)
 {
 	const CocoaAutoReleasePool pool;
@@ -90,7 +110,7 @@ bool IGraphicsMac::OSLoadFont(int /* ID */, const char* const name)
 	return resourceFileName ? !!AddFontResourceEx(resourceFileName, FR_PRIVATE, NULL) : NULL;
 }
 
-void IGraphicsMac::DrawScreen(const IRECT* /* pR */)
+void IGraphicsMac::DrawScreen(const IRECT* /* pRects */, int /* nRects */)
 {
 	CGContextRef pCGC = NULL;
 	CGRect r = CGRectMake(0.0f, 0.0f, (CGFloat)(Width() >> kScaleOS), (CGFloat)(Height() >> kScaleOS));
@@ -143,11 +163,10 @@ void IGraphicsMac::DrawScreen(const IRECT* /* pR */)
 
 bool IGraphicsMac::InitScale()
 {
-	if (mWantScale < 0)
-	{
-		if (!PreloadScale(kScaleOS)) return false;
-		mWantScale = mPrevScale = kScaleOS;
-	}
+	// Also reloads the cached bitmaps released by CloseWindow().
+	const int scale = mWantScale < 0 ? kScaleOS : mWantScale;
+	if (!PreloadScale(scale)) return false;
+	mWantScale = mPrevScale = scale;
 	return true;
 }
 
@@ -191,6 +210,8 @@ void* IGraphicsMac::OpenCarbonWindow(void* const pParentWnd, void* const pParent
 
 void IGraphicsMac::CloseWindow()
 {
+	const bool wasOpen = WindowIsOpen();
+
 	#ifndef IPLUG_NO_CARBON_SUPPORT
 	if (mGraphicsCarbon)
 	{
@@ -215,6 +236,13 @@ void IGraphicsMac::CloseWindow()
 			[graphicscocoa removeFromSuperview]; // Releases.
 		}
 	}
+
+	if (wasOpen) ReleaseCachedResources();
+}
+
+void IGraphicsMac::RescheduleRefresh()
+{
+	if (mGraphicsCocoa) [(IGRAPHICS_COCOA*)mGraphicsCocoa scheduleTimer];
 }
 
 bool IGraphicsMac::WindowIsOpen() const
@@ -311,7 +339,7 @@ bool IGraphicsMac::PluginPath(WDL_String* const pPath)
 	return false;
 }
 
-bool IGraphicsMac::UserDataPath(WDL_String* const pPath)
+bool IGraphics::UserDataPath(WDL_String* const pPath)
 {
 	struct passwd* const pw = getpwuid(getuid());
 	if (pw)
@@ -497,6 +525,13 @@ void IPlugDebugLog(const char* const str)
 {
 	NSLog(@"%s", str);
 }
+
+size_t IPlugResidentMemory()
+{
+	mach_task_basic_info_data_t info;
+	mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+	return task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) == KERN_SUCCESS ? (size_t)info.resident_size : 0;
+}
 #endif
 
 // TN: Fixes undefined symbols in Xcode debug build.
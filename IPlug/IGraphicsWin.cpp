@@ -3,12 +3,14 @@
 
 #include <commctrl.h>
 #include <objbase.h>
+#include <psapi.h>
 #include <shellapi.h>
 #include <shlobj.h>
 #include <windowsx.h>
 #include <wininet.h>
 
 #include <string.h>
+#include "WDL/fnv64.h"
 #include "WDL/wdlcstring.h"
 #include "WDL/wdlutf8.h"
 
@@ -20,17 +22,20 @@ static const int PARAM_EDIT_ID = 99;
 static const UINT_PTR IPLUG_TIMER_ID = 2;
 static const UINT IPLUG_DEFAULT_DPI = USER_DEFAULT_SCREEN_DPI * 2;
 
-static void ScalePoint(LPPOINT const lpPoint, const int dpi)
+// Maps window to GUI coordinates, by the draw scale rather than the DPI,
+// because the host may have resized the window.
+static void ScalePoint(LPPOINT const lpPoint, const IGraphicsWin* const pGraphics)
 {
-	lpPoint->x = MulDiv(lpPoint->x, IPLUG_DEFAULT_DPI, dpi);
-	lpPoint->y = MulDiv(lpPoint->y, IPLUG_DEFAULT_DPI, dpi);
+	const int scaleMul = pGraphics->ScaleMul();
+	lpPoint->x = MulDiv(lpPoint->x, IGraphics::kScaleUnit, scaleMul);
+	lpPoint->y = MulDiv(lpPoint->y, IGraphics::kScaleUnit, scaleMul);
 }
 
-static void ScaleLParamXY(LPPOINT const lpPoint, const LPARAM lParam, const int dpi)
+static void ScaleLParamXY(LPPOINT const lpPoint, const LPARAM lParam, const IGraphicsWin* const pGraphics)
 {
 	lpPoint->x = GET_X_LPARAM(lParam);
 	lpPoint->y = GET_Y_LPARAM(lParam);
-	ScalePoint(lpPoint, dpi);
+	ScalePoint(lpPoint, pGraphics);
 }
 
 static bool WantFocus(IGraphicsWin* const pGraphics)
@@ -76,8 +81,9 @@ LRESULT CALLBACK IGraphicsWin::WndProc(HWND const hWnd, const UINT msg, const WP
 		IGraphicsWin* const pGraphics = (IGraphicsWin*)lpcs->lpCreateParams;
 		SetWindowLongPtrW(hWnd, GWLP_USERDATA, (LPARAM)pGraphics);
 
-		const int mSec = (int)(1000.0 / pGraphics->FPS());
-		SetTimer(hWnd, IPLUG_TIMER_ID, mSec, NULL);
+		pGraphics->WakeRefresh();
+		pGraphics->mTimerMs = pGraphics->RefreshInterval();
+		SetTimer(hWnd, IPLUG_TIMER_ID, pGraphics->mTimerMs, NULL);
 
 		if (WantFocus(pGraphics)) SetFocus(hWnd);
 		return 0;
@@ -92,44 +98,26 @@ LRESULT CALLBACK IGraphicsWin::WndProc(HWND const hWnd, const UINT msg, const WP
 		{
 			if (wParam == IPLUG_TIMER_ID)
 			{
-				IRECT dirtyR;
-				if (pGraphics->IsDirty(&dirtyR))
+				IRECT unionR;
+				const bool dirty = pGraphics->IsDirty(&unionR);
+				if (dirty)
 				{
-					RECT cR, r;
-					GetClientRect(hWnd, &cR);
+					RECT r;
 
-					const int scale = pGraphics->Scale();
+					// Invalidate each dirty region separately, so the update
+					// region doesn't include whatever is in between.
+					const int nDirty = pGraphics->NDirtyRects();
+					const IRECT* const pDirty = pGraphics->GetDirtyRects();
 
-					const int wMul = cR.right - cR.left;
-					const int hMul = cR.bottom - cR.top;
-					const int wDiv = pGraphics->Width();
-					const int hDiv = pGraphics->Height();
-
-					if ((wDiv >> scale) == wMul && (hDiv >> scale) == hMul)
-					{
-						r.left = dirtyR.L >> scale;
-						r.top = dirtyR.T >> scale;
-						r.right = dirtyR.R >> scale;
-						r.bottom = dirtyR.B >> scale;
-					}
-					else
+					for (int i = 0; i < nDirty; ++i)
 					{
-						const int x = MulDiv(dirtyR.L, wMul, wDiv);
-						const int y = MulDiv(dirtyR.T, hMul, hDiv);
-						const int w = MulDiv(dirtyR.R - dirtyR.L, wMul, wDiv);
-						const int h = MulDiv(dirtyR.B - dirtyR.T, hMul, hDiv);
-
-						r.left = x - 1;
-						r.top = y - 1;
-						r.right = x + w + 1;
-						r.bottom = y + h + 1;
-
-						r.left = wdl_max(r.left, cR.left);
-						r.top = wdl_max(r.top, cR.top);
-						r.right = wdl_min(r.right, cR.right);
-						r.bottom = wdl_min(r.bottom, cR.bottom);
+						const IRECT dirtyR = pGraphics->ToPixelsInner(&pDirty[i]);
+						r.left = dirtyR.L;
+						r.top = dirtyR.T;
+						r.right = dirtyR.R;
+						r.bottom = dirtyR.B;
+						InvalidateRect(hWnd, &r, FALSE);
 					}
-					InvalidateRect(hWnd, &r, FALSE);
 
 					if (pGraphics->mParamEditWnd)
 					{
@@ -145,6 +133,10 @@ LRESULT CALLBACK IGraphicsWin::WndProc(HWND const hWnd, const UINT msg, const WP
 				{
 					pGraphics->GetPlug()->EndDelayedInformHostOfParamChange();
 				}
+
+				// Slow down when idle, the param change timer counts ticks.
+				pGraphics->UpdateRefreshRate(dirty || pGraphics->mParamChangeTimer);
+				if (pGraphics->RefreshInterval() != pGraphics->mTimerMs) pGraphics->RescheduleRefresh();
 			}
 			return 0;
 		}
@@ -165,7 +157,7 @@ LRESULT CALLBACK IGraphicsWin::WndProc(HWND const hWnd, const UINT msg, const WP
 			SetCapture(hWnd);
 
 			POINT p;
-			ScaleLParamXY(&p, lParam, pGraphics->mDPI);
+			ScaleLParamXY(&p, lParam, pGraphics);
 
 			pGraphics->OnMouseDown(p.x, p.y, GetMouseMod(wParam));
 			return 0;
@@ -174,7 +166,7 @@ LRESULT CALLBACK IGraphicsWin::WndProc(HWND const hWnd, const UINT msg, const WP
 		case WM_MOUSEMOVE:
 		{
 			POINT p;
-			ScaleLParamXY(&p, lParam, pGraphics->mDPI);
+			ScaleLParamXY(&p, lParam, pGraphics);
 
 			if (!(wParam & (MK_LBUTTON | MK_RBUTTON)))
 			{
@@ -235,7 +227,7 @@ LRESULT CALLBACK IGraphicsWin::WndProc(HWND const hWnd, const UINT msg, const WP
 			ReleaseCapture();
 
 			POINT p;
-			ScaleLParamXY(&p, lParam, pGraphics->mDPI);
+			ScaleLParamXY(&p, lParam, pGraphics);
 
 			// TN: Shouldn't this set left/right mouse button flag, so you
 			// can detect which button was turned off?
@@ -247,7 +239,7 @@ LRESULT CALLBACK IGraphicsWin::WndProc(HWND const hWnd, const UINT msg, const WP
 		case WM_RBUTTONDBLCLK:
 		{
 			POINT p;
-			ScaleLParamXY(&p, lParam, pGraphics->mDPI);
+			ScaleLParamXY(&p, lParam, pGraphics);
 
 			if (pGraphics->OnMouseDblClick(p.x, p.y, GetMouseMod(wParam)))
 			{
@@ -303,7 +295,7 @@ LRESULT CALLBACK IGraphicsWin::WndProc(HWND const hWnd, const UINT msg, const WP
 				POINT p;
 				GetCursorPos(&p);
 				ScreenToClient(hWnd, &p);
-				ScalePoint(&p, pGraphics->mDPI);
+				ScalePoint(&p, pGraphics);
 				const IMouseMod mod = GetKeyMod();
 				const bool ret = msg == WM_KEYDOWN ? pGraphics->OnKeyDown(p.x, p.y, mod, key) : pGraphics->OnKeyUp(p.x, p.y, mod, key);
 				if (ret) return 0;
@@ -319,28 +311,39 @@ LRESULT CALLBACK IGraphicsWin::WndProc(HWND const hWnd, const UINT msg, const WP
 			RECT r;
 			if (GetUpdateRect(hWnd, &r, FALSE))
 			{
-				IRECT ir(r.left, r.top, r.right, r.bottom);
-				GetClientRect(hWnd, &r);
+				IRECT rects[IGraphics::kMaxDirtyRects];
+				int n = 0;
 
-				const int wMul = pGraphics->Width();
-				const int hMul = pGraphics->Height();
-				const int wDiv = r.right - r.left;
-				const int hDiv = r.bottom - r.top;
+				// Redraw the rectangles that make up the update region, or
+				// its bounding box if there are too many.
+				HRGN const rgn = CreateRectRgn(0, 0, 0, 0);
+				if (rgn && GetUpdateRgn(hWnd, rgn, FALSE) == COMPLEXREGION)
+				{
+					struct { RGNDATAHEADER rdh; RECT r[IGraphics::kMaxDirtyRects]; } data;
+					if (GetRegionData(rgn, sizeof(data), (RGNDATA*)&data))
+					{
+						n = data.rdh.nCount;
+						for (int i = 0; i < n; ++i)
+						{
+							rects[i] = IRECT(data.r[i].left, data.r[i].top, data.r[i].right, data.r[i].bottom);
+						}
+					}
+				}
+				if (rgn) DeleteObject(rgn);
 
-				if (wMul != wDiv || hMul != hDiv)
+				if (!n)
 				{
-					const int x = MulDiv(ir.L, wMul, wDiv);
-					const int y = MulDiv(ir.T, hMul, hDiv);
-					const int w = MulDiv(ir.R - ir.L, wMul, wDiv);
-					const int h = MulDiv(ir.B - ir.T, hMul, hDiv);
-
-					ir.L = x;
-					ir.T = y;
-					ir.R = x + w;
-					ir.B = y + h;
+					rects[0] = IRECT(r.left, r.top, r.right, r.bottom);
+					n = 1;
 				}
 
-				pGraphics->Draw(&ir);
+				// Round outward, so DrawScreen() covers the whole update region.
+				for (int i = 0; i < n; ++i)
+				{
+					rects[i] = pGraphics->FromPixels(&rects[i]);
+				}
+
+				pGraphics->Draw(rects, n);
 			}
 			return 0;
 		}
@@ -448,6 +451,7 @@ IGraphicsWin::IGraphicsWin(
 	mDefEditProc = NULL;
 	mTooltipIdx = -1;
 	mParamChangeTimer = 0;
+	mTimerMs = 0;
 	mAutoCommitDelay = 0;
 	mOldKeyboardFocus = -1;
 	mDPI = USER_DEFAULT_SCREEN_DPI;
@@ -465,6 +469,7 @@ IGraphicsWin::IGraphicsWin(
 
 IGraphicsWin::~IGraphicsWin()
 {
+	CancelBitmapLoading();
 	CloseWindow();
 	if (mUser32DLL) FreeLibrary(mUser32DLL);
 	if (mCoInit) CoUninitialize();
@@ -475,6 +480,19 @@ LICE_IBitmap* IGraphicsWin::OSLoadBitmap(const int ID, const char*)
 	return LICE_LoadPNGFromResource(mHInstance, MAKEINTRESOURCE(ID));
 }
 
+WDL_UINT64 IGraphicsWin::OSHashBitmap(const int ID, const char*)
+{
+	HRSRC const hResource = FindResource(mHInstance, MAKEINTRESOURCE(ID), "PNG");
+	if (!hResource) return 0;
+
+	const DWORD dwSize = SizeofResource(mHInstance, hResource);
+	HGLOBAL const res = LoadResource(mHInstance, hResource);
+	const void* const pResourceData = res ? LockResource(res) : NULL;
+	if (!(dwSize && pResourceData)) return 0;
+
+	return WDL_FNV64(WDL_FNV64_IV, (const unsigned char*)pResourceData, (int)dwSize);
+}
+
 bool IGraphicsWin::OSLoadFont(const int ID, const char*)
 {
 	HRSRC const hResource = FindResource(mHInstance, MAKEINTRESOURCE(ID), "TTF");
@@ -558,41 +576,19 @@ void IGraphicsWin::Resize(int w, int h)
 	}
 } */
 
-void IGraphicsWin::DrawScreen(const IRECT* const pR)
+void IGraphicsWin::DrawScreen(const IRECT* const pRects, const int nRects)
 {
 	HWND const hWnd = (HWND)GetWindow();
 
 	PAINTSTRUCT ps;
 	HDC const dc = BeginPaint(hWnd, &ps);
 
-	RECT r;
-	GetClientRect(hWnd, &r);
-
+	// The back buffer is window sized (see SetWindowSize()), so always 1:1.
 	HDC const dcSrc = mBackBuf.getDC();
-	const int scale = Scale();
-
-	const int wSrc = Width() >> scale;
-	const int hSrc = Height() >> scale;
-	const int wDest = r.right - r.left;
-	const int hDest = r.bottom - r.top;
-
-	if (wDest == wSrc && hDest == hSrc)
+	for (int i = 0; i < nRects; ++i)
 	{
-		const int x = pR->L >> scale;
-		const int cx = pR->W() >> scale;
-		const int y = pR->T >> scale;
-		const int cy = pR->H() >> scale;
-
-		BitBlt(dc, x, y, cx, cy, dcSrc, x, y, SRCCOPY);
-	}
-	else
-	{
-		const int mode = (wDest % wSrc) || (hDest % hSrc) ? HALFTONE : COLORONCOLOR;
-
-		SetStretchBltMode(dc, mode);
-		if (mode == HALFTONE) SetBrushOrgEx(dc, 0, 0, NULL);
-
-		StretchBlt(dc, r.left, r.top, wDest, hDest, dcSrc, 0, 0, wSrc, hSrc, SRCCOPY);
+		const IRECT r = ToPixelsInner(&pRects[i]);
+		BitBlt(dc, r.L, r.T, r.W(), r.H(), dcSrc, r.L, r.T, SRCCOPY);
 	}
 
 	EndPaint(hWnd, &ps);
@@ -607,13 +603,7 @@ void* IGraphicsWin::OpenWindow(void* const pParentWnd)
 	if (!dpi) dpi = mGetDpiForWindow ? mGetDpiForWindow(mParentWnd) : USER_DEFAULT_SCREEN_DPI;
 	mDPI = dpi;
 
-	const int scale = dpi > USER_DEFAULT_SCREEN_DPI ? kScaleFull : kScaleHalf;
-	if (!PrepDraw(scale)) return NULL;
-
-	w = MulDiv(w, dpi, IPLUG_DEFAULT_DPI);
-	h = MulDiv(h, dpi, IPLUG_DEFAULT_DPI);
-	GetPlug()->ResizeGraphics(w, h);
-
+	// Close first, because this releases the cached bitmaps.
 	if (mPlugWnd)
 	{
 		RECT pR, cR;
@@ -624,6 +614,11 @@ void* IGraphicsWin::OpenWindow(void* const pParentWnd)
 		y = cR.top - pR.top;
 	}
 
+	w = MulDiv(w, dpi, IPLUG_DEFAULT_DPI);
+	h = MulDiv(h, dpi, IPLUG_DEFAULT_DPI);
+	if (!PrepDrawForSize(w, h)) return NULL;
+	GetPlug()->ResizeGraphics(w, h);
+
 	if (nWndClassReg++ == 0)
 	{
 		const WNDCLASSW wndClass = { CS_DBLCLKS, WndProc, 0, 0, mHInstance, NULL, LoadCursor(NULL, IDC_ARROW), NULL, NULL, wndClassName };
@@ -747,6 +742,15 @@ void IGraphicsWin::SetWindowTitle(const char* const str)
 	SetWindowTextW(mPlugWnd, buf);
 }
 
+void IGraphicsWin::RescheduleRefresh()
+{
+	if (mPlugWnd)
+	{
+		mTimerMs = RefreshInterval();
+		SetTimer(mPlugWnd, IPLUG_TIMER_ID, mTimerMs, NULL);
+	}
+}
+
 void IGraphicsWin::CloseWindow()
 {
 	if (mPlugWnd)
@@ -781,9 +785,37 @@ void IGraphicsWin::CloseWindow()
 		{
 			UnregisterClassW(wndClassName, mHInstance);
 		}
+
+		ReleaseCachedResources();
 	}
 }
 
+// Draws at the window size, with the smallest bitmap set that isn't
+// smaller than the window. Bitmaps that don't match are resampled once.
+bool IGraphicsWin::PrepDrawForSize(const int w, const int h)
+{
+	const int scale = w > (Width() >> 1) || h > (Height() >> 1) ? kScaleFull : kScaleHalf;
+
+	// Rounded up, so the back buffer covers the whole window.
+	const int mulX = (int)((((WDL_INT64)w << 16) + Width() - 1) / Width());
+	const int mulY = (int)((((WDL_INT64)h << 16) + Height() - 1) / Height());
+	return PrepDraw(scale, wdl_max(mulX, mulY));
+}
+
+bool IGraphicsWin::SetWindowSize(const int w, const int h)
+{
+	if (!mPlugWnd || w <= 0 || h <= 0) return false;
+	if (!PrepDrawForSize(w, h)) return false;
+
+	// Used for the param edit font.
+	mDPI = MulDiv(w, IPLUG_DEFAULT_DPI, Width());
+
+	SetWindowPos(mPlugWnd, NULL, 0, 0, w, h, SWP_NOMOVE | SWP_NOZORDER | SWP_NOACTIVATE);
+	SetAllControlsDirty();
+
+	return true;
+}
+
 static const int PARAM_EDIT_W = 40 * 2;
 static const int PARAM_EDIT_H = 16 * 2;
 
@@ -994,7 +1026,7 @@ bool IGraphicsWin::PluginPath(WDL_String* const pPath)
 	return GetModulePath(mHInstance, pPath);
 }
 
-bool IGraphicsWin::UserDataPath(WDL_String* const pPath)
+bool IGraphics::UserDataPath(WDL_String* const pPath)
 {
 	WCHAR pathStr[MAX_PATH];
 
@@ -1207,7 +1239,7 @@ void IGraphicsWin::ScaleMouseWheel(HWND const hWnd, const POINT* const pPoint, c
 
 	r.left = pPoint->x - r.left;
 	r.top = pPoint->y - r.top;
-	ScalePoint((LPPOINT)&r, mDPI);
+	ScalePoint((LPPOINT)&r, this);
 
 	OnMouseWheel(r.left, r.top, mod, delta);
 }
@@ -1217,7 +1249,7 @@ int IGraphicsWin::ProcessKey(const bool state, const IMouseMod mod, const int ke
 	POINT p;
 	GetCursorPos(&p);
 	ScreenToClient(mPlugWnd, &p);
-	ScalePoint(&p, mDPI);
+	ScalePoint(&p, this);
 	return state ? OnKeyDown(p.x, p.y, mod, key) : OnKeyUp(p.x, p.y, mod, key);
 }
 
@@ -1261,4 +1293,10 @@ void IPlugDebugLog(const char* const str)
 {
 	OutputDebugString(str);
 }
+
+size_t IPlugResidentMemory()
+{
+	PROCESS_MEMORY_COUNTERS pmc;
+	return GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)) ? pmc.WorkingSetSize : 0;
+}
 #endif
@@ -17,7 +17,9 @@ public:
 	inline void SetHInstance(HINSTANCE const hInstance) { mHInstance = hInstance; }
 
 	// void Resize(int w, int h);
-	void DrawScreen(const IRECT* pR);
+	bool SetWindowSize(int w, int h);
+	bool PrepDrawForSize(int w, int h);
+	void DrawScreen(const IRECT* pRects, int nRects);
 
 	void* OpenWindow(void* pParentWnd);
 	void CloseWindow();
@@ -27,7 +29,6 @@ public:
 
 	bool HostPath(WDL_String* pPath);
 	bool PluginPath(WDL_String* pPath);
-	bool UserDataPath(WDL_String* pPath);
 
 	bool PromptForFile(WDL_String* pFilename, int action = kFileOpen, const char* dir = NULL, const char* extensions = NULL);
 	// bool PromptForColor(IColor* pColor, const char* prompt = NULL);
@@ -55,9 +56,12 @@ public:
 
 	// Defaults to 0, which means auto detect via GetDpiForWindow().
 	inline void ForceDPI(const int dpi) { mForceDPI = dpi; }
+	inline int GetForcedDPI() const { return mForceDPI; }
 
 protected:
 	LICE_IBitmap* OSLoadBitmap(int ID, const char* name);
+	void RescheduleRefresh();
+	WDL_UINT64 OSHashBitmap(int ID, const char* name);
 	bool OSLoadFont(int ID, const char* name);
 
 	void ScaleMouseWheel(HWND hWnd, const POINT* pPoint, IMouseMod mod, float delta);
@@ -81,6 +85,7 @@ private:
 	WNDPROC mDefEditProc;
 	int mTooltipIdx;
 	int mParamChangeTimer;
+	int mTimerMs; // Current interval of IPLUG_TIMER_ID.
 	int mAutoCommitDelay;
 	int mOldKeyboardFocus;
 	int mDPI;
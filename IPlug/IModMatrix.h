@@ -0,0 +1,222 @@
+#pragma once
+
+/*
+	IModMatrix routes modulation sources to destinations. The routes are
+	compiled (whenever the patch changes) into a flat table, without the
+	routes that have no effect, sorted by destination, so Process() only
+	visits active routes, accumulating each destination with a vectorized
+	multiply-add per route. Inactive routes, and destinations without
+	routes, cost nothing.
+
+	Sources and destinations are buffers of per-sample values, typically a
+	short sub-block (e.g. 32 samples), so fast sources such as LFOs and
+	envelopes still modulate smoothly. What the values mean (bipolar or
+	unipolar, and the destination's range) is up to the plugin.
+*/
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+	#define IMODMATRIX_SSE2
+	#include <emmintrin.h>
+#elif defined(_M_ARM64) || defined(__aarch64__)
+	#define IMODMATRIX_NEON
+	#include <arm_neon.h>
+#endif
+
+#include <string.h>
+
+#include "WDL/heapbuf.h"
+#include "WDL/wdltypes.h"
+
+class IModMatrix
+{
+public:
+	struct Route
+	{
+		int mSrc, mDst;
+		double mAmount;
+	};
+
+	IModMatrix():
+		mNSources(0),
+		mNDests(0),
+		mNRoutes(0),
+		mNActiveDests(0)
+	{}
+
+	// Not while processing (allocates). Clears all routes.
+	bool Resize(const int nSources, const int nDests, const int maxRoutes)
+	{
+		mNSources = mNDests = mNRoutes = mNActiveDests = 0;
+
+		mRoutes.Resize(maxRoutes, false);
+		mDests.Resize(nDests + 1, false);
+		mSourceUsed.Resize(nSources, false);
+		if (mRoutes.GetSize() != maxRoutes || mDests.GetSize() != nDests + 1 || mSourceUsed.GetSize() != nSources) return false;
+
+		memset(mSourceUsed.Get(), 0, nSources * sizeof(bool));
+
+		mNSources = nSources;
+		mNDests = nDests;
+		return true;
+	}
+
+	// Mutex locked, doesn't allocate. Keeps only the routes with a valid
+	// source and destination, and a non-zero amount (merging routes with the
+	// same source and destination), and returns the number of routes kept.
+	int Compile(const Route* const pRoutes, const int nRoutes)
+	{
+		Route* const pTable = mRoutes.Get();
+		const int maxRoutes = mRoutes.GetSize();
+
+		int n = 0;
+		for (int i = 0; i < nRoutes; ++i)
+		{
+			const Route r = pRoutes[i];
+			if ((unsigned int)r.mSrc >= (unsigned int)mNSources || (unsigned int)r.mDst >= (unsigned int)mNDests || r.mAmount == 0.0) continue;
+
+			// Insertion sort by destination, then source (there are only a
+			// few routes).
+			int j = n;
+			while (j > 0 && Less(r, pTable[j - 1])) --j;
+
+			if (j > 0 && pTable[j - 1].mSrc == r.mSrc && pTable[j - 1].mDst == r.mDst)
+			{
+				pTable[j - 1].mAmount += r.mAmount;
+				continue;
+			}
+
+			if (n == maxRoutes) continue;
+			memmove(&pTable[j + 1], &pTable[j], (n - j) * sizeof(Route));
+			pTable[j] = r;
+			++n;
+		}
+
+		// Merged routes can cancel out.
+		int k = 0;
+		for (int i = 0; i < n; ++i)
+		{
+			if (pTable[i].mAmount != 0.0) pTable[k++] = pTable[i];
+		}
+		n = k;
+
+		bool* const pSourceUsed = mSourceUsed.Get();
+		memset(pSourceUsed, 0, mNSources * sizeof(bool));
+
+		// First route of each active destination, and an end marker.
+		Dest* const pDests = mDests.Get();
+		int nDests = 0;
+		for (int i = 0; i < n; ++i)
+		{
+			pSourceUsed[pTable[i].mSrc] = true;
+			if (i == 0 || pTable[i].mDst != pTable[i - 1].mDst)
+			{
+				pDests[nDests].mDst = pTable[i].mDst;
+				pDests[nDests++].mFirst = i;
+			}
+		}
+		pDests[nDests].mDst = -1;
+		pDests[nDests].mFirst = n;
+
+		mNRoutes = n;
+		mNActiveDests = nDests;
+		return n;
+	}
+
+	inline bool IsActive() const { return mNRoutes > 0; }
+	inline int NRoutes() const { return mNRoutes; }
+
+	inline bool IsSourceUsed(const int src) const { return (unsigned int)src < (unsigned int)mNSources && mSourceUsed.Get()[src]; }
+
+	inline bool IsDestActive(const int dst) const
+	{
+		const Dest* const pDests = mDests.Get();
+		for (int i = 0; i < mNActiveDests; ++i)
+		{
+			if (pDests[i].mDst == dst) return true;
+		}
+		return false;
+	}
+
+	// Audio thread. ppSources[src] are nFrames values, but only used sources
+	// (see IsSourceUsed()) are read. ppDests[dst] are set to the sum of
+	// amount*source for active destinations (see IsDestActive()), other
+	// destinations are left as is.
+	void Process(const double* const* const ppSources, double* const* const ppDests, const int nFrames) const
+	{
+		const Route* const pTable = mRoutes.Get();
+		const Dest* const pDests = mDests.Get();
+
+		for (int i = 0; i < mNActiveDests; ++i)
+		{
+			double* const pOut = ppDests[pDests[i].mDst];
+			const int first = pDests[i].mFirst, end = pDests[i + 1].mFirst;
+
+			Scale(pOut, ppSources[pTable[first].mSrc], pTable[first].mAmount, nFrames);
+			for (int j = first + 1; j < end; ++j)
+			{
+				MulAdd(pOut, ppSources[pTable[j].mSrc], pTable[j].mAmount, nFrames);
+			}
+		}
+	}
+
+protected:
+	struct Dest { int mDst, mFirst; };
+
+	static inline bool Less(const Route& a, const Route& b)
+	{
+		return a.mDst < b.mDst || (a.mDst == b.mDst && a.mSrc < b.mSrc);
+	}
+
+	// out = in*amount
+	static void Scale(double* const pOut, const double* const pIn, const double amount, const int n)
+	{
+		int i = 0;
+
+		#if defined(IMODMATRIX_SSE2)
+		const __m128d va = _mm_set1_pd(amount);
+		for (; i + 2 <= n; i += 2)
+		{
+			_mm_storeu_pd(&pOut[i], _mm_mul_pd(_mm_loadu_pd(&pIn[i]), va));
+		}
+		#elif defined(IMODMATRIX_NEON)
+		const float64x2_t va = vdupq_n_f64(amount);
+		for (; i + 2 <= n; i += 2)
+		{
+			vst1q_f64(&pOut[i], vmulq_f64(vld1q_f64(&pIn[i]), va));
+		}
+		#endif
+
+		for (; i < n; ++i) pOut[i] = pIn[i] * amount;
+	}
+
+	// out += in*amount
+	static void MulAdd(double* const pOut, const double* const pIn, const double amount, const int n)
+	{
+		int i = 0;
+
+		#if defined(IMODMATRIX_SSE2)
+		const __m128d va = _mm_set1_pd(amount);
+		for (; i + 2 <= n; i += 2)
+		{
+			_mm_storeu_pd(&pOut[i], _mm_add_pd(_mm_loadu_pd(&pOut[i]), _mm_mul_pd(_mm_loadu_pd(&pIn[i]), va)));
+		}
+		#elif defined(IMODMATRIX_NEON)
+		const float64x2_t va = vdupq_n_f64(amount);
+		for (; i + 2 <= n; i += 2)
+		{
+			vst1q_f64(&pOut[i], vfmaq_f64(vld1q_f64(&pOut[i]), vld1q_f64(&pIn[i]), va));
+		}
+		#endif
+
+		for (; i < n; ++i) pOut[i] += pIn[i] * amount;
+	}
+
+	// Compiled routes, sorted by destination, then source.
+	WDL_TypedBuf<Route> mRoutes;
+	// Active destinations, and an end marker.
+	WDL_TypedBuf<Dest> mDests;
+	WDL_TypedBuf<bool> mSourceUsed;
+
+	int mNSources, mNDests;
+	int mNRoutes, mNActiveDests;
+};
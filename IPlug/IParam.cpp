@@ -1,4 +1,5 @@
 #include "IParam.h"
+#include "IValueText.h"
 
 #include <string.h>
 
@@ -15,6 +16,48 @@ void IParam::SetShortName(const char* const name)
 	strcpy(mShortName, name);
 }
 
+bool IParam::FromDisplayText(const char* const str, double* const pNormalizedValue) const
+{
+	if (MapDisplayText(str, pNormalizedValue)) return true;
+
+	double v;
+	if (!IValueText::Parse(str, &v)) return false;
+
+	if (DisplayIsNegated()) v = -v;
+	*pNormalizedValue = GetNormalized(v);
+	return true;
+}
+
+void IParam::FromNormalized(const int batchClass, const IParam* const* const ppParams, const double* const pNormalized, double* const pValues, const int n)
+{
+	switch (batchClass)
+	{
+		case kTypeBool: IBoolParam::FromNormalized(ppParams, pNormalized, pValues, n); break;
+		case kTypeInt: IIntParam::FromNormalized(ppParams, pNormalized, pValues, n); break;
+		case kTypeEnum: IEnumParam::FromNormalized(ppParams, pNormalized, pValues, n); break;
+		case kTypeDouble: IDoubleParam::FromNormalized(ppParams, pNormalized, pValues, n); break;
+		case kTypeNormalized: INormalizedParam::FromNormalized(ppParams, pNormalized, pValues, n); break;
+		case kBatchDoublePow: IDoublePowParam::FromNormalized(ppParams, pNormalized, pValues, n); break;
+		case kBatchDoubleExp: IDoubleExpParam::FromNormalized(ppParams, pNormalized, pValues, n); break;
+		default: assert(0); break;
+	}
+}
+
+void IParam::ToNormalized(const int batchClass, const IParam* const* const ppParams, const double* const pValues, double* const pNormalized, const int n)
+{
+	switch (batchClass)
+	{
+		case kTypeBool: IBoolParam::ToNormalized(ppParams, pValues, pNormalized, n); break;
+		case kTypeInt: IIntParam::ToNormalized(ppParams, pValues, pNormalized, n); break;
+		case kTypeEnum: IEnumParam::ToNormalized(ppParams, pValues, pNormalized, n); break;
+		case kTypeDouble: IDoubleParam::ToNormalized(ppParams, pValues, pNormalized, n); break;
+		case kTypeNormalized: INormalizedParam::ToNormalized(ppParams, pValues, pNormalized, n); break;
+		case kBatchDoublePow: IDoublePowParam::ToNormalized(ppParams, pValues, pNormalized, n); break;
+		case kBatchDoubleExp: IDoubleExpParam::ToNormalized(ppParams, pValues, pNormalized, n); break;
+		default: assert(0); break;
+	}
+}
+
 IBoolParam::IBoolParam(
 	const char* const name,
 	const bool defaultVal,
@@ -39,6 +82,13 @@ void IBoolParam::SetNormalized(const double normalizedValue)
 	mBoolVal = normalizedValue >= 0.5;
 }
 
+bool IBoolParam::SetValue(const double value)
+{
+	const bool prev = mBoolVal;
+	mBoolVal = value >= 0.5;
+	return mBoolVal != prev;
+}
+
 double IBoolParam::GetNormalized(const double nonNormalizedValue) const
 {
 	return nonNormalizedValue >= 0.5;
@@ -79,6 +129,16 @@ bool IBoolParam::MapDisplayText(const char* const str, double* const pNormalized
 	return true;
 }
 
+void IBoolParam::FromNormalized(const IParam* const* /* ppParams */, const double* const pNormalized, double* const pValues, const int n)
+{
+	for (int i = 0; i < n; ++i) pValues[i] = (double)(pNormalized[i] >= 0.5);
+}
+
+void IBoolParam::ToNormalized(const IParam* const* /* ppParams */, const double* const pValues, double* const pNormalized, const int n)
+{
+	for (int i = 0; i < n; ++i) pNormalized[i] = (double)(pValues[i] >= 0.5);
+}
+
 bool IBoolParam::Serialize(ByteChunk* const pChunk) const
 {
 	return !!pChunk->PutBool(mBoolVal);
@@ -89,6 +149,14 @@ int IBoolParam::Unserialize(const ByteChunk* const pChunk, const int startPos)
 	return pChunk->GetBool(&mBoolVal, startPos);
 }
 
+int IBoolParam::UnserializeValue(const ByteChunk* const pChunk, const int startPos, double* const pValue) const
+{
+	bool boolVal = false;
+	const int pos = pChunk->GetBool(&boolVal, startPos);
+	*pValue = (double)boolVal;
+	return pos;
+}
+
 IEnumParam::IEnumParam(
 	const char* const name,
 	const int defaultVal,
@@ -118,6 +186,13 @@ void IEnumParam::SetNormalized(const double normalizedValue)
 	mIntVal = FromNormalized(normalizedValue);
 }
 
+bool IEnumParam::SetValue(const double value)
+{
+	const int prev = mIntVal;
+	mIntVal = Bounded((int)(value + 0.5));
+	return mIntVal != prev;
+}
+
 double IEnumParam::GetNormalized() const
 {
 	return ToNormalized(mIntVal);
@@ -169,6 +244,18 @@ bool IEnumParam::MapDisplayText(const char* const str, double* const pNormalized
 	return false;
 }
 
+void IEnumParam::FromNormalized(const IParam* const* const ppParams, const double* const pNormalized, double* const pValues, const int n)
+{
+	const IEnumParam* const* const pp = (const IEnumParam* const*)ppParams;
+	for (int i = 0; i < n; ++i) pValues[i] = (double)pp[i]->FromNormalized(pNormalized[i]);
+}
+
+void IEnumParam::ToNormalized(const IParam* const* const ppParams, const double* const pValues, double* const pNormalized, const int n)
+{
+	const IEnumParam* const* const pp = (const IEnumParam* const*)ppParams;
+	for (int i = 0; i < n; ++i) pNormalized[i] = pp[i]->GetNormalized(pValues[i]);
+}
+
 bool IEnumParam::Serialize(ByteChunk* const pChunk) const
 {
 	return !!pChunk->PutInt32(mIntVal);
@@ -179,6 +266,14 @@ int IEnumParam::Unserialize(const ByteChunk* const pChunk, const int startPos)
 	return pChunk->GetInt32(&mIntVal, startPos);
 }
 
+int IEnumParam::UnserializeValue(const ByteChunk* const pChunk, const int startPos, double* const pValue) const
+{
+	int intVal = 0;
+	const int pos = pChunk->GetInt32(&intVal, startPos);
+	*pValue = (double)Bounded(intVal);
+	return pos;
+}
+
 IIntParam::IIntParam(
 	const char* const name,
 	const int defaultVal,
@@ -216,6 +311,13 @@ void IIntParam::SetNormalized(const double normalizedValue)
 	mIntVal = FromNormalized(normalizedValue);
 }
 
+bool IIntParam::SetValue(const double value)
+{
+	const int prev = mIntVal;
+	mIntVal = Bounded((int)floor(value + 0.5));
+	return mIntVal != prev;
+}
+
 double IIntParam::GetNormalized() const
 {
 	return Normalized(mIntVal, mMin, mMax);
@@ -248,7 +350,7 @@ char* IIntParam::ToString(const int intVal, char* const buf, const int bufSize)
 		const int displayValue = DisplayIsNegated() ? -intVal : intVal;
 
 		const bool sign = displayValue && (mMin >= 0) != (mMax >= 0);
-		snprintf(tmp, sizeof(tmp), sign ? "%+d" : "%d", displayValue);
+		IValueText::FormatInt(tmp, sizeof(tmp), displayValue, sign);
 	}
 
 	lstrcpyn_safe(buf, displayText, bufSize);
@@ -300,6 +402,18 @@ bool IIntParam::MapDisplayText(const char* const str, double* const pNormalizedV
 	return false;
 }
 
+void IIntParam::FromNormalized(const IParam* const* const ppParams, const double* const pNormalized, double* const pValues, const int n)
+{
+	const IIntParam* const* const pp = (const IIntParam* const*)ppParams;
+	for (int i = 0; i < n; ++i) pValues[i] = (double)pp[i]->FromNormalized(pNormalized[i]);
+}
+
+void IIntParam::ToNormalized(const IParam* const* const ppParams, const double* const pValues, double* const pNormalized, const int n)
+{
+	const IIntParam* const* const pp = (const IIntParam* const*)ppParams;
+	for (int i = 0; i < n; ++i) pNormalized[i] = pp[i]->GetNormalized(pValues[i]);
+}
+
 bool IIntParam::Serialize(ByteChunk* const pChunk) const
 {
 	return !!pChunk->PutInt32(mIntVal);
@@ -310,6 +424,14 @@ int IIntParam::Unserialize(const ByteChunk* const pChunk, const int startPos)
 	return pChunk->GetInt32(&mIntVal, startPos);
 }
 
+int IIntParam::UnserializeValue(const ByteChunk* const pChunk, const int startPos, double* const pValue) const
+{
+	int intVal = mMin;
+	const int pos = pChunk->GetInt32(&intVal, startPos);
+	*pValue = (double)Bounded(intVal);
+	return pos;
+}
+
 #ifndef NDEBUG
 void IIntParam::AssertInt(const int intVal) const
 {
@@ -364,6 +486,13 @@ void IDoubleParam::SetNormalized(const double normalizedValue)
 	mValue = FromNormalized(normalizedValue);
 }
 
+bool IDoubleParam::SetValue(const double value)
+{
+	const double prev = mValue;
+	mValue = value;
+	return mValue != prev;
+}
+
 double IDoubleParam::GetNormalized() const
 {
 	return Normalize(mValue, mMin, mMax);
@@ -397,7 +526,7 @@ char* IDoubleParam::ToString(const double nonNormalizedValue, char* const buf, c
 		if (nz && DisplayIsNegated()) displayValue = -displayValue;
 
 		const bool sign = nz && (mMin >= 0.0) != (mMax >= 0.0);
-		snprintf(tmp, sizeof(tmp), sign ? "%+.*f" : "%.*f", (int)mDisplayPrecision, displayValue);
+		IValueText::Format(tmp, sizeof(tmp), displayValue, mDisplayPrecision, sign);
 	}
 
 	lstrcpyn_safe(buf, displayText, bufSize);
@@ -473,6 +602,18 @@ bool IDoubleParam::MapDisplayText(const char* const str, double* const pNormaliz
 	return false;
 }
 
+void IDoubleParam::FromNormalized(const IParam* const* const ppParams, const double* const pNormalized, double* const pValues, const int n)
+{
+	const IDoubleParam* const* const pp = (const IDoubleParam* const*)ppParams;
+	for (int i = 0; i < n; ++i) pValues[i] = (pp[i]->mMax - pp[i]->mMin) * pNormalized[i] + pp[i]->mMin;
+}
+
+void IDoubleParam::ToNormalized(const IParam* const* const ppParams, const double* const pValues, double* const pNormalized, const int n)
+{
+	const IDoubleParam* const* const pp = (const IDoubleParam* const*)ppParams;
+	for (int i = 0; i < n; ++i) pNormalized[i] = Normalize(pValues[i], pp[i]->mMin, pp[i]->mMax);
+}
+
 bool IDoubleParam::Serialize(ByteChunk* const pChunk) const
 {
 	return !!pChunk->PutDouble(mValue);
@@ -483,6 +624,14 @@ int IDoubleParam::Unserialize(const ByteChunk* const pChunk, const int startPos)
 	return pChunk->GetDouble(&mValue, startPos);
 }
 
+int IDoubleParam::UnserializeValue(const ByteChunk* const pChunk, const int startPos, double* const pValue) const
+{
+	double v = mMin;
+	const int pos = pChunk->GetDouble(&v, startPos);
+	*pValue = Bounded(v);
+	return pos;
+}
+
 #ifndef NDEBUG
 void IDoubleParam::AssertValue(const double nonNormalizedValue) const
 {
@@ -506,6 +655,7 @@ IDoublePowParam::IDoublePowParam(
 ):
 	IDoubleParam(name, defaultVal, minVal, maxVal, displayPrecision, label)
 {
+	mBatchClass = kBatchDoublePow;
 	SetShape(shape);
 }
 
@@ -535,6 +685,43 @@ char* IDoublePowParam::GetDisplayForHost(const double normalizedValue, char* con
 	return ToString(nonNormalizedValue, buf, bufSize, &normalizedValue);
 }
 
+// Same math as the scalar versions, just in a different order, so the
+// results are identical. The shapes are gathered in chunks, for
+// IFastMath::Pow() with a different power per value.
+
+static const int kShapeChunk = 32;
+
+void IDoublePowParam::FromNormalized(const IParam* const* const ppParams, const double* const pNormalized, double* const pValues, const int n)
+{
+	const IDoublePowParam* const* const pp = (const IDoublePowParam* const*)ppParams;
+	double shapes[kShapeChunk];
+
+	for (int i = 0; i < n; i += kShapeChunk)
+	{
+		const int m = wdl_min(n - i, kShapeChunk);
+		for (int j = 0; j < m; ++j) shapes[j] = pp[i + j]->mShape;
+		IFastMath::Pow(&pNormalized[i], shapes, &pValues[i], m);
+	}
+
+	IDoubleParam::FromNormalized(ppParams, pValues, pValues, n);
+}
+
+void IDoublePowParam::ToNormalized(const IParam* const* const ppParams, const double* const pValues, double* const pNormalized, const int n)
+{
+	const IDoublePowParam* const* const pp = (const IDoublePowParam* const*)ppParams;
+	for (int i = 0; i < n; ++i) pNormalized[i] = wdl_max((pValues[i] - pp[i]->mMin) / (pp[i]->mMax - pp[i]->mMin), 0.0);
+
+	double shapes[kShapeChunk];
+	for (int i = 0; i < n; i += kShapeChunk)
+	{
+		const int m = wdl_min(n - i, kShapeChunk);
+		for (int j = 0; j < m; ++j) shapes[j] = 1.0 / pp[i + j]->mShape;
+		IFastMath::Pow(&pNormalized[i], shapes, &pNormalized[i], m);
+	}
+
+	for (int i = 0; i < n; ++i) pNormalized[i] = wdl_min(pNormalized[i], 1.0);
+}
+
 IDoubleExpParam::IDoubleExpParam(
 	const double shape,
 	const char* const name,
@@ -546,6 +733,7 @@ IDoubleExpParam::IDoubleExpParam(
 ):
 	IDoubleParam(name, defaultVal, minVal, maxVal, displayPrecision, label)
 {
+	mBatchClass = kBatchDoubleExp;
 	SetShape(shape);
 }
 
@@ -576,6 +764,26 @@ char* IDoubleExpParam::GetDisplayForHost(const double normalizedValue, char* con
 	return ToString(nonNormalizedValue, buf, bufSize, &normalizedValue);
 }
 
+void IDoubleExpParam::FromNormalized(const IParam* const* const ppParams, const double* const pNormalized, double* const pValues, const int n)
+{
+	const IDoubleExpParam* const* const pp = (const IDoubleExpParam* const*)ppParams;
+	for (int i = 0; i < n; ++i) pValues[i] = pNormalized[i] * pp[i]->mShape;
+
+	IFastMath::Exp(pValues, pValues, n);
+	for (int i = 0; i < n; ++i) pValues[i] = (pValues[i] - 1.0) / pp[i]->mExpMin1;
+
+	IDoubleParam::FromNormalized(ppParams, pValues, pValues, n);
+}
+
+void IDoubleExpParam::ToNormalized(const IParam* const* const ppParams, const double* const pValues, double* const pNormalized, const int n)
+{
+	const IDoubleExpParam* const* const pp = (const IDoubleExpParam* const*)ppParams;
+	for (int i = 0; i < n; ++i) pNormalized[i] = wdl_max((pValues[i] - pp[i]->mMin) / (pp[i]->mMax - pp[i]->mMin), 0.0) * pp[i]->mExpMin1 + 1.0;
+
+	IFastMath::Log(pNormalized, pNormalized, n);
+	for (int i = 0; i < n; ++i) pNormalized[i] = wdl_min(pNormalized[i] / pp[i]->mShape, 1.0);
+}
+
 INormalizedParam::INormalizedParam(
 	const char* const name,
 	const double defaultVal
@@ -591,6 +799,13 @@ void INormalizedParam::SetNormalized(const double normalizedValue)
 	Set(normalizedValue);
 }
 
+bool INormalizedParam::SetValue(const double value)
+{
+	const double prev = mValue;
+	mValue = Bounded(value);
+	return mValue != prev;
+}
+
 double INormalizedParam::GetNormalized(const double nonNormalizedValue) const
 {
 	return Bounded(nonNormalizedValue);
@@ -601,7 +816,7 @@ char* INormalizedParam::ToString(const double normalizedValue, char* const buf,
 	assert(normalizedValue >= 0.0 && normalizedValue <= 1.0);
 
 	char tmp[12];
-	snprintf(tmp, sizeof(tmp), "%.6g", normalizedValue);
+	IValueText::FormatGeneral(tmp, sizeof(tmp), normalizedValue, 6);
 
 	if (tmp[0] && !tmp[1])
 	{
@@ -624,6 +839,16 @@ char* INormalizedParam::GetDisplayForHost(const double normalizedValue, char* co
 	return ToString(normalizedValue, buf, bufSize);
 }
 
+void INormalizedParam::FromNormalized(const IParam* const* /* ppParams */, const double* const pNormalized, double* const pValues, const int n)
+{
+	if (pValues != pNormalized) memcpy(pValues, pNormalized, n * sizeof(double));
+}
+
+void INormalizedParam::ToNormalized(const IParam* const* /* ppParams */, const double* const pValues, double* const pNormalized, const int n)
+{
+	for (int i = 0; i < n; ++i) pNormalized[i] = Bounded(pValues[i]);
+}
+
 bool INormalizedParam::Serialize(ByteChunk* const pChunk) const
 {
 	return !!pChunk->PutDouble(mValue);
@@ -633,3 +858,11 @@ int INormalizedParam::Unserialize(const ByteChunk* const pChunk, const int start
 {
 	return pChunk->GetDouble(&mValue, startPos);
 }
+
+int INormalizedParam::UnserializeValue(const ByteChunk* const pChunk, const int startPos, double* const pValue) const
+{
+	double v = 0.0;
+	const int pos = pChunk->GetDouble(&v, startPos);
+	*pValue = Bounded(v);
+	return pos;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Containers.h"
+#include "IFastMath.h"
 
 #include <assert.h>
 #include <math.h>
@@ -14,15 +15,22 @@ class IParam
 {
 public:
 	enum EParamType { kTypeNone = 0, kTypeBool, kTypeInt, kTypeEnum, kTypeDouble, kTypeNormalized };
+	// Params of the same batch class convert in a single batch call (see
+	// IParamBatch). Same as the type, except for shaped double params.
+	enum EBatchClass { kBatchDoublePow = kTypeNormalized + 1, kBatchDoubleExp, kNumBatchClasses };
+	enum ESmoothCurve { kSmoothLinear = 0, kSmoothOnePole };
 
 	IParam(
 		const int type,
 		const char* const name
 	):
 		mType(type),
+		mBatchClass(type),
 		mNegateDisplay(0),
 		mGlobalParam(0),
+		mSmoothCurve(kSmoothLinear),
 		_unused(0),
+		mSmoothTime(0.0f),
 		mName(name)
 	{
 		mShortName[0] = 0;
@@ -31,6 +39,7 @@ public:
 	virtual ~IParam() {}
 
 	inline int Type() const { return mType; }
+	inline int BatchClass() const { return mBatchClass; }
 
 	// Call this if your param is [x, y], but you want to always display [-x, -y].
 	inline void NegateDisplay(const bool negate = true) { mNegateDisplay = negate; }
@@ -39,6 +48,18 @@ public:
 	inline void SetGlobal(const bool global) { mGlobalParam = global; }
 	inline bool IsGlobal() const { return mGlobalParam; }
 
+	// Ramps to new values in ms, instead of jumping (see
+	// IPlugBase::SmoothParam()). Linear ramps take exactly ms, one-pole
+	// ones get within 1%.
+	inline void SetSmoothing(const double ms, const int curve = kSmoothLinear)
+	{
+		mSmoothTime = (float)ms;
+		mSmoothCurve = curve == kSmoothOnePole;
+	}
+
+	inline double GetSmoothingTime() const { return mSmoothTime; }
+	inline int GetSmoothingCurve() const { return mSmoothCurve; }
+
 	virtual void SetNormalized(double normalizedValue) = 0;
 	virtual double GetNormalized() const = 0;
 	virtual double GetNormalized(double nonNormalizedValue) const = 0;
@@ -62,8 +83,26 @@ public:
 		return false;
 	}
 
+	// Inverse of GetDisplayForHost(), also accepts a trailing label. Returns
+	// false if str isn't a display text or a number. Doesn't change the
+	// param, so doesn't need the mutex.
+	bool FromDisplayText(const char* str, double* pNormalizedValue) const;
+
+	// Batch versions of FromNormalized() and ToNormalized() (or the
+	// equivalent) for n params of the same batch class, one value each, in
+	// and out can be the same. Plain values are Bool(), Int(), or Value()
+	// as double. See IParamBatch for params of mixed classes.
+	static void FromNormalized(int batchClass, const IParam* const* ppParams, const double* pNormalized, double* pValues, int n);
+	static void ToNormalized(int batchClass, const IParam* const* ppParams, const double* pValues, double* pNormalized, int n);
+
+	// Sets the plain value (see above), and returns true if it changed.
+	virtual bool SetValue(double value) = 0;
+
 	virtual bool Serialize(ByteChunk* pChunk) const = 0;
 	virtual int Unserialize(const ByteChunk* pChunk, int startPos) = 0;
+	// Decodes the serialized plain value (bounded), without changing the
+	// param.
+	virtual int UnserializeValue(const ByteChunk* pChunk, int startPos, double* pValue) const = 0;
 	virtual int Size() const = 0;
 
 	// Returns IDoublePowParam shape so non-normalized value
@@ -93,10 +132,11 @@ protected:
 
 	static void Delete(WDL_FastString* const str) { delete str; }
 
-	char mType, mDisplayPrecision;
+	char mType, mBatchClass, mDisplayPrecision;
 	bool mBoolVal;
 
-	unsigned int mNegateDisplay:1, mGlobalParam:1, _unused:30;
+	unsigned int mNegateDisplay:1, mGlobalParam:1, mSmoothCurve:1, _unused:29;
+	float mSmoothTime;
 
 	WDL_FastString mName;
 	char mShortName[8];
@@ -118,6 +158,7 @@ public:
 	inline bool Bool() const { return mBoolVal; }
 
 	void SetNormalized(double normalizedValue);
+	bool SetValue(double value);
 	double GetNormalized() const { return (double)mBoolVal; }
 	double GetNormalized(double nonNormalizedValue) const;
 	char* GetDisplayForHost(char* buf, int bufSize = 128);
@@ -129,8 +170,12 @@ public:
 	const char* GetDisplayText(bool boolVal) const;
 	bool MapDisplayText(const char* str, double* pNormalizedValue) const;
 
+	static void FromNormalized(const IParam* const* ppParams, const double* pNormalized, double* pValues, int n);
+	static void ToNormalized(const IParam* const* ppParams, const double* pValues, double* pNormalized, int n);
+
 	bool Serialize(ByteChunk* pChunk) const;
 	int Unserialize(const ByteChunk* pChunk, int startPos);
+	int UnserializeValue(const ByteChunk* pChunk, int startPos, double* pValue) const;
 	int Size() const { return (int)sizeof(char); }
 
 protected:
@@ -178,6 +223,7 @@ public:
 	}
 
 	void SetNormalized(double normalizedValue);
+	bool SetValue(double value);
 	double GetNormalized() const;
 	double GetNormalized(double nonNormalizedValue) const;
 	char* GetDisplayForHost(char* buf, int bufSize = 128);
@@ -189,8 +235,12 @@ public:
 	const char* GetDisplayText(int intVal) const;
 	bool MapDisplayText(const char* str, double* pNormalizedValue) const;
 
+	static void FromNormalized(const IParam* const* ppParams, const double* pNormalized, double* pValues, int n);
+	static void ToNormalized(const IParam* const* ppParams, const double* pValues, double* pNormalized, int n);
+
 	bool Serialize(ByteChunk* pChunk) const;
 	int Unserialize(const ByteChunk* pChunk, int startPos);
+	int UnserializeValue(const ByteChunk* pChunk, int startPos, double* pValue) const;
 	int Size() const { return (int)sizeof(int); }
 
 protected:
@@ -253,6 +303,7 @@ public:
 	}
 
 	void SetNormalized(double normalizedValue);
+	bool SetValue(double value);
 	double GetNormalized() const;
 	double GetNormalized(double nonNormalizedValue) const;
 	char* GetDisplayForHost(char* buf, int bufSize = 128);
@@ -265,8 +316,12 @@ public:
 	const char* GetDisplayText(int intVal) const;
 	bool MapDisplayText(const char* str, double* pNormalizedValue) const;
 
+	static void FromNormalized(const IParam* const* ppParams, const double* pNormalized, double* pValues, int n);
+	static void ToNormalized(const IParam* const* ppParams, const double* pValues, double* pNormalized, int n);
+
 	bool Serialize(ByteChunk* pChunk) const;
 	int Unserialize(const ByteChunk* pChunk, int startPos);
+	int UnserializeValue(const ByteChunk* pChunk, int startPos, double* pValue) const;
 	int Size() const { return (int)sizeof(int); }
 
 protected:
@@ -342,6 +397,7 @@ public:
 	}
 
 	void SetNormalized(double normalizedValue);
+	bool SetValue(double value);
 	double GetNormalized() const;
 	double GetNormalized(double nonNormalizedValue) const;
 	char* GetDisplayForHost(char* buf, int bufSize = 128);
@@ -363,8 +419,12 @@ public:
 		*pMax = mMax;
 	}
 
+	static void FromNormalized(const IParam* const* ppParams, const double* pNormalized, double* pValues, int n);
+	static void ToNormalized(const IParam* const* ppParams, const double* pValues, double* pNormalized, int n);
+
 	bool Serialize(ByteChunk* pChunk) const;
 	int Unserialize(const ByteChunk* pChunk, int startPos);
+	int UnserializeValue(const ByteChunk* pChunk, int startPos, double* pValue) const;
 	int Size() const { return (int)sizeof(double); }
 
 	inline void SetDisplayPrecision(const int displayPrecision)
@@ -417,7 +477,7 @@ public:
 
 	double FromNormalized(const double normalizedValue) const
 	{
-		return IDoubleParam::FromNormalized(pow(normalizedValue, mShape));
+		return IDoubleParam::FromNormalized(IFastMath::Pow(normalizedValue, mShape));
 	}
 
 	double ToNormalized(const double nonNormalizedValue) const
@@ -429,6 +489,9 @@ public:
 		return Normalize(nonNormalizedValue, mMin, mMax, mShape);
 	}
 
+	static void FromNormalized(const IParam* const* ppParams, const double* pNormalized, double* pValues, int n);
+	static void ToNormalized(const IParam* const* ppParams, const double* pValues, double* pNormalized, int n);
+
 	void SetNormalized(double normalizedValue);
 	double GetNormalized() const;
 	double GetNormalized(double nonNormalizedValue) const;
@@ -440,7 +503,7 @@ protected:
 		double normalizedValue = (nonNormalizedValue - minVal) / (maxVal - minVal);
 		normalizedValue = wdl_max(normalizedValue, 0.0);
 
-		normalizedValue = pow(normalizedValue, 1.0 / shape);
+		normalizedValue = IFastMath::Pow(normalizedValue, 1.0 / shape);
 		normalizedValue = wdl_min(normalizedValue, 1.0);
 
 		return normalizedValue;
@@ -469,7 +532,7 @@ public:
 		assert(shape != 0.0);
 
 		mShape = shape;
-		mExpMin1 = exp(shape) - 1.0;
+		mExpMin1 = IFastMath::Exp(shape) - 1.0;
 	}
 
 	// Adjusts the shape so nonNormalizedValue corresponds to normalizedValue = 0.5.
@@ -478,7 +541,7 @@ public:
 
 	double FromNormalized(const double normalizedValue) const
 	{
-		return IDoubleParam::FromNormalized((exp(normalizedValue * mShape) - 1.0) / mExpMin1);
+		return IDoubleParam::FromNormalized((IFastMath::Exp(normalizedValue * mShape) - 1.0) / mExpMin1);
 	}
 
 	double ToNormalized(const double nonNormalizedValue) const
@@ -490,6 +553,9 @@ public:
 		return Normalize(nonNormalizedValue, mMin, mMax, mShape, mExpMin1);
 	}
 
+	static void FromNormalized(const IParam* const* ppParams, const double* pNormalized, double* pValues, int n);
+	static void ToNormalized(const IParam* const* ppParams, const double* pValues, double* pNormalized, int n);
+
 	void SetNormalized(double normalizedValue);
 	double GetNormalized() const;
 	double GetNormalized(double nonNormalizedValue) const;
@@ -501,7 +567,7 @@ protected:
 		double normalizedValue = (nonNormalizedValue - minVal) / (maxVal - minVal);
 		normalizedValue = wdl_max(normalizedValue, 0.0);
 
-		normalizedValue = log(normalizedValue * expMin1 + 1.0) / shape;
+		normalizedValue = IFastMath::Log(normalizedValue * expMin1 + 1.0) / shape;
 		normalizedValue = wdl_min(normalizedValue, 1.0);
 
 		return normalizedValue;
@@ -530,6 +596,7 @@ public:
 	}
 
 	void SetNormalized(double normalizedValue);
+	bool SetValue(double value);
 	double GetNormalized() const { return mValue; }
 	double GetNormalized(double nonNormalizedValue) const;
 	char* GetDisplayForHost(char* buf, int bufSize = 128);
@@ -537,8 +604,12 @@ public:
 
 	char* ToString(double normalizedValue, char* buf, int bufSize = 128) const;
 
+	static void FromNormalized(const IParam* const* ppParams, const double* pNormalized, double* pValues, int n);
+	static void ToNormalized(const IParam* const* ppParams, const double* pValues, double* pNormalized, int n);
+
 	bool Serialize(ByteChunk* pChunk) const;
 	int Unserialize(const ByteChunk* pChunk, int startPos);
+	int UnserializeValue(const ByteChunk* pChunk, int startPos, double* pValue) const;
 	int GetSize() const { return (int)sizeof(double); }
 
 protected:
@@ -0,0 +1,104 @@
+#pragma once
+
+/*
+	IParamBatch converts values of mixed params between normalized and
+	plain (see the batch IParam::FromNormalized() and ToNormalized()). The
+	params are grouped by batch class (a counting sort, so in linear time),
+	and each class is converted in a single batch call, so e.g. all shaped
+	params share one vectorized pow() pass.
+*/
+
+#include <string.h>
+
+#include "IParam.h"
+
+#include "WDL/heapbuf.h"
+#include "WDL/wdltypes.h"
+
+class IParamBatch
+{
+public:
+	IParamBatch(): mNParams(0) {}
+
+	// Not while processing (allocates).
+	bool Resize(const int nParams)
+	{
+		mNParams = 0;
+		mOrder.Resize(nParams, false);
+		mParams.Resize(nParams, false);
+		mValues.Resize(nParams * 2, false);
+		if (mOrder.GetSize() != nParams || mParams.GetSize() != nParams || mValues.GetSize() != nParams * 2) return false;
+
+		mNParams = nParams;
+		return true;
+	}
+
+	// Doesn't allocate. Converts pIn[i] for param ppParams[pIndexes[i]] (or
+	// ppParams[i] if pIndexes is NULL), for up to Resize() values. Writes to
+	// pOut (can be pIn), or if NULL to an internal buffer, valid until the
+	// next call. Returns the output.
+	inline const double* FromNormalized(IParam* const* const ppParams, const int* const pIndexes, const double* const pIn, double* const pOut, const int n)
+	{
+		return Convert(IParam::FromNormalized, ppParams, pIndexes, pIn, pOut, n);
+	}
+
+	inline const double* ToNormalized(IParam* const* const ppParams, const int* const pIndexes, const double* const pIn, double* const pOut, const int n)
+	{
+		return Convert(IParam::ToNormalized, ppParams, pIndexes, pIn, pOut, n);
+	}
+
+	inline int GetMemoryFootprint() const
+	{
+		return mOrder.GetSize() * (int)sizeof(int) + mParams.GetSize() * (int)sizeof(const IParam*) + mValues.GetSize() * (int)sizeof(double);
+	}
+
+protected:
+	typedef void (*ConvertProc)(int batchClass, const IParam* const* ppParams, const double* pIn, double* pOut, int n);
+
+	const double* Convert(const ConvertProc convert, IParam* const* const ppParams, const int* const pIndexes, const double* const pIn, double* pOut, int n)
+	{
+		n = wdl_min(n, mNParams);
+
+		int* const pOrder = mOrder.Get();
+		const IParam** const ppSorted = mParams.Get();
+		double* const pSorted = mValues.Get();
+		if (!pOut) pOut = pSorted + mNParams;
+
+		// Start of each class.
+		int start[IParam::kNumBatchClasses + 1];
+		memset(start, 0, sizeof(start));
+
+		for (int i = 0; i < n; ++i) ++start[GetParam(ppParams, pIndexes, i)->BatchClass() + 1];
+		for (int c = 0; c < IParam::kNumBatchClasses; ++c) start[c + 1] += start[c];
+
+		for (int i = 0; i < n; ++i)
+		{
+			const IParam* const pParam = GetParam(ppParams, pIndexes, i);
+			const int k = start[pParam->BatchClass()]++;
+			pOrder[k] = i;
+			ppSorted[k] = pParam;
+			pSorted[k] = pIn[i];
+		}
+
+		// Now start[c] is the end of class c.
+		for (int c = 0, first = 0; c < IParam::kNumBatchClasses; first = start[c++])
+		{
+			if (start[c] > first) convert(c, &ppSorted[first], &pSorted[first], &pSorted[first], start[c] - first);
+		}
+
+		for (int k = 0; k < n; ++k) pOut[pOrder[k]] = pSorted[k];
+		return pOut;
+	}
+
+	static inline const IParam* GetParam(IParam* const* const ppParams, const int* const pIndexes, const int i)
+	{
+		return ppParams[pIndexes ? pIndexes[i] : i];
+	}
+
+	WDL_TypedBuf<int> mOrder;
+	WDL_TypedBuf<const IParam*> mParams;
+	// Sorted values, and the internal output buffer.
+	WDL_TypedBuf<double> mValues;
+
+	int mNParams;
+};
@@ -0,0 +1,323 @@
+#pragma once
+
+/*
+	IParamSmoother ramps params to their new values, so automation doesn't
+	cause zipper noise (see IParam::SetSmoothing(), and
+	IPlugBase::SmoothParam()). Ramps run on normalized values, so they
+	follow the param's shape, and are either linear (reaching the target
+	after the smoothing time), or one-pole (within 1% after the smoothing
+	time).
+
+	Only params that are still moving are kept, packed into flat arrays per
+	curve, so advancing a sub-block is a single vectorized pass over those.
+	Params drop out as soon as they settle, so they cost nothing.
+*/
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+	#define IPARAMSMOOTHER_SSE2
+	#include <emmintrin.h>
+#elif defined(_M_ARM64) || defined(__aarch64__)
+	#define IPARAMSMOOTHER_NEON
+	#include <arm_neon.h>
+#endif
+
+#include <math.h>
+
+#include "IFastMath.h"
+
+#include "WDL/heapbuf.h"
+#include "WDL/wdltypes.h"
+
+class IParamSmoother
+{
+public:
+	enum ECurve { kLinear = 0, kOnePole, kNumCurves };
+
+	// Suggested sub-block size, values are constant within a sub-block.
+	static const int kBlockSize = 32;
+
+	IParamSmoother():
+		mSlots(NULL),
+		mOutIdx(NULL),
+		mCurrent(NULL),
+		mOutValues(NULL),
+		mNParams(0),
+		mNOut(0)
+	{
+		for (int i = 0; i < kNumCurves; ++i) mRamps[i].mN = 0;
+	}
+
+	// Not while processing (allocates). Forgets all values.
+	bool Resize(const int nParams)
+	{
+		mNParams = 0;
+		mInts.Resize(nParams * (kNumCurves + 2), false);
+		mDoubles.Resize(nParams * (kNumCurves * 4 + 2), false);
+		if (mInts.GetSize() != nParams * (kNumCurves + 2) || mDoubles.GetSize() != nParams * (kNumCurves * 4 + 2)) return false;
+
+		int* pInts = mInts.Get();
+		double* pDoubles = mDoubles.Get();
+
+		mSlots = pInts; pInts += nParams;
+		mOutIdx = pInts; pInts += nParams;
+		mCurrent = pDoubles; pDoubles += nParams;
+		mOutValues = pDoubles; pDoubles += nParams;
+
+		for (int i = 0; i < kNumCurves; ++i)
+		{
+			Ramps* const pRamps = &mRamps[i];
+			pRamps->mIdx = pInts; pInts += nParams;
+			pRamps->mCur = pDoubles; pDoubles += nParams;
+			pRamps->mTarget = pDoubles; pDoubles += nParams;
+			pRamps->mRate = pDoubles; pDoubles += nParams;
+			pRamps->mRemaining = pDoubles; pDoubles += nParams;
+			pRamps->mN = 0;
+		}
+
+		for (int i = 0; i < nParams; ++i)
+		{
+			mSlots[i] = -1;
+			// Unknown, so the first target is set right away.
+			mCurrent[i] = -1.0;
+		}
+
+		mNParams = nParams;
+		mNOut = 0;
+		return true;
+	}
+
+	// Mutex locked. Starts ramping from the current value to the normalized
+	// target value, or returns false if the target should be applied right
+	// away (not smoothed, or the first value).
+	bool SetTarget(const int idx, const double target, const double samples, const int curve)
+	{
+		if ((unsigned int)idx >= (unsigned int)mNParams) return false;
+
+		double cur = mCurrent[idx];
+		if (mSlots[idx] >= 0) cur = Remove(idx);
+
+		if (samples < 1.0 || cur < 0.0 || cur == target)
+		{
+			mCurrent[idx] = target;
+			return false;
+		}
+
+		Ramps* const pRamps = &mRamps[curve == kOnePole ? kOnePole : kLinear];
+		const int slot = pRamps->mN++;
+
+		pRamps->mIdx[slot] = idx;
+		pRamps->mCur[slot] = cur;
+		pRamps->mTarget[slot] = target;
+
+		if (curve == kOnePole)
+		{
+			// 5 time constants, exp(-5) < 1%.
+			pRamps->mRate[slot] = 5.0 / samples;
+		}
+		else
+		{
+			pRamps->mRate[slot] = (target - cur) / samples;
+			pRamps->mRemaining[slot] = samples;
+		}
+
+		mSlots[idx] = (int)(pRamps - mRamps) * mNParams + slot;
+		return true;
+	}
+
+	inline bool IsActive() const { return mRamps[kLinear].mN + mRamps[kOnePole].mN > 0; }
+
+	// Audio thread. Advances all ramps by nFrames, and returns the number of
+	// params in GetIndexes() and GetValues(), including those that settled.
+	int Tick(const int nFrames)
+	{
+		mNOut = 0;
+		const double n = (double)nFrames;
+
+		Ramps* pRamps = &mRamps[kLinear];
+		if (pRamps->mN)
+		{
+			AdvanceLinear(pRamps->mCur, pRamps->mRate, pRamps->mRemaining, n, pRamps->mN);
+
+			for (int i = 0; i < pRamps->mN;)
+			{
+				const bool settled = pRamps->mRemaining[i] <= 0.0;
+				if (settled) pRamps->mCur[i] = pRamps->mTarget[i];
+				Output(pRamps, i, settled);
+				if (!settled) ++i;
+			}
+		}
+
+		pRamps = &mRamps[kOnePole];
+		if (pRamps->mN)
+		{
+			// Per-sample rate to per-block decay, using mRemaining as scratch.
+			double* const pDecay = pRamps->mRemaining;
+			for (int i = 0; i < pRamps->mN; ++i) pDecay[i] = -n * pRamps->mRate[i];
+			IFastMath::Exp(pDecay, pDecay, pRamps->mN);
+
+			AdvanceOnePole(pRamps->mCur, pRamps->mTarget, pDecay, pRamps->mN);
+
+			for (int i = 0; i < pRamps->mN;)
+			{
+				// About 1/10 of a 16-bit step.
+				const bool settled = fabs(pRamps->mCur[i] - pRamps->mTarget[i]) <= 1e-6;
+				if (settled) pRamps->mCur[i] = pRamps->mTarget[i];
+				Output(pRamps, i, settled);
+				if (!settled) ++i;
+			}
+		}
+
+		return mNOut;
+	}
+
+	// Mutex locked. Jumps to the end of all ramps, with the same output as
+	// Tick().
+	int Settle()
+	{
+		mNOut = 0;
+		for (int c = 0; c < kNumCurves; ++c)
+		{
+			Ramps* const pRamps = &mRamps[c];
+			while (pRamps->mN)
+			{
+				pRamps->mCur[0] = pRamps->mTarget[0];
+				Output(pRamps, 0, true);
+			}
+		}
+		return mNOut;
+	}
+
+	// Param indexes, and their smoothed normalized values.
+	inline const int* GetIndexes() const { return mOutIdx; }
+	inline const double* GetValues() const { return mOutValues; }
+
+	inline int GetMemoryFootprint() const { return mInts.GetSize() * (int)sizeof(int) + mDoubles.GetSize() * (int)sizeof(double); }
+
+protected:
+	struct Ramps
+	{
+		// Param index, current and target value, and the linear step per
+		// sample or the one-pole rate, and the remaining linear samples, per
+		// slot.
+		int* mIdx;
+		double *mCur, *mTarget, *mRate, *mRemaining;
+		int mN;
+	};
+
+	// Writes the slot's value to the output, and removes the slot if the
+	// param settled, moving the last slot in its place.
+	void Output(Ramps* const pRamps, const int slot, const bool settled)
+	{
+		const int idx = pRamps->mIdx[slot];
+		const double v = pRamps->mCur[slot];
+
+		mOutIdx[mNOut] = idx;
+		mOutValues[mNOut++] = v;
+		mCurrent[idx] = v;
+
+		if (settled)
+		{
+			mSlots[idx] = -1;
+			MoveLast(pRamps, slot);
+		}
+	}
+
+	// Removes the param's ramp, and returns its current value.
+	double Remove(const int idx)
+	{
+		Ramps* const pRamps = &mRamps[mSlots[idx] / mNParams];
+		const int slot = mSlots[idx] % mNParams;
+
+		const double cur = pRamps->mCur[slot];
+		mSlots[idx] = -1;
+		MoveLast(pRamps, slot);
+		return cur;
+	}
+
+	void MoveLast(Ramps* const pRamps, const int slot)
+	{
+		const int last = --pRamps->mN;
+		if (slot == last) return;
+
+		const int idx = pRamps->mIdx[last];
+		pRamps->mIdx[slot] = idx;
+		pRamps->mCur[slot] = pRamps->mCur[last];
+		pRamps->mTarget[slot] = pRamps->mTarget[last];
+		pRamps->mRate[slot] = pRamps->mRate[last];
+		pRamps->mRemaining[slot] = pRamps->mRemaining[last];
+
+		mSlots[idx] = (int)(pRamps - mRamps) * mNParams + slot;
+	}
+
+	// m = min(n, remaining), cur += step*m, remaining -= m
+	static void AdvanceLinear(double* const pCur, const double* const pStep, double* const pRemaining, const double n, const int nSlots)
+	{
+		int i = 0;
+
+		#if defined(IPARAMSMOOTHER_SSE2)
+		const __m128d vn = _mm_set1_pd(n);
+		for (; i + 2 <= nSlots; i += 2)
+		{
+			const __m128d r = _mm_loadu_pd(&pRemaining[i]);
+			const __m128d m = _mm_min_pd(vn, r);
+			_mm_storeu_pd(&pCur[i], _mm_add_pd(_mm_loadu_pd(&pCur[i]), _mm_mul_pd(_mm_loadu_pd(&pStep[i]), m)));
+			_mm_storeu_pd(&pRemaining[i], _mm_sub_pd(r, m));
+		}
+		#elif defined(IPARAMSMOOTHER_NEON)
+		const float64x2_t vn = vdupq_n_f64(n);
+		for (; i + 2 <= nSlots; i += 2)
+		{
+			const float64x2_t r = vld1q_f64(&pRemaining[i]);
+			const float64x2_t m = vminq_f64(vn, r);
+			vst1q_f64(&pCur[i], vfmaq_f64(vld1q_f64(&pCur[i]), vld1q_f64(&pStep[i]), m));
+			vst1q_f64(&pRemaining[i], vsubq_f64(r, m));
+		}
+		#endif
+
+		for (; i < nSlots; ++i)
+		{
+			const double m = wdl_min(n, pRemaining[i]);
+			pCur[i] += pStep[i] * m;
+			pRemaining[i] -= m;
+		}
+	}
+
+	// cur = target + (cur - target)*decay
+	static void AdvanceOnePole(double* const pCur, const double* const pTarget, const double* const pDecay, const int nSlots)
+	{
+		int i = 0;
+
+		#if defined(IPARAMSMOOTHER_SSE2)
+		for (; i + 2 <= nSlots; i += 2)
+		{
+			const __m128d t = _mm_loadu_pd(&pTarget[i]);
+			const __m128d d = _mm_sub_pd(_mm_loadu_pd(&pCur[i]), t);
+			_mm_storeu_pd(&pCur[i], _mm_add_pd(t, _mm_mul_pd(d, _mm_loadu_pd(&pDecay[i]))));
+		}
+		#elif defined(IPARAMSMOOTHER_NEON)
+		for (; i + 2 <= nSlots; i += 2)
+		{
+			const float64x2_t t = vld1q_f64(&pTarget[i]);
+			const float64x2_t d = vsubq_f64(vld1q_f64(&pCur[i]), t);
+			vst1q_f64(&pCur[i], vfmaq_f64(t, d, vld1q_f64(&pDecay[i])));
+		}
+		#endif
+
+		for (; i < nSlots; ++i) pCur[i] = pTarget[i] + (pCur[i] - pTarget[i]) * pDecay[i];
+	}
+
+	// Per param: slot (curve * nParams + slot, or -1 if settled), and
+	// output index. Per curve: param index per slot.
+	WDL_TypedBuf<int> mInts;
+	// Per param: last output value (or -1 if unknown), and output value.
+	// Per curve: Ramps arrays.
+	WDL_TypedBuf<double> mDoubles;
+
+	int* mSlots;
+	int* mOutIdx;
+	double* mCurrent;
+	double* mOutValues;
+
+	Ramps mRamps[kNumCurves];
+	int mNParams, mNOut;
+};
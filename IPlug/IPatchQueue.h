@@ -0,0 +1,185 @@
+#pragma once
+
+/*
+	IPatchQueue hands complete sets of param values (patches), decoded off
+	the audio thread, over to the audio thread, which swaps them in at a
+	block boundary.
+
+	The loader (main thread) fills a patch from its pool, and publishes it
+	with a single pointer exchange, replacing a previous patch that wasn't
+	picked up yet. The audio thread takes it at the start of a block, and
+	optionally fades the output out first, and back in after the swap. It
+	never locks, allocates, or frees.
+*/
+
+#ifdef _WIN32
+	#include <windows.h>
+#endif
+
+#include "WDL/heapbuf.h"
+#include "WDL/ptrlist.h"
+#include "WDL/wdltypes.h"
+
+struct IPatch
+{
+	WDL_TypedBuf<double> mValues; // Normalized, one per param.
+	volatile int mInUse; // Published, but not applied yet.
+
+	IPatch(): mInUse(0) {}
+};
+
+class IPatchQueue
+{
+public:
+	IPatchQueue():
+		mFadeMs(0.0),
+		mGain(1.0),
+		mFadeStep(0.0),
+		mPending(NULL),
+		mIncoming(NULL)
+	{}
+
+	~IPatchQueue() { mPool.Empty(true); }
+
+	// Fade out before, and in after a swap. Defaults to 0, which swaps
+	// immediately.
+	inline void SetFade(const double ms) { mFadeMs = ms; }
+	inline double GetFade() const { return mFadeMs; }
+
+	// Loader thread. Returns an unused patch, or NULL if out of memory.
+	IPatch* Alloc(const int nValues)
+	{
+		IPatch* pPatch = NULL;
+		for (int i = 0; i < mPool.GetSize() && !pPatch; ++i)
+		{
+			if (!mPool.Get(i)->mInUse) pPatch = mPool.Get(i);
+		}
+
+		if (!pPatch) pPatch = mPool.Add(new IPatch);
+		if (pPatch && !pPatch->mValues.ResizeOK(nValues, false)) pPatch = NULL;
+
+		return pPatch;
+	}
+
+	// Loader thread.
+	void Publish(IPatch* const pPatch)
+	{
+		pPatch->mInUse = 1;
+		IPatch* const pOld = Exchange(&mPending, pPatch);
+
+		// Replaced before the audio thread got to it.
+		if (pOld) pOld->mInUse = 0;
+	}
+
+	// Loader thread. True until all published patches have been applied.
+	bool Busy() const
+	{
+		for (int i = 0; i < mPool.GetSize(); ++i)
+		{
+			if (mPool.Get(i)->mInUse) return true;
+		}
+		return false;
+	}
+
+	// Audio thread. Returns the patch to apply before processing this
+	// block (then call Release()), or NULL.
+	IPatch* BeginBlock(const double sampleRate)
+	{
+		if (!mIncoming && mPending)
+		{
+			mIncoming = Exchange(&mPending, NULL);
+			mFadeStep = mFadeMs > 0.0 && sampleRate > 0.0 ? 1000.0 / (mFadeMs * sampleRate) : 0.0;
+		}
+
+		IPatch* const pPatch = mIncoming;
+		if (!pPatch || (mFadeStep > 0.0 && mGain > 0.0)) return NULL;
+
+		mIncoming = NULL;
+		return pPatch;
+	}
+
+	// Audio thread. Fades the output out while a patch is incoming, or
+	// back in after it was applied.
+	void EndBlock(double* const* const ppOut, const int nChannels, const int nFrames)
+	{
+		const double target = mIncoming ? 0.0 : 1.0;
+		const double gain = mGain;
+		if (gain == target) return;
+
+		if (mFadeStep <= 0.0)
+		{
+			mGain = 1.0;
+			return;
+		}
+
+		const double step = target > gain ? mFadeStep : -mFadeStep;
+
+		for (int c = 0; c < nChannels; ++c)
+		{
+			double* const pOut = ppOut[c];
+			double g = gain;
+			for (int i = 0; i < nFrames; ++i)
+			{
+				g = wdl_max(wdl_min(g + step, 1.0), 0.0);
+				pOut[i] *= g;
+			}
+		}
+
+		mGain = wdl_max(wdl_min(gain + step * (double)nFrames, 1.0), 0.0);
+	}
+
+	// Audio thread.
+	inline void Release(IPatch* const pPatch)
+	{
+		Barrier();
+		pPatch->mInUse = 0;
+	}
+
+	// Returns the incoming or pending patch to apply right away (then call
+	// Release()), for when the audio thread isn't running.
+	IPatch* Flush()
+	{
+		IPatch* pPatch = mIncoming;
+		mIncoming = NULL;
+
+		IPatch* const pPending = Exchange(&mPending, NULL);
+		if (pPending)
+		{
+			if (pPatch) Release(pPatch);
+			pPatch = pPending;
+		}
+
+		mGain = 1.0;
+		return pPatch;
+	}
+
+protected:
+	static inline void Barrier()
+	{
+		#ifdef _WIN32
+		MemoryBarrier();
+		#else
+		__sync_synchronize();
+		#endif
+	}
+
+	static inline IPatch* Exchange(IPatch* volatile* const ppDest, IPatch* const pPatch)
+	{
+		#ifdef _WIN32
+		return (IPatch*)InterlockedExchangePointer((PVOID volatile*)ppDest, pPatch);
+		#else
+		__sync_synchronize();
+		return __sync_lock_test_and_set(ppDest, pPatch);
+		#endif
+	}
+
+	WDL_PtrList<IPatch> mPool; // Loader thread only.
+	double mFadeMs;
+
+	// Audio thread only.
+	double WDL_FIXALIGN mGain, mFadeStep;
+
+	IPatch* volatile mPending;
+	IPatch* mIncoming;
+}
+WDL_FIXALIGN;
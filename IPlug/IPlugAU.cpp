@@ -396,7 +396,9 @@ ComponentResult IPlugAU::IPlugAUEntry(ComponentParameters* const params, void* c
 		return ret;
 	}
 
+	// Hosts send MIDI from the render thread.
 	_this->mMutex.Enter();
+	IPLUG_RT_SAFETY_SCOPE_IF(select == kMusicDeviceMIDIEventSelect || select == kMusicDeviceSysExSelect)
 
 	switch (select)
 	{
@@ -428,6 +430,7 @@ ComponentResult IPlugAU::IPlugAUEntry(ComponentParameters* const params, void* c
 			{
 				_this->mPlugFlags &= ~kPlugFlagsActive;
 				_this->OnActivate(false);
+				_this->FlushPatchQueue();
 			}
 			break;
 		}
@@ -1245,13 +1248,7 @@ ComponentResult IPlugAU::GetProperty(const AudioUnitPropertyID propID, const Aud
 					const CStrLocal cStr(pVFS->inString);
 					const IParam* const pParam = GetParam(pVFS->inParamID);
 					double v;
-					const bool mapped = pParam->MapDisplayText(cStr.mCStr, &v);
-					if (!mapped)
-					{
-						v = strtod(cStr.mCStr, NULL);
-						if (pParam->DisplayIsNegated()) v = -v;
-						v = pParam->GetNormalized(v);
-					}
+					if (!pParam->FromDisplayText(cStr.mCStr, &v)) v = pParam->GetNormalized();
 					pVFS->outValue = (AudioUnitParameterValue)v;
 				}
 			}
@@ -1894,6 +1891,7 @@ ComponentResult IPlugAU::RenderProc(void* const pPlug, AudioUnitRenderActionFlag
 	const UInt32 outputBusIdx, const UInt32 nFrames, AudioBufferList* const pOutBufList)
 {
 	IPlugAU* const _this = (IPlugAU*)pPlug;
+	IPLUG_RT_SAFETY_SCOPE
 
 	if (!(pTimestamp->mFlags & kAudioTimeStampSampleTimeValid) ||
 		outputBusIdx >= _this->mOutBuses.GetSize() ||
@@ -1995,6 +1993,8 @@ ComponentResult IPlugAU::RenderProc(void* const pPlug, AudioUnitRenderActionFlag
 		_this->AttachOutputBuffers(chIdx + i, 1, (AudioSampleType**)&pOutBufList->mBuffers[i].mData);
 	}
 
+	WDL_denormal_ftz_scope ftz;
+
 	if (_this->IsBypassed())
 	{
 		_this->PassThroughBuffers((AudioSampleType)0, nFrames);
@@ -2160,7 +2160,7 @@ IPlugBase(
 
 bool IPlugAU::AllocStateChunk(int chunkSize)
 {
-	if (chunkSize < 0) chunkSize = GetParamsChunkSize(0, NParams());
+	if (chunkSize < 0) chunkSize = GetStateChunkSize();
 	return mState.Alloc(chunkSize) == chunkSize;
 }
 
@@ -1,11 +1,15 @@
 #include "IPlugBase.h"
 #include "IGraphics.h"
 #include "Hosts.h"
+#include "IPresetBank.h"
 
 #include <stdarg.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "WDL/fnv64.h"
 #include "WDL/wdlcstring.h"
+#include "WDL/zlib/zlib.h"
 
 template <class SRC, class DEST>
 void IPlugBase::CastCopy(DEST* const pDest, const SRC* const pSrc, const int n)
@@ -80,15 +84,24 @@ IPlugBase::IPlugBase(
 	mBlockSize(0),
 	mLatency(latency),
 	mGraphics(NULL),
+	mParamReset(false),
+	mParamsChangedOnAudioThread(false),
 	mPresetChunkSize(-1)
 {
 	assert(plugDoes == (plugDoes & (kPlugIsInst | kPlugDoesMidi)));
 
+	#ifdef IPLUG_RT_SAFETY
+	IRTSafety::Init();
+	#endif
+
 	for (int i = 0; i < nPresets; ++i)
 	{
 		mPresets.Add(new IPreset(i));
 	}
 
+	mParamSmoother.Resize(nParams);
+	mParamBatch.Resize(nParams);
+
 	int nInputs = 0, nOutputs = 0;
 	while (channelIOStr)
 	{
@@ -296,7 +309,7 @@ void IPlugBase::AttachOutputBuffers(const int idx, int n, float* const* ppData)
 
 void IPlugBase::ProcessBuffers(float /* sampleType */, const int nFrames)
 {
-	ProcessDoubleReplacing(mInData.Get(), mOutData.Get(), nFrames);
+	ProcessDoubleReplacingMetered(nFrames);
 	const int n = NOutChannels();
 	const OutChannel* const* const ppOutChannel = mOutChannels.GetList();
 	for (int i = 0; i < n; ++i)
@@ -311,7 +324,7 @@ void IPlugBase::ProcessBuffers(float /* sampleType */, const int nFrames)
 
 void IPlugBase::ProcessBuffersAccumulating(float /* sampleType */, const int nFrames)
 {
-	ProcessDoubleReplacing(mInData.Get(), mOutData.Get(), nFrames);
+	ProcessDoubleReplacingMetered(nFrames);
 	const int n = NOutChannels();
 	const OutChannel* const* const ppOutChannel = mOutChannels.GetList();
 	for (int i = 0; i < n; ++i)
@@ -369,11 +382,19 @@ void IPlugBase::SetParameterFromGUI(const int idx, const double normalizedValue)
 
 void IPlugBase::OnParamReset()
 {
+	// Jump instead of smoothing.
+	mParamReset = true;
+
 	const int n = mParams.GetSize();
 	for (int i = 0; i < n; ++i)
 	{
 		OnParamChange(i);
 	}
+
+	// The loaded values win over the morph, until it is moved.
+	mPresetMorph.Sync();
+
+	mParamReset = false;
 }
 
 void IPlugBase::BeginDelayedInformHostOfParamChange(const int idx)
@@ -654,6 +675,97 @@ bool IPlugBase::RestorePreset(const char* const name)
 	return false;
 }
 
+bool IPlugBase::SetMorphPresets(const int idxA, const int idxB, const int idxC, const int idxD)
+{
+	const int idx[IPresetMorph::kMaxPresets] = { idxA, idxB, idxC, idxD };
+
+	int nPresets = 0;
+	while (nPresets < IPresetMorph::kMaxPresets && idx[nPresets] >= 0) ++nPresets;
+
+	// Decode without locking, the morph only needs the mutex to swap in.
+	const int nParams = NParams();
+	WDL_TypedBuf<double> buf;
+	bool initOK = nPresets >= 2 && buf.ResizeOK(nParams * nPresets, false);
+
+	const double* ppValues[IPresetMorph::kMaxPresets];
+	for (int i = 0; i < nPresets && initOK; ++i)
+	{
+		const IPreset* const pPreset = mPresets.Get(idx[i]);
+		double* const pValues = buf.Get() + i * nParams;
+		ppValues[i] = pValues;
+
+		initOK = pPreset && pPreset->mInitialized;
+		if (!initOK) break;
+
+		// Global params aren't in presets, so these won't morph.
+		for (int j = 0; j < nParams; ++j) pValues[j] = mParams.Get(j)->GetNormalized();
+		initOK = DecodePreset(&pPreset->mChunk, 0, pValues) >= 0;
+	}
+
+	mMutex.Enter();
+
+	if (initOK)
+		initOK = mPresetMorph.Init(ppValues, nPresets, nParams);
+	else
+		mPresetMorph.Clear();
+
+	mMutex.Leave();
+
+	return initOK || !nPresets;
+}
+
+bool IPlugBase::LoadPreset(const void* const pData, const int size)
+{
+	ByteChunk chunk;
+	if (size < 0 || chunk.Alloc(size) != size || chunk.PutBytes(pData, size) != size) return false;
+
+	IPatch* const pPatch = mPatchQueue.Alloc(NParams());
+	if (!pPatch) return false;
+
+	// Global params aren't in presets, so keep these as they are.
+	double* const pValues = pPatch->mValues.Get();
+	const int n = NParams();
+	for (int i = 0; i < n; ++i) pValues[i] = mParams.Get(i)->GetNormalized();
+
+	if (DecodePreset(&chunk, 0, pValues) < 0) return false;
+
+	mPatchQueue.Publish(pPatch);
+
+	// If not processing, then apply it right away.
+	if (!IsActive())
+	{
+		mMutex.Enter();
+		if (!IsActive()) FlushPatchQueue();
+		mMutex.Leave();
+	}
+
+	return true;
+}
+
+bool IPlugBase::WritePresetBank(const char* const path, const char* const tags)
+{
+	mMutex.Enter();
+	ModifyCurrentPreset();
+
+	IPresetBankWriter writer;
+	writer.SetUserVersion(GetEffectVersion(false));
+	bool savedOK = true;
+
+	const int n = mPresets.GetSize();
+	for (int i = 0; i < n && savedOK; ++i)
+	{
+		const IPreset* const pPreset = mPresets.Get(i);
+		if (pPreset->mInitialized)
+		{
+			const ByteChunk* const pChunk = &pPreset->mChunk;
+			savedOK = writer.Add(pPreset->mName.Get(), tags, pChunk->GetBytes(), pChunk->Size());
+		}
+	}
+
+	mMutex.Leave();
+	return savedOK && writer.Write(path);
+}
+
 const char* IPlugBase::GetPresetName(int idx) const
 {
 	if (idx < 0) idx = mCurrentPresetIdx;
@@ -760,6 +872,32 @@ int IPlugBase::UnserializePreset(const ByteChunk* const pChunk, int pos, int /*
 	return pos;
 }
 
+int IPlugBase::DecodePreset(const ByteChunk* const pChunk, int pos, double* const pValues) const
+{
+	const int n = mParams.GetSize();
+
+	// Plain values of the preset (non-global) params, then normalized.
+	WDL_TypedBuf<int> indexes;
+	WDL_TypedBuf<double> values;
+	IParamBatch batch;
+	if (!indexes.ResizeOK(n, false) || !values.ResizeOK(n, false) || !batch.Resize(n)) return n ? -1 : pos;
+
+	int nDecoded = 0;
+	for (int i = 0; i < n && pos >= 0; ++i)
+	{
+		const IParam* const pParam = mParams.Get(i);
+		if (pParam->IsGlobal()) continue;
+
+		indexes.Get()[nDecoded] = i;
+		pos = pParam->UnserializeValue(pChunk, pos, &values.Get()[nDecoded++]);
+	}
+
+	batch.ToNormalized(GetParams(), indexes.Get(), values.Get(), values.Get(), nDecoded);
+	for (int i = 0; i < nDecoded; ++i) pValues[indexes.Get()[i]] = values.Get()[i];
+
+	return pos;
+}
+
 int IPlugBase::GetParamsChunkSize(const int fromIdx, const int toIdx) const
 {
 	int size = 0;
@@ -789,14 +927,412 @@ int IPlugBase::UnserializeParams(const int fromIdx, const int toIdx, const ByteC
 	return pos;
 }
 
+int IPlugBase::DecodeParams(const int fromIdx, const int toIdx, const ByteChunk* const pChunk, int pos, double* const pValues) const
+{
+	const int n = toIdx - fromIdx;
+	IParamBatch batch;
+	if (n > 0 && !batch.Resize(n)) return -1;
+
+	for (int i = fromIdx; i < toIdx && pos >= 0; ++i)
+	{
+		pos = mParams.Get(i)->UnserializeValue(pChunk, pos, &pValues[i]);
+	}
+
+	batch.ToNormalized(GetParams() + fromIdx, NULL, pValues + fromIdx, pValues + fromIdx, n);
+	return pos;
+}
+
+// Tagged state: header (magic, version, flags, size, uncompressed size),
+// followed by blocks (tag, size, data). Readers skip unknown blocks.
+static const int kStateMagic = 'IPst';
+static const int kStateVersion = 2;
+static const int kStateHeaderSize = 4 * (int)sizeof(int);
+
+enum EStateFlags { kStateZlib = 1 };
+
+// Compress if the uncompressed state is at least this large.
+static const int kStateZlibMinSize = 1024;
+
+// Params block: (ID, index, size, Serialize() data) for each param that
+// isn't at its default. The ID is a hash of the param's name, so states
+// still load after params were inserted or reordered.
+static const int kStateParamsTag = 'prmi';
+// Params block of version 1: (index, size, Serialize() data).
+static const int kStateParamsByIndexTag = 'prms';
+
+static unsigned int GetStateParamID(const IParam* const pParam)
+{
+	const char* const name = pParam->GetNameForHost();
+	const WDL_UINT64 h = WDL_FNV64(WDL_FNV64_IV, (const unsigned char*)name, (int)strlen(name));
+	return (unsigned int)(h ^ (h >> 32));
+}
+
+static bool PutStateHeader(ByteChunk* const pChunk, const int flags, const int size, const int rawSize)
+{
+	return pChunk->PutInt32(kStateMagic) && pChunk->PutInt16(kStateVersion) && pChunk->PutInt16(flags) &&
+		pChunk->PutInt32(size) && pChunk->PutInt32(rawSize);
+}
+
+static bool IsTaggedState(const ByteChunk* const pChunk, const int startPos)
+{
+	int magic;
+	return pChunk->GetInt32(&magic, startPos) >= 0 && magic == kStateMagic;
+}
+
+// Overwrites an int that was put earlier.
+static void PatchInt32(ByteChunk* const pChunk, const int pos, const int n)
+{
+	const int endPos = pChunk->Resize(pos);
+	pChunk->PutInt32(n);
+	pChunk->Resize(endPos);
+}
+
+// zlib is built with Z_SOLO, so it has no default allocator.
+static voidpf ZAlloc(voidpf, const uInt items, const uInt size) { return malloc((size_t)items * size); }
+static void ZFree(voidpf, const voidpf p) { free(p); }
+
+// Returns the compressed size, or 0 on error.
+static int CompressState(const void* const pSrc, const int srcSize, WDL_HeapBuf* const pDest)
+{
+	z_stream z;
+	memset(&z, 0, sizeof(z));
+	z.zalloc = ZAlloc;
+	z.zfree = ZFree;
+	if (deflateInit(&z, Z_DEFAULT_COMPRESSION) != Z_OK) return 0;
+
+	int size = 0;
+	const int bound = (int)deflateBound(&z, (uLong)srcSize);
+	if (pDest->ResizeOK(bound, false))
+	{
+		z.next_in = (Bytef*)pSrc;
+		z.avail_in = (uInt)srcSize;
+		z.next_out = (Bytef*)pDest->Get();
+		z.avail_out = (uInt)bound;
+		if (deflate(&z, Z_FINISH) == Z_STREAM_END) size = (int)z.total_out;
+	}
+
+	deflateEnd(&z);
+	return size;
+}
+
+static bool UncompressState(const void* const pSrc, const int srcSize, void* const pDest, const int destSize)
+{
+	z_stream z;
+	memset(&z, 0, sizeof(z));
+	z.zalloc = ZAlloc;
+	z.zfree = ZFree;
+	if (inflateInit(&z) != Z_OK) return false;
+
+	z.next_in = (Bytef*)pSrc;
+	z.avail_in = (uInt)srcSize;
+	z.next_out = (Bytef*)pDest;
+	z.avail_out = (uInt)destSize;
+	const bool uncompressedOK = inflate(&z, Z_FINISH) == Z_STREAM_END && z.total_out == (uLong)destSize;
+
+	inflateEnd(&z);
+	return uncompressedOK;
+}
+
+void IPlugBase::StoreParamDefault(const IParam* const pParam)
+{
+	// Make room first, Serialize() doesn't grow the chunk.
+	const int pos = mParamDefaults.Size();
+	mParamDefaults.Resize(pos + pParam->Size());
+	mParamDefaults.Resize(pos);
+	pParam->Serialize(&mParamDefaults);
+}
+
+int IPlugBase::GetStateChunkSize() const
+{
+	const int nParams = NParams();
+	return kStateHeaderSize + 2 * (int)sizeof(int) + nParams * 7 + GetParamsChunkSize(0, nParams);
+}
+
 bool IPlugBase::SerializeState(ByteChunk* const pChunk)
 {
-	return SerializeParams(0, NParams(), pChunk);
+	const int startPos = pChunk->Size();
+	bool savedOK = PutStateHeader(pChunk, 0, 0, 0);
+
+	const int payloadPos = pChunk->Size();
+	savedOK = savedOK && pChunk->PutInt32(kStateParamsTag) && pChunk->PutInt32(0);
+
+	const int n = mParams.GetSize();
+	const char* const pDefaults = (const char*)mParamDefaults.GetBytes();
+	int defaultPos = 0;
+
+	for (int i = 0; i < n && savedOK; ++i)
+	{
+		const IParam* const pParam = mParams.Get(i);
+		const int size = pParam->Size();
+
+		const int entryPos = pChunk->Size();
+		savedOK = pChunk->PutInt32(GetStateParamID(pParam)) && pChunk->PutInt16(i) && pChunk->PutByte(size) && pParam->Serialize(pChunk);
+
+		// Leave out params at their default.
+		const char* const pData = (const char*)pChunk->GetBytes() + entryPos + 7;
+		if (savedOK && defaultPos + size <= mParamDefaults.Size() && !memcmp(pData, pDefaults + defaultPos, size))
+		{
+			pChunk->Resize(entryPos);
+		}
+		defaultPos += size;
+	}
+
+	if (!savedOK) return savedOK;
+
+	const int blockPos = payloadPos + 2 * (int)sizeof(int);
+	PatchInt32(pChunk, payloadPos + (int)sizeof(int), pChunk->Size() - blockPos);
+
+	const int rawSize = pChunk->Size() - payloadPos;
+	int size = rawSize, flags = 0;
+
+	if (rawSize >= kStateZlibMinSize)
+	{
+		WDL_HeapBuf buf;
+		const int zSize = CompressState((const char*)pChunk->GetBytes() + payloadPos, rawSize, &buf);
+		if (zSize > 0 && zSize < rawSize)
+		{
+			pChunk->Resize(payloadPos);
+			savedOK = !!pChunk->PutBytes(buf.Get(), zSize);
+			size = zSize;
+			flags = kStateZlib;
+		}
+	}
+
+	const int endPos = pChunk->Resize(startPos);
+	savedOK &= PutStateHeader(pChunk, flags, size, rawSize);
+	pChunk->Resize(endPos);
+
+	return savedOK;
 }
 
 int IPlugBase::UnserializeState(const ByteChunk* const pChunk, const int startPos)
 {
-	return UnserializeParams(0, NParams(), pChunk, startPos);
+	if (!IsTaggedState(pChunk, startPos)) return UnserializeParams(0, NParams(), pChunk, startPos);
+
+	const int n = NParams();
+	WDL_TypedBuf<int> paramPos;
+	paramPos.Resize(n, false);
+	if (paramPos.GetSize() != n) return -1;
+
+	ByteChunk raw;
+	const ByteChunk* pData;
+	const int endPos = ReadState(pChunk, startPos, &raw, &pData, paramPos.Get());
+	if (endPos < 0) return endPos;
+
+	// Params that aren't in the state are at their default.
+	int defaultPos = 0;
+	for (int i = 0; i < n; ++i)
+	{
+		IParam* const pParam = mParams.Get(i);
+		const int pos = paramPos.Get()[i];
+		if (pos >= 0) pParam->Unserialize(pData, pos);
+		else pParam->Unserialize(&mParamDefaults, defaultPos);
+		defaultPos += pParam->Size();
+	}
+
+	return endPos;
+}
+
+int IPlugBase::DecodeState(const ByteChunk* const pChunk, const int startPos, IPatch* const pPatch) const
+{
+	double* const pValues = pPatch->mValues.Get();
+	if (!IsTaggedState(pChunk, startPos)) return DecodeParams(0, NParams(), pChunk, startPos, pValues);
+
+	const int n = NParams();
+	WDL_TypedBuf<int> paramPos;
+	paramPos.Resize(n, false);
+	if (paramPos.GetSize() != n) return -1;
+
+	ByteChunk raw;
+	const ByteChunk* pData;
+	const int endPos = ReadState(pChunk, startPos, &raw, &pData, paramPos.Get());
+	if (endPos < 0) return endPos;
+
+	IParamBatch batch;
+	if (!batch.Resize(n)) return -1;
+
+	// Plain values, then normalized.
+	int defaultPos = 0;
+	for (int i = 0; i < n; ++i)
+	{
+		const IParam* const pParam = mParams.Get(i);
+		const int pos = paramPos.Get()[i];
+		if (pos >= 0) pParam->UnserializeValue(pData, pos, &pValues[i]);
+		else pParam->UnserializeValue(&mParamDefaults, defaultPos, &pValues[i]);
+		defaultPos += pParam->Size();
+	}
+
+	batch.ToNormalized(GetParams(), NULL, pValues, pValues, n);
+	return endPos;
+}
+
+int IPlugBase::ReadState(const ByteChunk* const pChunk, int pos, ByteChunk* const pRaw, const ByteChunk** const ppData, int* const pParamPos) const
+{
+	int magic, size, rawSize;
+	short version, flags;
+
+	pos = pChunk->GetInt32(&magic, pos);
+	pos = pChunk->GetInt16(&version, pos);
+	pos = pChunk->GetInt16(&flags, pos);
+	pos = pChunk->GetInt32(&size, pos);
+	pos = pChunk->GetInt32(&rawSize, pos);
+
+	// Newer versions can add blocks (which are skipped), but an unknown
+	// flag means the blocks can't be read.
+	if (pos < 0 || (flags & ~kStateZlib) || size < 0 || rawSize < 0 || pos + size > pChunk->Size()) return -1;
+	const int endPos = pos + size;
+
+	const ByteChunk* pData = pChunk;
+	int dataEndPos = endPos;
+
+	if (flags & kStateZlib)
+	{
+		if (pRaw->Alloc(rawSize) != rawSize) return -1;
+		if (!UncompressState((const char*)pChunk->GetBytes() + pos, size, pRaw->GetBytes(), rawSize)) return -1;
+
+		pRaw->Resize(rawSize);
+		pData = pRaw;
+		pos = 0;
+		dataEndPos = rawSize;
+	}
+
+	for (int i = 0; i < mParams.GetSize(); ++i) pParamPos[i] = -1;
+
+	while (pos >= 0 && pos < dataEndPos)
+	{
+		int tag, blockSize;
+		pos = pData->GetInt32(&tag, pos);
+		pos = pData->GetInt32(&blockSize, pos);
+		if (pos < 0 || blockSize < 0 || pos + blockSize > dataEndPos) return -1;
+
+		if (tag == kStateParamsTag || tag == kStateParamsByIndexTag)
+		{
+			if (ReadStateParams(pData, pos, pos + blockSize, tag == kStateParamsTag, pParamPos) < 0) return -1;
+		}
+		pos += blockSize;
+	}
+
+	*ppData = pData;
+	return pos >= 0 ? endPos : pos;
+}
+
+int IPlugBase::ReadStateParams(const ByteChunk* const pChunk, int pos, const int endPos, const bool byID, int* const pParamPos) const
+{
+	const int n = mParams.GetSize();
+
+	while (pos >= 0 && pos < endPos)
+	{
+		unsigned int id = 0;
+		unsigned short idx;
+		unsigned char size;
+		if (byID) pos = pChunk->Get(&id, pos);
+		pos = pChunk->Get(&idx, pos);
+		pos = pChunk->Get(&size, pos);
+		if (pos < 0 || pos + size > endPos) return -1;
+
+		// Match by ID, preferring the param at the same index (in case
+		// names aren't unique). Skip params that were removed, or that
+		// changed type.
+		int i = idx < n && (!byID || GetStateParamID(mParams.Get(idx)) == id) ? idx : -1;
+		for (int j = 0; byID && i < 0 && j < n; ++j)
+		{
+			if (GetStateParamID(mParams.Get(j)) == id) i = j;
+		}
+
+		if (i >= 0 && mParams.Get(i)->Size() == size) pParamPos[i] = pos;
+		pos += size;
+	}
+	return pos;
+}
+
+void IPlugBase::ApplyPatch(IPatch* const pPatch)
+{
+	const int n = wdl_min(NParams(), pPatch->mValues.GetSize());
+	const double* const pValues = mParamBatch.FromNormalized(GetParams(), NULL, pPatch->mValues.Get(), NULL, n);
+
+	for (int i = 0; i < n; ++i)
+	{
+		mParams.Get(i)->SetValue(pValues[i]);
+	}
+
+	mPatchQueue.Release(pPatch);
+
+	OnParamReset();
+	RedrawParamControls();
+}
+
+void IPlugBase::FlushPatchQueue()
+{
+	IPatch* const pPatch = mPatchQueue.Flush();
+	if (pPatch) ApplyPatch(pPatch);
+}
+
+void IPlugBase::ApplyMorph()
+{
+	const int n = mPresetMorph.Tick();
+	if (!n) return;
+
+	const int* const pIndexes = mPresetMorph.GetIndexes();
+	const double* const pNormalized = mPresetMorph.GetValues();
+	const double* const pValues = mParamBatch.FromNormalized(GetParams(), pIndexes, pNormalized, NULL, n);
+
+	for (int i = 0; i < n; ++i)
+	{
+		const int idx = pIndexes[i];
+		IParam* const pParam = mParams.Get(idx);
+
+		const int type = pParam->Type();
+		if (type == IParam::kTypeBool || type == IParam::kTypeInt || type == IParam::kTypeEnum)
+		{
+			// Stepped params only change once they snap to another step.
+			if (pParam->SetValue(pValues[i])) OnParamChange(idx);
+			continue;
+		}
+
+		// Straight to the smoother, or if not smoothed to OnParamSmooth(),
+		// without the OnParamChange() round trip.
+		const double v = pNormalized[i];
+		pParam->SetNormalized(v);
+
+		const double samples = mParamReset ? 0.0 : pParam->GetSmoothingTime() * 0.001 * mSampleRate;
+		if (!mParamSmoother.SetTarget(idx, v, samples, pParam->GetSmoothingCurve())) OnParamSmooth(idx, pValues[i]);
+	}
+
+	// The GUI catches up on its next timer tick.
+	mParamsChangedOnAudioThread = true;
+}
+
+void IPlugBase::SmoothParam(const int idx)
+{
+	const IParam* const pParam = mParams.Get(idx);
+	const double samples = mParamReset ? 0.0 : pParam->GetSmoothingTime() * 0.001 * mSampleRate;
+
+	double v = pParam->GetNormalized();
+	if (mParamSmoother.SetTarget(idx, v, samples, pParam->GetSmoothingCurve())) return;
+
+	IParam::FromNormalized(pParam->BatchClass(), &pParam, &v, &v, 1);
+	OnParamSmooth(idx, v);
+}
+
+void IPlugBase::TickParamSmoothing(const int nFrames)
+{
+	if (mParamSmoother.IsActive()) ApplySmoothing(mParamSmoother.Tick(nFrames));
+}
+
+void IPlugBase::SettleParamSmoothing()
+{
+	if (mParamSmoother.IsActive()) ApplySmoothing(mParamSmoother.Settle());
+}
+
+void IPlugBase::ApplySmoothing(const int n)
+{
+	const int* const pIndexes = mParamSmoother.GetIndexes();
+	const double* const pValues = mParamBatch.FromNormalized(GetParams(), pIndexes, mParamSmoother.GetValues(), NULL, n);
+
+	for (int i = 0; i < n; ++i)
+	{
+		OnParamSmooth(pIndexes[i], pValues[i]);
+	}
 }
 
 void IPlugBase::RedrawParamControls()
@@ -941,4 +1477,170 @@ void IPlugBase::DumpPresetSrcCode(const char* const paramEnumNames[], const char
 	IPlugDebugLog(str.Get());
 }
 
+static unsigned int StressRand(unsigned int* const pSeed)
+{
+	unsigned int x = *pSeed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *pSeed = x;
+}
+
+static int StressCompare(const void* const a, const void* const b)
+{
+	const double x = *(const double*)a, y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+void IPlugBase::StressTest(const int nBlocks, unsigned int seed)
+{
+	if (nBlocks <= 0) return;
+	if (!seed) seed = 1;
+
+	const int maxFrames = wdl_max(mBlockSize, 1);
+	const int nIn = NInChannels(), nOut = NOutChannels();
+
+	WDL_TypedBuf<double> buf;
+	double* const pBuf = buf.ResizeOK((nIn + nOut) * maxFrames);
+	WDL_TypedBuf<double*> ptrs;
+	double** const ppBuf = ptrs.ResizeOK(nIn + nOut);
+	WDL_TypedBuf<double> times;
+	double* const pTimes = times.ResizeOK(nBlocks);
+	if (!(pBuf && ppBuf && pTimes)) return;
+
+	memset(pBuf, 0, (nIn + nOut) * maxFrames * sizeof(double));
+	for (int i = 0; i < nIn + nOut; ++i) ppBuf[i] = pBuf + i * maxFrames;
+
+	ByteChunk savedState;
+	savedState.Alloc(wdl_max(GetStateChunkSize(), ByteChunk::kDefaultSize));
+
+	const int nParams = NParams();
+	const bool doesMidiIn = DoesMIDI(kPlugDoesMidiIn);
+
+	// Locked for the whole run, so the host's blocks can't interleave with
+	// the stress blocks (the host's audio callback waits until we're done).
+	mMutex.Enter();
+	SerializeState(&savedState);
+
+	#ifdef IPLUG_RT_SAFETY
+	const int nViolations = IRTSafety::GetThreadViolationCount();
+	#endif
+
+	double maxLoadTime = 0.0;
+
+	WDL_denormal_ftz_scope ftz;
+
+	for (int b = 0; b < nBlocks; ++b)
+	{
+		// 1 in 8 blocks is a single sample, otherwise anything up to the max.
+		const int nFrames = StressRand(&seed) & 7 ? (int)(StressRand(&seed) % (unsigned int)maxFrames) + 1 : 1;
+
+		// State load in mid-stream, same as the API classes (e.g.
+		// IPlugCLAP::ClapStateLoad()): decoded here, and swapped in by the
+		// next block. Loads the saved state, so after the automation below
+		// it actually changes the params.
+		if (!(b & 63))
+		{
+			const double loadTime = time_precise();
+
+			IPatch* const pPatch = mPatchQueue.Alloc(nParams);
+			if (pPatch && DecodeState(&savedState, 0, pPatch) >= 0) mPatchQueue.Publish(pPatch);
+
+			maxLoadTime = wdl_max(maxLoadTime, time_precise() - loadTime);
+		}
+
+		// Everything from here on would happen on the audio thread.
+		#ifdef IPLUG_RT_SAFETY
+		IRTSafety::EnterAudioThread();
+		#endif
+
+		const double startTime = time_precise();
+
+		// Automation on every param.
+		for (int i = 0; i < nParams; ++i)
+		{
+			GetParam(i)->SetNormalized((double)(StressRand(&seed) & 0xFFFF) / 65535.0);
+			OnParamChange(i);
+		}
+
+		// MIDI burst of up to 256 events.
+		if (doesMidiIn)
+		{
+			const int nEvents = (int)(StressRand(&seed) % 257);
+			for (int i = 0; i < nEvents; ++i)
+			{
+				const unsigned int r = StressRand(&seed);
+				static const int status[4] = { IMidiMsg::kNoteOn, IMidiMsg::kNoteOff, IMidiMsg::kControlChange, IMidiMsg::kPitchWheel };
+				const IMidiMsg msg((int)(r % (unsigned int)nFrames), 0x80 | (status[(r >> 16) & 3] << 4), (r >> 8) & 127, (r >> 24) & 127);
+				ProcessMidiMsg(&msg);
+			}
+		}
+
+		// Same path as the API classes, so with patch swap and fade, preset
+		// morph, and audio tap.
+		AttachInputBuffers(0, nIn, (const double* const*)ppBuf, nFrames);
+		AttachOutputBuffers(0, nOut, ppBuf + nIn);
+		ProcessBuffers((double)0.0, nFrames);
+
+		pTimes[b] = (time_precise() - startTime) * mSampleRate / (double)nFrames;
+
+		#ifdef IPLUG_RT_SAFETY
+		IRTSafety::LeaveAudioThread();
+		#endif
+	}
+
+	// Forget the voices and filter state of the stress run as well.
+	FlushPatchQueue();
+	Reset();
+	if (UnserializeState(&savedState, 0) >= 0) OnParamReset();
+	mDSPLoadMeter.RequestReset();
+
+	#ifdef IPLUG_RT_SAFETY
+	const int n = IRTSafety::GetThreadViolationCount() - nViolations;
+	#endif
+
+	mMutex.Leave();
+
+	qsort(pTimes, nBlocks, sizeof(double), StressCompare);
+	const double p999 = pTimes[(int)(0.999 * (double)(nBlocks - 1))], max = pTimes[nBlocks - 1];
+
+	DebugLog("StressTest: %d blocks, p99.9 %.1f%%, max %.1f%%, state load max %.2f ms", nBlocks, p999 * 100.0, max * 100.0, maxLoadTime * 1000.0);
+
+	#ifdef IPLUG_RT_SAFETY
+	if (n) DebugLog("StressTest: %d allocations/locks on the audio thread, see IRTSafety", n);
+	#endif
+}
+
+int IPlugBase::DumpMemoryFootprint()
+{
+	const int nParams = NParams();
+	const int paramBytes = nParams * (int)(sizeof(IParam*) + sizeof(IParam)) + mParamDefaults.AllocSize() + mParamSmoother.GetMemoryFootprint() + mParamBatch.GetMemoryFootprint();
+
+	const int nPresets = NPresets();
+	int presetBytes = nPresets * (int)(sizeof(IPreset*) + sizeof(IPreset));
+	for (int i = 0; i < nPresets; ++i)
+	{
+		const IPreset* const pPreset = mPresets.Get(i);
+		presetBytes += pPreset->mChunk.AllocSize() + pPreset->mName.GetLength();
+	}
+
+	int channelBytes = mInData.GetSize() * (int)sizeof(double*) + mOutData.GetSize() * (int)sizeof(double*);
+	for (int i = 0; i < mInChannels.GetSize(); ++i)
+	{
+		channelBytes += (int)sizeof(InChannel) + mInChannels.Get(i)->mScratchBuf.GetSize() * (int)sizeof(double);
+	}
+	for (int i = 0; i < mOutChannels.GetSize(); ++i)
+	{
+		channelBytes += (int)sizeof(OutChannel) + mOutChannels.Get(i)->mScratchBuf.GetSize() * (int)sizeof(double);
+	}
+
+	int graphicsBytes = 0, sharedBytes = 0;
+	if (mGraphics) mGraphics->GetMemoryFootprint(&graphicsBytes, &sharedBytes);
+
+	DebugLog("Memory: params %d (%d), presets %d (%d), channels %d", paramBytes, nParams, presetBytes, nPresets, channelBytes);
+	DebugLog("Memory: graphics %d, shared bitmap cache %d", graphicsBytes, sharedBytes);
+
+	return paramBytes + presetBytes + channelBytes + graphicsBytes;
+}
+
 #endif // NDEBUG
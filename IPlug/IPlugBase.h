@@ -1,11 +1,24 @@
 #pragma once
 
 #include "Containers.h"
+#include "IAudioTap.h"
+#include "IDSPLoadMeter.h"
+#include "IParamBatch.h"
+#include "IParamSmoother.h"
+#include "IPatchQueue.h"
+#include "IPresetMorph.h"
 #include "IPlugStructs.h"
 #include "IParam.h"
+#include "IRTSafety.h"
 
 #include <assert.h>
 
+// Process entry points use WDL_denormal_ftz_scope, which makes the
+// denormal_*() filters no-ops if FTZ is available.
+#ifndef WDL_DENORMAL_WANTS_SCOPED_FTZ
+	#define WDL_DENORMAL_WANTS_SCOPED_FTZ
+#endif
+#include "WDL/denormal.h"
 #include "WDL/mutex.h"
 #include "WDL/wdlstring.h"
 #include "WDL/wdltypes.h"
@@ -55,6 +68,8 @@ public:
 	// Mutex is already locked.
 	virtual void Reset() {} // Called (at least) once.
 	virtual void OnParamChange(int paramIdx) {}
+	// Smoothed plain value (see SmoothParam()), as IParam::FromNormalized().
+	virtual void OnParamSmooth(int paramIdx, double value) {}
 	virtual void OnPresetChange(int presetIdx) {}
 
 	// Default passthrough. Inputs and outputs are [nChannel][nSample].
@@ -97,10 +112,20 @@ public:
 	virtual bool SerializePreset(ByteChunk* pChunk);
 	// Returns the new chunk position (endPos).
 	virtual int UnserializePreset(const ByteChunk* pChunk, int startPos, int version = 0);
-
-	// By default serializes all (global + preset) parameters.
+	// Same as UnserializePreset(), but decodes into normalized values. If
+	// you override UnserializePreset(), then override this as well.
+	virtual int DecodePreset(const ByteChunk* pChunk, int startPos, double* pValues) const;
+
+	// By default serializes all (global + preset) parameters, tagged by
+	// name hash and index, and only if they differ from their defaults. Large states are
+	// zlib compressed. UnserializeState() also reads the untagged format
+	// of SerializeParams(), which older versions used.
 	virtual bool SerializeState(ByteChunk* pChunk);
 	virtual int UnserializeState(const ByteChunk* pChunk, int startPos);
+	// Same as UnserializeState(), but decodes into pPatch rather than into
+	// the params, so it's safe to call while processing. If you override
+	// UnserializeState(), then override this as well.
+	virtual int DecodeState(const ByteChunk* pChunk, int startPos, IPatch* pPatch) const;
 
 	// By default serializes global parameters, followed by each preset
 	// (in SerializePreset() format, but with extra info).
@@ -129,6 +154,7 @@ public:
 		}
 		#endif
 
+		StoreParamDefault(pParam);
 		return (T*)mParams.Add(pParam);
 	}
 
@@ -146,9 +172,46 @@ public:
 	bool RestorePreset(int idx = -1);
 	bool RestorePreset(const char* name);
 
+	// Loads preset data (in SerializePreset() format), e.g. from an
+	// IPresetBank. Decoded on the calling thread, and swapped in at the
+	// next block, like a CLAP state load.
+	bool LoadPreset(const void* pData, int size);
+	// Writes all presets to a bank file (see IPresetBank.h).
+	bool WritePresetBank(const char* path, const char* tags = NULL);
+
+	// Morphs between 2 or 4 presets (see IPresetMorph.h), or stops morphing
+	// if idxA < 0. Call again after changing any of these presets.
+	bool SetMorphPresets(int idxA, int idxB = -1, int idxC = -1, int idxD = -1);
+	// Can be called from any thread, applied at the start of the next block.
+	// Typically called from OnParamChange() for a global (so not in presets)
+	// morph param, so the host can automate it. OnParamReset() keeps the
+	// loaded values until the position moves again. Morphed continuous
+	// params go to OnParamSmooth() (ramped if smoothed, see SmoothParam()),
+	// stepped params to OnParamChange() when they reach another step.
+	inline void SetMorphPosition(const double x, const double y = 0.0) { mPresetMorph.SetPosition(x, y); }
+
+	// Param smoothing (see IParam::SetSmoothing() and IParamSmoother.h).
+	// Call from OnParamChange(), instead of applying the value. Ramps the
+	// value, which is then passed to OnParamSmooth() in TickParamSmoothing(),
+	// or calls OnParamSmooth() right away if the param isn't smoothed, or if
+	// all params are being reset (e.g. state load).
+	void SmoothParam(int idx);
+	// Audio thread. Advances all ramps by nFrames (see
+	// IParamSmoother::kBlockSize), and calls OnParamSmooth() for each.
+	void TickParamSmoothing(int nFrames);
+	// Jumps to the end of all ramps, e.g. in Reset().
+	void SettleParamSmoothing();
+	inline bool ParamsAreSmoothing() const { return mParamSmoother.IsActive(); }
+
 	inline int GetPresetChunkSize() const { return mPresetChunkSize; }
 
 	inline WDL_Mutex* GetMutex() { return &mMutex; }
+	// Can be read without locking the mutex.
+	inline IDSPLoadMeter* GetDSPLoadMeter() { return &mDSPLoadMeter; }
+	inline IAudioTap* GetAudioTap() { return &mAudioTap; }
+
+	// Output fade out/in around state loads while processing (0 = off).
+	inline void SetPatchFade(const double ms) { mPatchQueue.SetFade(ms); }
 	inline IGraphics* GetGUI() const { return mGraphics; }
 
 	const char* GetEffectName() const { return mEffectName.Get(); }
@@ -174,6 +237,15 @@ public:
 	void OnParamReset(); // Calls OnParamChange(each param).
 	void RedrawParamControls(); // Called after restoring state.
 
+	// True (once) if the audio thread changed params without updating the
+	// controls (see ApplyMorph()). Polled by IGraphics::IsDirty().
+	inline bool TakeParamsChangedOnAudioThread()
+	{
+		if (!mParamsChangedOnAudioThread) return false;
+		mParamsChangedOnAudioThread = false;
+		return true;
+	}
+
 	// If a parameter change comes from the GUI, midi, or external input,
 	// the host needs to be informed in case the changes are being automated.
 	virtual void BeginInformHostOfParamChange(int idx, bool lockMutex = true) = 0;
@@ -247,6 +319,22 @@ public:
 	static inline void DebugLog(const char*, ...) {}
 	#endif
 
+	#ifndef NDEBUG
+	// Runs the plugin core with random block sizes (up to the current block
+	// size), MIDI bursts, automation on every param, and mid-stream state
+	// loads (through the patch queue), and logs the p99.9 and max block
+	// load, and the max state load (decode) time. Restores the state, and
+	// calls Reset(), afterwards. Keeps the mutex locked for the whole run,
+	// so the host's processing stalls while it runs. Mutex should NOT be
+	// locked.
+	void StressTest(int nBlocks = 10000, unsigned int seed = 1);
+
+	// Logs an estimate of the heap used by this instance per category, and
+	// returns the total in bytes (not including caches that are shared by
+	// all instances). API and plugin classes add their own buffers.
+	virtual int DumpMemoryFootprint();
+	#endif
+
 protected:
 	// ----------------------------------------
 	// Useful stuff for your plugin class to call, implemented here or in the API class, or partly in both.
@@ -342,11 +430,33 @@ protected:
 	}
 
 	int GetParamsChunkSize(const int fromIdx, const int toIdx) const;
+	// Returns max chunk size that SerializeState() will need.
+	int GetStateChunkSize() const;
 
 	// Will append if the chunk is already started.
 	bool SerializeParams(int fromIdx, int toIdx /* up to but *not* including */, ByteChunk* pChunk) const;
 	// Returns the new chunk position (endPos).
 	int UnserializeParams(int fromIdx, int toIdx, const ByteChunk* pChunk, int startPos);
+	// Decodes into normalized values, without changing the params.
+	int DecodeParams(int fromIdx, int toIdx, const ByteChunk* pChunk, int startPos, double* pValues) const;
+
+	// Reads a tagged state without changing the params, uncompressing it
+	// into pRaw if needed. Sets *ppData to the chunk with the param data,
+	// and pParamPos[i] to the position of param i in it, or to -1 if it
+	// isn't in the state (so it's at its default). Returns the new chunk
+	// position (endPos).
+	int ReadState(const ByteChunk* pChunk, int startPos, ByteChunk* pRaw, const ByteChunk** ppData, int* pParamPos) const;
+	int ReadStateParams(const ByteChunk* pChunk, int startPos, int endPos, bool byID, int* pParamPos) const;
+	void StoreParamDefault(const IParam* pParam);
+
+	// Sets all params from pPatch, and releases it.
+	void ApplyPatch(IPatch* pPatch);
+	// Applies a queued patch right away. Call when not processing.
+	void FlushPatchQueue();
+	// Sets (only) the params changed by the preset morph, and flags the GUI.
+	void ApplyMorph();
+	// Calls OnParamSmooth() for the smoother's output.
+	void ApplySmoothing(int n);
 
 	// ----------------------------------------
 	// Internal IPlug stuff (but API classes need to get at it).
@@ -372,7 +482,7 @@ protected:
 
 	void AttachInputBuffers(int idx, int n, const double* const* ppData, int nFrames);
 	void AttachOutputBuffers(int idx, int n, double* const* ppData);
-	void ProcessBuffers(double /* sampleType */, const int nFrames) { ProcessDoubleReplacing(mInData.Get(), mOutData.Get(), nFrames); }
+	void ProcessBuffers(double /* sampleType */, const int nFrames) { ProcessDoubleReplacingMetered(nFrames); }
 	void PassThroughBuffers(double /* sampleType */, const int nFrames) { ProcessDoubleReplacing(mInData.Get(), mOutData.Get(), nFrames); }
 	void AttachInputBuffers(int idx, int n, const float* const* ppData, int nFrames);
 	void AttachOutputBuffers(int idx, int n, float* const* ppData);
@@ -380,7 +490,23 @@ protected:
 	void ProcessBuffersAccumulating(float /* sampleType */, int nFrames);
 	void PassThroughBuffers(float /* sampleType */, int nFrames);
 
+	inline void ProcessDoubleReplacingMetered(const int nFrames)
+	{
+		mDSPLoadMeter.BeginBlock();
+
+		IPatch* const pPatch = mPatchQueue.BeginBlock(mSampleRate);
+		if (pPatch) ApplyPatch(pPatch);
+		if (mPresetMorph.IsActive()) ApplyMorph();
+
+		ProcessDoubleReplacing(mInData.Get(), mOutData.Get(), nFrames);
+		mPatchQueue.EndBlock(mOutData.Get(), NOutChannels(), nFrames);
+
+		mDSPLoadMeter.EndBlock(nFrames, mSampleRate);
+		mAudioTap.Write(mOutData.Get(), NOutChannels(), nFrames);
+	}
+
 	WDL_PtrList_DeleteOnDestroy<IParam> mParams;
+	ByteChunk mParamDefaults; // Serialized, see StoreParamDefault().
 	WDL_PtrList_DeleteOnDestroy<IPreset> mPresets;
 	int mCurrentPresetIdx, mParamChangeIdx;
 
@@ -397,6 +523,15 @@ protected:
 
 	IGraphics* mGraphics;
 
+	IDSPLoadMeter mDSPLoadMeter;
+	IAudioTap mAudioTap;
+	IPatchQueue mPatchQueue;
+	IPresetMorph mPresetMorph;
+	IParamSmoother mParamSmoother;
+	IParamBatch mParamBatch; // For ApplyPatch(), ApplyMorph(), and ApplySmoothing().
+	bool mParamReset;
+	volatile bool mParamsChangedOnAudioThread;
+
 	WDL_TypedBuf<const double*> mInData;
 	WDL_TypedBuf<double*> mOutData;
 
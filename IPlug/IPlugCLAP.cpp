@@ -1,7 +1,11 @@
 #include "IPlugCLAP.h"
 #include "IGraphics.h"
+#include "IPresetBank.h"
+#include "IValueText.h"
 
-#ifdef __APPLE__
+#ifdef _WIN32
+	#include "IGraphicsWin.h"
+#elif defined(__APPLE__)
 	#include "IGraphicsMac.h"
 #endif
 
@@ -17,8 +21,19 @@ uint32_t CLAP_ABI ClapFactoryGetPluginCount(const clap_plugin_factory* pFactory)
 const clap_plugin_descriptor* CLAP_ABI ClapFactoryGetPluginDescriptor(const clap_plugin_factory* pFactory, uint32_t index);
 const clap_plugin* CLAP_ABI ClapFactoryCreatePlugin(const clap_plugin_factory* pFactory, const clap_host* pHost, const char* id);
 
+uint32_t CLAP_ABI ClapPresetDiscoveryCount(const clap_preset_discovery_factory* pFactory);
+const clap_preset_discovery_provider_descriptor* CLAP_ABI ClapPresetDiscoveryGetDescriptor(const clap_preset_discovery_factory* pFactory, uint32_t index);
+const clap_preset_discovery_provider* CLAP_ABI ClapPresetDiscoveryCreate(const clap_preset_discovery_factory* pFactory, const clap_preset_discovery_indexer* pIndexer, const char* id);
+
 } // extern "C"
 
+// Editor size limits, relative to the full scale GUI size.
+static const double kMinGUIScale = 0.25, kMaxGUIScale = 2.0;
+
+// As passed to clap_entry.init(): the plugin binary on Windows, the bundle
+// on macOS.
+static WDL_String sClapEntryPath;
+
 static const char* const sClapWindowAPI =
 #ifdef _WIN32
 	CLAP_WINDOW_API_WIN32;
@@ -124,7 +139,7 @@ IPlugBase(
 
 bool IPlugCLAP::AllocStateChunk(int chunkSize)
 {
-	if (chunkSize < 0) chunkSize = GetParamsChunkSize(0, NParams());
+	if (chunkSize < 0) chunkSize = GetStateChunkSize();
 	return mState.Alloc(chunkSize) == chunkSize;
 }
 
@@ -214,6 +229,17 @@ void IPlugCLAP::ResizeGraphics(const int w, const int h)
 	}
 }
 
+#ifndef NDEBUG
+int IPlugCLAP::DumpMemoryFootprint()
+{
+	const int bytes = mState.AllocSize() + mParamChanges.GetSize() * (int)sizeof(unsigned int) +
+		mMidiOut.GetSize() * (int)sizeof(IMidiMsg) + mSysExBuf.GetSize();
+
+	DebugLog("Memory: CLAP state/events %d", bytes);
+	return IPlugBase::DumpMemoryFootprint() + bytes;
+}
+#endif
+
 bool IPlugCLAP::SendMidiMsg(const IMidiMsg* const pMsg)
 {
 	mMutex.Enter();
@@ -499,6 +525,12 @@ void IPlugCLAP::PushMidiMsgs(const clap_output_events* const pOutEvents, const I
 	}
 }
 
+bool CLAP_ABI IPlugCLAP::ClapEntryInit(const char* const path)
+{
+	sClapEntryPath.Set(path ? path : "");
+	return true;
+}
+
 const void* CLAP_ABI IPlugCLAP::ClapEntryGetFactory(const char* const id)
 {
 	static const clap_plugin_factory factory =
@@ -508,7 +540,17 @@ const void* CLAP_ABI IPlugCLAP::ClapEntryGetFactory(const char* const id)
 		ClapFactoryCreatePlugin
 	};
 
-	return !strcmp(id, CLAP_PLUGIN_FACTORY_ID) ? &factory : NULL;
+	static const clap_preset_discovery_factory presetDiscoveryFactory =
+	{
+		ClapPresetDiscoveryCount,
+		ClapPresetDiscoveryGetDescriptor,
+		ClapPresetDiscoveryCreate
+	};
+
+	if (!strcmp(id, CLAP_PLUGIN_FACTORY_ID)) return &factory;
+	if (!strcmp(id, CLAP_PRESET_DISCOVERY_FACTORY_ID)) return &presetDiscoveryFactory;
+
+	return NULL;
 }
 
 bool CLAP_ABI IPlugCLAP::ClapInit(const clap_plugin* const pPlug)
@@ -600,6 +642,7 @@ void CLAP_ABI IPlugCLAP::ClapStopProcessing(const clap_plugin* const pPlug)
 	if (flags & kPlugFlagsActive)
 	{
 		_this->mPlugFlags = flags & ~kPlugFlagsActive;
+		_this->FlushPatchQueue();
 		_this->OnActivate(false);
 	}
 
@@ -620,6 +663,8 @@ clap_process_status CLAP_ABI IPlugCLAP::ClapProcess(const clap_plugin* const pPl
 {
 	IPlugCLAP* const _this = (IPlugCLAP*)pPlug->plugin_data;
 	_this->mMutex.Enter();
+	IPLUG_RT_SAFETY_SCOPE
+	WDL_denormal_ftz_scope ftz;
 
 	const uint32_t nFrames = pProcess->frames_count;
 	const clap_event_transport* const pTransport = pProcess->transport;
@@ -806,6 +851,16 @@ const void* CLAP_ABI IPlugCLAP::ClapGetExtension(const clap_plugin* const pPlug,
 		return &gui;
 	}
 
+	if (!strcmp(id, CLAP_EXT_PRESET_LOAD))
+	{
+		static const clap_plugin_preset_load presetLoad =
+		{
+			ClapPresetLoadFromLocation
+		};
+
+		return &presetLoad;
+	}
+
 	return NULL;
 }
 
@@ -868,11 +923,11 @@ bool CLAP_ABI IPlugCLAP::ClapParamsGetValue(const clap_plugin* const pPlug, cons
 	IPlugCLAP* const _this = (IPlugCLAP*)pPlug->plugin_data;
 	if (!_this->NParams(idx)) return false;
 
-	_this->mMutex.Enter();
-
+	// Hosts poll this a lot, so don't wait for the audio thread. Each param
+	// value is a single aligned word, which is only ever written with a
+	// single store (state loads too, see ApplyPatch()), so it can be read
+	// without locking.
 	*pValue = GetParamValue(_this->GetParam(idx));
-
-	_this->mMutex.Leave();
 	return true;
 }
 
@@ -881,8 +936,8 @@ bool CLAP_ABI IPlugCLAP::ClapParamsValueToText(const clap_plugin* const pPlug, c
 	IPlugCLAP* const _this = (IPlugCLAP*)pPlug->plugin_data;
 	if (!_this->NParams(idx)) return false;
 
-	_this->mMutex.Enter();
-
+	// Only depends on the value passed in, and on param properties that
+	// don't change after construction, so no locking.
 	IParam* const pParam = _this->GetParam(idx);
 	double v = value;
 
@@ -902,15 +957,8 @@ bool CLAP_ABI IPlugCLAP::ClapParamsValueToText(const clap_plugin* const pPlug, c
 	}
 
 	pParam->GetDisplayForHost(v, buf, bufSize);
-	const char* const label = pParam->GetLabelForHost();
-
-	if (label && *label)
-	{
-		lstrcatn(buf, " ", bufSize);
-		lstrcatn(buf, label, bufSize);
-	}
+	IValueText::AppendLabel(buf, bufSize, (int)strlen(buf), pParam->GetLabelForHost());
 
-	_this->mMutex.Leave();
 	return true;
 }
 
@@ -919,20 +967,12 @@ bool CLAP_ABI IPlugCLAP::ClapParamsTextToValue(const clap_plugin* const pPlug, c
 	IPlugCLAP* const _this = (IPlugCLAP*)pPlug->plugin_data;
 	if (!_this->NParams(idx)) return false;
 
-	_this->mMutex.Enter();
-
+	// No locking, see ClapParamsValueToText().
 	const IParam* const pParam = _this->GetParam(idx);
 	double v;
 
 	const int type = pParam->Type();
-	const bool mapped = pParam->MapDisplayText(str, &v);
-
-	if (!mapped)
-	{
-		v = strtod(str, NULL);
-		if (pParam->DisplayIsNegated()) v = -v;
-		v = pParam->GetNormalized(v);
-	}
+	if (!pParam->FromDisplayText(str, &v)) return false;
 
 	if (type == IParam::kTypeEnum)
 	{
@@ -940,8 +980,6 @@ bool CLAP_ABI IPlugCLAP::ClapParamsTextToValue(const clap_plugin* const pPlug, c
 	}
 
 	*pValue = v;
-
-	_this->mMutex.Leave();
 	return true;
 }
 
@@ -976,8 +1014,13 @@ bool CLAP_ABI IPlugCLAP::ClapStateSave(const clap_plugin* const pPlug, const cla
 
 	if (ok)
 	{
-		pChunk->Clear();
-		ok = _this->SerializeState(pChunk);
+		// If a loaded state is still waiting to be swapped in, then save
+		// that rather than the current params.
+		if (!_this->mPatchQueue.Busy())
+		{
+			pChunk->Clear();
+			ok = _this->SerializeState(pChunk);
+		}
 
 		const void* const pData = pChunk->GetBytes();
 		const int64_t size = pChunk->Size();
@@ -992,42 +1035,56 @@ bool CLAP_ABI IPlugCLAP::ClapStateSave(const clap_plugin* const pPlug, const cla
 bool CLAP_ABI IPlugCLAP::ClapStateLoad(const clap_plugin* const pPlug, const clap_istream* const pStream)
 {
 	IPlugCLAP* const _this = (IPlugCLAP*)pPlug->plugin_data;
-	_this->mMutex.Enter();
 
+	// Read and decode without locking, so processing continues meanwhile.
+	// Load and save are main thread only, so they don't share mState.
 	ByteChunk* const pChunk = &_this->mState;
+	pChunk->Clear();
 
-	const int maxSize = pChunk->AllocSize();
+	// The host may return less than asked for, so read until the end of
+	// the stream, growing the chunk if the state is larger than expected
+	// (e.g. saved by a newer version).
 	bool ok = true;
-
-	if (pChunk->Size() < maxSize)
+	for (;;)
 	{
-		pChunk->Resize(maxSize);
-		ok = pChunk->Size() == maxSize;
+		const int pos = pChunk->Size();
+		int allocSize = pChunk->AllocSize();
+		if (pos == allocSize) allocSize = wdl_max(allocSize * 2, (int)ByteChunk::kDefaultSize);
+
+		pChunk->Resize(allocSize);
+		ok = pChunk->Size() == allocSize;
+		if (!ok) break;
+
+		const int64_t size = pStream->read(pStream, (char*)pChunk->GetBytes() + pos, (uint64_t)(allocSize - pos));
+		ok = size >= 0;
+
+		pChunk->Resize(pos + (ok ? (int)size : 0));
+		if (size <= 0) break;
 	}
 
+	IPatch* pPatch = NULL;
+
 	if (ok)
 	{
-		const int64_t size = pStream->read(pStream, pChunk->GetBytes(), maxSize);
-		ok = size >= 0;
-
-		if (ok)
-		{
-			pChunk->Resize((int)size);
-			ok = pChunk->Size() == size;
-		}
+		pPatch = _this->mPatchQueue.Alloc(_this->NParams());
+		ok = pPatch && _this->DecodeState(pChunk, 0, pPatch) >= 0;
 	}
 
 	if (ok)
 	{
-		const int pos = _this->UnserializeState(pChunk, 0);
-		ok = pos >= 0;
+		// The audio thread swaps it in at the next block, or if it isn't
+		// processing, then apply it right away (ClapStopProcessing() also
+		// flushes, in case it stops after this check).
+		_this->mPatchQueue.Publish(pPatch);
 
-		_this->OnParamReset();
+		if (!(_this->mPlugFlags & kPlugFlagsActive))
+		{
+			_this->mMutex.Enter();
+			if (!(_this->mPlugFlags & kPlugFlagsActive)) _this->FlushPatchQueue();
+			_this->mMutex.Leave();
+		}
 	}
 
-	if (ok) _this->RedrawParamControls();
-
-	_this->mMutex.Leave();
 	return ok;
 }
 
@@ -1208,6 +1265,30 @@ void CLAP_ABI IPlugCLAP::ClapGUIDestroy(const clap_plugin* const pPlug)
 	_this->mGUIWidth = _this->mGUIHeight = 0;
 }
 
+bool CLAP_ABI IPlugCLAP::ClapGUISetScale(const clap_plugin* const pPlug, const double scale)
+{
+	#ifdef _WIN32
+	IPlugCLAP* const _this = (IPlugCLAP*)pPlug->plugin_data;
+	_this->mMutex.Enter();
+
+	IGraphicsWin* const pGraphics = (IGraphicsWin*)_this->GetGUI();
+	bool ret = false;
+
+	// Takes effect when the window is (re)opened.
+	if (pGraphics && scale > 0.0)
+	{
+		pGraphics->ForceDPI((int)(scale * (double)USER_DEFAULT_SCREEN_DPI + 0.5));
+		ret = true;
+	}
+
+	_this->mMutex.Leave();
+	return ret;
+	#else
+	// Cocoa uses logical points, and handles the backing scale itself.
+	return false;
+	#endif
+}
+
 bool CLAP_ABI IPlugCLAP::ClapGUIGetSize(const clap_plugin* const pPlug, uint32_t* const pWidth, uint32_t* const pHeight)
 {
 	IPlugCLAP* const _this = (IPlugCLAP*)pPlug->plugin_data;
@@ -1230,6 +1311,15 @@ bool CLAP_ABI IPlugCLAP::ClapGUIGetSize(const clap_plugin* const pPlug, uint32_t
 
 			w = pGraphics->Width() >> scale;
 			h = pGraphics->Height() >> scale;
+
+			#ifdef _WIN32
+			const int dpi = ((const IGraphicsWin*)pGraphics)->GetForcedDPI();
+			if (dpi)
+			{
+				w = MulDiv(pGraphics->Width(), dpi, USER_DEFAULT_SCREEN_DPI * 2);
+				h = MulDiv(pGraphics->Height(), dpi, USER_DEFAULT_SCREEN_DPI * 2);
+			}
+			#endif
 		}
 
 		*pWidth = w;
@@ -1242,6 +1332,71 @@ bool CLAP_ABI IPlugCLAP::ClapGUIGetSize(const clap_plugin* const pPlug, uint32_t
 	return ret;
 }
 
+bool CLAP_ABI IPlugCLAP::ClapGUICanResize(const clap_plugin* const pPlug)
+{
+	#ifdef _WIN32
+	const IPlugCLAP* const _this = (const IPlugCLAP*)pPlug->plugin_data;
+	return !!_this->GetGUI();
+	#else
+	return false;
+	#endif
+}
+
+bool CLAP_ABI IPlugCLAP::ClapGUIGetResizeHints(const clap_plugin* const pPlug, clap_gui_resize_hints* const pHints)
+{
+	const IPlugCLAP* const _this = (const IPlugCLAP*)pPlug->plugin_data;
+	const IGraphics* const pGraphics = _this->GetGUI();
+	if (!pGraphics || !ClapGUICanResize(pPlug)) return false;
+
+	pHints->can_resize_horizontally = true;
+	pHints->can_resize_vertically = true;
+	pHints->preserve_aspect_ratio = true;
+	pHints->aspect_ratio_width = pGraphics->Width();
+	pHints->aspect_ratio_height = pGraphics->Height();
+
+	return true;
+}
+
+bool CLAP_ABI IPlugCLAP::ClapGUIAdjustSize(const clap_plugin* const pPlug, uint32_t* const pWidth, uint32_t* const pHeight)
+{
+	const IPlugCLAP* const _this = (const IPlugCLAP*)pPlug->plugin_data;
+	const IGraphics* const pGraphics = _this->GetGUI();
+	if (!pGraphics || !ClapGUICanResize(pPlug)) return false;
+
+	// Largest size that fits, with the GUI aspect ratio.
+	const double w = (double)pGraphics->Width();
+	const double h = (double)pGraphics->Height();
+
+	double scale = wdl_min((double)*pWidth / w, (double)*pHeight / h);
+	scale = wdl_max(wdl_min(scale, kMaxGUIScale), kMinGUIScale);
+
+	*pWidth = (uint32_t)(w * scale + 0.5);
+	*pHeight = (uint32_t)(h * scale + 0.5);
+
+	return true;
+}
+
+bool CLAP_ABI IPlugCLAP::ClapGUISetSize(const clap_plugin* const pPlug, const uint32_t width, const uint32_t height)
+{
+	IPlugCLAP* const _this = (IPlugCLAP*)pPlug->plugin_data;
+	_this->mMutex.Enter();
+
+	IGraphics* const pGraphics = _this->GetGUI();
+	bool ret = false;
+
+	// If the window isn't open, then ClapGUIShow() will apply the size.
+	if (pGraphics && ClapGUICanResize(pPlug) &&
+		(!pGraphics->WindowIsOpen() || pGraphics->SetWindowSize((int)width, (int)height)))
+	{
+		_this->mGUIWidth = (int)width;
+		_this->mGUIHeight = (int)height;
+		ret = true;
+	}
+
+	_this->mMutex.Leave();
+	return ret;
+}
+
 bool CLAP_ABI IPlugCLAP::ClapGUISetParent(const clap_plugin* const pPlug, const clap_window* const pWindow)
 {
 	IPlugCLAP* const _this = (IPlugCLAP*)pPlug->plugin_data;
@@ -1257,8 +1412,18 @@ bool CLAP_ABI IPlugCLAP::ClapGUIShow(const clap_plugin* const pPlug)
 	IGraphics* const pGraphics = _this->GetGUI();
 	bool ret = false;
 
+	const int w = _this->mGUIWidth, h = _this->mGUIHeight;
+
 	if (pGraphics && (pGraphics->WindowIsOpen() || pGraphics->OpenWindow(_this->mGUIParent)))
 	{
+		// Restore the size set by the host, OpenWindow() may have changed it.
+		if (w && h && pGraphics->SetWindowSize(w, h))
+		{
+			if (w != _this->mGUIWidth || h != _this->mGUIHeight) _this->ResizeGraphics(w, h);
+			_this->mGUIWidth = w;
+			_this->mGUIHeight = h;
+		}
+
 		_this->OnGUIOpen();
 		ret = true;
 	}
@@ -1285,3 +1450,176 @@ bool CLAP_ABI IPlugCLAP::ClapGUIHide(const clap_plugin* const pPlug)
 	_this->mMutex.Leave();
 	return ret;
 }
+
+bool CLAP_ABI IPlugCLAP::ClapPresetLoadFromLocation(const clap_plugin* const pPlug, const uint32_t locationKind, const char* const location, const char* const loadKey)
+{
+	IPlugCLAP* const _this = (IPlugCLAP*)pPlug->plugin_data;
+
+	// Load key is the preset index in the bank, see IPresetProviderCLAP.
+	IPresetBank bank;
+	const void* pData = NULL;
+	int size = 0;
+
+	if (locationKind == CLAP_PRESET_DISCOVERY_LOCATION_FILE && location && bank.Open(location))
+	{
+		const int idx = loadKey ? atoi(loadKey) : 0;
+		pData = bank.GetData(idx, &size);
+	}
+
+	const bool loadedOK = pData && _this->LoadPreset(pData, size);
+
+	const clap_host* const pHost = _this->mClapHost;
+	const clap_host_preset_load* const pHostPresetLoad = (const clap_host_preset_load*)pHost->get_extension(pHost, CLAP_EXT_PRESET_LOAD);
+	if (pHostPresetLoad)
+	{
+		if (loadedOK)
+			pHostPresetLoad->loaded(pHost, locationKind, location, loadKey);
+		else
+			pHostPresetLoad->on_error(pHost, locationKind, location, loadKey, 0, pData ? "Invalid preset" : "Preset not found");
+	}
+
+	return loadedOK;
+}
+
+const clap_preset_discovery_provider* IPresetProviderCLAP::Create(
+	const clap_preset_discovery_provider_descriptor* const pDesc,
+	const clap_preset_discovery_indexer* const pIndexer,
+	const char* const mfrName,
+	const char* const plugName,
+	const char* const plugID
+)
+{
+	IPresetProviderCLAP* const _this = new IPresetProviderCLAP;
+	if (!_this) return NULL;
+
+	_this->mProvider.desc = pDesc;
+	_this->mProvider.provider_data = _this;
+	_this->mProvider.init = ClapInit;
+	_this->mProvider.destroy = ClapDestroy;
+	_this->mProvider.get_metadata = ClapGetMetadata;
+	_this->mProvider.get_extension = ClapGetExtension;
+
+	// Not allowed to call back into the indexer before init().
+	_this->mIndexer = pIndexer;
+
+	IPresetLibrary::DefaultPath(&_this->mPath, mfrName, plugName);
+	GetFactoryBankPath(&_this->mFactoryPath);
+	_this->mPlugName.Set(plugName);
+	_this->mPlugID = plugID;
+
+	return &_this->mProvider;
+}
+
+bool IPresetProviderCLAP::GetFactoryBankPath(WDL_String* const pPath)
+{
+	pPath->Set(sClapEntryPath.Get());
+	if (!pPath->GetLength()) return false;
+
+	#ifdef _WIN32
+	pPath->remove_fileext();
+	pPath->Append("." IPRESETBANK_EXT);
+	#elif defined(__APPLE__)
+	pPath->Append("/Contents/Resources/" IPRESETBANK_FACTORY "." IPRESETBANK_EXT);
+	#endif
+
+	return true;
+}
+
+bool CLAP_ABI IPresetProviderCLAP::ClapInit(const clap_preset_discovery_provider* const pProvider)
+{
+	const IPresetProviderCLAP* const _this = (const IPresetProviderCLAP*)pProvider->provider_data;
+	const clap_preset_discovery_indexer* const pIndexer = _this->mIndexer;
+
+	const clap_preset_discovery_filetype fileType =
+	{
+		"Preset bank",
+		NULL,
+		IPRESETBANK_EXT
+	};
+
+	if (!pIndexer->declare_filetype(pIndexer, &fileType)) return false;
+
+	// Only read here, if it wasn't installed then there just are no
+	// factory presets.
+	IPresetBank bank;
+	if (*_this->mFactoryPath.Get() && bank.Open(_this->mFactoryPath.Get()))
+	{
+		const clap_preset_discovery_location factoryLocation =
+		{
+			CLAP_PRESET_DISCOVERY_IS_FACTORY_CONTENT,
+			_this->mPlugName.Get(),
+			CLAP_PRESET_DISCOVERY_LOCATION_FILE,
+			_this->mFactoryPath.Get()
+		};
+
+		pIndexer->declare_location(pIndexer, &factoryLocation);
+	}
+	bank.Close();
+
+	if (*_this->mPath.Get())
+	{
+		const clap_preset_discovery_location userLocation =
+		{
+			CLAP_PRESET_DISCOVERY_IS_USER_CONTENT,
+			_this->mPlugName.Get(),
+			CLAP_PRESET_DISCOVERY_LOCATION_FILE,
+			_this->mPath.Get()
+		};
+
+		pIndexer->declare_location(pIndexer, &userLocation);
+	}
+
+	return true;
+}
+
+void CLAP_ABI IPresetProviderCLAP::ClapDestroy(const clap_preset_discovery_provider* const pProvider)
+{
+	IPresetProviderCLAP* const _this = (IPresetProviderCLAP*)pProvider->provider_data;
+	delete _this;
+}
+
+bool CLAP_ABI IPresetProviderCLAP::ClapGetMetadata(const clap_preset_discovery_provider* const pProvider, const uint32_t locationKind, const char* const location, const clap_preset_discovery_metadata_receiver* const pReceiver)
+{
+	const IPresetProviderCLAP* const _this = (const IPresetProviderCLAP*)pProvider->provider_data;
+
+	IPresetBank bank;
+	if (locationKind != CLAP_PRESET_DISCOVERY_LOCATION_FILE || !location || !bank.Open(location))
+	{
+		pReceiver->on_error(pReceiver, 0, "Invalid preset bank");
+		return false;
+	}
+
+	const bool isFactory = !strcmp(location, _this->mFactoryPath.Get());
+
+	const clap_plugin_id plugID = { "clap", _this->mPlugID };
+
+	const int n = bank.NPresets();
+	for (int i = 0; i < n; ++i)
+	{
+		char loadKey[16];
+		snprintf(loadKey, sizeof(loadKey), "%d", i);
+		if (!pReceiver->begin_preset(pReceiver, bank.GetName(i), loadKey)) break;
+
+		pReceiver->add_plugin_id(pReceiver, &plugID);
+		if (isFactory) pReceiver->set_flags(pReceiver, CLAP_PRESET_DISCOVERY_IS_FACTORY_CONTENT);
+
+		// Tags are comma separated, add each as a feature.
+		const char* p = bank.GetTags(i);
+		while (*p)
+		{
+			while (*p == ' ' || *p == ',') ++p;
+			const char* const pStart = p;
+			while (*p && *p != ',') ++p;
+
+			int len = (int)(p - pStart);
+			while (len > 0 && pStart[len - 1] == ' ') --len;
+			if (!len) continue;
+
+			char feature[256];
+			lstrcpyn_safe(feature, pStart, wdl_min(len + 1, (int)sizeof(feature)));
+			pReceiver->add_feature(pReceiver, feature);
+		}
+	}
+
+	return true;
+}
@@ -4,6 +4,7 @@
 #include "clap/clap.h"
 
 #include "WDL/heapbuf.h"
+#include "WDL/wdlstring.h"
 #include "WDL/wdltypes.h"
 
 #ifndef CLAP_ABI
@@ -55,6 +56,10 @@ public:
 	// Should be called only by the graphics object when it resizes itself.
 	void ResizeGraphics(int w, int h);
 
+	#ifndef NDEBUG
+	int DumpMemoryFootprint();
+	#endif
+
 protected:
 	void HostSpecificInit() {}
 
@@ -108,7 +113,7 @@ private:
 public:
 	inline clap_plugin* GetTheClap() { return &mClapPlug; }
 
-	static bool CLAP_ABI ClapEntryInit(const char* path) { return true; }
+	static bool CLAP_ABI ClapEntryInit(const char* path);
 	static void CLAP_ABI ClapEntryDeinit() {}
 	static const void* CLAP_ABI ClapEntryGetFactory(const char* id);
 
@@ -151,16 +156,54 @@ public:
 	static bool CLAP_ABI ClapGUIGetPreferredAPI(const clap_plugin* pPlug, const char** pID, bool* pIsFloating);
 	static bool CLAP_ABI ClapGUICreate(const clap_plugin* pPlug, const char* id, bool isFloating);
 	static void CLAP_ABI ClapGUIDestroy(const clap_plugin* pPlug);
-	static bool CLAP_ABI ClapGUISetScale(const clap_plugin* pPlug, double scale) { return false; }
+	static bool CLAP_ABI ClapGUISetScale(const clap_plugin* pPlug, double scale);
 	static bool CLAP_ABI ClapGUIGetSize(const clap_plugin* pPlug, uint32_t* pWidth, uint32_t* pHeight);
-	static bool CLAP_ABI ClapGUICanResize(const clap_plugin* pPlug) { return false; }
-	static bool CLAP_ABI ClapGUIGetResizeHints(const clap_plugin* pPlug, clap_gui_resize_hints* pHints) { return false; }
-	static bool CLAP_ABI ClapGUIAdjustSize(const clap_plugin* pPlug, uint32_t* pWidth, uint32_t* pHeight) { return false; }
-	static bool CLAP_ABI ClapGUISetSize(const clap_plugin* pPlug, uint32_t width, uint32_t height) { return false; }
+	static bool CLAP_ABI ClapGUICanResize(const clap_plugin* pPlug);
+	static bool CLAP_ABI ClapGUIGetResizeHints(const clap_plugin* pPlug, clap_gui_resize_hints* pHints);
+	static bool CLAP_ABI ClapGUIAdjustSize(const clap_plugin* pPlug, uint32_t* pWidth, uint32_t* pHeight);
+	static bool CLAP_ABI ClapGUISetSize(const clap_plugin* pPlug, uint32_t width, uint32_t height);
 	static bool CLAP_ABI ClapGUISetParent(const clap_plugin* pPlug, const clap_window* pWindow);
 	static bool CLAP_ABI ClapGUISetTransient(const clap_plugin* pPlug, const clap_window* pWindow) { return false; }
 	static void CLAP_ABI ClapGUISuggestTitle(const clap_plugin* pPlug, const char* title) {}
 	static bool CLAP_ABI ClapGUIShow(const clap_plugin* pPlug);
 	static bool CLAP_ABI ClapGUIHide(const clap_plugin* pPlug);
+
+	static bool CLAP_ABI ClapPresetLoadFromLocation(const clap_plugin* pPlug, uint32_t locationKind, const char* location, const char* loadKey);
 }
 WDL_FIXALIGN;
+
+// Preset discovery for the host's preset browser. Reads only the bank
+// files (see IPresetBank.h), i.e. the factory bank written at build time
+// (see IPlugWriteFactoryBank() in IPlug_include_in_plug_src.h), and the
+// user banks in the preset library, so it never creates the plugin, its
+// GUI, or DSP.
+class IPresetProviderCLAP
+{
+public:
+	// Use ClapPresetDiscoveryCreate() instead (defined in IPlug_include_in_plug_src.h).
+	static const clap_preset_discovery_provider* Create(
+		const clap_preset_discovery_provider_descriptor* pDesc,
+		const clap_preset_discovery_indexer* pIndexer,
+		const char* mfrName,
+		const char* plugName,
+		const char* plugID
+	);
+
+private:
+	IPresetProviderCLAP() {}
+
+	// Next to the plugin binary on Windows, in the bundle's resources on
+	// macOS. Returns false if clap_entry.init() wasn't called.
+	static bool GetFactoryBankPath(WDL_String* pPath);
+
+	static bool CLAP_ABI ClapInit(const clap_preset_discovery_provider* pProvider);
+	static void CLAP_ABI ClapDestroy(const clap_preset_discovery_provider* pProvider);
+	static bool CLAP_ABI ClapGetMetadata(const clap_preset_discovery_provider* pProvider, uint32_t locationKind, const char* location, const clap_preset_discovery_metadata_receiver* pReceiver);
+	static const void* CLAP_ABI ClapGetExtension(const clap_preset_discovery_provider* pProvider, const char* id) { return NULL; }
+
+	clap_preset_discovery_provider mProvider;
+	const clap_preset_discovery_indexer* mIndexer;
+
+	WDL_String mPath, mFactoryPath, mPlugName;
+	const char* mPlugID;
+};
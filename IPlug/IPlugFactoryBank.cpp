@@ -0,0 +1,55 @@
+/*
+	Build tool that writes the factory bank of a CLAP plugin, i.e. loads
+	the plugin binary, and calls its IPlugWriteFactoryBank() (see
+	IPlug_include_in_plug_src.h). Run after linking by the Makefile, and
+	by a run script phase of the CLAP target in Xcode.
+
+	Usage: IPlugFactoryBank <plugin binary> <bank file>
+*/
+
+#include <stdio.h>
+
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <dlfcn.h>
+#endif
+
+typedef bool (*WriteFactoryBankProc)(const char* path);
+
+int main(const int argc, const char* const* const argv)
+{
+	if (argc != 3)
+	{
+		fprintf(stderr, "Usage: IPlugFactoryBank <plugin binary> <bank file>\n");
+		return 1;
+	}
+
+	const char* const plugPath = argv[1];
+	const char* const bankPath = argv[2];
+
+	#ifdef _WIN32
+	const HMODULE hLib = LoadLibraryA(plugPath);
+	WriteFactoryBankProc const writeFactoryBank = hLib ? (WriteFactoryBankProc)GetProcAddress(hLib, "IPlugWriteFactoryBank") : NULL;
+	#else
+	void* const hLib = dlopen(plugPath, RTLD_NOW | RTLD_LOCAL);
+	WriteFactoryBankProc const writeFactoryBank = hLib ? (WriteFactoryBankProc)dlsym(hLib, "IPlugWriteFactoryBank") : NULL;
+	#endif
+
+	if (!writeFactoryBank)
+	{
+		fprintf(stderr, "IPlugFactoryBank: Can't load IPlugWriteFactoryBank() from %s\n", plugPath);
+		return 1;
+	}
+
+	const bool writtenOK = writeFactoryBank(bankPath);
+	if (!writtenOK) fprintf(stderr, "IPlugFactoryBank: Can't write %s\n", bankPath);
+
+	#ifdef _WIN32
+	FreeLibrary(hLib);
+	#else
+	dlclose(hLib);
+	#endif
+
+	return writtenOK ? 0 : 1;
+}
@@ -82,6 +82,7 @@ struct IText
 	static const char* const kDefaultFont;
 
 	LICE_IFont* mCached;
+	int mCachedGen; // Font cache generation of mCached.
 	const char* mFont;
 	int mSize;
 	IColor mColor;
@@ -103,6 +104,7 @@ struct IText
 		const int quality = kQualityDefault
 	):
 		mCached(NULL),
+		mCachedGen(0),
 		mFont(font ? font : kDefaultFont),
 		mSize(size),
 		mColor(color),
@@ -121,6 +123,7 @@ struct IText
 		const IColor color
 	):
 		mCached(NULL),
+		mCachedGen(0),
 		mFont(kDefaultFont),
 		mSize(kDefaultSize),
 		mColor(color),
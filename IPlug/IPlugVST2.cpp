@@ -145,7 +145,7 @@ bool IPlugVST2::AllocStateChunk(int chunkSize)
 {
 	if (chunkSize < 0)
 	{
-		chunkSize = GetParamsChunkSize(0, NParams());
+		chunkSize = GetStateChunkSize();
 	}
 	chunkSize += kInitializeVSTChunkSize;
 	return mState.Alloc(chunkSize) == chunkSize;
@@ -285,6 +285,16 @@ void IPlugVST2::ResizeGraphics(const int w, const int h)
 	}
 }
 
+#ifndef NDEBUG
+int IPlugVST2::DumpMemoryFootprint()
+{
+	const int bytes = mState.AllocSize() + mBankState.AllocSize();
+
+	DebugLog("Memory: VST2 state %d", bytes);
+	return IPlugBase::DumpMemoryFootprint() + bytes;
+}
+#endif
+
 bool IPlugVST2::IsRenderingOffline()
 {
 	const bool offline = mHostCallback(&mAEffect, audioMasterGetCurrentProcessLevel, 0, 0, NULL, 0.0f) == kVstProcessLevelOffline;
@@ -401,16 +411,11 @@ static int GetIPlugVerFromChunk(const ByteChunk* const pChunk, int* const pPos)
 	return ver;
 }
 
+// Keeps the current value if ptr isn't a valid display text or number.
 static double VSTString2Parameter(const IParam* const pParam, const char* const ptr)
 {
 	double v;
-	const bool mapped = pParam->MapDisplayText(ptr, &v);
-	if (!mapped)
-	{
-		v = strtod(ptr, NULL);
-		if (pParam->DisplayIsNegated()) v = -v;
-		v = pParam->GetNormalized(v);
-	}
+	if (!pParam->FromDisplayText(ptr, &v)) v = pParam->GetNormalized();
 	return v;
 }
 
@@ -429,7 +434,39 @@ VstIntPtr VSTCALLBACK IPlugVST2::VSTDispatcher(AEffect* const pEffect, const Vst
 	IPlugVST2* const _this = (IPlugVST2*)pEffect->object;
 	if (!_this) return ret;
 
+	// Hosts call these a lot (e.g. drawing automation), and they only read
+	// the param value, which is a single aligned word (see
+	// IPlugCLAP::ClapParamsGetValue()), so don't wait for the audio thread.
+	switch (opCode)
+	{
+		case effGetParamLabel:
+		{
+			if (_this->NParams(idx))
+			{
+				vst_strncpy((char*)ptr, _this->GetParam(idx)->GetLabelForHost(), _this->GetMaxParamStrLen());
+			}
+			return ret;
+		}
+
+		case effGetParamDisplay:
+		{
+			if (_this->NParams(idx))
+			{
+				_this->GetParam(idx)->GetDisplayForHost((char*)ptr, _this->GetMaxParamStrLen());
+			}
+			return ret;
+		}
+
+		case effVendorSpecific:
+		{
+			if (idx == effGetParamDisplay) return _this->VSTVendorSpecific(idx, value, ptr, opt);
+			break;
+		}
+	}
+
+	// Hosts send MIDI from the audio thread.
 	_this->mMutex.Enter();
+	IPLUG_RT_SAFETY_SCOPE_IF(opCode == effProcessEvents)
 
 	switch (opCode)
 	{
@@ -476,24 +513,6 @@ VstIntPtr VSTCALLBACK IPlugVST2::VSTDispatcher(AEffect* const pEffect, const Vst
 			break;
 		}
 
-		case effGetParamLabel:
-		{
-			if (_this->NParams(idx))
-			{
-				vst_strncpy((char*)ptr, _this->GetParam(idx)->GetLabelForHost(), _this->GetMaxParamStrLen());
-			}
-			break;
-		}
-
-		case effGetParamDisplay:
-		{
-			if (_this->NParams(idx))
-			{
-				_this->GetParam(idx)->GetDisplayForHost((char*)ptr, _this->GetMaxParamStrLen());
-			}
-			break;
-		}
-
 		case effGetParamName:
 		{
 			if (_this->NParams(idx))
@@ -537,6 +556,9 @@ VstIntPtr VSTCALLBACK IPlugVST2::VSTDispatcher(AEffect* const pEffect, const Vst
 			{
 				_this->mPlugFlags ^= IPlugBase::kPlugFlagsActive;
 				_this->OnActivate(active);
+
+				// Apply a preset that was loaded too late for the last block.
+				if (!active) _this->FlushPatchQueue();
 			}
 			break;
 		}
@@ -1081,6 +1103,8 @@ void VSTCALLBACK IPlugVST2::VSTProcess(AEffect* const pEffect, float** const inp
 { 
 	IPlugVST2* const _this = (IPlugVST2*)pEffect->object;
 	_this->mMutex.Enter();
+	IPLUG_RT_SAFETY_SCOPE
+	WDL_denormal_ftz_scope ftz;
 
 	_this->VSTPrepProcess(inputs, outputs, nFrames);
 	_this->ProcessBuffersAccumulating((float)0.0f, nFrames);
@@ -1092,6 +1116,8 @@ void VSTCALLBACK IPlugVST2::VSTProcessReplacing(AEffect* const pEffect, float**
 { 
 	IPlugVST2* const _this = (IPlugVST2*)pEffect->object;
 	_this->mMutex.Enter();
+	IPLUG_RT_SAFETY_SCOPE
+	WDL_denormal_ftz_scope ftz;
 
 	_this->VSTPrepProcess(inputs, outputs, nFrames);
 	_this->ProcessBuffers((float)0.0f, nFrames);
@@ -1103,6 +1129,8 @@ void VSTCALLBACK IPlugVST2::VSTProcessDoubleReplacing(AEffect* const pEffect, do
 {  
 	IPlugVST2* const _this = (IPlugVST2*)pEffect->object;
 	_this->mMutex.Enter();
+	IPLUG_RT_SAFETY_SCOPE
+	WDL_denormal_ftz_scope ftz;
 
 	_this->VSTPrepProcess(inputs, outputs, nFrames);
 	_this->ProcessBuffers((double)0.0, nFrames);
@@ -51,6 +51,10 @@ public:
 	// Should be called only by the graphics object when it resizes itself.
 	void ResizeGraphics(int w, int h);
 
+	#ifndef NDEBUG
+	int DumpMemoryFootprint();
+	#endif
+
 protected:
 	void HostSpecificInit();
 	void AttachGraphics(IGraphics* pGraphics);  
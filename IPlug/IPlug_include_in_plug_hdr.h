@@ -20,6 +20,15 @@
 	#error "No API defined!"
 #endif
 
+#if defined(CLAP_API) && !defined(NDEBUG)
+	// Creates 1, 10, 100, and 500 plugin instances (through the factory,
+	// with a host that has no extensions), and logs construction time,
+	// resident memory, and render throughput per instance count, followed
+	// by a per-instance memory breakdown. Runs when the plugin is loaded
+	// with the IPLUG_BENCHMARK environment variable set.
+	void IPlugBenchmarkInstances();
+#endif
+
 #ifndef PLUG_PRODUCT
 	#define PLUG_PRODUCT ""
 #endif
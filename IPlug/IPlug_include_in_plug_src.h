@@ -111,6 +111,7 @@ void* PLUG_FACTORY(const AudioComponentDescription* const pDesc)
 
 #elif defined(CLAP_API)
 
+#include <stdlib.h>
 #include <string.h>
 
 extern "C" {
@@ -172,16 +173,233 @@ const clap_plugin* CLAP_ABI ClapFactoryCreatePlugin(const clap_plugin_factory* /
 	return pClap;
 }
 
+static const char* const sClapPresetProviderID = BUNDLE_DOMAIN ".clap." BUNDLE_NAME ".presets";
+
+uint32_t CLAP_ABI ClapPresetDiscoveryCount(const clap_preset_discovery_factory* /* pFactory */)
+{
+	return 1;
+}
+
+const clap_preset_discovery_provider_descriptor* CLAP_ABI ClapPresetDiscoveryGetDescriptor(const clap_preset_discovery_factory* /* pFactory */, const uint32_t index)
+{
+	if (index != 0) return NULL;
+
+	static const clap_preset_discovery_provider_descriptor desc =
+	{
+		CLAP_VERSION,
+		sClapPresetProviderID,
+		PLUG_NAME " Presets",
+		PLUG_MFR
+	};
+
+	return &desc;
+}
+
+static const void* CLAP_ABI FactoryBankHostGetExtension(const clap_host* /* pHost */, const char* /* id */) { return NULL; }
+static void CLAP_ABI FactoryBankHostRequest(const clap_host* /* pHost */) {}
+
+// Writes the built-in presets to the factory bank. Only called at build
+// time by IPlugFactoryBank (see IPlug/IPlugFactoryBank.cpp), because the
+// presets are made by the constructor, so this creates a temporary
+// instance (with a silent host, and without init()). The preset provider
+// only reads the bank, and never creates the plugin.
+EXPORT bool IPlugWriteFactoryBank(const char* const path)
+{
+	static const clap_host host =
+	{
+		CLAP_VERSION,
+		NULL,
+		"IPlugFactoryBank",
+		"",
+		"",
+		"1.0",
+		FactoryBankHostGetExtension,
+		FactoryBankHostRequest,
+		FactoryBankHostRequest,
+		FactoryBankHostRequest
+	};
+
+	IPlugCLAP* const pPlug = new PLUG_CLASS_NAME((void*)&host);
+	if (!pPlug) return false;
+
+	pPlug->EnsureDefaultPreset();
+	const bool writtenOK = pPlug->WritePresetBank(path);
+
+	const clap_plugin* const pClap = pPlug->GetTheClap();
+	pClap->destroy(pClap);
+
+	return writtenOK;
+}
+
+const clap_preset_discovery_provider* CLAP_ABI ClapPresetDiscoveryCreate(const clap_preset_discovery_factory* /* pFactory */, const clap_preset_discovery_indexer* const pIndexer, const char* const id)
+{
+	if (!clap_version_is_compatible(pIndexer->clap_version) || strcmp(id, sClapPresetProviderID)) return NULL;
+	return IPresetProviderCLAP::Create(ClapPresetDiscoveryGetDescriptor(NULL, 0), pIndexer, PLUG_MFR, PLUG_NAME, sClapPlugID);
+}
+
+#ifndef NDEBUG
+
+// Debug builds run IPlugBenchmarkInstances() when loaded with the
+// IPLUG_BENCHMARK environment variable set (e.g. IPLUG_BENCHMARK=1).
+static bool CLAP_ABI ClapEntryInitDebug(const char* const path)
+{
+	if (!IPlugCLAP::ClapEntryInit(path)) return false;
+
+	const char* const env = getenv("IPLUG_BENCHMARK");
+	if (env && *env && strcmp(env, "0")) IPlugBenchmarkInstances();
+
+	return true;
+}
+
+#define CLAP_ENTRY_INIT ClapEntryInitDebug
+
+#else
+
+#define CLAP_ENTRY_INIT IPlugCLAP::ClapEntryInit
+
+#endif
+
 CLAP_EXPORT const clap_plugin_entry clap_entry =
 {
 	CLAP_VERSION,
-	IPlugCLAP::ClapEntryInit,
+	CLAP_ENTRY_INIT,
 	IPlugCLAP::ClapEntryDeinit,
 	IPlugCLAP::ClapEntryGetFactory
 };
 
 } // extern "C"
 
+#ifndef NDEBUG
+
+static const void* CLAP_ABI BenchmarkHostGetExtension(const clap_host* /* pHost */, const char* /* id */) { return NULL; }
+static void CLAP_ABI BenchmarkHostRequest(const clap_host* /* pHost */) {}
+
+static uint32_t CLAP_ABI BenchmarkInEventsSize(const clap_input_events* /* pList */) { return 0; }
+static const clap_event_header* CLAP_ABI BenchmarkInEventsGet(const clap_input_events* /* pList */, uint32_t /* index */) { return NULL; }
+static bool CLAP_ABI BenchmarkOutEventsTryPush(const clap_output_events* /* pList */, const clap_event_header* /* pEvent */) { return true; }
+
+void IPlugBenchmarkInstances()
+{
+	static const int kCounts[] = { 1, 10, 100, 500 };
+	static const int kNumCounts = sizeof(kCounts) / sizeof(kCounts[0]);
+
+	static const double kSampleRate = 48000.0;
+	static const int kBlockSize = 512, kNumBlocks = 100;
+
+	// Silent host: no extensions, no events in, and anything pushed out is
+	// dropped.
+	static const clap_host host =
+	{
+		CLAP_VERSION,
+		NULL,
+		"IPlugBenchmarkInstances",
+		"",
+		"",
+		"1.0",
+		BenchmarkHostGetExtension,
+		BenchmarkHostRequest,
+		BenchmarkHostRequest,
+		BenchmarkHostRequest
+	};
+
+	static const clap_input_events inEvents = { NULL, BenchmarkInEventsSize, BenchmarkInEventsGet };
+	static const clap_output_events outEvents = { NULL, BenchmarkOutEventsTryPush };
+
+	WDL_TypedBuf<float> buf;
+	float* const pBuf = buf.Resize(2 * kBlockSize);
+	float* ppData[2] = { pBuf, pBuf + kBlockSize };
+
+	clap_audio_buffer audioOut;
+	memset(&audioOut, 0, sizeof(audioOut));
+	audioOut.data32 = ppData;
+	audioOut.channel_count = 2;
+
+	clap_process process;
+	memset(&process, 0, sizeof(process));
+	process.steady_time = -1;
+	process.frames_count = kBlockSize;
+	process.audio_outputs = &audioOut;
+	process.audio_outputs_count = 1;
+	process.in_events = &inEvents;
+	process.out_events = &outEvents;
+
+	WDL_PtrList<const clap_plugin> instances;
+
+	for (int c = 0; c < kNumCounts; ++c)
+	{
+		int n = kCounts[c];
+
+		const size_t startMem = IPlugResidentMemory();
+		double startTime = time_precise();
+
+		// Same as a host: through the factory, then init.
+		for (int i = 0; i < n; ++i)
+		{
+			const clap_plugin* const pClap = ClapFactoryCreatePlugin(NULL, &host, sClapPlugID);
+			if (!pClap) break;
+
+			if (!pClap->init(pClap))
+			{
+				pClap->destroy(pClap);
+				break;
+			}
+			instances.Add(pClap);
+		}
+
+		const double ctorTime = time_precise() - startTime;
+		if (instances.GetSize() != n)
+		{
+			IPlugBase::DebugLog("Benchmark: failed to create instance %d", instances.GetSize());
+			n = instances.GetSize();
+		}
+		if (!n) break;
+
+		// Signed, the working set can shrink (e.g. the OS trimming it).
+		const double memPerInstance = (double)((WDL_INT64)IPlugResidentMemory() - (WDL_INT64)startMem) / (double)n;
+
+		for (int i = 0; i < n; ++i)
+		{
+			const clap_plugin* const pClap = instances.Get(i);
+			pClap->activate(pClap, kSampleRate, 1, kBlockSize);
+			pClap->start_processing(pClap);
+		}
+
+		startTime = time_precise();
+
+		for (int b = 0; b < kNumBlocks; ++b)
+		{
+			for (int i = 0; i < n; ++i)
+			{
+				const clap_plugin* const pClap = instances.Get(i);
+				pClap->process(pClap, &process);
+			}
+		}
+
+		const double renderTime = time_precise() - startTime;
+		const double realtime = (double)(n * kNumBlocks * kBlockSize) / kSampleRate / renderTime;
+
+		IPlugBase::DebugLog("Benchmark: %d instances, ctor %.3f ms/instance, %.0f bytes/instance resident, %.1fx realtime (%.1fx per instance)",
+			n, ctorTime * 1000.0 / (double)n, memPerInstance, realtime, realtime / (double)n);
+
+		if (c == kNumCounts - 1)
+		{
+			IPlugCLAP* const pPlug = (IPlugCLAP*)instances.Get(0)->plugin_data;
+			IPlugBase::DebugLog("Benchmark: %d bytes/instance heap estimate, %d bytes sizeof", pPlug->DumpMemoryFootprint(), (int)sizeof(PLUG_CLASS_NAME));
+		}
+
+		for (int i = 0; i < n; ++i)
+		{
+			const clap_plugin* const pClap = instances.Get(i);
+			pClap->stop_processing(pClap);
+			pClap->deactivate(pClap);
+			pClap->destroy(pClap);
+		}
+		instances.Empty();
+	}
+}
+
+#endif // NDEBUG
+
 #else
 	#error "No API defined!"
 #endif
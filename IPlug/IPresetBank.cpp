@@ -0,0 +1,489 @@
+#include "IPresetBank.h"
+#include "IGraphics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "WDL/dirscan.h"
+
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+#include "WDL/fileread.h"
+#include "WDL/wdlatomic.h"
+
+static const char kMagic[4] = { 'I', 'P', 'P', 'B' };
+static const int kVersion = 1;
+
+// Larger banks aren't mapped (and won't open).
+static const unsigned int kMaxBankSize = 0x40000000;
+
+// Followed by the entries, name index, tag index, strings, and data. All
+// offsets are from the start of the file, and 4-byte aligned, except for
+// the data. Native (little) endian, so on big endian the version won't
+// match.
+struct IPresetBankHeader
+{
+	char magic[4];
+	int version;
+	int nPresets, nTags;
+	int entriesOfs, nameIndexOfs, tagIndexOfs;
+	int stringsOfs, stringsSize;
+	int dataOfs, dataSize;
+	int userVersion;
+};
+
+// ASCII only, so the index order doesn't depend on the locale.
+static inline int ToLower(const int c)
+{
+	return c >= 'A' && c <= 'Z' ? c + 'a' - 'A' : c;
+}
+
+// Case-insensitive, compares only the first len chars (or all if len < 0).
+static int CompareStr(const char* const a, const char* const b, const int len = -1)
+{
+	for (int i = 0; len < 0 || i < len; ++i)
+	{
+		const int ca = ToLower((unsigned char)a[i]), cb = ToLower((unsigned char)b[i]);
+		if (ca != cb) return ca - cb;
+		if (!ca) break;
+	}
+	return 0;
+}
+
+static bool IsValidSection(const int ofs, const WDL_INT64 size, const int align, const WDL_INT64 fileSize)
+{
+	return ofs >= (int)sizeof(IPresetBankHeader) && size >= 0 && !(ofs % align) && (WDL_INT64)ofs + size <= fileSize;
+}
+
+// In 64 bits, so a bogus count can't overflow the size.
+static bool IsValidArray(const int ofs, const int count, const int elemSize, const WDL_INT64 fileSize)
+{
+	return count >= 0 && count <= fileSize / elemSize &&
+		IsValidSection(ofs, (WDL_INT64)count * elemSize, 4, fileSize);
+}
+
+bool IPresetBank::Open(const char* const path)
+{
+	Close();
+
+	mFile = new WDL_FileRead(path, 0, 0, 0, 0, kMaxBankSize);
+	const WDL_INT64 fileSize = mFile->IsOpen() ? (WDL_INT64)mFile->GetSize() : 0;
+
+	int len = (int)fileSize;
+	const char* const pView = fileSize > (WDL_INT64)sizeof(IPresetBankHeader) ? (const char*)mFile->GetMappedView(0, &len) : NULL;
+
+	const IPresetBankHeader* const pHeader = (const IPresetBankHeader*)pView;
+	const bool validOK = pView && len == fileSize &&
+		!memcmp(pHeader->magic, kMagic, sizeof(kMagic)) && pHeader->version == kVersion &&
+		IsValidArray(pHeader->entriesOfs, pHeader->nPresets, (int)sizeof(Entry), fileSize) &&
+		IsValidArray(pHeader->nameIndexOfs, pHeader->nPresets, (int)sizeof(IndexEntry), fileSize) &&
+		IsValidArray(pHeader->tagIndexOfs, pHeader->nTags, (int)sizeof(IndexEntry), fileSize) &&
+		IsValidSection(pHeader->stringsOfs, pHeader->stringsSize, 1, fileSize) && pHeader->stringsSize > 0 &&
+		IsValidSection(pHeader->dataOfs, pHeader->dataSize, 1, fileSize) &&
+		!pView[pHeader->stringsOfs + pHeader->stringsSize - 1]; // So all strings are terminated.
+
+	if (!validOK)
+	{
+		Close();
+		return false;
+	}
+
+	mPath.Set(path);
+	mView = pView;
+	mEntries = (const Entry*)(pView + pHeader->entriesOfs);
+	mNameIndex = (const IndexEntry*)(pView + pHeader->nameIndexOfs);
+	mTagIndex = (const IndexEntry*)(pView + pHeader->tagIndexOfs);
+	mStrings = pView + pHeader->stringsOfs;
+	mData = pView + pHeader->dataOfs;
+	mStringsSize = pHeader->stringsSize;
+	mDataSize = pHeader->dataSize;
+	mNPresets = pHeader->nPresets;
+	mNTags = pHeader->nTags;
+	mUserVersion = pHeader->userVersion;
+
+	return true;
+}
+
+void IPresetBank::Close()
+{
+	delete mFile;
+	mFile = NULL;
+	mView = NULL;
+	mStringsSize = mDataSize = 0;
+	mNPresets = mNTags = 0;
+	mUserVersion = 0;
+	mPath.Set("");
+}
+
+// Entries are only validated when used, so opening doesn't touch them.
+
+const char* IPresetBank::GetName(const int idx) const
+{
+	return (unsigned int)idx < (unsigned int)mNPresets ? GetStr(mEntries[idx].mNameOfs) : "";
+}
+
+const char* IPresetBank::GetTags(const int idx) const
+{
+	return (unsigned int)idx < (unsigned int)mNPresets ? GetStr(mEntries[idx].mTagsOfs) : "";
+}
+
+const void* IPresetBank::GetData(const int idx, int* const pSize) const
+{
+	*pSize = 0;
+	if ((unsigned int)idx >= (unsigned int)mNPresets) return NULL;
+
+	const Entry* const pEntry = &mEntries[idx];
+	const int ofs = pEntry->mDataOfs, size = pEntry->mDataSize;
+	if (ofs < 0 || size < 0 || ofs > mDataSize - size) return NULL;
+
+	*pSize = size;
+	return mData + ofs;
+}
+
+int IPresetBank::GetByName(const int pos) const
+{
+	const int idx = (unsigned int)pos < (unsigned int)mNPresets ? mNameIndex[pos].mIdx : -1;
+	return (unsigned int)idx < (unsigned int)mNPresets ? idx : -1;
+}
+
+int IPresetBank::GetByTag(const int pos) const
+{
+	const int idx = (unsigned int)pos < (unsigned int)mNTags ? mTagIndex[pos].mIdx : -1;
+	return (unsigned int)idx < (unsigned int)mNPresets ? idx : -1;
+}
+
+const char* IPresetBank::GetTag(const int pos) const
+{
+	return (unsigned int)pos < (unsigned int)mNTags ? GetStr(mTagIndex[pos].mStrOfs) : "";
+}
+
+int IPresetBank::LowerBound(const IndexEntry* const pIndex, int n, const char* const str, const int len) const
+{
+	int first = 0;
+	while (n > 0)
+	{
+		const int half = n >> 1, mid = first + half;
+		if (CompareStr(GetStr(pIndex[mid].mStrOfs), str, len) < 0)
+		{
+			first = mid + 1;
+			n -= half + 1;
+		}
+		else
+		{
+			n = half;
+		}
+	}
+	return first;
+}
+
+int IPresetBank::UpperBound(const IndexEntry* const pIndex, int n, const char* const str, const int len) const
+{
+	int first = 0;
+	while (n > 0)
+	{
+		const int half = n >> 1, mid = first + half;
+		if (CompareStr(GetStr(pIndex[mid].mStrOfs), str, len) <= 0)
+		{
+			first = mid + 1;
+			n -= half + 1;
+		}
+		else
+		{
+			n = half;
+		}
+	}
+	return first;
+}
+
+int IPresetBank::Find(const char* const name) const
+{
+	const int pos = LowerBound(mNameIndex, mNPresets, name, -1);
+	return pos < mNPresets && !CompareStr(GetStr(mNameIndex[pos].mStrOfs), name) ? GetByName(pos) : -1;
+}
+
+int IPresetBank::FindPrefix(const char* const prefix, int* const pFirst) const
+{
+	const int len = (int)strlen(prefix);
+	const int first = LowerBound(mNameIndex, mNPresets, prefix, len);
+	*pFirst = first;
+	return UpperBound(mNameIndex + first, mNPresets - first, prefix, len);
+}
+
+int IPresetBank::FindTag(const char* const tag, int* const pFirst) const
+{
+	const int first = LowerBound(mTagIndex, mNTags, tag, -1);
+	*pFirst = first;
+	return UpperBound(mTagIndex + first, mNTags - first, tag, -1);
+}
+
+bool IPresetBankWriter::Add(const char* const name, const char* const tags, const void* const pData, const int size)
+{
+	Preset* const pPreset = new Preset;
+	pPreset->mName.Set(name);
+	pPreset->mTags.Set(tags ? tags : "");
+
+	if (size < 0 || !pPreset->mData.ResizeOK(size, false))
+	{
+		delete pPreset;
+		return false;
+	}
+
+	memcpy(pPreset->mData.Get(), pData, size);
+	mPresets.Add(pPreset);
+	return true;
+}
+
+static void CreateParentDirs(const char* const path)
+{
+	WDL_String dir(path);
+	char* const p = dir.Get();
+
+	// Skip the root (or drive), and create each level in turn.
+	for (int i = 1; p[i]; ++i)
+	{
+		const char c = p[i];
+		if (c != '/' && c != '\\') continue;
+
+		p[i] = 0;
+		#ifdef _WIN32
+		WCHAR dirW[MAX_PATH];
+		if (i > 2 && MultiByteToWideChar(CP_UTF8, 0, p, -1, dirW, MAX_PATH)) CreateDirectoryW(dirW, NULL);
+		#else
+		mkdir(p, 0755);
+		#endif
+		p[i] = c;
+	}
+}
+
+struct IPresetBankSortEntry
+{
+	const char* mStr;
+	const char* mName;
+	int mStrOfs, mIdx;
+};
+
+// By string, then by name, then in the order added.
+static int CompareSortEntries(const void* const pA, const void* const pB)
+{
+	const IPresetBankSortEntry* const a = (const IPresetBankSortEntry*)pA;
+	const IPresetBankSortEntry* const b = (const IPresetBankSortEntry*)pB;
+
+	int cmp = CompareStr(a->mStr, b->mStr);
+	if (!cmp) cmp = CompareStr(a->mName, b->mName);
+	return cmp ? cmp : a->mIdx - b->mIdx;
+}
+
+bool IPresetBankWriter::Write(const char* const path) const
+{
+	const int nPresets = mPresets.GetSize();
+
+	// Strings: names, tags (as added), then each tag separately.
+	WDL_TypedBuf<char> strings;
+	WDL_TypedBuf<IPresetBankSortEntry> nameIndex, tagIndex;
+	WDL_TypedBuf<int> entries;
+	if (!(nameIndex.ResizeOK(nPresets, false) && entries.ResizeOK(nPresets * 4, false))) return false;
+
+	int dataSize = 0;
+	for (int i = 0; i < nPresets; ++i)
+	{
+		const Preset* const pPreset = mPresets.Get(i);
+		int* const pEntry = entries.Get() + i * 4;
+
+		pEntry[0] = strings.GetSize();
+		strings.Add(pPreset->mName.Get(), pPreset->mName.GetLength() + 1);
+		pEntry[1] = strings.GetSize();
+		strings.Add(pPreset->mTags.Get(), pPreset->mTags.GetLength() + 1);
+		pEntry[2] = dataSize;
+		pEntry[3] = pPreset->mData.GetSize();
+		dataSize += pEntry[3];
+
+		IPresetBankSortEntry* const pName = nameIndex.Get() + i;
+		pName->mStrOfs = pEntry[0];
+		pName->mIdx = i;
+
+		// Split the tags, and trim spaces.
+		const char* p = pPreset->mTags.Get();
+		while (*p)
+		{
+			while (*p == ' ' || *p == ',') ++p;
+			const char* const pStart = p;
+			while (*p && *p != ',') ++p;
+
+			const char* pEnd = p;
+			while (pEnd > pStart && pEnd[-1] == ' ') --pEnd;
+			if (pEnd == pStart) continue;
+
+			IPresetBankSortEntry tag;
+			tag.mStrOfs = strings.GetSize();
+			tag.mIdx = i;
+			tagIndex.Add(tag);
+
+			const char nul = 0;
+			strings.Add(pStart, (int)(pEnd - pStart));
+			strings.Add(&nul, 1);
+		}
+	}
+
+	const int nTags = tagIndex.GetSize();
+	const char* const pStrings = strings.Get();
+	if (strings.GetSize() < 1 || (nTags && !pStrings)) return false;
+
+	// Pointers only now, as the strings may have moved while adding.
+	for (int i = 0; i < nPresets; ++i)
+	{
+		IPresetBankSortEntry* const pName = nameIndex.Get() + i;
+		pName->mStr = pName->mName = pStrings + pName->mStrOfs;
+	}
+	for (int i = 0; i < nTags; ++i)
+	{
+		IPresetBankSortEntry* const pTag = tagIndex.Get() + i;
+		pTag->mStr = pStrings + pTag->mStrOfs;
+		pTag->mName = nameIndex.Get()[pTag->mIdx].mName;
+	}
+
+	if (nPresets) qsort(nameIndex.Get(), nPresets, sizeof(IPresetBankSortEntry), CompareSortEntries);
+	if (nTags) qsort(tagIndex.Get(), nTags, sizeof(IPresetBankSortEntry), CompareSortEntries);
+
+	IPresetBankHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, kMagic, sizeof(kMagic));
+	header.version = kVersion;
+	header.nPresets = nPresets;
+	header.nTags = nTags;
+	header.entriesOfs = (int)sizeof(header);
+	header.nameIndexOfs = header.entriesOfs + nPresets * 4 * (int)sizeof(int);
+	header.tagIndexOfs = header.nameIndexOfs + nPresets * 2 * (int)sizeof(int);
+	header.stringsOfs = header.tagIndexOfs + nTags * 2 * (int)sizeof(int);
+	header.stringsSize = strings.GetSize();
+	header.dataOfs = header.stringsOfs + header.stringsSize;
+	header.dataSize = dataSize;
+	header.userVersion = mUserVersion;
+
+	if ((WDL_INT64)header.dataOfs + dataSize >= kMaxBankSize) return false;
+
+	WDL_TypedBuf<int> index;
+	int* const pIndex = index.ResizeOK(wdl_max(nPresets, nTags) * 2, false);
+	if (!pIndex && (nPresets || nTags)) return false;
+
+	// Unique per process and per call, so concurrent writers (also threads
+	// or instances within the same process) don't share a temp file.
+	static int sNWrites = 0;
+	const unsigned int n = (unsigned int)wdl_atomic_incr(&sNWrites);
+
+	WDL_String tmp;
+	#ifdef _WIN32
+	const unsigned int pid = (unsigned int)GetCurrentProcessId();
+	#else
+	const unsigned int pid = (unsigned int)getpid();
+	#endif
+	tmp.SetFormatted(1024, "%s.%u.%u.tmp", path, pid, n);
+
+	CreateParentDirs(path);
+
+	#ifdef _WIN32
+	WCHAR pathW[MAX_PATH], tmpW[MAX_PATH];
+	if (!(MultiByteToWideChar(CP_UTF8, 0, path, -1, pathW, MAX_PATH) && MultiByteToWideChar(CP_UTF8, 0, tmp.Get(), -1, tmpW, MAX_PATH))) return false;
+	FILE* const fp = _wfopen(tmpW, L"wb");
+	#else
+	FILE* const fp = fopen(tmp.Get(), "wb");
+	#endif
+	if (!fp) return false;
+
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+	ok = ok && (int)fwrite(entries.Get(), sizeof(int) * 4, nPresets, fp) == nPresets;
+
+	for (int i = 0; i < nPresets; ++i)
+	{
+		pIndex[i * 2] = nameIndex.Get()[i].mStrOfs;
+		pIndex[i * 2 + 1] = nameIndex.Get()[i].mIdx;
+	}
+	ok = ok && (int)fwrite(pIndex, sizeof(int) * 2, nPresets, fp) == nPresets;
+
+	for (int i = 0; i < nTags; ++i)
+	{
+		pIndex[i * 2] = tagIndex.Get()[i].mStrOfs;
+		pIndex[i * 2 + 1] = tagIndex.Get()[i].mIdx;
+	}
+	ok = ok && (int)fwrite(pIndex, sizeof(int) * 2, nTags, fp) == nTags;
+
+	ok = ok && fwrite(pStrings, 1, header.stringsSize, fp) == (size_t)header.stringsSize;
+	for (int i = 0; i < nPresets && ok; ++i)
+	{
+		const WDL_HeapBuf* const pData = &mPresets.Get(i)->mData;
+		ok = fwrite(pData->Get(), 1, pData->GetSize(), fp) == (size_t)pData->GetSize();
+	}
+	ok = !fclose(fp) && ok;
+
+	#ifdef _WIN32
+	ok = ok && !!MoveFileExW(tmpW, pathW, MOVEFILE_REPLACE_EXISTING);
+	if (!ok) DeleteFileW(tmpW);
+	#else
+	ok = ok && !rename(tmp.Get(), path);
+	if (!ok) unlink(tmp.Get());
+	#endif
+
+	return ok;
+}
+
+static int CompareBanks(const IPresetBank** const a, const IPresetBank** const b)
+{
+	return strcmp((*a)->GetPath(), (*b)->GetPath());
+}
+
+int IPresetLibrary::Open(const char* const dir)
+{
+	Close();
+
+	static const char ext[] = "." IPRESETBANK_EXT;
+	const int extLen = (int)sizeof(ext) - 1;
+
+	WDL_DirScan scan;
+	for (int ret = scan.First(dir); !ret; ret = scan.Next())
+	{
+		const char* const fn = scan.GetCurrentFN();
+		const int len = (int)strlen(fn);
+		if (scan.GetCurrentIsDirectory() || len <= extLen || CompareStr(fn + len - extLen, ext)) continue;
+
+		WDL_String path;
+		scan.GetCurrentFullFN(&path);
+
+		IPresetBank* const pBank = new IPresetBank;
+		if (pBank->Open(path.Get()))
+			mBanks.Add(pBank);
+		else
+			delete pBank;
+	}
+
+	// Directory order isn't defined.
+	qsort(mBanks.GetList(), mBanks.GetSize(), sizeof(IPresetBank*), (int (*)(const void*, const void*))CompareBanks);
+	return mBanks.GetSize();
+}
+
+IPresetBank* IPresetLibrary::Find(const char* const name, int* const pIdx) const
+{
+	for (int i = 0; i < mBanks.GetSize(); ++i)
+	{
+		IPresetBank* const pBank = mBanks.Get(i);
+		const int idx = pBank->Find(name);
+		if (idx >= 0)
+		{
+			*pIdx = idx;
+			return pBank;
+		}
+	}
+	return NULL;
+}
+
+bool IPresetLibrary::DefaultPath(WDL_String* const pPath, const char* const mfrName, const char* const plugName)
+{
+	if (!IGraphics::UserDataPath(pPath, mfrName, plugName)) return false;
+
+	pPath->Append(WDL_DIRCHAR_STR "Presets");
+	return true;
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+/*
+	On-disk preset library. Each collection is a single bank file, which is
+	memory-mapped (via WDL_FileRead), so opening a bank only reads its
+	header, and preset names, tags, and data are paged in on demand.
+
+	A bank file holds a name index (sorted case-insensitively), and a tag
+	index (sorted by tag, then name), so Find(), FindPrefix(), and FindTag()
+	are binary searches, and never parse or scan the presets.
+
+	Preset data is in SerializePreset() format, see IPlugBase::LoadPreset()
+	and IPlugBase::WritePresetBank().
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "WDL/heapbuf.h"
+#include "WDL/ptrlist.h"
+#include "WDL/wdlstring.h"
+#include "WDL/wdltypes.h"
+
+// File name extension of bank files (without the dot).
+#define IPRESETBANK_EXT "iplugbank"
+
+// Bank with the built-in presets, written at build time, see
+// IPlugWriteFactoryBank() in IPlug_include_in_plug_src.h.
+#define IPRESETBANK_FACTORY "Factory"
+
+class WDL_FileRead;
+
+class IPresetBank
+{
+public:
+	IPresetBank():
+		mFile(NULL),
+		mView(NULL),
+		mEntries(NULL),
+		mNameIndex(NULL),
+		mTagIndex(NULL),
+		mStrings(NULL),
+		mData(NULL),
+		mStringsSize(0),
+		mDataSize(0),
+		mNPresets(0),
+		mNTags(0),
+		mUserVersion(0)
+	{}
+	~IPresetBank() { Close(); }
+
+	// Returns false if the file doesn't exist or isn't a valid bank.
+	bool Open(const char* path);
+	void Close();
+
+	inline bool IsOpen() const { return !!mView; }
+	inline const char* GetPath() const { return mPath.Get(); }
+
+	inline int NPresets() const { return mNPresets; }
+	inline int NTags() const { return mNTags; }
+
+	// As set by IPresetBankWriter::SetUserVersion().
+	inline int GetUserVersion() const { return mUserVersion; }
+
+	// Presets are in the order they were added to the bank.
+	const char* GetName(int idx) const;
+	const char* GetTags(int idx) const; // Comma separated.
+	const void* GetData(int idx, int* pSize) const;
+
+	// Returns the preset with this name (case-insensitive), or -1.
+	int Find(const char* name) const;
+
+	// Returns the number of presets whose name starts with prefix, and the
+	// position of the first in the name index (see GetByName()).
+	int FindPrefix(const char* prefix, int* pFirst) const;
+	// Returns the number of presets with this tag, and the position of the
+	// first in the tag index (see GetByTag()).
+	int FindTag(const char* tag, int* pFirst) const;
+
+	// Preset at this position in the name or tag index.
+	int GetByName(int pos) const;
+	int GetByTag(int pos) const;
+	// Tag at this position in the tag index.
+	const char* GetTag(int pos) const;
+
+protected:
+	struct Entry { int mNameOfs, mTagsOfs, mDataOfs, mDataSize; };
+	struct IndexEntry { int mStrOfs, mIdx; };
+
+	// Position of the first index entry whose string isn't less than str,
+	// comparing only the first len chars (or all if len < 0).
+	int LowerBound(const IndexEntry* pIndex, int n, const char* str, int len) const;
+	int UpperBound(const IndexEntry* pIndex, int n, const char* str, int len) const;
+
+	inline const char* GetStr(const int ofs) const
+	{
+		return (unsigned int)ofs < (unsigned int)mStringsSize ? mStrings + ofs : "";
+	}
+
+	WDL_FileRead* mFile;
+	WDL_String mPath;
+
+	const char* mView;
+	const Entry* mEntries;
+	const IndexEntry* mNameIndex;
+	const IndexEntry* mTagIndex;
+	const char* mStrings;
+	const char* mData;
+	int mStringsSize, mDataSize;
+	int mNPresets, mNTags;
+	int mUserVersion;
+};
+
+class IPresetBankWriter
+{
+public:
+	IPresetBankWriter(): mUserVersion(0) {}
+	~IPresetBankWriter() { mPresets.Empty(true); }
+
+	// tags is comma separated (can be NULL). Data is copied.
+	bool Add(const char* name, const char* tags, const void* pData, int size);
+	inline int NPresets() const { return mPresets.GetSize(); }
+
+	// Stored as is, e.g. the plugin version the presets were written by.
+	inline void SetUserVersion(const int version) { mUserVersion = version; }
+
+	// Writes to a temporary file first, and then renames it, so readers
+	// never see a partially written bank. Creates the directory if needed.
+	bool Write(const char* path) const;
+
+protected:
+	struct Preset
+	{
+		WDL_FastString mName, mTags;
+		WDL_HeapBuf mData;
+	};
+
+	WDL_PtrList<Preset> mPresets;
+	int mUserVersion;
+};
+
+// All banks in a directory, one per collection.
+class IPresetLibrary
+{
+public:
+	~IPresetLibrary() { Close(); }
+
+	// Opens every bank in dir, and returns the number of banks.
+	int Open(const char* dir);
+	void Close() { mBanks.Empty(true); }
+
+	inline int NBanks() const { return mBanks.GetSize(); }
+	inline IPresetBank* GetBank(const int idx) const { return mBanks.Get(idx); }
+
+	// Returns the bank with a preset with this name, and sets *pIdx, or
+	// returns NULL if not found.
+	IPresetBank* Find(const char* name, int* pIdx) const;
+
+	// Per-user library folder of this plugin. Doesn't need the plugin or
+	// its GUI, so hosts can use it to index presets.
+	static bool DefaultPath(WDL_String* pPath, const char* mfrName, const char* plugName);
+
+protected:
+	WDL_PtrList<IPresetBank> mBanks;
+};
@@ -0,0 +1,219 @@
+#pragma once
+
+/*
+	IPresetMorph blends between 2 or 4 presets. The presets are decoded
+	once into flat arrays of normalized values, keeping only the params that
+	actually differ, so moving the morph position costs a single vectorized
+	pass over those, instead of decoding or dispatching every param.
+
+	With 2 presets (A, B) the position is x = [0, 1]. With 4 presets they
+	are the corners of a square (A = top left, B = top right, C = bottom
+	left, D = bottom right), and the position (x, y) is bilinear.
+
+	Values are blended normalized, not plain, so each param moves along its
+	own shape (e.g. an exp frequency param sweeps evenly in pitch), which is
+	also how IParamSmoother ramps them.
+
+	The position can be set from any thread. The blend is recomputed on the
+	audio thread, and only if the position changed.
+*/
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+	#define IPRESETMORPH_SSE2
+	#include <emmintrin.h>
+#elif defined(_M_ARM64) || defined(__aarch64__)
+	#define IPRESETMORPH_NEON
+	#include <arm_neon.h>
+#endif
+
+#include "WDL/heapbuf.h"
+#include "WDL/wdltypes.h"
+
+class IPresetMorph
+{
+public:
+	static const int kMaxPresets = 4;
+
+	IPresetMorph():
+		mX(0.0),
+		mY(0.0),
+		mLastX(-1.0),
+		mLastY(-1.0),
+		mNPresets(0)
+	{}
+
+	// Mutex locked. ppValues[i] points to nValues normalized values for
+	// preset i. Returns false (and stops morphing) if nPresets isn't 2 or 4,
+	// or if out of memory.
+	bool Init(const double* const* const ppValues, const int nPresets, const int nValues)
+	{
+		Clear();
+		if (nPresets != 2 && nPresets != kMaxPresets) return false;
+
+		int n = 0;
+		for (int i = 0; i < nValues; ++i)
+		{
+			for (int j = 1; j < nPresets; ++j)
+			{
+				if (ppValues[j][i] != ppValues[0][i])
+				{
+					++n;
+					break;
+				}
+			}
+		}
+
+		const int nBufs = nPresets == 2 ? 3 : 5;
+		mIndexes.Resize(n, false);
+		mBuf.Resize(n * nBufs, false);
+		if (mIndexes.GetSize() != n || mBuf.GetSize() != n * nBufs) return false;
+
+		double* const pBase = mBuf.Get();
+		double* const pDX = pBase + n;
+		double* const pDY = pBase + n * 3;
+		double* const pDXY = pBase + n * 4;
+
+		n = 0;
+		for (int i = 0; i < nValues; ++i)
+		{
+			const double a = ppValues[0][i], b = ppValues[1][i];
+			const double c = nPresets > 2 ? ppValues[2][i] : a;
+			const double d = nPresets > 2 ? ppValues[3][i] : a;
+			if (a == b && a == c && a == d) continue;
+
+			mIndexes.Get()[n] = i;
+			pBase[n] = a;
+			pDX[n] = b - a;
+			if (nPresets > 2)
+			{
+				pDY[n] = c - a;
+				pDXY[n] = a - b - c + d;
+			}
+			++n;
+		}
+
+		mNPresets = nPresets;
+
+		// Force the next Tick() to apply the blend.
+		mLastX = mLastY = -1.0;
+		return true;
+	}
+
+	// Mutex locked.
+	void Clear()
+	{
+		mNPresets = 0;
+		mIndexes.Resize(0, false);
+		mBuf.Resize(0, false);
+	}
+
+	inline bool IsActive() const { return mNPresets > 0; }
+	inline int NPresets() const { return mNPresets; }
+
+	// Any thread. x, y = [0, 1], y is ignored when morphing between 2.
+	inline void SetPosition(const double x, const double y = 0.0)
+	{
+		mX = wdl_max(wdl_min(x, 1.0), 0.0);
+		mY = wdl_max(wdl_min(y, 1.0), 0.0);
+	}
+
+	// Mutex locked. Takes the current position as already applied, so the
+	// next Tick() only blends once the position moves. Call after loading
+	// a state or preset, so its values aren't overwritten by the blend.
+	inline void Sync()
+	{
+		mLastX = mX;
+		mLastY = mNPresets > 2 ? mY : 0.0;
+	}
+
+	inline double GetX() const { return mX; }
+	inline double GetY() const { return mY; }
+
+	// Audio thread. Blends if the position changed, and returns the number
+	// of values in GetIndexes() and GetValues(), or 0 if nothing changed.
+	int Tick()
+	{
+		const double x = mX, y = mNPresets > 2 ? mY : 0.0;
+		if (x == mLastX && y == mLastY) return 0;
+
+		mLastX = x;
+		mLastY = y;
+
+		const int n = mIndexes.GetSize();
+		double* const pBase = mBuf.Get();
+		double* const pOut = pBase + n * 2;
+
+		if (mNPresets > 2)
+			Bilerp(pOut, pBase, pBase + n, pBase + n * 3, pBase + n * 4, x, y, n);
+		else
+			Lerp(pOut, pBase, pBase + n, x, n);
+
+		return n;
+	}
+
+	// Param indexes, and their blended normalized values.
+	inline const int* GetIndexes() const { return mIndexes.Get(); }
+	inline const double* GetValues() const { return mBuf.Get() + mIndexes.GetSize() * 2; }
+
+protected:
+	// out = a + x*dx
+	static void Lerp(double* const pOut, const double* const pA, const double* const pDX, const double x, const int n)
+	{
+		int i = 0;
+
+		#if defined(IPRESETMORPH_SSE2)
+		const __m128d vx = _mm_set1_pd(x);
+		for (; i + 2 <= n; i += 2)
+		{
+			const __m128d v = _mm_add_pd(_mm_loadu_pd(&pA[i]), _mm_mul_pd(_mm_loadu_pd(&pDX[i]), vx));
+			_mm_storeu_pd(&pOut[i], v);
+		}
+		#elif defined(IPRESETMORPH_NEON)
+		const float64x2_t vx = vdupq_n_f64(x);
+		for (; i + 2 <= n; i += 2)
+		{
+			vst1q_f64(&pOut[i], vfmaq_f64(vld1q_f64(&pA[i]), vld1q_f64(&pDX[i]), vx));
+		}
+		#endif
+
+		for (; i < n; ++i) pOut[i] = pA[i] + pDX[i] * x;
+	}
+
+	// out = a + x*dx + y*(dy + x*dxy)
+	static void Bilerp(double* const pOut, const double* const pA, const double* const pDX, const double* const pDY, const double* const pDXY, const double x, const double y, const int n)
+	{
+		int i = 0;
+
+		#if defined(IPRESETMORPH_SSE2)
+		const __m128d vx = _mm_set1_pd(x), vy = _mm_set1_pd(y);
+		for (; i + 2 <= n; i += 2)
+		{
+			const __m128d dy = _mm_add_pd(_mm_loadu_pd(&pDY[i]), _mm_mul_pd(_mm_loadu_pd(&pDXY[i]), vx));
+			const __m128d v = _mm_add_pd(_mm_loadu_pd(&pA[i]), _mm_mul_pd(_mm_loadu_pd(&pDX[i]), vx));
+			_mm_storeu_pd(&pOut[i], _mm_add_pd(v, _mm_mul_pd(dy, vy)));
+		}
+		#elif defined(IPRESETMORPH_NEON)
+		const float64x2_t vx = vdupq_n_f64(x), vy = vdupq_n_f64(y);
+		for (; i + 2 <= n; i += 2)
+		{
+			const float64x2_t dy = vfmaq_f64(vld1q_f64(&pDY[i]), vld1q_f64(&pDXY[i]), vx);
+			const float64x2_t v = vfmaq_f64(vld1q_f64(&pA[i]), vld1q_f64(&pDX[i]), vx);
+			vst1q_f64(&pOut[i], vfmaq_f64(v, dy, vy));
+		}
+		#endif
+
+		for (; i < n; ++i) pOut[i] = pA[i] + pDX[i] * x + (pDY[i] + pDXY[i] * x) * y;
+	}
+
+	// Base (preset A), dX, output, and with 4 presets dY, dXY, n each.
+	WDL_TypedBuf<double> mBuf;
+	WDL_TypedBuf<int> mIndexes;
+
+	volatile double WDL_FIXALIGN mX, mY;
+
+	// Audio thread only.
+	double mLastX, mLastY;
+
+	int mNPresets;
+}
+WDL_FIXALIGN;
@@ -0,0 +1,282 @@
+#include "IRTSafety.h"
+
+#ifdef IPLUG_RT_SAFETY
+
+#ifdef NDEBUG
+	#error "IPLUG_RT_SAFETY requires a debug build"
+#endif
+
+#include "IGraphics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "WDL/wdlatomic.h"
+
+#ifdef _WIN32
+	#include <windows.h>
+	#if defined(_MSC_VER) && defined(_DEBUG)
+		#include <crtdbg.h>
+		#define IRTSAFETY_CRT_ALLOC_HOOK
+	#endif
+#else
+	#include <execinfo.h>
+	#include <pthread.h>
+	#include <unistd.h>
+	#ifdef __APPLE__
+		#include <malloc/malloc.h>
+		#include <mach/mach.h>
+		#define IRTSAFETY_MALLOC_ZONE
+	#endif
+#endif
+
+#ifdef _MSC_VER
+	#include <intrin.h>
+	#define IRTSAFETY_THREAD_LOCAL __declspec(thread)
+	#define IRTSAFETY_CALLER _ReturnAddress()
+#else
+	#define IRTSAFETY_THREAD_LOCAL __thread
+	#define IRTSAFETY_CALLER __builtin_return_address(0)
+#endif
+
+// Per thread: audio thread nesting depth, reporting (so we don't trap
+// ourselves), and violation count.
+enum EThreadVar { kAudioThread = 0, kReporting, kViolations, kNumThreadVars };
+
+#ifdef IRTSAFETY_MALLOC_ZONE
+
+// __thread variables are allocated (with malloc) on first use, so they
+// can't be used in the malloc hook, but pthread keys can.
+static pthread_key_t sThreadKeys[kNumThreadVars];
+static volatile int sThreadKeysCreated = 0;
+
+static inline int GetThreadVar(const int i) { return sThreadKeysCreated ? (int)(intptr_t)pthread_getspecific(sThreadKeys[i]) : 0; }
+static inline void SetThreadVar(const int i, const int value) { if (sThreadKeysCreated) pthread_setspecific(sThreadKeys[i], (void*)(intptr_t)value); }
+
+#else
+
+static IRTSAFETY_THREAD_LOCAL int sThreadVars[kNumThreadVars];
+
+static inline int GetThreadVar(const int i) { return sThreadVars[i]; }
+static inline void SetThreadVar(const int i, const int value) { sThreadVars[i] = value; }
+
+#endif
+
+static inline bool IsTrapping() { return GetThreadVar(kAudioThread) > 0 && !GetThreadVar(kReporting); }
+
+static int sViolations[IRTSafety::kNumViolations];
+static bool sAbort = false;
+
+// Only the first few violations get a full report.
+static const int kMaxReports = 16;
+static int sReports = 0;
+
+// Callers that have already been reported.
+static const int kMaxCallers = 64;
+static const void* volatile sCallers[kMaxCallers];
+static int sNCallers = 0;
+
+#ifdef IRTSAFETY_CRT_ALLOC_HOOK
+
+static _CRT_ALLOC_HOOK sPrevAllocHook = NULL;
+
+static int __cdecl AllocHook(const int allocType, void* const pData, const size_t size, const int blockType, const long request, const unsigned char* const filename, const int line)
+{
+	// CRT internal blocks are allocated by the CRT itself (e.g. stdio).
+	if (IsTrapping() && blockType != _CRT_BLOCK)
+	{
+		IRTSafety::Violation(allocType == _HOOK_FREE ? IRTSafety::kFree : IRTSafety::kAlloc, (int)size);
+	}
+	return sPrevAllocHook ? sPrevAllocHook(allocType, pData, size, blockType, request, filename, line) : TRUE;
+}
+
+#endif
+
+#ifdef IRTSAFETY_MALLOC_ZONE
+
+// The default zone's original functions.
+static malloc_zone_t sPrevZone;
+
+static void* ZoneMalloc(malloc_zone_t* const pZone, const size_t size)
+{
+	if (IsTrapping()) IRTSafety::Violation(IRTSafety::kAlloc, (int)size);
+	return sPrevZone.malloc(pZone, size);
+}
+
+static void* ZoneCalloc(malloc_zone_t* const pZone, const size_t n, const size_t size)
+{
+	if (IsTrapping()) IRTSafety::Violation(IRTSafety::kAlloc, (int)(n * size));
+	return sPrevZone.calloc(pZone, n, size);
+}
+
+static void* ZoneValloc(malloc_zone_t* const pZone, const size_t size)
+{
+	if (IsTrapping()) IRTSafety::Violation(IRTSafety::kAlloc, (int)size);
+	return sPrevZone.valloc(pZone, size);
+}
+
+static void* ZoneRealloc(malloc_zone_t* const pZone, void* const ptr, const size_t size)
+{
+	if (IsTrapping()) IRTSafety::Violation(IRTSafety::kAlloc, (int)size);
+	return sPrevZone.realloc(pZone, ptr, size);
+}
+
+static void* ZoneMemalign(malloc_zone_t* const pZone, const size_t alignment, const size_t size)
+{
+	if (IsTrapping()) IRTSafety::Violation(IRTSafety::kAlloc, (int)size);
+	return sPrevZone.memalign(pZone, alignment, size);
+}
+
+static void ZoneFree(malloc_zone_t* const pZone, void* const ptr)
+{
+	if (ptr && IsTrapping()) IRTSafety::Violation(IRTSafety::kFree);
+	sPrevZone.free(pZone, ptr);
+}
+
+static void ZoneFreeDefiniteSize(malloc_zone_t* const pZone, void* const ptr, const size_t size)
+{
+	if (ptr && IsTrapping()) IRTSafety::Violation(IRTSafety::kFree, (int)size);
+	sPrevZone.free_definite_size(pZone, ptr, size);
+}
+
+static void HookMallocZone()
+{
+	// malloc() goes straight to the first zone, the (virtual) default zone
+	// forwards to it as well.
+	vm_address_t* pZones = NULL;
+	unsigned int nZones = 0;
+	malloc_zone_t* pZone = malloc_default_zone();
+	if (malloc_get_all_zones(mach_task_self(), NULL, &pZones, &nZones) == KERN_SUCCESS && nZones) pZone = (malloc_zone_t*)pZones[0];
+
+	sPrevZone = *pZone;
+
+	// Zones are read-only since macOS 10.7.
+	vm_protect(mach_task_self(), (vm_address_t)pZone, sizeof(malloc_zone_t), 0, VM_PROT_READ | VM_PROT_WRITE);
+
+	pZone->malloc = ZoneMalloc;
+	pZone->calloc = ZoneCalloc;
+	pZone->valloc = ZoneValloc;
+	pZone->realloc = ZoneRealloc;
+	pZone->free = ZoneFree;
+	if (pZone->version >= 5 && pZone->memalign) pZone->memalign = ZoneMemalign;
+	if (pZone->version >= 6 && pZone->free_definite_size) pZone->free_definite_size = ZoneFreeDefiniteSize;
+
+	vm_protect(mach_task_self(), (vm_address_t)pZone, sizeof(malloc_zone_t), 0, VM_PROT_READ);
+}
+
+#endif
+
+void IRTSafety::Init()
+{
+	static int init = 0;
+	if (wdl_atomic_incr(&init) != 1) return;
+
+	#ifdef IRTSAFETY_CRT_ALLOC_HOOK
+	sPrevAllocHook = _CrtSetAllocHook(AllocHook);
+	#endif
+
+	#ifdef IRTSAFETY_MALLOC_ZONE
+	for (int i = 0; i < kNumThreadVars; ++i) pthread_key_create(&sThreadKeys[i], NULL);
+	sThreadKeysCreated = 1;
+	HookMallocZone();
+	#endif
+}
+
+void IRTSafety::EnterAudioThread() { SetThreadVar(kAudioThread, GetThreadVar(kAudioThread) + 1); }
+void IRTSafety::LeaveAudioThread() { SetThreadVar(kAudioThread, GetThreadVar(kAudioThread) - 1); }
+bool IRTSafety::IsAudioThread() { return IsTrapping(); }
+
+// Returns true if caller was already reported, otherwise remembers it.
+static bool IsCallerReported(const void* const caller)
+{
+	const int n = wdl_min(sNCallers, kMaxCallers);
+	for (int i = 0; i < n; ++i)
+	{
+		if (sCallers[i] == caller) return true;
+	}
+
+	const int i = wdl_atomic_incr(&sNCallers) - 1;
+	if (i < kMaxCallers) sCallers[i] = caller;
+	return false;
+}
+
+static void LogStackTrace()
+{
+	static const int kMaxFrames = 32;
+	void* frames[kMaxFrames];
+
+	#ifdef _WIN32
+	const int n = CaptureStackBackTrace(2, kMaxFrames, frames, NULL);
+	for (int i = 0; i < n; ++i)
+	{
+		char str[32];
+		snprintf(str, sizeof(str), "  #%d %p\n", i, frames[i]);
+		IPlugDebugLog(str);
+	}
+	#else
+	// backtrace_symbols_fd() doesn't malloc.
+	const int n = backtrace(frames, kMaxFrames);
+	backtrace_symbols_fd(frames, n, STDERR_FILENO);
+	#endif
+}
+
+void IRTSafety::Violation(const int type, const int size, const void* const caller)
+{
+	if (GetThreadVar(kReporting)) return;
+	SetThreadVar(kReporting, 1);
+
+	wdl_atomic_incr(&sViolations[type]);
+	SetThreadVar(kViolations, GetThreadVar(kViolations) + 1);
+
+	if (sAbort || ((!caller || !IsCallerReported(caller)) && wdl_atomic_incr(&sReports) <= kMaxReports))
+	{
+		static const char* const what[kNumViolations] = { "malloc", "free", "WDL_HeapBuf realloc", "WDL_Mutex enter" };
+
+		char str[96];
+		snprintf(str, sizeof(str), "IRTSafety: %s (%d bytes) on audio thread\n", what[type], size);
+		IPlugDebugLog(str);
+
+		LogStackTrace();
+	}
+
+	if (sAbort) abort();
+
+	SetThreadVar(kReporting, 0);
+}
+
+int IRTSafety::GetViolationCount(const int type)
+{
+	return sViolations[type];
+}
+
+int IRTSafety::GetViolationCount()
+{
+	int n = 0;
+	for (int i = 0; i < kNumViolations; ++i) n += sViolations[i];
+	return n;
+}
+
+int IRTSafety::GetThreadViolationCount()
+{
+	return GetThreadVar(kViolations);
+}
+
+void IRTSafety::SetAbort(const bool abortOnViolation)
+{
+	sAbort = abortOnViolation;
+}
+
+// WDL hooks, see WDL_HEAPBUF_ONREALLOC and WDL_MUTEX_ONENTER.
+
+void IRTSafetyOnHeapBufRealloc(const int newAlloc)
+{
+	if (IRTSafety::IsAudioThread()) IRTSafety::Violation(IRTSafety::kHeapBufRealloc, newAlloc);
+}
+
+void IRTSafetyOnMutexEnter()
+{
+	// WDL_Mutex::Enter() is inlined, so this is where the mutex is taken.
+	if (IRTSafety::IsAudioThread()) IRTSafety::Violation(IRTSafety::kMutexEnter, 0, IRTSAFETY_CALLER);
+}
+
+#endif // IPLUG_RT_SAFETY
@@ -0,0 +1,76 @@
+#pragma once
+
+/*
+	Real-time safety checker for debug builds.
+
+	The API classes mark the audio thread while inside their process
+	callbacks, from right after they lock the plugin mutex (the process
+	lock itself is expected, so it isn't reported). While marked, any heap
+	(de)allocation, WDL_HeapBuf growth, or WDL_Mutex acquisition is
+	reported through IPlugDebugLog() with a stack trace, or aborts the
+	process if SetAbort(true) was called. Each place that takes a mutex is
+	only reported once, so a lock taken every block doesn't crowd out the
+	other reports.
+
+	Enable by defining IPLUG_RT_SAFETY, and hook WDL by defining
+	WDL_HEAPBUF_ONREALLOC=IRTSafetyOnHeapBufRealloc and
+	WDL_MUTEX_ONENTER=IRTSafetyOnMutexEnter (the Debug configurations do
+	this). Heap allocations are trapped through the MSVC debug CRT on
+	Windows, and through the default malloc zone on macOS.
+*/
+
+#ifdef IPLUG_RT_SAFETY
+
+class IRTSafety
+{
+public:
+	enum EViolation
+	{
+		kAlloc = 0,
+		kFree,
+		kHeapBufRealloc,
+		kMutexEnter,
+		kNumViolations
+	};
+
+	// Installs the malloc hook (if available), called by IPlugBase.
+	static void Init();
+
+	static void EnterAudioThread();
+	static void LeaveAudioThread();
+	static bool IsAudioThread();
+
+	// Called by the hooks. If caller isn't NULL, only the first violation
+	// from there is reported (but all are counted).
+	static void Violation(int type, int size = 0, const void* caller = NULL);
+
+	// Total number of violations per type, since the process started.
+	static int GetViolationCount(int type);
+	static int GetViolationCount();
+	// Number of violations on the calling thread, since it started.
+	static int GetThreadViolationCount();
+
+	static void SetAbort(bool abortOnViolation);
+};
+
+// Marks the calling thread as the audio thread while in scope.
+class IRTSafetyScope
+{
+public:
+	IRTSafetyScope(const bool audioThread = true): mAudioThread(audioThread) { if (mAudioThread) IRTSafety::EnterAudioThread(); }
+	~IRTSafetyScope() { if (mAudioThread) IRTSafety::LeaveAudioThread(); }
+
+protected:
+	bool mAudioThread;
+};
+
+#define IPLUG_RT_SAFETY_SCOPE IRTSafetyScope _rtSafetyScope;
+// For callbacks that only sometimes come from the audio thread.
+#define IPLUG_RT_SAFETY_SCOPE_IF(audioThread) IRTSafetyScope _rtSafetyScope(audioThread);
+
+#else
+
+#define IPLUG_RT_SAFETY_SCOPE
+#define IPLUG_RT_SAFETY_SCOPE_IF(audioThread)
+
+#endif // IPLUG_RT_SAFETY
@@ -0,0 +1,280 @@
+#pragma once
+
+/*
+	Number formatting and parsing for param display, without snprintf() and
+	strtod(), so it doesn't allocate, lock, or depend on the C locale (the
+	decimal point is always '.').
+
+	Parse() reads back anything Format() writes exactly, so value -> text
+	-> value -> text always gives the same text. Decimals with up to 15
+	significant digits (which covers any display precision) are converted
+	with a single rounding.
+*/
+
+#include <math.h>
+#include <string.h>
+
+#include "WDL/wdltypes.h"
+
+class IValueText
+{
+public:
+	// Like "%.*f", or "%+.*f" if sign. Returns the length, truncated to
+	// bufSize - 1.
+	static int Format(char* const buf, const int bufSize, const double value, int precision, const bool sign = false)
+	{
+		precision = wdl_max(wdl_min(precision, kMaxPrecision), 0);
+
+		const bool neg = value < 0.0;
+		const double scaled = Scale10(neg ? -value : value, precision) + 0.5;
+		if (!(scaled < 1e18)) return FormatGeneral(buf, bufSize, value, 15);
+
+		const WDL_UINT64 n = (WDL_UINT64)scaled;
+
+		// Right to left.
+		char tmp[kMaxLen];
+		char* p = tmp + kMaxLen;
+
+		WDL_UINT64 r = n;
+		for (int i = 0; i < precision; ++i)
+		{
+			*--p = (char)('0' + (int)(r % 10));
+			r /= 10;
+		}
+		if (precision) *--p = '.';
+		p = WriteDigits(p, r, 1);
+
+		// No "-0.0" for values that round to 0.
+		if (neg && n) *--p = '-';
+		else if (sign) *--p = '+';
+
+		return Copy(buf, bufSize, p, (int)(tmp + kMaxLen - p));
+	}
+
+	// Like "%d", or "%+d" if sign.
+	static int FormatInt(char* const buf, const int bufSize, const int value, const bool sign = false)
+	{
+		const bool neg = value < 0;
+		const WDL_UINT64 n = neg ? (WDL_UINT64)(-(WDL_INT64)value) : (WDL_UINT64)value;
+
+		char tmp[kMaxLen];
+		char* p = WriteDigits(tmp + kMaxLen, n, 1);
+
+		if (neg) *--p = '-';
+		else if (sign && n) *--p = '+';
+
+		return Copy(buf, bufSize, p, (int)(tmp + kMaxLen - p));
+	}
+
+	// Like "%.*g", nDigits = [1, 15].
+	static int FormatGeneral(char* const buf, const int bufSize, const double value, int nDigits = 6)
+	{
+		nDigits = wdl_max(wdl_min(nDigits, 15), 1);
+
+		char tmp[kMaxLen];
+		int len = 0;
+
+		if (value != value) return Copy(buf, bufSize, "nan", 3);
+
+		double a = value;
+		if (a < 0.0)
+		{
+			tmp[len++] = '-';
+			a = -a;
+		}
+
+		if (a > 1.7976931348623157e308) return Copy(buf, bufSize, value < 0.0 ? "-inf" : "inf", value < 0.0 ? 4 : 3);
+		if (a == 0.0) return Copy(buf, bufSize, "0", 1);
+
+		// n = a rounded to nDigits significant digits, a ~= n * 10^(e - nDigits + 1)
+		const double limit = Pow10(nDigits);
+		int e = (int)floor(log10(a));
+		double scaled = floor(Scale10(a, nDigits - 1 - e) + 0.5);
+		if (scaled >= limit) scaled = floor(Scale10(a, nDigits - 1 - ++e) + 0.5);
+		else if (scaled < limit * 0.1) scaled = floor(Scale10(a, nDigits - 1 - --e) + 0.5);
+
+		char digits[kMaxLen];
+		WriteDigits(digits + nDigits, (WDL_UINT64)scaled, nDigits);
+
+		// Trailing zeros aren't significant.
+		int nSig = nDigits;
+		while (nSig > 1 && digits[nSig - 1] == '0') --nSig;
+
+		if (e < -4 || e >= nDigits)
+		{
+			tmp[len++] = digits[0];
+			if (nSig > 1)
+			{
+				tmp[len++] = '.';
+				for (int i = 1; i < nSig; ++i) tmp[len++] = digits[i];
+			}
+
+			tmp[len++] = 'e';
+			tmp[len++] = e < 0 ? '-' : '+';
+
+			char exp[8];
+			const char* pExp = WriteDigits(exp + sizeof(exp), (WDL_UINT64)(e < 0 ? -e : e), 2);
+			while (pExp < exp + sizeof(exp)) tmp[len++] = *pExp++;
+		}
+		else if (e < 0)
+		{
+			tmp[len++] = '0';
+			tmp[len++] = '.';
+			for (int i = e + 1; i < 0; ++i) tmp[len++] = '0';
+			for (int i = 0; i < nSig; ++i) tmp[len++] = digits[i];
+		}
+		else
+		{
+			for (int i = 0; i <= e; ++i) tmp[len++] = digits[i];
+			if (nSig > e + 1)
+			{
+				tmp[len++] = '.';
+				for (int i = e + 1; i < nSig; ++i) tmp[len++] = digits[i];
+			}
+		}
+
+		return Copy(buf, bufSize, tmp, len);
+	}
+
+	// Appends " label" (if not empty) to the len chars in buf.
+	static int AppendLabel(char* const buf, const int bufSize, int len, const char* const label)
+	{
+		if (!label || !*label || len + 1 >= bufSize) return len;
+
+		buf[len++] = ' ';
+		return len + Copy(buf + len, bufSize - len, label, (int)strlen(label));
+	}
+
+	// Parses a decimal number, with optional leading spaces, sign, and
+	// exponent. Accepts ',' as the decimal point as well, as typed in some
+	// locales. Ignores anything after the number (e.g. a label), and sets
+	// *ppEnd to it. Returns false if there is no number.
+	static bool Parse(const char* const str, double* const pValue, const char** const ppEnd = NULL)
+	{
+		const char* p = str;
+		while (*p == ' ' || *p == '\t') ++p;
+
+		const bool neg = *p == '-';
+		if (*p == '-' || *p == '+') ++p;
+
+		// Up to 18 digits, the rest only counts for the exponent.
+		WDL_UINT64 m = 0;
+		int nDigits = 0, exp10 = 0;
+		bool any = false;
+
+		for (; IsDigit(*p); ++p)
+		{
+			any = true;
+			if (nDigits < 18)
+			{
+				m = m * 10 + (*p - '0');
+				if (m) ++nDigits;
+			}
+			else
+			{
+				++exp10;
+			}
+		}
+
+		if (*p == '.' || *p == ',')
+		{
+			for (++p; IsDigit(*p); ++p)
+			{
+				any = true;
+				if (nDigits < 18)
+				{
+					m = m * 10 + (*p - '0');
+					if (m) ++nDigits;
+					--exp10;
+				}
+			}
+		}
+
+		if (!any)
+		{
+			if (ppEnd) *ppEnd = str;
+			return false;
+		}
+
+		if ((*p == 'e' || *p == 'E') && (IsDigit(p[1]) || ((p[1] == '-' || p[1] == '+') && IsDigit(p[2]))))
+		{
+			++p;
+			const bool negExp = *p == '-';
+			if (*p == '-' || *p == '+') ++p;
+
+			int e = 0;
+			for (; IsDigit(*p); ++p)
+			{
+				if (e < 10000) e = e * 10 + (*p - '0');
+			}
+			exp10 += negExp ? -e : e;
+		}
+
+		double v = (double)m;
+		if (m)
+		{
+			// Exact (single rounding) if m and 10^exp10 are exact doubles.
+			if (m < ((WDL_UINT64)1 << 53) && exp10 >= -kMaxExactPow10 && exp10 <= kMaxExactPow10)
+				v = exp10 < 0 ? v / Pow10(-exp10) : v * Pow10(exp10);
+			else
+				v = Scale10(v, exp10);
+		}
+
+		*pValue = neg ? -v : v;
+		if (ppEnd) *ppEnd = p;
+		return true;
+	}
+
+protected:
+	enum
+	{
+		kMaxLen = 40,
+		kMaxPrecision = 15,
+		kMaxExactPow10 = 22
+	};
+
+	static inline bool IsDigit(const char c) { return c >= '0' && c <= '9'; }
+
+	// 10^i for i = [0, 22], exact.
+	static inline double Pow10(const int i)
+	{
+		static const double pow10[kMaxExactPow10 + 1] =
+		{
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+		};
+		return pow10[i];
+	}
+
+	// x * 10^i, dividing for negative i (more accurate than multiplying by
+	// an inexact 10^-i).
+	static double Scale10(double x, int i)
+	{
+		for (; i > kMaxExactPow10; i -= kMaxExactPow10) x *= Pow10(kMaxExactPow10);
+		for (; i < -kMaxExactPow10; i += kMaxExactPow10) x /= Pow10(kMaxExactPow10);
+		return i < 0 ? x / Pow10(-i) : x * Pow10(i);
+	}
+
+	// Writes at least minDigits digits of n, right to left, ending at pEnd,
+	// and returns the first digit.
+	static char* WriteDigits(char* p, WDL_UINT64 n, const int minDigits)
+	{
+		char* const pEnd = p;
+		do
+		{
+			*--p = (char)('0' + (int)(n % 10));
+			n /= 10;
+		}
+		while (n || pEnd - p < minDigits);
+		return p;
+	}
+
+	static int Copy(char* const buf, const int bufSize, const char* const str, int len)
+	{
+		if (bufSize <= 0) return 0;
+		len = wdl_min(len, bufSize - 1);
+		memcpy(buf, str, len);
+		buf[len] = 0;
+		return len;
+	}
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+/*
+	IWakeup lets a GUI reader that stopped polling be woken up by the next
+	update from the audio thread (see IAudioTap and IDSPLoadMeter).
+
+	The target (a proc and its argument) is published as a single pointer,
+	and SetTarget() waits for any wake-up that is still calling the previous
+	target, so a control can clear its target in its destructor without
+	racing the audio thread.
+*/
+
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <sched.h>
+#endif
+
+#include "WDL/wdltypes.h"
+
+class IWakeup
+{
+public:
+	typedef void (*WakeProc)(void* pArg);
+
+	struct Target
+	{
+		WakeProc mProc;
+		void* mArg;
+	};
+
+	IWakeup():
+		mTarget(NULL),
+		mWaiting(0),
+		mBusy(0)
+	{}
+
+	// GUI thread. The target must stay valid until it is replaced (or
+	// cleared with NULL). Doesn't return while the audio thread is still
+	// calling the previous target.
+	void SetTarget(const Target* const pTarget)
+	{
+		mTarget = pTarget;
+		Barrier();
+
+		while (mBusy)
+		{
+			#ifdef _WIN32
+			Sleep(0);
+			#else
+			sched_yield();
+			#endif
+		}
+	}
+
+	// Reader. Call when there was nothing new since lastPos, where *pPos is
+	// the producer's position. Returns true if the next Signal() will call
+	// the target, or false if the producer moved on meanwhile (so read
+	// again instead).
+	bool Request(const volatile unsigned int* const pPos, const unsigned int lastPos)
+	{
+		mWaiting = 1;
+		Barrier();
+		if (*pPos == lastPos) return true;
+
+		mWaiting = 0;
+		return false;
+	}
+
+	// Audio thread, after publishing the new position.
+	inline void Signal()
+	{
+		Barrier();
+		if (mWaiting) Wake();
+	}
+
+	static inline void Barrier()
+	{
+		#ifdef _WIN32
+		MemoryBarrier();
+		#else
+		__sync_synchronize();
+		#endif
+	}
+
+protected:
+	void Wake()
+	{
+		mWaiting = 0;
+
+		// SetTarget() either sees us busy, or we see its new target.
+		mBusy = 1;
+		Barrier();
+
+		const Target* const pTarget = mTarget;
+		if (pTarget) pTarget->mProc(pTarget->mArg);
+
+		Barrier();
+		mBusy = 0;
+	}
+
+	const Target* volatile mTarget;
+	volatile int mWaiting, mBusy;
+};
@@ -1,13 +1,15 @@
 #include "SynthWorxSW1.h"
 #include "IPlug/IPlug_include_in_plug_src.h"
 
-#include <string.h>
+#include <stdio.h>
 
-class IKnobCustomControl: public IKnobMultiControl
+#include "WDL/db2val.h"
+
+class IKnobCustomControl: public IKnobVectorControl
 {
 public:
 	IKnobCustomControl(IPlugBase *pPlug, int x, int y, int paramIdx = -1, const IBitmap *pBitmap = NULL)
-	: IKnobMultiControl(pPlug, x, y, paramIdx, pBitmap) {}
+	: IKnobVectorControl(pPlug, x, y, paramIdx, pBitmap) {}
 
 	void PromptUserInput()
 	{
@@ -17,7 +19,7 @@ public:
 };
 
 SynthWorxSW1::SynthWorxSW1(void *instance):
-  IPLUG_CTOR(kNumParams, 1, instance),
+  IPLUG_CTOR(kNumParams, kNumPresets, instance),
   m_synth(new SawtoothSynth()),
   m_note_on(-1)
 {
@@ -39,7 +41,70 @@ SynthWorxSW1::SynthWorxSW1(void *instance):
   AddParam(kParamLFOFrequency, new IDoubleExpParam(3, "LFO Rate", 2, 0.1, 10, 2, "Hz"));
   AddParam(kParamLFOAmplitude, new IDoubleParam("LFO Depth", 0, 0, 1000, 0, "Hz"));
 
+  // Modulation matrix (no controls, host automation only)
+
+  static const char *const modSourceNames[kNumModSources + 1] = { "None", "LFO", "Envelope", "Velocity", "Aftertouch", "Mod Wheel", "Random" };
+  static const char *const modDestinationNames[kNumModDests] = { "Pitch", "Cutoff", "Resonance", "Amp", "Pan" };
+
+  for (int slot = 0; slot < kNumModSlots; slot++)
+  {
+    int index = kParamMod1Source + slot * kNumModSlotParams;
+    char name[32];
+
+    snprintf(name, sizeof(name), "Mod %d Source", slot + 1);
+    IEnumParam *pSourceParam = AddParam(index, new IEnumParam(name, 0, kNumModSources + 1));
+    for (int i = 0; i <= kNumModSources; i++) pSourceParam->SetDisplayText(i, modSourceNames[i]);
+
+    snprintf(name, sizeof(name), "Mod %d Destination", slot + 1);
+    IEnumParam *pDestinationParam = AddParam(index + 1, new IEnumParam(name, kModDstCutoff, kNumModDests));
+    for (int i = 0; i < kNumModDests; i++) pDestinationParam->SetDisplayText(i, modDestinationNames[i]);
+
+    snprintf(name, sizeof(name), "Mod %d Amount", slot + 1);
+    AddParam(index + 2, new IDoubleParam(name, 0, -100, 100, 0, "%"));
+  }
+
+  // Preset morph, global so presets don't move it
+
+  IDoubleParam *pMorphParam = new IDoubleParam("Morph", 0, 0, 100, 0, "%");
+  pMorphParam->SetGlobal(true);
+  AddParam(kParamMorph, pMorphParam);
+
+  // Smoothing, so automation doesn't zipper
+
+  GetParam(kParamAttackTime)->SetSmoothing(20.0);
+  GetParam(kParamDecayTime)->SetSmoothing(20.0);
+  GetParam(kParamSustainLevel)->SetSmoothing(20.0);
+  GetParam(kParamReleaseTime)->SetSmoothing(20.0);
+
+  GetParam(kParamCutoffFrequency)->SetSmoothing(100.0, IParam::kSmoothOnePole);
+  GetParam(kParamResonance)->SetSmoothing(100.0, IParam::kSmoothOnePole);
+
+  GetParam(kParamLFOFrequency)->SetSmoothing(50.0, IParam::kSmoothOnePole);
+  GetParam(kParamLFOAmplitude)->SetSmoothing(50.0);
+
+  for (int slot = 0; slot < kNumModSlots; slot++)
+  {
+    GetParam(kParamMod1Amount + slot * kNumModSlotParams)->SetSmoothing(20.0);
+  }
+
   MakeDefaultPreset("Default");
+  MakePresetFromNamedParams("Sweep", 9,
+    kParamEnvelope, true,
+    kParamAttackTime, 5.0,
+    kParamDecayTime, 400.0,
+    kParamSustainLevel, -18.0,
+    kParamReleaseTime, 600.0,
+    kParamCutoffFrequency, 800.0,
+    kParamResonance, 3.0,
+    kParamLFOFrequency, 5.0,
+    kParamLFOAmplitude, 600.0);
+
+  // Back to the defaults, and morph between the two.
+  RestorePreset(kPresetDefault);
+  SetMorphPresets(kPresetDefault, kPresetSweep);
+
+  // Fade out/in around state loads during playback
+  SetPatchFade(10.0);
 
   // GUI
 
@@ -48,6 +113,7 @@ SynthWorxSW1::SynthWorxSW1(void *instance):
   pGraphics->SetDefaultScale(IGraphics::kScaleHalf);
   pGraphics->EnableTooltips(true);
   pGraphics->HandleMouseWheel(IGraphics::kMouseWheelModKey);
+  pGraphics->EnableBitmapDiskCache();
 
   IBitmap background(BACKGROUND_PNG_ID, pGraphics->Width(), pGraphics->Height());
   pGraphics->AttachBackground(new IBackgroundControl(this, &background));
@@ -59,7 +125,7 @@ SynthWorxSW1::SynthWorxSW1(void *instance):
   pSwitchControl->SetTooltip("Envelope On/Off");
   pGraphics->AttachControl(pSwitchControl);
 
-  IBitmap knobBitmap(KNOB_PNG_ID, 88, 88, 129);
+  IBitmap knobBitmap(KNOB_PNG_ID, 88, 88);
   IControl *pKnobControl;
 
   pKnobControl = new IKnobCustomControl(this, 62, 150, kParamAttackTime, &knobBitmap);
@@ -96,6 +162,25 @@ SynthWorxSW1::SynthWorxSW1(void *instance):
   pKnobControl->SetTooltip("LFO Depth");
   pGraphics->AttachControl(pKnobControl);
 
+  // Preset morph knob, Default to Sweep
+
+  pKnobControl = new IKnobCustomControl(this, 380, 40, kParamMorph, &knobBitmap);
+  pKnobControl->SetTooltip("Preset Morph");
+  pGraphics->AttachControl(pKnobControl);
+
+  // Output scope, click to switch to spectrum
+
+  IRECT scopeRect(360, 150, 1140, 628);
+  IControl *pScopeControl = new IScopeControl(this, &scopeRect);
+  pScopeControl->SetTooltip("Scope/Spectrum");
+  pGraphics->AttachControl(pScopeControl);
+
+  #ifndef NDEBUG
+  // DSP load overlay, click to log and reset
+  IRECT loadRect(pGraphics->Width() - 340, 8, pGraphics->Width() - 8, 88);
+  pGraphics->AttachControl(new IDSPLoadControl(this, &loadRect));
+  #endif
+
   AttachGraphics(pGraphics);
 }
 
@@ -123,66 +208,105 @@ void SynthWorxSW1::OnParamChange(int index)
       break;
     }
 
+    // Blended at the start of the next block
+    case kParamMorph:
+    {
+      SetMorphPosition(GetParam(index)->GetNormalized());
+      break;
+    }
+
+    // Applied in OnParamSmooth()
+    default:
+    {
+      SmoothParam(index);
+      break;
+    }
+  }
+}
+
+void SynthWorxSW1::OnParamSmooth(int index, double value)
+{
+  switch (index)
+  {
     case kParamAttackTime:
     {
-      double attack = GetParam<IDoubleExpParam>(index)->Value() * 0.001;
+      double attack = value * 0.001;
       SetAttackTime(attack);
       break;
     }
 
     case kParamDecayTime:
     {
-      double decay = GetParam<IDoubleExpParam>(index)->Value() * 0.001;
+      double decay = value * 0.001;
       SetDecayTime(decay);
       break;
     }
 
     case kParamSustainLevel:
     {
-      double sustain = GetParam<IDoubleParam>(index)->DBToAmp();
+      double sustain = DB2VAL(value);
       SetSustainLevel(sustain);
       break;
     }
 
     case kParamReleaseTime:
     {
-      double release = GetParam<IDoubleExpParam>(index)->Value() * 0.001;
+      double release = value * 0.001;
       SetReleaseTime(release);
       break;
     }
 
     case kParamCutoffFrequency:
     {
-      double cutoff = GetParam<IDoubleExpParam>(index)->Value();
+      double cutoff = value;
       SetCutoffFrequency(cutoff);
       break;
     }
 
     case kParamResonance:
     {
-      double resonance = GetParam<IDoubleParam>(index)->Value();
+      double resonance = value;
       SetResonance(resonance);
       break;
     }
 
     case kParamLFOFrequency:
     {
-      double rate = GetParam<IDoubleExpParam>(index)->Value();
+      double rate = value;
       SetLFOFrequency(rate);
       break;
     }
 
     case kParamLFOAmplitude:
     {
-      double depth = GetParam<IDoubleParam>(index)->Value();
+      double depth = value;
       SetLFOAmplitude(depth);
       break;
     }
+
+    default:
+    if (index >= kParamMod1Source && index < kParamMorph)
+    {
+      int slot = (index - kParamMod1Source) / kNumModSlotParams;
+      switch ((index - kParamMod1Source) % kNumModSlotParams)
+      {
+        case 0: m_synth->SetModSource(slot, (int)value - 1); break; // None = -1
+        case 1: m_synth->SetModDestination(slot, (int)value); break;
+        case 2: m_synth->SetModAmount(slot, value * 0.01); break;
+      }
+      break;
+    }
   }
 }
 
 void SynthWorxSW1::Reset()
 {
+  #ifndef NDEBUG
+  int denormals = m_synth->GetDenormalCount();
+  if (denormals) DebugLog("Denormals: %d in voice state", denormals);
+  #endif
+
+  SettleParamSmoothing();
   m_synth->Reset();
 }
 
@@ -204,7 +328,7 @@ void SynthWorxSW1::ProcessMidiQueue(const IMidiMsg *msg)
       SetFrequency(freq);
 
       m_note_on = note;
-      m_synth->Attack();
+      m_synth->NoteOn(msg->mData2 / 127.0);
       break;
     }
 
@@ -216,10 +340,25 @@ void SynthWorxSW1::ProcessMidiQueue(const IMidiMsg *msg)
       break;
     }
 
+    case IMidiMsg::kPolyAftertouch:
+    {
+      int note = msg->mData1;
+
+      if (note == m_note_on) m_synth->SetAftertouch(msg->mData2 / 127.0);
+      break;
+    }
+
+    case IMidiMsg::kChannelAftertouch:
+    {
+      m_synth->SetAftertouch(msg->mData1 / 127.0);
+      break;
+    }
+
     case IMidiMsg::kControlChange:
     {
       int cc = msg->mData1;
 
+      if (cc == IMidiMsg::kModWheel) m_synth->SetModWheel(msg->mData2 / 127.0);
       if (cc == IMidiMsg::kAllNotesOff) m_note_on = -1;
       break;
     }
@@ -252,18 +391,32 @@ void SynthWorxSW1::ProcessDoubleReplacing(const double *const *inputs, double *c
       m_midi_queue.Remove();
     }
 
+    // Sub-blocks while params are smoothing
+    if (ParamsAreSmoothing()) next = wdl_min(next, offset + IParamSmoother::kBlockSize);
+
     int block = next - offset;
+    TickParamSmoothing(block);
+
     bool gate = !pluginIsBypassed && (m_note_on >= 0 || envelopIsEnabled);
-    Process(&outputs[0][offset], block, gate);
+    Process(&outputs[0][offset], &outputs[1][offset], block, gate);
 
     offset = next;
   }
 
-  memcpy(outputs[1], outputs[0], samples * sizeof(double));
-
   m_midi_queue.Flush(samples);
 }
 
+#ifndef NDEBUG
+int SynthWorxSW1::DumpMemoryFootprint()
+{
+  int synthBytes = sizeof(SawtoothSynth);
+  int midiBytes = m_midi_queue.GetSize() * sizeof(IMidiMsg);
+
+  DebugLog("Memory: synth %d, MIDI queue %d", synthBytes, midiBytes);
+  return IPlug::DumpMemoryFootprint() + synthBytes + midiBytes;
+}
+#endif
+
 bool SynthWorxSW1::OnGUIRescale(int wantScale)
 {
 	// Load image set depending on host GUI DPI.
@@ -1,11 +1,18 @@
 #include "IPlug/IPlug_include_in_plug_hdr.h"
 #include "IPlug/IMidiQueue.h"
+#include "IPlug/IModMatrix.h"
 
+#include <float.h>
 #include <math.h>
 
 #include "WDL/wdltypes.h"
 #include "WDL/ptrlist.h"
 
+// Denormals are slow on x87, and on SSE without FTZ.
+static inline bool isDenormal(float x) {
+  return x != 0.0f && fabsf(x) < FLT_MIN;
+}
+
 class SawtoothOscillator {
 public:
   SawtoothOscillator(float frequency, float sampleRate) : m_frequency(frequency), m_sampleRate(sampleRate) {
@@ -25,6 +32,9 @@ public:
     m_phaseIncrement = m_frequency / sampleRate;
   }
 
+  // Pitch modulation, until the next setFrequency()
+  void setPitchRatio(float ratio) { m_phaseIncrement = m_frequency * ratio / m_sampleRate; }
+
   float getNextSample() {
     float output = 2.0 * m_phase - 1.0; // Output a sawtooth wave between -1 and 1
     output = applyAntiAliasing(output);
@@ -64,33 +74,37 @@ public:
     m_cutoffFrequency(cutoffFrequency),
     m_resonance(resonance),
     m_sampleRate(sampleRate),
-    m_cutoffFrequencyTarget(cutoffFrequency),
-    m_resonanceTarget(resonance)
+    m_coefficientsChanged(false)
   {
     reset();
-    calculateSmoothingFactor();
     calculateCoefficients();
   }
 
-  void setCutoffFrequency(float cutoffFrequency) { m_cutoffFrequencyTarget = cutoffFrequency; }
-  void setResonance(float resonance) { m_resonanceTarget = resonance; }
+  // Cutoff frequency/resonance param changes are smoothed by the plugin
+  // (see IPlugBase::SmoothParam()).
+  void setCutoffFrequency(float cutoffFrequency) {
+    if (cutoffFrequency == m_cutoffFrequency) return;
+    m_cutoffFrequency = cutoffFrequency;
+    m_coefficientsChanged = true;
+  }
+
+  void setResonance(float resonance) {
+    if (resonance == m_resonance) return;
+    m_resonance = resonance;
+    m_coefficientsChanged = true;
+  }
 
   void setSampleRate(float sampleRate) {
     m_sampleRate = sampleRate;
 
     reset();
-    calculateSmoothingFactor();
     calculateCoefficients();
   }
 
   float process(float input) {
-    // Smooth cutoff frequency/resonance changes
-    if (m_cutoffFrequency != m_cutoffFrequencyTarget ||
-        m_resonance != m_resonanceTarget)
+    if (m_coefficientsChanged)
     {
-      m_cutoffFrequency = applySmoothing(m_cutoffFrequency, m_cutoffFrequencyTarget);
-      m_resonance = applySmoothing(m_resonance, m_resonanceTarget);
-
+      m_coefficientsChanged = false;
       calculateCoefficients();
     }
 
@@ -111,15 +125,22 @@ public:
     m_x1 = m_x2 = m_y1 = m_y2 = 0.0;
   }
 
-private:
-  float applySmoothing(float currentValue, float targetValue) {
-    return (targetValue - currentValue) * m_smoothingFactor + currentValue;
+  // Zero the state once the tail has decayed below -300 dB, long before it
+  // would turn denormal.
+  void flushTail() {
+    const float threshold = 1e-15f;
+    if (fabsf(m_y1) < threshold && fabsf(m_y2) < threshold &&
+        fabsf(m_x1) < threshold && fabsf(m_x2) < threshold)
+    {
+      reset();
+    }
   }
 
-  void calculateSmoothingFactor() {
-    m_smoothingFactor = 1.0 - exp(-5.0 / (0.100 /* 100 ms */ * m_sampleRate));
+  int denormalCount() const {
+    return isDenormal(m_x1) + isDenormal(m_x2) + isDenormal(m_y1) + isDenormal(m_y2);
   }
 
+private:
   void calculateCoefficients() {
     // Calculate filter coefficients based on cutoff frequency and resonance
     float omega = 2.0 * M_PI * m_cutoffFrequency / m_sampleRate;
@@ -138,11 +159,7 @@ private:
   float m_cutoffFrequency;
   float m_resonance;
   float m_sampleRate;
-
-  // Cutoff frequency/resonance smoothing
-  float m_cutoffFrequencyTarget;
-  float m_resonanceTarget;
-  float m_smoothingFactor;
+  bool m_coefficientsChanged;
 
   float m_x1, m_x2, m_y1, m_y2; // State variables
   float m_b0, m_b1, m_b2, m_a1, m_a2; // Filter coefficients
@@ -179,6 +196,34 @@ private:
   float m_phaseIncrement;
 };
 
+// Modulation matrix sources, LFO and random are bipolar, others are
+// unipolar.
+enum EModSources
+{
+  kModSrcLFO = 0,
+  kModSrcEnvelope,
+  kModSrcVelocity,
+  kModSrcAftertouch,
+  kModSrcModWheel,
+  kModSrcRandom,
+
+  kNumModSources
+};
+
+// Modulation matrix destinations, and their range at full amount.
+enum EModDests
+{
+  kModDstPitch = 0, // +/- 2 octaves
+  kModDstCutoff, // +/- 5 octaves
+  kModDstResonance, // +/- 3.5
+  kModDstAmp, // +/- 100%
+  kModDstPan, // Hard left/right
+
+  kNumModDests
+};
+
+static const int kNumModSlots = 4;
+
 class SawtoothSynth
 {
 public:
@@ -186,17 +231,47 @@ public:
     m_sawtooth(440, sampleRate),
 
     m_cutoffFrequency(1000),
-    m_filter(m_cutoffFrequency, 1.0, sampleRate), // A low-pass filter with initial cutoff frequency and resonance
-    m_lfo(2, 500, sampleRate), // An LFO with frequency 2 Hz, amplitude 500 Hz, and the same sample rate as the audio processing loop
+    m_resonance(1.0),
+    m_filter(m_cutoffFrequency, m_resonance, sampleRate), // A low-pass filter with initial cutoff frequency and resonance
+    m_lfo(2, 1, sampleRate), // A unit LFO with frequency 2 Hz, and the same sample rate as the audio processing loop
+    m_lfoAmplitude(500), // LFO to cutoff frequency in Hz
 
     m_envelopeBypass(true),
     m_sampleRate(sampleRate),
-    m_noteOnTime(0.0)
+    m_noteOnTime(0.0),
+
+    m_velocity(1.0),
+    m_aftertouch(0.0),
+    m_modWheel(0.0),
+    m_random(0.0),
+    m_randomSeed(1),
+    m_pitchModulated(false),
+    m_modRoutesChanged(false)
   {
+    #ifndef NDEBUG
+    m_denormalCount = 0;
+    #endif
+
     m_attackTime = 0.1;
     m_decayTime = 0.2;
     m_sustainLevel = 0.5;
     m_releaseTime = 0.3;
+
+    m_modMatrix.Resize(kNumModSources, kNumModDests, kNumModSlots);
+
+    for (int i = 0; i < kNumModSlots; i++)
+    {
+      m_modRoutes[i].mSrc = -1;
+      m_modRoutes[i].mDst = 0;
+      m_modRoutes[i].mAmount = 0.0;
+    }
+
+    for (int i = 0; i < kNumModSources; i++) m_modSourceBufs[i] = m_modSources[i];
+    for (int i = 0; i < kNumModDests; i++)
+    {
+      m_modDestBufs[i] = m_modDests[i];
+      m_modDestActive[i] = false;
+    }
   }
 
   void SetSampleRate(double rate)
@@ -221,10 +296,25 @@ public:
   void SetReleaseTime(double release) { m_releaseTime = release; }
 
   void SetCutoffFrequency(double cutoff) { m_cutoffFrequency = cutoff; }
-  void SetResonance(double resonance) { m_filter.setResonance(resonance); }
+
+  void SetResonance(double resonance)
+  {
+    m_resonance = resonance;
+    m_filter.setResonance(resonance);
+  }
 
   void SetLFOFrequency(double frequency) { m_lfo.setFrequency(frequency); }
-  void SetLFOAmplitude(double amplitude) { m_lfo.setAmplitude(amplitude); }
+  void SetLFOAmplitude(double amplitude) { m_lfoAmplitude = amplitude; }
+
+  // Modulation matrix slots, compiled at the start of the next Process().
+  // Source -1 = none.
+  void SetModSource(int slot, int source) { m_modRoutes[slot].mSrc = source; m_modRoutesChanged = true; }
+  void SetModDestination(int slot, int destination) { m_modRoutes[slot].mDst = destination; m_modRoutesChanged = true; }
+  void SetModAmount(int slot, double amount) { m_modRoutes[slot].mAmount = amount; m_modRoutesChanged = true; }
+
+  // MIDI modulation sources, [0, 1]
+  void SetAftertouch(double aftertouch) { m_aftertouch = aftertouch; }
+  void SetModWheel(double modWheel) { m_modWheel = modWheel; }
 
   void Reset()
   {
@@ -239,30 +329,163 @@ public:
 
   void Attack() { m_noteOnTime = 0.0; }
 
-  void Process(double *output, int samples, bool gate)
+  void NoteOn(double velocity)
   {
-    // The synthesizer's rendering loop
-    float sample;
+    Attack();
+    m_velocity = velocity;
+
+    // New random modulation value per note, [-1, 1)
+    m_randomSeed = m_randomSeed * 1664525 + 1013904223;
+    m_random = (double)(m_randomSeed >> 8) * (2.0 / 16777216.0) - 1.0;
+  }
+
+  void Process(double *left, double *right, int samples, bool gate)
+  {
+    if (m_modRoutesChanged)
+    {
+      m_modRoutesChanged = false;
+      m_modMatrix.Compile(m_modRoutes, kNumModSlots);
+      for (int i = 0; i < kNumModDests; i++) m_modDestActive[i] = m_modMatrix.IsDestActive(i);
+    }
+
+    // Undo modulation of removed routes
+    if (!m_modDestActive[kModDstPitch] && m_pitchModulated)
+    {
+      m_sawtooth.setPitchRatio(1.0);
+      m_pitchModulated = false;
+    }
+    if (!m_modDestActive[kModDstResonance]) m_filter.setResonance(m_resonance);
+
+    for (int offset = 0; offset < samples; offset += kModBlockSize)
+    {
+      int block = samples - offset < kModBlockSize ? samples - offset : kModBlockSize;
+      ProcessBlock(&left[offset], &right[offset], block, gate);
+    }
+
+    #ifndef NDEBUG
+    m_denormalCount += m_filter.denormalCount();
+    #endif
+
+    m_filter.flushTail();
+  }
+
+  #ifndef NDEBUG
+  // Denormal filter state variables seen at the end of a block.
+  int GetDenormalCount() const { return m_denormalCount; }
+  #endif
+
+private:
+  // Modulation sources/destinations are evaluated per sub-block.
+  static const int kModBlockSize = 32;
+
+  void ProcessBlock(double *left, double *right, int samples, bool gate)
+  {
+    double *lfo = m_modSources[kModSrcLFO];
+    double *envelope = m_modSources[kModSrcEnvelope];
+
     for (int i = 0; i < samples; i++)
     {
+      lfo[i] = m_lfo.getNextSample();
+
       // Calculate the envelope value for each sample
       float time = i / m_sampleRate;
-      float envelope = adsrEnvelope(time, m_noteOnTime);
-      sample = m_sawtooth.getNextSample() * envelope;
+      envelope[i] = adsrEnvelope(time, m_noteOnTime);
+    }
+
+    m_noteOnTime -= samples / m_sampleRate;
+
+    if (m_modMatrix.IsActive()) Modulate(samples);
+
+    const bool pitchMod = m_modDestActive[kModDstPitch];
+    const bool cutoffMod = m_modDestActive[kModDstCutoff];
+    const bool resonanceMod = m_modDestActive[kModDstResonance];
+    const bool ampMod = m_modDestActive[kModDstAmp];
+    const bool panMod = m_modDestActive[kModDstPan];
+
+    // The synthesizer's rendering loop
+    float sample;
+    for (int i = 0; i < samples; i++)
+    {
+      if (pitchMod) m_sawtooth.setPitchRatio(m_modDests[kModDstPitch][i]);
+      sample = m_sawtooth.getNextSample() * envelope[i];
 
       sample *= 0.25; // -12 dB
+      if (ampMod) sample *= m_modDests[kModDstAmp][i];
       sample = gate ? sample : 0.0;
 
-      float lfoOutput = m_lfo.getNextSample(); // Get the next sample of the LFO
-      m_filter.setCutoffFrequency(m_cutoffFrequency + lfoOutput); // Set the filter cutoff frequency to the initial value plus the LFO output
-      float input = sample; // Get the next sample from your sound source
-      output[i] = m_filter.process(input); // Filter the input using the modified cutoff frequency
+      float cutoff = m_cutoffFrequency + m_lfoAmplitude * lfo[i]; // The initial cutoff frequency plus the LFO output
+      if (cutoffMod) cutoff *= m_modDests[kModDstCutoff][i];
+      m_filter.setCutoffFrequency(cutoff);
+      if (resonanceMod) m_filter.setResonance(m_modDests[kModDstResonance][i]);
+
+      float output = m_filter.process(sample); // Filter the input using the modified cutoff frequency
+
+      if (panMod)
+      {
+        double pan = m_modDests[kModDstPan][i];
+        left[i] = output * (pan > 0.0 ? 1.0 - pan : 1.0);
+        right[i] = output * (pan < 0.0 ? 1.0 + pan : 1.0);
+      }
+      else
+      {
+        left[i] = right[i] = output;
+      }
     }
+  }
 
-    m_noteOnTime -= samples / m_sampleRate;
+  // Runs the modulation matrix, and maps its output to the ranges of the
+  // destinations.
+  void Modulate(int samples)
+  {
+    // Per note/controller sources, only if routed
+    const double constants[kNumModSources] = { 0.0, 0.0, m_velocity, m_aftertouch, m_modWheel, m_random };
+    for (int src = kModSrcVelocity; src < kNumModSources; src++)
+    {
+      if (!m_modMatrix.IsSourceUsed(src)) continue;
+      for (int i = 0; i < samples; i++) m_modSources[src][i] = constants[src];
+    }
+
+    m_modMatrix.Process(m_modSourceBufs, m_modDestBufs, samples);
+
+    // Octaves to frequency ratios
+    if (m_modDestActive[kModDstPitch])
+    {
+      double *pitch = m_modDests[kModDstPitch];
+      for (int i = 0; i < samples; i++) pitch[i] *= 2.0 * M_LN2;
+      IFastMath::Exp(pitch, pitch, samples);
+      m_pitchModulated = true;
+    }
+
+    if (m_modDestActive[kModDstCutoff])
+    {
+      double *cutoff = m_modDests[kModDstCutoff];
+      for (int i = 0; i < samples; i++) cutoff[i] *= 5.0 * M_LN2;
+      IFastMath::Exp(cutoff, cutoff, samples);
+    }
+
+    if (m_modDestActive[kModDstResonance])
+    {
+      double *resonance = m_modDests[kModDstResonance];
+      for (int i = 0; i < samples; i++)
+      {
+        double value = m_resonance + 3.5 * resonance[i];
+        resonance[i] = value < 0.5 ? 0.5 : value > 4.0 ? 4.0 : value;
+      }
+    }
+
+    if (m_modDestActive[kModDstAmp])
+    {
+      double *amp = m_modDests[kModDstAmp];
+      for (int i = 0; i < samples; i++) amp[i] = amp[i] > -1.0 ? 1.0 + amp[i] : 0.0;
+    }
+
+    if (m_modDestActive[kModDstPan])
+    {
+      double *pan = m_modDests[kModDstPan];
+      for (int i = 0; i < samples; i++) pan[i] = pan[i] < -1.0 ? -1.0 : pan[i] > 1.0 ? 1.0 : pan[i];
+    }
   }
 
-private:
   // A function to calculate the envelope value at a given time
   float adsrEnvelope(float time, float noteOnTime)
   {
@@ -281,26 +504,60 @@ private:
     }
     else
     {
-      // Sustain or Release phase
-      return m_sustainLevel * exp(-(deltaTime - m_attackTime - m_decayTime) / m_releaseTime);
+      // Sustain or Release phase, silent below -120 dB
+      float level = m_sustainLevel * exp(-(deltaTime - m_attackTime - m_decayTime) / m_releaseTime);
+      return level > 1e-6f ? level : 0.0;
     }
   }
 
   SawtoothOscillator m_sawtooth;
 
   float m_cutoffFrequency;
+  float m_resonance;
   LowPassFilter m_filter;
   SineLFO m_lfo;
+  float m_lfoAmplitude;
 
   bool m_envelopeBypass;
   float m_sampleRate;
   float m_noteOnTime;
 
+  // Modulation matrix
+  IModMatrix m_modMatrix;
+  IModMatrix::Route m_modRoutes[kNumModSlots];
+  bool m_modDestActive[kNumModDests];
+
+  double m_modSources[kNumModSources][kModBlockSize];
+  double m_modDests[kNumModDests][kModBlockSize];
+  const double *m_modSourceBufs[kNumModSources];
+  double *m_modDestBufs[kNumModDests];
+
+  double m_velocity;
+  double m_aftertouch;
+  double m_modWheel;
+  double m_random;
+  unsigned int m_randomSeed;
+  bool m_pitchModulated;
+  bool m_modRoutesChanged;
+
   // ADSR parameters
   float m_attackTime; // Time for the amplitude to reach its peak
   float m_decayTime; // Time for the amplitude to decay from peak to sustain level
   float m_sustainLevel; // Level at which the amplitude sustains
   float m_releaseTime; // Time for the amplitude to decay from sustain level to zero
+
+  #ifndef NDEBUG
+  int m_denormalCount;
+  #endif
+};
+
+// Built-in presets, the morph goes from kPresetDefault to kPresetSweep.
+enum EPresets
+{
+  kPresetDefault = 0,
+  kPresetSweep,
+
+  kNumPresets
 };
 
 enum EParams
@@ -319,9 +576,28 @@ enum EParams
   kParamLFOFrequency,
   kParamLFOAmplitude,
 
+  // Modulation matrix, kNumModSlots times source, destination, amount
+  kParamMod1Source,
+  kParamMod1Destination,
+  kParamMod1Amount,
+  kParamMod2Source,
+  kParamMod2Destination,
+  kParamMod2Amount,
+  kParamMod3Source,
+  kParamMod3Destination,
+  kParamMod3Amount,
+  kParamMod4Source,
+  kParamMod4Destination,
+  kParamMod4Amount,
+
+  // Morph between the built-in presets
+  kParamMorph,
+
   kNumParams
 };
 
+static const int kNumModSlotParams = kParamMod2Source - kParamMod1Source;
+
 class SynthWorxSW1 : public IPlug
 {
 public:
@@ -332,6 +608,7 @@ public:
   void SetBlockSize(int size);
 
   void OnParamChange(int index);
+  void OnParamSmooth(int index, double value);
 
   void SetFrequency(double frequency) { m_synth->SetFrequency(frequency); }
 
@@ -354,13 +631,17 @@ public:
 
   void ProcessDoubleReplacing(const double *const *inputs, double *const *outputs, int samples);
 
-  void Process(double *output, int samples, bool gate)
+  void Process(double *left, double *right, int samples, bool gate)
   {
-    m_synth->Process(output, samples, gate);
+    m_synth->Process(left, right, samples, gate);
   }
 
   bool OnGUIRescale(int wantScale);
 
+  #ifndef NDEBUG
+  int DumpMemoryFootprint();
+  #endif
+
 private:
   SawtoothSynth *m_synth;
 
@@ -44,6 +44,11 @@
 
 #include "wdltypes.h"
 
+#ifdef WDL_HEAPBUF_ONREALLOC
+// define to the name of a function that is called whenever the allocation size changes
+void WDL_HEAPBUF_ONREALLOC(int newalloc);
+#endif
+
 class WDL_HeapBuf
 {
   public:
@@ -156,6 +161,9 @@ class WDL_HeapBuf
          
               if (newalloc != m_alloc)
               {
+                #ifdef WDL_HEAPBUF_ONREALLOC
+                  WDL_HEAPBUF_ONREALLOC(newalloc);
+                #endif
 
                 #ifdef WDL_HEAPBUF_TRACE
                   wdl_log("WDL_HeapBuf: type %s realloc(%d) from %d\n",m_tracetype,newalloc,m_alloc);
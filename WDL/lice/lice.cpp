@@ -17,6 +17,7 @@
 #include <stdio.h> // only included in case we need to debug with sprintf etc
 
 #include "lice_combine.h"
+#include "lice_simd.h"
 #include "lice_extended.h"
 
 #ifndef _WIN32
@@ -1068,6 +1069,11 @@ static void LICE_BlitInt(LICE_IBitmap *dest, LICE_IBitmap *src, int dstx, int ds
   else 
   {
     int ia=(int)(alpha*256.0);
+
+    #ifndef LICE_NO_SIMD
+        if (LICE_SIMD_Blit(pdest,psrc,cpsize,i,src_span,dest_span,ia,mode)) return;
+    #endif
+
     #ifdef LICE_FAVOR_SIZE
         LICE_COMBINEFUNC blitfunc=NULL;      
         #define __LICE__ACTION(comb) blitfunc=comb::doPix;
@@ -1411,6 +1417,9 @@ void LICE_ScaledBlit(LICE_IBitmap *dest, LICE_IBitmap *src,
     }
     else
     {
+      #ifndef LICE_NO_SIMD
+        if (LICE_SIMD_ScaledBlit(pdest,psrc,dstw,dsth,icurx,icury,idx,idy,clip_r,clip_b,src_span,dest_span,ia,mode)) return;
+      #endif
       _LICE_Template_Blit0<_LICE_CombinePixelsClobberFAST>::scaleBlitFAST(pdest,psrc,dstw,dsth,icurx,icury,idx,idy,clip_r,clip_b,src_span,dest_span);
     }
   }
@@ -1467,6 +1476,10 @@ void LICE_ScaledBlit(LICE_IBitmap *dest, LICE_IBitmap *src,
     }
     else
     {
+      #ifndef LICE_NO_SIMD
+        if (LICE_SIMD_ScaledBlit(pdest,psrc,dstw,dsth,icurx,icury,idx,idy,clip_r,clip_b,src_span,dest_span,ia,mode)) return;
+      #endif
+
       #ifdef LICE_FAVOR_SIZE
         LICE_COMBINEFUNC blitfunc=NULL;      
         #define __LICE__ACTION(comb) blitfunc=comb::doPix;
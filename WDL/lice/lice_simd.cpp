@@ -0,0 +1,809 @@
+/*
+  Cockos WDL - LICE - Lightweight Image Compositing Engine
+  File: lice_simd.cpp (SIMD blit kernels)
+  See lice.h for license and other information
+*/
+
+#include "lice_simd.h"
+#include "lice_combine.h"
+#include "../wdltypes.h"
+
+#include <string.h>
+
+#if !defined(LICE_NO_SIMD) && LICE_PIXEL_A == 3
+  #if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    #define LICE_SIMD_X86
+  #elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+    #define LICE_SIMD_ARM
+  #endif
+#endif
+
+#ifdef LICE_SIMD_X86
+  #include <emmintrin.h>
+  #include <immintrin.h>
+  #ifdef _MSC_VER
+    #include <intrin.h>
+    #define LICE_SIMD_SSE2_TARGET
+    #define LICE_SIMD_AVX2_TARGET
+  #else
+    #ifdef __SSE2__
+      #define LICE_SIMD_SSE2_TARGET
+    #else
+      #define LICE_SIMD_SSE2_TARGET __attribute__((target("sse2")))
+    #endif
+    #define LICE_SIMD_AVX2_TARGET __attribute__((target("avx2")))
+  #endif
+#endif
+
+#ifdef LICE_SIMD_ARM
+  #include <arm_neon.h>
+#endif
+
+// Processes as many pixels of a row as it can (a multiple of the vector
+// size), and returns how many. The rest is done by the scalar combine.
+typedef int (*LICE_SIMD_RowFunc)(LICE_pixel_chan *dest, const LICE_pixel_chan *src, int n, int ia);
+
+// Scaled row, from 16.16 source x curx stepping by idx. Processes as many
+// of the n pixels as it can, and returns how many. The caller only passes
+// pixels whose source pixels (and their right and lower neighbours, when
+// filtering) are inside the clip.
+typedef int (*LICE_SIMD_ScaledCopyFunc)(LICE_pixel_chan *dest, const LICE_pixel_chan *src, int n, int curx, int idx);
+typedef int (*LICE_SIMD_ScaledBilinearFunc)(LICE_pixel_chan *dest, const LICE_pixel_chan *src, const LICE_pixel_chan *srcnext, int n, int curx, int idx, int yfrac);
+
+struct LICE_SIMD_Kernels
+{
+  LICE_SIMD_RowFunc copySrcAlpha; // _LICE_CombinePixelsCopySourceAlpha[IgnoreAlphaParm]NoClamp
+  LICE_SIMD_RowFunc addSrcAlpha; // _LICE_CombinePixelsAddSourceAlpha
+  LICE_SIMD_ScaledCopyFunc scaledCopy; // _LICE_CombinePixelsClobberFAST, no filter
+  LICE_SIMD_ScaledBilinearFunc scaledBilinear; // __LICE_BilinearFilterI, _LICE_CombinePixelsClobberNoClamp
+};
+
+// The bilinear kernels compute p1*f1 + p2*f2 + p3*f3 + p4*f4 in float. The
+// weights add up to 65536, so every product and partial sum is an integer
+// below 2^24, which float represents exactly: the result matches the
+// scalar integer math.
+
+
+#ifdef LICE_SIMD_X86
+
+// s + (d-s)*sc/256 for 16-bit channels, rounding toward zero like the
+// scalar code. (d-s)*sc doesn't fit in 16 bits, so this uses the high and
+// low halves of the product.
+static inline __m128i LICE_SIMD_SSE2_TARGET _SSE2_Lerp(const __m128i s, const __m128i d, const __m128i sc)
+{
+  const __m128i diff = _mm_sub_epi16(d, s);
+  const __m128i lo = _mm_mullo_epi16(diff, sc);
+  const __m128i hi = _mm_mulhi_epi16(diff, sc); // 0 or -1
+  __m128i q = _mm_or_si128(_mm_slli_epi16(hi, 8), _mm_srli_epi16(lo, 8));
+  q = _mm_sub_epi16(q, _mm_andnot_si128(_mm_cmpeq_epi16(_mm_and_si128(lo, _mm_set1_epi16(0xff)), _mm_setzero_si128()), hi));
+  return _mm_add_epi16(s, q);
+}
+
+// Per pixel 32-bit value (<= 256) to 4x16-bit, for the low/high 2 pixels.
+static inline __m128i LICE_SIMD_SSE2_TARGET _SSE2_Spread16(const __m128i v)
+{
+  return _mm_or_si128(v, _mm_slli_epi32(v, 16));
+}
+
+static int LICE_SIMD_SSE2_TARGET _SSE2_CopySrcAlpha(LICE_pixel_chan *dest, const LICE_pixel_chan *src, int n, int ia)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi32(1), c255 = _mm_set1_epi32(255), c256 = _mm_set1_epi32(256);
+  const __m128i ia32 = _mm_set1_epi32(ia);
+  const __m128i rgbmask = _mm_set1_epi32(0x00ffffff);
+  const bool ignoreParm = ia == 256;
+
+  int i=0;
+  for (; i+4<=n; i+=4)
+  {
+    const __m128i s = _mm_loadu_si128((const __m128i*)(src+i*4));
+    const __m128i d = _mm_loadu_si128((const __m128i*)(dest+i*4));
+
+    const __m128i a = _mm_srli_epi32(s, 24);
+    const __m128i w = _mm_srli_epi32(_mm_madd_epi16(_mm_add_epi32(a, one), ia32), 8);
+    const __m128i sc = _SSE2_Spread16(_mm_sub_epi32(c256, w));
+
+    // min(255, w + dest alpha), with w = a if ignoring the alpha parameter
+    const __m128i outa = _mm_slli_epi32(_mm_min_epi16(_mm_add_epi32(ignoreParm ? a : w, _mm_srli_epi32(d, 24)), c255), 24);
+
+    const __m128i lo = _SSE2_Lerp(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi32(sc, sc));
+    const __m128i hi = _SSE2_Lerp(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi32(sc, sc));
+    __m128i r = _mm_or_si128(_mm_and_si128(_mm_packus_epi16(lo, hi), rgbmask), outa);
+
+    const __m128i skip = _mm_cmpeq_epi32(a, zero);
+    r = _mm_or_si128(_mm_and_si128(skip, d), _mm_andnot_si128(skip, r));
+    _mm_storeu_si128((__m128i*)(dest+i*4), r);
+  }
+  return i;
+}
+
+static int LICE_SIMD_SSE2_TARGET _SSE2_AddSrcAlpha(LICE_pixel_chan *dest, const LICE_pixel_chan *src, int n, int ia)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi32(1);
+  const __m128i ia32 = _mm_set1_epi32(ia);
+
+  int i=0;
+  for (; i+4<=n; i+=4)
+  {
+    const __m128i s = _mm_loadu_si128((const __m128i*)(src+i*4));
+    const __m128i d = _mm_loadu_si128((const __m128i*)(dest+i*4));
+
+    const __m128i a = _mm_srli_epi32(s, 24);
+    const __m128i al = _SSE2_Spread16(_mm_srli_epi32(_mm_madd_epi16(_mm_add_epi32(a, one), ia32), 8));
+
+    // s*al <= 255*256, so unsigned 16-bit is enough
+    const __m128i lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi32(al, al)), 8);
+    const __m128i hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi32(al, al)), 8);
+    __m128i r = _mm_adds_epu8(d, _mm_packus_epi16(lo, hi));
+
+    const __m128i skip = _mm_cmpeq_epi32(a, zero);
+    r = _mm_or_si128(_mm_and_si128(skip, d), _mm_andnot_si128(skip, r));
+    _mm_storeu_si128((__m128i*)(dest+i*4), r);
+  }
+  return i;
+}
+
+static int LICE_SIMD_SSE2_TARGET _SSE2_ScaledCopy(LICE_pixel_chan *dest, const LICE_pixel_chan *src, int n, int curx, int idx)
+{
+  const LICE_pixel *in = (const LICE_pixel *)src;
+
+  int i=0;
+  for (; i+4<=n; i+=4, curx+=idx*4)
+  {
+    const __m128i p = _mm_set_epi32((int)in[(curx+idx*3)>>16], (int)in[(curx+idx*2)>>16], (int)in[(curx+idx)>>16], (int)in[curx>>16]);
+    _mm_storeu_si128((__m128i*)(dest+i*4), p);
+  }
+  return i;
+}
+
+static inline __m128i LICE_SIMD_SSE2_TARGET _SSE2_BilinearChan(const __m128i p1, const __m128i p2, const __m128i p3, const __m128i p4,
+                                                               const __m128 f1, const __m128 f2, const __m128 f3, const __m128 f4, const int shift)
+{
+  const __m128i mask = _mm_set1_epi32(0xff);
+  __m128 sum = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p1, shift), mask)), f1);
+  sum = _mm_add_ps(sum, _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p2, shift), mask)), f2));
+  sum = _mm_add_ps(sum, _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p3, shift), mask)), f3));
+  sum = _mm_add_ps(sum, _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p4, shift), mask)), f4));
+  return _mm_slli_epi32(_mm_srli_epi32(_mm_cvttps_epi32(sum), 16), shift);
+}
+
+static int LICE_SIMD_SSE2_TARGET _SSE2_ScaledBilinear(LICE_pixel_chan *dest, const LICE_pixel_chan *src, const LICE_pixel_chan *srcnext, int n, int curx, int idx, int yfrac)
+{
+  const LICE_pixel *in = (const LICE_pixel *)src, *innext = (const LICE_pixel *)srcnext;
+  const __m128i fracmask = _mm_set1_epi32(0xffff), c65536 = _mm_set1_epi32(65536);
+  const __m128i yf = _mm_set1_epi32(yfrac);
+
+  int i=0;
+  for (; i+4<=n; i+=4, curx+=idx*4)
+  {
+    const __m128i x = _mm_set_epi32(curx+idx*3, curx+idx*2, curx+idx, curx);
+    int offs[4];
+    _mm_storeu_si128((__m128i*)offs, _mm_srli_epi32(x, 16));
+
+    const __m128i p1 = _mm_set_epi32((int)in[offs[3]], (int)in[offs[2]], (int)in[offs[1]], (int)in[offs[0]]);
+    const __m128i p2 = _mm_set_epi32((int)in[offs[3]+1], (int)in[offs[2]+1], (int)in[offs[1]+1], (int)in[offs[0]+1]);
+    const __m128i p3 = _mm_set_epi32((int)innext[offs[3]], (int)innext[offs[2]], (int)innext[offs[1]], (int)innext[offs[0]]);
+    const __m128i p4 = _mm_set_epi32((int)innext[offs[3]+1], (int)innext[offs[2]+1], (int)innext[offs[1]+1], (int)innext[offs[0]+1]);
+
+    // (xfrac*yfrac)>>16, both fit in the low 16 bits
+    const __m128i xf = _mm_and_si128(x, fracmask);
+    const __m128i f4 = _mm_mulhi_epu16(xf, yf);
+    const __m128 f1 = _mm_cvtepi32_ps(_mm_add_epi32(_mm_sub_epi32(_mm_sub_epi32(c65536, yf), xf), f4));
+    const __m128 f2 = _mm_cvtepi32_ps(_mm_sub_epi32(xf, f4));
+    const __m128 f3 = _mm_cvtepi32_ps(_mm_sub_epi32(yf, f4));
+    const __m128 f4f = _mm_cvtepi32_ps(f4);
+
+    __m128i r = _SSE2_BilinearChan(p1, p2, p3, p4, f1, f2, f3, f4f, 0);
+    r = _mm_or_si128(r, _SSE2_BilinearChan(p1, p2, p3, p4, f1, f2, f3, f4f, 8));
+    r = _mm_or_si128(r, _SSE2_BilinearChan(p1, p2, p3, p4, f1, f2, f3, f4f, 16));
+    r = _mm_or_si128(r, _SSE2_BilinearChan(p1, p2, p3, p4, f1, f2, f3, f4f, 24));
+    _mm_storeu_si128((__m128i*)(dest+i*4), r);
+  }
+  return i;
+}
+
+// Same as SSE2, 8 pixels at a time. The unpacks work per 128-bit lane, as
+// does packus, so the pixel order comes out right.
+
+static inline __m256i LICE_SIMD_AVX2_TARGET _AVX2_Lerp(const __m256i s, const __m256i d, const __m256i sc)
+{
+  const __m256i diff = _mm256_sub_epi16(d, s);
+  const __m256i lo = _mm256_mullo_epi16(diff, sc);
+  const __m256i hi = _mm256_mulhi_epi16(diff, sc);
+  __m256i q = _mm256_or_si256(_mm256_slli_epi16(hi, 8), _mm256_srli_epi16(lo, 8));
+  q = _mm256_sub_epi16(q, _mm256_andnot_si256(_mm256_cmpeq_epi16(_mm256_and_si256(lo, _mm256_set1_epi16(0xff)), _mm256_setzero_si256()), hi));
+  return _mm256_add_epi16(s, q);
+}
+
+static inline __m256i LICE_SIMD_AVX2_TARGET _AVX2_Spread16(const __m256i v)
+{
+  return _mm256_or_si256(v, _mm256_slli_epi32(v, 16));
+}
+
+static int LICE_SIMD_AVX2_TARGET _AVX2_CopySrcAlpha(LICE_pixel_chan *dest, const LICE_pixel_chan *src, int n, int ia)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi32(1), c255 = _mm256_set1_epi32(255), c256 = _mm256_set1_epi32(256);
+  const __m256i ia32 = _mm256_set1_epi32(ia);
+  const __m256i rgbmask = _mm256_set1_epi32(0x00ffffff);
+  const bool ignoreParm = ia == 256;
+
+  int i=0;
+  for (; i+8<=n; i+=8)
+  {
+    const __m256i s = _mm256_loadu_si256((const __m256i*)(src+i*4));
+    const __m256i d = _mm256_loadu_si256((const __m256i*)(dest+i*4));
+
+    const __m256i a = _mm256_srli_epi32(s, 24);
+    const __m256i w = _mm256_srli_epi32(_mm256_madd_epi16(_mm256_add_epi32(a, one), ia32), 8);
+    const __m256i sc = _AVX2_Spread16(_mm256_sub_epi32(c256, w));
+
+    const __m256i outa = _mm256_slli_epi32(_mm256_min_epi16(_mm256_add_epi32(ignoreParm ? a : w, _mm256_srli_epi32(d, 24)), c255), 24);
+
+    const __m256i lo = _AVX2_Lerp(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi32(sc, sc));
+    const __m256i hi = _AVX2_Lerp(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi32(sc, sc));
+    __m256i r = _mm256_or_si256(_mm256_and_si256(_mm256_packus_epi16(lo, hi), rgbmask), outa);
+
+    r = _mm256_blendv_epi8(r, d, _mm256_cmpeq_epi32(a, zero));
+    _mm256_storeu_si256((__m256i*)(dest+i*4), r);
+  }
+  return i;
+}
+
+static int LICE_SIMD_AVX2_TARGET _AVX2_AddSrcAlpha(LICE_pixel_chan *dest, const LICE_pixel_chan *src, int n, int ia)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i ia32 = _mm256_set1_epi32(ia);
+
+  int i=0;
+  for (; i+8<=n; i+=8)
+  {
+    const __m256i s = _mm256_loadu_si256((const __m256i*)(src+i*4));
+    const __m256i d = _mm256_loadu_si256((const __m256i*)(dest+i*4));
+
+    const __m256i a = _mm256_srli_epi32(s, 24);
+    const __m256i al = _AVX2_Spread16(_mm256_srli_epi32(_mm256_madd_epi16(_mm256_add_epi32(a, one), ia32), 8));
+
+    const __m256i lo = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi32(al, al)), 8);
+    const __m256i hi = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi32(al, al)), 8);
+    __m256i r = _mm256_adds_epu8(d, _mm256_packus_epi16(lo, hi));
+
+    r = _mm256_blendv_epi8(r, d, _mm256_cmpeq_epi32(a, zero));
+    _mm256_storeu_si256((__m256i*)(dest+i*4), r);
+  }
+  return i;
+}
+
+static int LICE_SIMD_AVX2_TARGET _AVX2_ScaledCopy(LICE_pixel_chan *dest, const LICE_pixel_chan *src, int n, int curx, int idx)
+{
+  const __m256i step = _mm256_set1_epi32(idx*8);
+  __m256i x = _mm256_add_epi32(_mm256_set1_epi32(curx), _mm256_mullo_epi32(_mm256_set1_epi32(idx), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+
+  int i=0;
+  for (; i+8<=n; i+=8, x=_mm256_add_epi32(x, step))
+  {
+    const __m256i p = _mm256_i32gather_epi32((const int *)src, _mm256_srli_epi32(x, 16), 4);
+    _mm256_storeu_si256((__m256i*)(dest+i*4), p);
+  }
+  return i;
+}
+
+static inline __m256i LICE_SIMD_AVX2_TARGET _AVX2_BilinearChan(const __m256i p1, const __m256i p2, const __m256i p3, const __m256i p4,
+                                                               const __m256 f1, const __m256 f2, const __m256 f3, const __m256 f4, const int shift)
+{
+  const __m256i mask = _mm256_set1_epi32(0xff);
+  __m256 sum = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(p1, shift), mask)), f1);
+  sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(p2, shift), mask)), f2));
+  sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(p3, shift), mask)), f3));
+  sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(p4, shift), mask)), f4));
+  return _mm256_slli_epi32(_mm256_srli_epi32(_mm256_cvttps_epi32(sum), 16), shift);
+}
+
+static int LICE_SIMD_AVX2_TARGET _AVX2_ScaledBilinear(LICE_pixel_chan *dest, const LICE_pixel_chan *src, const LICE_pixel_chan *srcnext, int n, int curx, int idx, int yfrac)
+{
+  const __m256i fracmask = _mm256_set1_epi32(0xffff), c65536 = _mm256_set1_epi32(65536), one = _mm256_set1_epi32(1);
+  const __m256i yf = _mm256_set1_epi32(yfrac);
+  const __m256i step = _mm256_set1_epi32(idx*8);
+  __m256i x = _mm256_add_epi32(_mm256_set1_epi32(curx), _mm256_mullo_epi32(_mm256_set1_epi32(idx), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+
+  int i=0;
+  for (; i+8<=n; i+=8, x=_mm256_add_epi32(x, step))
+  {
+    const __m256i offs = _mm256_srli_epi32(x, 16), offs1 = _mm256_add_epi32(offs, one);
+    const __m256i p1 = _mm256_i32gather_epi32((const int *)src, offs, 4);
+    const __m256i p2 = _mm256_i32gather_epi32((const int *)src, offs1, 4);
+    const __m256i p3 = _mm256_i32gather_epi32((const int *)srcnext, offs, 4);
+    const __m256i p4 = _mm256_i32gather_epi32((const int *)srcnext, offs1, 4);
+
+    const __m256i xf = _mm256_and_si256(x, fracmask);
+    const __m256i f4 = _mm256_mulhi_epu16(xf, yf);
+    const __m256 f1 = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_sub_epi32(_mm256_sub_epi32(c65536, yf), xf), f4));
+    const __m256 f2 = _mm256_cvtepi32_ps(_mm256_sub_epi32(xf, f4));
+    const __m256 f3 = _mm256_cvtepi32_ps(_mm256_sub_epi32(yf, f4));
+    const __m256 f4f = _mm256_cvtepi32_ps(f4);
+
+    __m256i r = _AVX2_BilinearChan(p1, p2, p3, p4, f1, f2, f3, f4f, 0);
+    r = _mm256_or_si256(r, _AVX2_BilinearChan(p1, p2, p3, p4, f1, f2, f3, f4f, 8));
+    r = _mm256_or_si256(r, _AVX2_BilinearChan(p1, p2, p3, p4, f1, f2, f3, f4f, 16));
+    r = _mm256_or_si256(r, _AVX2_BilinearChan(p1, p2, p3, p4, f1, f2, f3, f4f, 24));
+    _mm256_storeu_si256((__m256i*)(dest+i*4), r);
+  }
+  return i;
+}
+
+static void _x86_cpuid(int info[4], const int leaf)
+{
+  #ifdef _MSC_VER
+  __cpuidex(info, leaf, 0);
+  #else
+  __asm__ __volatile__("cpuid" : "=a"(info[0]), "=b"(info[1]), "=c"(info[2]), "=d"(info[3]) : "a"(leaf), "c"(0));
+  #endif
+}
+
+static bool _x86_HasSSE2()
+{
+  #if defined(_M_X64) || defined(__x86_64__)
+  return true;
+  #else
+  int info[4];
+  _x86_cpuid(info, 1);
+  return (info[3] & (1<<26)) != 0;
+  #endif
+}
+
+static bool _x86_HasAVX2()
+{
+  int info[4];
+  _x86_cpuid(info, 0);
+  if (info[0] < 7) return false;
+
+  // AVX and OSXSAVE, and the OS saves the YMM registers
+  _x86_cpuid(info, 1);
+  if ((info[2] & ((1<<27)|(1<<28))) != ((1<<27)|(1<<28))) return false;
+
+  #ifdef _MSC_VER
+  const unsigned int xcr0 = (unsigned int)_xgetbv(0);
+  #else
+  unsigned int xcr0, xcr0hi;
+  __asm__ __volatile__("xgetbv" : "=a"(xcr0), "=d"(xcr0hi) : "c"(0));
+  #endif
+  if ((xcr0 & 6) != 6) return false;
+
+  _x86_cpuid(info, 7);
+  return (info[1] & (1<<5)) != 0;
+}
+
+#endif // LICE_SIMD_X86
+
+
+#ifdef LICE_SIMD_ARM
+
+static inline int16x8_t _NEON_Lerp(const int16x8_t s, const int16x8_t d, const int16x8_t sc)
+{
+  const int16x8_t diff = vsubq_s16(d, s);
+  int32x4_t lo = vmull_s16(vget_low_s16(diff), vget_low_s16(sc));
+  int32x4_t hi = vmull_s16(vget_high_s16(diff), vget_high_s16(sc));
+
+  // divide by 256 rounding toward zero
+  const int32x4_t c255 = vdupq_n_s32(255);
+  lo = vshrq_n_s32(vaddq_s32(lo, vandq_s32(vshrq_n_s32(lo, 31), c255)), 8);
+  hi = vshrq_n_s32(vaddq_s32(hi, vandq_s32(vshrq_n_s32(hi, 31), c255)), 8);
+  return vaddq_s16(s, vcombine_s16(vmovn_s32(lo), vmovn_s32(hi)));
+}
+
+static inline uint32x4x2_t _NEON_Spread16(const uint32x4_t v)
+{
+  const uint32x4_t v2 = vorrq_u32(v, vshlq_n_u32(v, 16));
+  return vzipq_u32(v2, v2);
+}
+
+static int _NEON_CopySrcAlpha(LICE_pixel_chan *dest, const LICE_pixel_chan *src, int n, int ia)
+{
+  const uint32x4_t c255 = vdupq_n_u32(255), c256 = vdupq_n_u32(256);
+  const uint32x4_t rgbmask = vdupq_n_u32(0x00ffffff);
+  const bool ignoreParm = ia == 256;
+
+  int i=0;
+  for (; i+4<=n; i+=4)
+  {
+    const uint8x16_t s = vld1q_u8(src+i*4);
+    const uint8x16_t d = vld1q_u8(dest+i*4);
+
+    const uint32x4_t a = vshrq_n_u32(vreinterpretq_u32_u8(s), 24);
+    const uint32x4_t w = vshrq_n_u32(vmulq_n_u32(vaddq_u32(a, vdupq_n_u32(1)), (unsigned int)ia), 8);
+    const uint32x4x2_t sc = _NEON_Spread16(vsubq_u32(c256, w));
+
+    const uint32x4_t outa = vshlq_n_u32(vminq_u32(vaddq_u32(ignoreParm ? a : w, vshrq_n_u32(vreinterpretq_u32_u8(d), 24)), c255), 24);
+
+    const int16x8_t lo = _NEON_Lerp(vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(s))), vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(d))), vreinterpretq_s16_u32(sc.val[0]));
+    const int16x8_t hi = _NEON_Lerp(vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(s))), vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(d))), vreinterpretq_s16_u32(sc.val[1]));
+    const uint32x4_t rgb = vreinterpretq_u32_u8(vcombine_u8(vqmovun_s16(lo), vqmovun_s16(hi)));
+    const uint32x4_t r = vorrq_u32(vandq_u32(rgb, rgbmask), outa);
+
+    const uint32x4_t skip = vceqq_u32(a, vdupq_n_u32(0));
+    vst1q_u8(dest+i*4, vreinterpretq_u8_u32(vbslq_u32(skip, vreinterpretq_u32_u8(d), r)));
+  }
+  return i;
+}
+
+static int _NEON_AddSrcAlpha(LICE_pixel_chan *dest, const LICE_pixel_chan *src, int n, int ia)
+{
+  int i=0;
+  for (; i+4<=n; i+=4)
+  {
+    const uint8x16_t s = vld1q_u8(src+i*4);
+    const uint8x16_t d = vld1q_u8(dest+i*4);
+
+    const uint32x4_t a = vshrq_n_u32(vreinterpretq_u32_u8(s), 24);
+    const uint32x4x2_t al = _NEON_Spread16(vshrq_n_u32(vmulq_n_u32(vaddq_u32(a, vdupq_n_u32(1)), (unsigned int)ia), 8));
+
+    const uint16x8_t lo = vshrq_n_u16(vmulq_u16(vmovl_u8(vget_low_u8(s)), vreinterpretq_u16_u32(al.val[0])), 8);
+    const uint16x8_t hi = vshrq_n_u16(vmulq_u16(vmovl_u8(vget_high_u8(s)), vreinterpretq_u16_u32(al.val[1])), 8);
+    const uint8x16_t r = vqaddq_u8(d, vcombine_u8(vmovn_u16(lo), vmovn_u16(hi)));
+
+    const uint32x4_t skip = vceqq_u32(a, vdupq_n_u32(0));
+    vst1q_u8(dest+i*4, vreinterpretq_u8_u32(vbslq_u32(skip, vreinterpretq_u32_u8(d), vreinterpretq_u32_u8(r))));
+  }
+  return i;
+}
+
+static int _NEON_ScaledCopy(LICE_pixel_chan *dest, const LICE_pixel_chan *src, int n, int curx, int idx)
+{
+  const LICE_pixel *in = (const LICE_pixel *)src;
+
+  int i=0;
+  for (; i+4<=n; i+=4, curx+=idx*4)
+  {
+    const uint32_t p[4] = { in[curx>>16], in[(curx+idx)>>16], in[(curx+idx*2)>>16], in[(curx+idx*3)>>16] };
+    vst1q_u32((uint32_t *)(dest+i*4), vld1q_u32(p));
+  }
+  return i;
+}
+
+static inline uint32x4_t _NEON_BilinearChan(const uint32x4_t p1, const uint32x4_t p2, const uint32x4_t p3, const uint32x4_t p4,
+                                            const float32x4_t f1, const float32x4_t f2, const float32x4_t f3, const float32x4_t f4, const int shift)
+{
+  const uint32x4_t mask = vdupq_n_u32(0xff);
+  const int32x4_t sr = vdupq_n_s32(-shift), sl = vdupq_n_s32(shift);
+  float32x4_t sum = vmulq_f32(vcvtq_f32_u32(vandq_u32(vshlq_u32(p1, sr), mask)), f1);
+  sum = vaddq_f32(sum, vmulq_f32(vcvtq_f32_u32(vandq_u32(vshlq_u32(p2, sr), mask)), f2));
+  sum = vaddq_f32(sum, vmulq_f32(vcvtq_f32_u32(vandq_u32(vshlq_u32(p3, sr), mask)), f3));
+  sum = vaddq_f32(sum, vmulq_f32(vcvtq_f32_u32(vandq_u32(vshlq_u32(p4, sr), mask)), f4));
+  return vshlq_u32(vshrq_n_u32(vcvtq_u32_f32(sum), 16), sl);
+}
+
+static int _NEON_ScaledBilinear(LICE_pixel_chan *dest, const LICE_pixel_chan *src, const LICE_pixel_chan *srcnext, int n, int curx, int idx, int yfrac)
+{
+  const LICE_pixel *in = (const LICE_pixel *)src, *innext = (const LICE_pixel *)srcnext;
+  const uint32x4_t fracmask = vdupq_n_u32(0xffff), c65536 = vdupq_n_u32(65536);
+  const uint32x4_t yf = vdupq_n_u32((unsigned int)yfrac);
+
+  int i=0;
+  for (; i+4<=n; i+=4, curx+=idx*4)
+  {
+    const int x[4] = { curx, curx+idx, curx+idx*2, curx+idx*3 };
+    const int o[4] = { x[0]>>16, x[1]>>16, x[2]>>16, x[3]>>16 };
+    const uint32_t p1[4] = { in[o[0]], in[o[1]], in[o[2]], in[o[3]] };
+    const uint32_t p2[4] = { in[o[0]+1], in[o[1]+1], in[o[2]+1], in[o[3]+1] };
+    const uint32_t p3[4] = { innext[o[0]], innext[o[1]], innext[o[2]], innext[o[3]] };
+    const uint32_t p4[4] = { innext[o[0]+1], innext[o[1]+1], innext[o[2]+1], innext[o[3]+1] };
+
+    // xfrac*yfrac < 2^32, so the low 32 bits of the product are exact
+    const uint32x4_t xf = vandq_u32(vreinterpretq_u32_s32(vld1q_s32(x)), fracmask);
+    const uint32x4_t f4 = vshrq_n_u32(vmulq_u32(xf, yf), 16);
+    const float32x4_t f1 = vcvtq_f32_u32(vaddq_u32(vsubq_u32(vsubq_u32(c65536, yf), xf), f4));
+    const float32x4_t f2 = vcvtq_f32_u32(vsubq_u32(xf, f4));
+    const float32x4_t f3 = vcvtq_f32_u32(vsubq_u32(yf, f4));
+    const float32x4_t f4f = vcvtq_f32_u32(f4);
+
+    const uint32x4_t v1 = vld1q_u32(p1), v2 = vld1q_u32(p2), v3 = vld1q_u32(p3), v4 = vld1q_u32(p4);
+    uint32x4_t r = _NEON_BilinearChan(v1, v2, v3, v4, f1, f2, f3, f4f, 0);
+    r = vorrq_u32(r, _NEON_BilinearChan(v1, v2, v3, v4, f1, f2, f3, f4f, 8));
+    r = vorrq_u32(r, _NEON_BilinearChan(v1, v2, v3, v4, f1, f2, f3, f4f, 16));
+    r = vorrq_u32(r, _NEON_BilinearChan(v1, v2, v3, v4, f1, f2, f3, f4f, 24));
+    vst1q_u32((uint32_t *)(dest+i*4), r);
+  }
+  return i;
+}
+
+#endif // LICE_SIMD_ARM
+
+
+static const LICE_SIMD_Kernels *LICE_SIMD_GetKernels(const int level)
+{
+  switch (level)
+  {
+    #ifdef LICE_SIMD_X86
+    case LICE_SIMD_SSE2: { static const LICE_SIMD_Kernels k = { _SSE2_CopySrcAlpha, _SSE2_AddSrcAlpha, _SSE2_ScaledCopy, _SSE2_ScaledBilinear }; return &k; }
+    case LICE_SIMD_AVX2: { static const LICE_SIMD_Kernels k = { _AVX2_CopySrcAlpha, _AVX2_AddSrcAlpha, _AVX2_ScaledCopy, _AVX2_ScaledBilinear }; return &k; }
+    #endif
+    #ifdef LICE_SIMD_ARM
+    case LICE_SIMD_NEON: { static const LICE_SIMD_Kernels k = { _NEON_CopySrcAlpha, _NEON_AddSrcAlpha, _NEON_ScaledCopy, _NEON_ScaledBilinear }; return &k; }
+    #endif
+  }
+  return NULL;
+}
+
+static int LICE_SIMD_DetectLevel()
+{
+  static int level = -1;
+  if (level < 0)
+  {
+    int l = LICE_SIMD_NONE;
+    #ifdef LICE_SIMD_X86
+    if (_x86_HasAVX2()) l = LICE_SIMD_AVX2;
+    else if (_x86_HasSSE2()) l = LICE_SIMD_SSE2;
+    #endif
+    #ifdef LICE_SIMD_ARM
+    l = LICE_SIMD_NEON;
+    #endif
+    level = l;
+  }
+  return level;
+}
+
+static int s_LICE_SIMD_level = -1; // -1 = detected
+
+int LICE_SIMD_GetLevel()
+{
+  return s_LICE_SIMD_level < 0 ? LICE_SIMD_DetectLevel() : s_LICE_SIMD_level;
+}
+
+bool LICE_SIMD_SetLevel(const int level)
+{
+  if (level >= 0 && level != LICE_SIMD_NONE && (level > LICE_SIMD_DetectLevel() || !LICE_SIMD_GetKernels(level))) return false;
+  s_LICE_SIMD_level = level;
+  return true;
+}
+
+template <class COMBFUNC> static void LICE_SIMD_BlitRows(const LICE_SIMD_RowFunc row, LICE_pixel_chan *dest, const LICE_pixel_chan *src, int w, int h, int src_span, int dest_span, int ia)
+{
+  while (h-->0)
+  {
+    int n = row(dest, src, w, ia);
+    const LICE_pixel_chan *pin = src + n*sizeof(LICE_pixel);
+    LICE_pixel_chan *pout = dest + n*sizeof(LICE_pixel);
+    for (; n < w; ++n)
+    {
+      COMBFUNC::doPix(pout, pin[LICE_PIXEL_R], pin[LICE_PIXEL_G], pin[LICE_PIXEL_B], pin[LICE_PIXEL_A], ia);
+      pin += sizeof(LICE_pixel);
+      pout += sizeof(LICE_pixel);
+    }
+    dest += dest_span;
+    src += src_span;
+  }
+}
+
+// Mirrors the clamp=false cases of __LICE_ACTION_SRCALPHA that have kernels.
+static bool LICE_SIMD_BlitWith(const LICE_SIMD_Kernels *k, LICE_pixel_chan *dest, const LICE_pixel_chan *src, int w, int h, int src_span, int dest_span, int ia, int mode)
+{
+  if (!k || ia <= 0 || ia > 256) return false;
+
+  switch (mode & (LICE_BLIT_MODE_MASK|LICE_BLIT_USE_ALPHA))
+  {
+    case LICE_BLIT_MODE_COPY|LICE_BLIT_USE_ALPHA:
+      if (ia == 256) LICE_SIMD_BlitRows<_LICE_CombinePixelsCopySourceAlphaIgnoreAlphaParmNoClamp>(k->copySrcAlpha, dest, src, w, h, src_span, dest_span, ia);
+      else LICE_SIMD_BlitRows<_LICE_CombinePixelsCopySourceAlphaNoClamp>(k->copySrcAlpha, dest, src, w, h, src_span, dest_span, ia);
+    return true;
+
+    #ifndef LICE_DISABLE_BLEND_ADD
+    case LICE_BLIT_MODE_ADD|LICE_BLIT_USE_ALPHA:
+      LICE_SIMD_BlitRows<_LICE_CombinePixelsAddSourceAlpha>(k->addSrcAlpha, dest, src, w, h, src_span, dest_span, ia);
+    return true;
+    #endif
+  }
+  return false;
+}
+
+static void LICE_SIMD_Extent(const LICE_pixel_chan *p, int w, int h, int span, const LICE_pixel_chan **lo, const LICE_pixel_chan **hi)
+{
+  const LICE_pixel_chan *last = p + (h-1)*span;
+  *lo = span < 0 ? last : p;
+  *hi = (span < 0 ? p : last) + w*sizeof(LICE_pixel);
+}
+
+bool LICE_SIMD_Blit(LICE_pixel_chan *dest, const LICE_pixel_chan *src, int w, int h, int src_span, int dest_span, int ia, int mode)
+{
+  if (w < 4 || h < 1) return false;
+
+  // The scalar code combines one pixel at a time, so blitting onto an
+  // overlapping area of the same bitmap has to stay scalar.
+  const LICE_pixel_chan *slo, *shi, *dlo, *dhi;
+  LICE_SIMD_Extent(src, w, h, src_span, &slo, &shi);
+  LICE_SIMD_Extent(dest, w, h, dest_span, &dlo, &dhi);
+  if (slo < dhi && dlo < shi) return false;
+
+  return LICE_SIMD_BlitWith(LICE_SIMD_GetKernels(LICE_SIMD_GetLevel()), dest, src, w, h, src_span, dest_span, ia, mode);
+}
+
+// How many of n pixels, from 16.16 source x curx >= 0 stepping by idx > 0,
+// have a source column below lim.
+static int LICE_SIMD_Inside(int curx, int idx, unsigned int lim, int n)
+{
+  if ((unsigned int)(curx >> 16) >= lim) return 0;
+  const WDL_INT64 m = (((WDL_INT64)lim << 16) - curx + idx - 1) / idx;
+  return m < n ? (int)m : n;
+}
+
+// Same as _LICE_Template_Blit0::scaleBlitFAST() (!filter) and
+// _LICE_Template_Blit2::scaleBlit() (filter) for LICE_BLIT_MODE_COPY at
+// full alpha. The kernel does the pixels that don't touch the clip edges,
+// the scalar code the rest.
+static void LICE_SIMD_ScaledRows(const LICE_SIMD_Kernels *k, LICE_pixel_chan *dest, const LICE_pixel_chan *src, int w, int h,
+                                 int icurx, int icury, int idx, int idy, unsigned int clipright, unsigned int clipbottom,
+                                 int src_span, int dest_span, bool filter)
+{
+  // The filter also reads the pixels to the right and below.
+  const unsigned int inr = filter ? clipright-1 : clipright, inb = filter ? clipbottom-1 : clipbottom;
+
+  for (; h-->0; dest += dest_span, icury += idy)
+  {
+    const unsigned int cury = icury >> 16;
+    if (cury >= clipbottom) continue;
+
+    const int yfrac = icury & 65535;
+    const LICE_pixel_chan *inptr = src + (int)cury * src_span;
+
+    int n = 0;
+    if (k && cury < inb)
+    {
+      n = LICE_SIMD_Inside(icurx, idx, inr, w);
+      n = filter ? k->scaledBilinear(dest, inptr, inptr+src_span, n, icurx, idx, yfrac) : k->scaledCopy(dest, inptr, n, icurx, idx);
+    }
+
+    int curx = icurx + n*idx;
+    LICE_pixel_chan *pout = dest + n*sizeof(LICE_pixel);
+    for (; n < w; ++n, curx += idx, pout += sizeof(LICE_pixel))
+    {
+      const unsigned int offs = curx >> 16;
+      const LICE_pixel_chan *pin = inptr + offs*sizeof(LICE_pixel);
+
+      if (!filter)
+      {
+        if (offs < clipright) _LICE_CombinePixelsClobberFAST::doPixFAST((LICE_pixel *)pout, *(const LICE_pixel *)pin);
+        continue;
+      }
+
+      int r, g, b, a;
+      if (cury < clipbottom-1)
+      {
+        if (offs < clipright-1) __LICE_BilinearFilterI(&r, &g, &b, &a, pin, pin+src_span, curx&0xffff, yfrac);
+        else if (offs == clipright-1) __LICE_LinearFilterI(&r, &g, &b, &a, pin, pin+src_span, yfrac);
+        else continue;
+      }
+      else
+      {
+        if (offs < clipright-1) __LICE_LinearFilterI(&r, &g, &b, &a, pin, pin+sizeof(LICE_pixel), curx&0xffff);
+        else if (offs == clipright-1) { r = pin[LICE_PIXEL_R]; g = pin[LICE_PIXEL_G]; b = pin[LICE_PIXEL_B]; a = pin[LICE_PIXEL_A]; }
+        else continue;
+      }
+      _LICE_CombinePixelsClobberNoClamp::doPix(pout, r, g, b, a, 256);
+    }
+  }
+}
+
+static bool LICE_SIMD_ScaledBlitWith(const LICE_SIMD_Kernels *k, LICE_pixel_chan *dest, const LICE_pixel_chan *src, int w, int h,
+                                     int icurx, int icury, int idx, int idy, unsigned int clipright, unsigned int clipbottom,
+                                     int src_span, int dest_span, int ia, int mode)
+{
+  if (!k || ia != 256 || icurx < 0 || idx <= 0 || (mode & (LICE_BLIT_MODE_MASK|LICE_BLIT_USE_ALPHA)) != LICE_BLIT_MODE_COPY) return false;
+
+  switch (mode & LICE_BLIT_FILTER_MASK)
+  {
+    case LICE_BLIT_FILTER_NONE:
+      LICE_SIMD_ScaledRows(k, dest, src, w, h, icurx, icury, idx, idy, clipright, clipbottom, src_span, dest_span, false);
+    return true;
+
+    case LICE_BLIT_FILTER_BILINEAR:
+      LICE_SIMD_ScaledRows(k, dest, src, w, h, icurx, icury, idx, idy, clipright, clipbottom, src_span, dest_span, true);
+    return true;
+  }
+  return false;
+}
+
+bool LICE_SIMD_ScaledBlit(LICE_pixel_chan *dest, const LICE_pixel_chan *src, int w, int h,
+                          int icurx, int icury, int idx, int idy, unsigned int clipright, unsigned int clipbottom,
+                          int src_span, int dest_span, int ia, int mode)
+{
+  if (w < 4 || h < 1 || clipright < 1 || clipbottom < 1) return false;
+
+  const LICE_pixel_chan *slo, *shi, *dlo, *dhi;
+  LICE_SIMD_Extent(src, clipright, clipbottom, src_span, &slo, &shi);
+  LICE_SIMD_Extent(dest, w, h, dest_span, &dlo, &dhi);
+  if (slo < dhi && dlo < shi) return false;
+
+  return LICE_SIMD_ScaledBlitWith(LICE_SIMD_GetKernels(LICE_SIMD_GetLevel()), dest, src, w, h, icurx, icury, idx, idy, clipright, clipbottom, src_span, dest_span, ia, mode);
+}
+
+int LICE_SIMD_SelfTest()
+{
+  static const int w = 37, h = 3; // not a multiple of any vector size
+  static const int ias[] = { 1, 37, 128, 200, 255, 256 };
+  static const int modes[] = { LICE_BLIT_MODE_COPY|LICE_BLIT_USE_ALPHA, LICE_BLIT_MODE_ADD|LICE_BLIT_USE_ALPHA };
+  static const int advances[] = { 0x5ed3, 0xb000, 0x10000, 0x12345, 0x1c000, 0x2a000 }; // 16.16
+
+  LICE_pixel src[w*h], dest[w*h], ref[w*h], out[w*h];
+
+  // Bottom up, like a DIB section, so the spans are negative. The scalar
+  // scaled blits compute source rows as unsigned*span, so they get a top
+  // down source.
+  LICE_WrapperBitmap srcbm(src, w, h, w, true), refbm(ref, w, h, w, true), outbm(out, w, h, w, true);
+  LICE_WrapperBitmap scaledsrcbm(src, w, h, w, false);
+
+  const int prevLevel = LICE_SIMD_GetLevel();
+  unsigned int seed = 0x12345678;
+  int errors = 0;
+
+  for (int level = LICE_SIMD_NONE+1; level <= LICE_SIMD_NEON; ++level)
+  {
+    if (!LICE_SIMD_SetLevel(level)) continue;
+
+    for (int pass = 0; pass < 16; ++pass)
+    {
+      for (int i = 0; i < w*h; ++i)
+      {
+        seed = seed*1664525 + 1013904223;
+        LICE_pixel s = seed;
+        seed = seed*1664525 + 1013904223;
+        dest[i] = seed;
+
+        // Plenty of fully transparent/opaque pixels.
+        switch ((s >> 8) & 3)
+        {
+          case 0: s &= 0x00ffffff; break;
+          case 1: s |= 0xff000000; break;
+        }
+        src[i] = s;
+      }
+
+      // The reference is the scalar LICE code, the same calls with SIMD
+      // turned off.
+      for (size_t m = 0; m < sizeof(modes)/sizeof(modes[0]); ++m)
+      {
+        for (size_t j = 0; j < sizeof(ias)/sizeof(ias[0]); ++j)
+        {
+          const float alpha = (float)ias[j] / 256.0f;
+
+          memcpy(ref, dest, sizeof(ref));
+          LICE_SIMD_SetLevel(LICE_SIMD_NONE);
+          LICE_Blit(&refbm, &srcbm, 0, 0, 0, 0, w, h, alpha, modes[m]);
+
+          memcpy(out, dest, sizeof(out));
+          LICE_SIMD_SetLevel(level);
+          LICE_Blit(&outbm, &srcbm, 0, 0, 0, 0, w, h, alpha, modes[m]);
+
+          for (int i = 0; i < w*h; ++i) errors += ref[i] != out[i];
+        }
+      }
+
+      // Scaled, up and down, starting at random fractions, and running
+      // past the right and bottom edges of the source.
+      for (size_t j = 0; j < sizeof(advances)/sizeof(advances[0]); ++j)
+      {
+        for (int filter = 0; filter < 2; ++filter)
+        {
+          seed = seed*1664525 + 1013904223;
+          const int idx = advances[j], idy = advances[(j+pass)%(sizeof(advances)/sizeof(advances[0]))];
+          const float srcx = (float)(seed & 0x3ffff) / 65536.0f, srcy = (float)((seed >> 14) & 0x1ffff) / 65536.0f;
+          const float srcw = (float)(w*idx) / 65536.0f, srch = (float)(h*idy) / 65536.0f;
+          const int mode = LICE_BLIT_MODE_COPY | (filter ? LICE_BLIT_FILTER_BILINEAR : LICE_BLIT_FILTER_NONE);
+
+          memcpy(ref, dest, sizeof(ref));
+          LICE_SIMD_SetLevel(LICE_SIMD_NONE);
+          LICE_ScaledBlit(&refbm, &scaledsrcbm, 0, 0, w, h, srcx, srcy, srcw, srch, 1.0f, mode);
+
+          memcpy(out, dest, sizeof(out));
+          LICE_SIMD_SetLevel(level);
+          LICE_ScaledBlit(&outbm, &scaledsrcbm, 0, 0, w, h, srcx, srcy, srcw, srch, 1.0f, mode);
+
+          for (int i = 0; i < w*h; ++i) errors += ref[i] != out[i];
+        }
+      }
+    }
+  }
+
+  LICE_SIMD_SetLevel(prevLevel);
+  return errors;
+}
@@ -0,0 +1,54 @@
+/*
+  Cockos WDL - LICE - Lightweight Image Compositing Engine
+  File: lice_simd.h (SIMD blit kernels)
+  See lice.h for license and other information
+
+  SSE2/AVX2/NEON versions of the source alpha copy and add blits, and of
+  the scaled copy (unfiltered and bilinear), chosen at runtime. Results
+  are identical to the scalar code in lice_combine.h and lice.cpp, which
+  is still used for the last few pixels of each row, the clip edges, and
+  when no SIMD kernel is available.
+
+  Define LICE_NO_SIMD to disable.
+*/
+
+#ifndef _LICE_SIMD_H_
+#define _LICE_SIMD_H_
+
+#include "lice.h"
+
+enum
+{
+  LICE_SIMD_NONE=0,
+  LICE_SIMD_SSE2,
+  LICE_SIMD_AVX2,
+  LICE_SIMD_NEON
+};
+
+// Blits w*h pixels, spans are in bytes and may be negative. Returns false
+// (and doesn't touch dest) if there is no SIMD kernel for mode/ia.
+bool LICE_SIMD_Blit(LICE_pixel_chan *dest, const LICE_pixel_chan *src, int w, int h, int src_span, int dest_span, int ia, int mode);
+
+// Scaled blit rows, same arguments as _LICE_Template_Blit2::scaleBlit()
+// (16.16 source position and advance). Handles LICE_BLIT_MODE_COPY at full
+// alpha, without filtering or bilinear. Returns false (and doesn't touch
+// dest) otherwise.
+bool LICE_SIMD_ScaledBlit(LICE_pixel_chan *dest, const LICE_pixel_chan *src, int w, int h,
+                          int icurx, int icury, int idx, int idy, unsigned int clipright, unsigned int clipbottom,
+                          int src_span, int dest_span, int ia, int mode);
+
+// Level in use, by default the best one supported by this CPU/build.
+int LICE_SIMD_GetLevel();
+
+// Forces a level (LICE_SIMD_NONE for the scalar code), or -1 for the best
+// one. Returns false if this CPU/build doesn't support it. Not while
+// another thread is blitting.
+bool LICE_SIMD_SetLevel(int level);
+
+// Compares every supported level against the scalar code, with the same
+// LICE_Blit() and LICE_ScaledBlit() calls on random pixels, and returns
+// the number of mismatching pixels. Sets the level while running, so not
+// while another thread is blitting.
+int LICE_SIMD_SelfTest();
+
+#endif
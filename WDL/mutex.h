@@ -56,6 +56,11 @@
 #include <assert.h>
 #endif
 
+#ifdef WDL_MUTEX_ONENTER
+// define to the name of a function that is called before every Enter()
+void WDL_MUTEX_ONENTER(void);
+#endif
+
 class WDL_Mutex {
   public:
     WDL_Mutex() 
@@ -92,6 +97,9 @@ class WDL_Mutex {
 
     void Enter()
     {
+#ifdef WDL_MUTEX_ONENTER
+      WDL_MUTEX_ONENTER();
+#endif
 #ifdef _WIN32
       EnterCriticalSection(&m_cs);
 #elif defined(WDL_MAC_USE_CARBON_CRITSEC)